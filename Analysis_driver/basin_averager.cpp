@@ -137,6 +137,7 @@ int main (int nNumberofArgs,char *argv[])
   // set default string method
   string_default_map["slope method"] = "polynomial";
   string_default_map["averaging_raster_vector"] = "NULL";
+  string_default_map["averaging_percentiles"] = "NULL";
   string_default_map["basin_outlet_csv"] = "NULL";
   string_default_map["sample_ID_column_name"] = "IDs";
   string_default_map["parameter_file_for_spawning"] = "NULL";
@@ -465,6 +466,108 @@ int main (int nNumberofArgs,char *argv[])
     }
   }
 
+  // Average the rasters in the averaging_raster_vector over each basin.
+  // All the rasters are summarised in a single pass over each basin's nodes
+  // and the basins are processed in parallel.
+  if (vec_of_rasters.size() > 0 && vec_of_rasters[0] != "NULL" && vec_of_rasters[0] != "")
+  {
+    cout << "I am going to average your rasters over the basins." << endl;
+    int n_rasters = int(vec_of_rasters.size());
+
+    // load the rasters
+    vector<LSDRaster> averaging_rasters;
+    for (int r = 0; r<n_rasters; r++)
+    {
+      cout << "Loading the raster: " << DATA_DIR+vec_of_rasters[r] << endl;
+      LSDRaster this_raster(DATA_DIR+vec_of_rasters[r], raster_ext);
+
+      // the rasters are read at the row and column of the DEM nodes, so they
+      // must be on the same grid as the DEM. Their nodata values may differ.
+      map<string,string> DEM_georef = topography_raster.get_GeoReferencingStrings();
+      map<string,string> this_georef = this_raster.get_GeoReferencingStrings();
+      if (this_raster.get_NRows() != topography_raster.get_NRows() ||
+          this_raster.get_NCols() != topography_raster.get_NCols() ||
+          this_raster.get_XMinimum() != topography_raster.get_XMinimum() ||
+          this_raster.get_YMinimum() != topography_raster.get_YMinimum() ||
+          this_raster.get_DataResolution() != topography_raster.get_DataResolution() ||
+          this_georef["ENVI_coordinate_system"] != DEM_georef["ENVI_coordinate_system"])
+      {
+        cout << "ERROR: the raster " << vec_of_rasters[r] << " is not on the same grid as the DEM." << endl;
+        cout << "It needs the same rows, columns, origin, resolution and coordinate system." << endl;
+        cout << "Please reproject or resample it to match the DEM." << endl;
+        exit(EXIT_FAILURE);
+      }
+      averaging_rasters.push_back(this_raster);
+    }
+    vector<LSDRaster*> averaging_raster_pointers;
+    for (int r = 0; r<n_rasters; r++)
+    {
+      averaging_raster_pointers.push_back(&averaging_rasters[r]);
+    }
+
+    // get the percentiles, if any
+    vector<float> percentiles;
+    if (this_string_map["averaging_percentiles"] != "NULL")
+    {
+      percentiles = LSDPP.parse_float_vector("averaging_percentiles");
+    }
+    int n_percentiles = int(percentiles.size());
+
+    // the outlet nodes of the basins. These are the same as the outlets used
+    // by LSDBasin: the penultimate node of the link below each junction
+    int n_basins = int(basin_junctions.size());
+    vector<int> outlet_nodes = 
+          JunctionNetwork.get_node_list_of_penultimate_node_from_junction_list(basin_junctions, FlowInfo);
+
+    vector< vector<basin_zonal_stats> > zonal_stats = 
+          calculate_basin_zonal_stats(FlowInfo, outlet_nodes, averaging_raster_pointers, percentiles, true);
+
+    // only print IDs if there is one for every basin
+    bool print_IDs = (int(IDs.size()) == n_basins);
+
+    string averages_fname = OUT_DIR+OUT_ID+"_BasinAverages.csv";
+    cout << "Printing the basin averages to: " << averages_fname << endl;
+    ofstream averages_out;
+    averages_out.open(averages_fname.c_str());
+    averages_out << "basin_junction";
+    if (print_IDs)
+    {
+      averages_out << "," << this_string_map["sample_ID_column_name"];
+    }
+    for (int r = 0; r<n_rasters; r++)
+    {
+      string rn = vec_of_rasters[r];
+      averages_out << "," << rn << "_N," << rn << "_mean," << rn << "_std_dev,"
+                   << rn << "_std_error," << rn << "_min," << rn << "_max," << rn << "_median";
+      for (int p = 0; p<n_percentiles; p++)
+      {
+        averages_out << "," << rn << "_p" << percentiles[p];
+      }
+    }
+    averages_out << endl;
+
+    for (int b = 0; b<n_basins; b++)
+    {
+      averages_out << basin_junctions[b];
+      if (print_IDs)
+      {
+        averages_out << "," << IDs[b];
+      }
+      for (int r = 0; r<n_rasters; r++)
+      {
+        basin_zonal_stats& zs = zonal_stats[b][r];
+        averages_out << "," << zs.n_data << "," << zs.mean << "," << zs.std_dev << "," 
+                     << zs.std_error << "," << zs.minimum << "," << zs.maximum << "," << zs.median;
+        for (int p = 0; p<n_percentiles; p++)
+        {
+          averages_out << "," << zs.percentiles[p];
+        }
+      }
+      averages_out << endl;
+    }
+    averages_out.close();
+  }
+
   // Print basins to file if wanted
   if(this_bool_map["print_basin_raster"])
   {
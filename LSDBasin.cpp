@@ -220,7 +220,7 @@ void LSDBasin::create(int JunctionNumber, LSDFlowInfo& FlowInfo, LSDJunctionNetw
 // Calculate mean basin value.
 // SWDG 12/12/13
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinMean(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinMean(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -251,7 +251,7 @@ float LSDBasin::CalculateBasinMean(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate max basin value.
 // SWDG 12/12/13
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinMax(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinMax(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   //could use max_element here? how would that cope with NDVs??
 
@@ -278,7 +278,7 @@ float LSDBasin::CalculateBasinMax(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate min basin value.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinMin(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinMin(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -303,7 +303,7 @@ float LSDBasin::CalculateBasinMin(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate median basin value.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -341,7 +341,7 @@ float LSDBasin::CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate percentile basin value.
 // MDH 5/2/17
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster Data, int Percentile)
+float LSDBasin::CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster& Data, int Percentile)
 {
 
 	int i;
@@ -385,11 +385,58 @@ float LSDBasin::CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster Data,
 	return PercentileValue;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Median and percentiles estimated from a quantile sketch of the basin
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+QuantileSketch LSDBasin::BuildBasinQuantileSketch(LSDFlowInfo& FlowInfo, LSDRaster& Data, float sketch_compression)
+{
+  int i,j;
+  QuantileSketch sketch(sketch_compression);
+  for (int q = 0; q < int(BasinNodes.size()); ++q)
+  {
+    FlowInfo.retrieve_current_row_and_col(BasinNodes[q], i, j);
+    float this_value = Data.get_data_element(i,j);
+    if (this_value != NoDataValue)
+    {
+      sketch.add(this_value);
+    }
+  }
+  return sketch;
+}
+
+float LSDBasin::CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster& Data, float sketch_compression)
+{
+  if (sketch_compression <= 0)
+  {
+    return CalculateBasinMedian(FlowInfo, Data);
+  }
+  QuantileSketch sketch = BuildBasinQuantileSketch(FlowInfo, Data, sketch_compression);
+  if (sketch.get_count() == 0)
+  {
+    return NoDataValue;
+  }
+  return float(sketch.percentile(50));
+}
+
+float LSDBasin::CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster& Data, int Percentile, float sketch_compression)
+{
+  if (sketch_compression <= 0)
+  {
+    return CalculateBasinPercentile(FlowInfo, Data, Percentile);
+  }
+  QuantileSketch sketch = BuildBasinQuantileSketch(FlowInfo, Data, sketch_compression);
+  if (sketch.get_count() == 0)
+  {
+    return NoDataValue;
+  }
+  return float(sketch.percentile(Percentile));
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Calculate Standard devaition of the basin values.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinStdDev(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinStdDev(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -414,7 +461,7 @@ float LSDBasin::CalculateBasinStdDev(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate Standard Error of the basin values.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinStdError(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinStdError(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -440,7 +487,7 @@ float LSDBasin::CalculateBasinStdError(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate basin range.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDBasin::CalculateBasinRange(LSDFlowInfo& FlowInfo, LSDRaster Data){
+float LSDBasin::CalculateBasinRange(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -469,7 +516,7 @@ float LSDBasin::CalculateBasinRange(LSDFlowInfo& FlowInfo, LSDRaster Data){
 // Calculate basin range.
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-int LSDBasin::CalculateNumDataPoints(LSDFlowInfo& FlowInfo, LSDRaster Data){
+int LSDBasin::CalculateNumDataPoints(LSDFlowInfo& FlowInfo, LSDRaster& Data){
 
   int i;
   int j;
@@ -488,6 +535,17 @@ int LSDBasin::CalculateNumDataPoints(LSDFlowInfo& FlowInfo, LSDRaster Data){
   return count;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Calculate the statistics of several rasters in one scan of the basin nodes
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<basin_zonal_stats> LSDBasin::CalculateBasinZonalStats(LSDFlowInfo& FlowInfo,
+                                           vector<LSDRaster*>& Data, vector<float>& percentiles,
+                                           bool calculate_median)
+{
+  return calculate_zonal_stats_of_nodes(FlowInfo, BasinNodes, Data, percentiles,
+                                        calculate_median);
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Calculate E* and R* values for the basin, using hilltop flow routed hillslope
 // lengths.
@@ -678,7 +736,7 @@ void LSDBasin::Plot_Boomerang(LSDRaster& Slope, LSDRaster& DinfArea, LSDFlowInfo
 // Bug fixed in the average calculation when values wrapped around 0
 // SWDG 17/2/14
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDBasin::set_AspectMean(LSDFlowInfo& FlowInfo, LSDRaster Aspect){
+void LSDBasin::set_AspectMean(LSDFlowInfo& FlowInfo, LSDRaster& Aspect){
 
   int i;
   int j;
@@ -1264,23 +1322,36 @@ void LSDBasin::set_All_Parameters(LSDRaster& Elevation, LSDFlowInfo& FlowInfo, L
   raster_selection.push_back(0);
 
   vector<LSDRaster> Surfaces = Elevation.calculate_polyfit_surface_metrics(window_radius, raster_selection);
-  LSDRaster TotalCurv = Surfaces[3];
-  LSDRaster ProfileCurv = Surfaces[5];
-  LSDRaster PlanCurv = Surfaces[4];
-  LSDRaster Aspect = Surfaces[2];
-  LSDRaster Slope = Surfaces[1];
+  LSDRaster& TotalCurv = Surfaces[3];
+  LSDRaster& ProfileCurv = Surfaces[5];
+  LSDRaster& PlanCurv = Surfaces[4];
+  LSDRaster& Aspect = Surfaces[2];
+  LSDRaster& Slope = Surfaces[1];
   LSDRaster DinfArea = Elevation.D_inf_units();
 
-  set_SlopeMean(FlowInfo, Slope);
-  set_ElevationMean(FlowInfo, Elevation);
-  set_ReliefMean(FlowInfo, Relief);
-  set_PlanCurvMean(FlowInfo, PlanCurv);
-  set_ProfileCurvMean(FlowInfo, ProfileCurv);
-  set_TotalCurvMean(FlowInfo, TotalCurv);
-  set_PlanCurvMax(FlowInfo, PlanCurv);
-  set_ProfileCurvMax(FlowInfo, ProfileCurv);
-  set_TotalCurvMax(FlowInfo, TotalCurv);
-  set_CHTMean(FlowInfo, CHT);
+  // the means and maxima all come from a single scan of the basin. No median
+  // or percentiles are needed, so the values are not kept or sorted
+  vector<LSDRaster*> zonal_rasters;
+  zonal_rasters.push_back(&Slope);
+  zonal_rasters.push_back(&Elevation);
+  zonal_rasters.push_back(&Relief);
+  zonal_rasters.push_back(&PlanCurv);
+  zonal_rasters.push_back(&ProfileCurv);
+  zonal_rasters.push_back(&TotalCurv);
+  zonal_rasters.push_back(&CHT);
+  vector<float> no_percentiles;
+  vector<basin_zonal_stats> zonal_stats = CalculateBasinZonalStats(FlowInfo, zonal_rasters, no_percentiles, false);
+  SlopeMean = zonal_stats[0].mean;
+  ElevationMean = zonal_stats[1].mean;
+  ReliefMean = zonal_stats[2].mean;
+  PlanCurvMean = zonal_stats[3].mean;
+  ProfileCurvMean = zonal_stats[4].mean;
+  TotalCurvMean = zonal_stats[5].mean;
+  PlanCurvMax = zonal_stats[3].maximum;
+  ProfileCurvMax = zonal_stats[4].maximum;
+  TotalCurvMax = zonal_stats[5].maximum;
+  CHTMean = zonal_stats[6].mean;
+
   set_AspectMean(FlowInfo, Aspect);
   set_FlowLength(StreamNetwork, FlowInfo);
   set_DrainageDensity();
@@ -1297,7 +1368,7 @@ void LSDBasin::set_All_Parameters(LSDRaster& Elevation, LSDFlowInfo& FlowInfo, L
 // Write integer basin parameters into the shape of the basin.
 // SWDG 12/12/13
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDBasin::set_HilltopPx(LSDFlowInfo& FlowInfo, LSDRaster Hilltops){
+void LSDBasin::set_HilltopPx(LSDFlowInfo& FlowInfo, LSDRaster& Hilltops){
 
   int i;
   int j;
@@ -2712,6 +2783,10 @@ void LSDCosmoBasin::create(int JunctionNumber, LSDFlowInfo& FlowInfo,
 
   //cout << "LSDCosmoBasin, Line 893, basin outlet is: " << basin_outlet << endl;
 
+  // the concentration kernel is built when it is first needed
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
+
   NumberOfCells = int(BasinNodes.size());
   Area = NumberOfCells * (DataResolution*DataResolution);
 
@@ -2834,6 +2909,8 @@ void LSDCosmoBasin::populate_scaling_vectors(LSDFlowInfo& FlowInfo,
   topographic_shielding = tshield_temp;
   production_scaling =  prod_temp;
   snow_shielding = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -2920,7 +2997,50 @@ void LSDCosmoBasin::populate_scaling_vectors(LSDFlowInfo& FlowInfo,
   topographic_shielding = tshield_temp;
   production_scaling =  prod_temp;
   snow_shielding = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
+
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This populates the topographic shielding and production scaling from
+// a production scaling array covering the whole DEM, so the pressure and
+// scaling of each pixel are calculated once per DEM rather than once for
+// every basin that contains the pixel.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoBasin::populate_scaling_vectors(LSDFlowInfo& FlowInfo,
+                                               LSDRaster& Elevation_Data,
+                                               LSDRaster& T_Shield,
+                                               Array2D<double>& Production_scaling)
+{
+  int row,col;
+  int n_nodes = int(BasinNodes.size());
+
+  vector<double> tshield_temp(n_nodes,double(NoDataValue));
+  vector<double> prod_temp(n_nodes,double(NoDataValue));
+  vector<double> snow_temp(n_nodes,double(NoDataValue));
+
+  for (int q = 0; q < n_nodes; ++q)
+  {
+    FlowInfo.retrieve_current_row_and_col(BasinNodes[q], row, col);
+
+    //exclude NDV from average
+    if (Elevation_Data.get_data_element(row,col) != NoDataValue)
+    {
+      prod_temp[q] = Production_scaling[row][col];
+      tshield_temp[q] = double(T_Shield.get_data_element(row,col));
+      snow_temp[q] = 1.0;
+    }
+  }
 
+  // set the shielding vectors
+  topographic_shielding = tshield_temp;
+  production_scaling =  prod_temp;
+  snow_shielding = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -2996,6 +3116,7 @@ void LSDCosmoBasin::get_atmospheric_pressure(LSDFlowInfo& FlowInfo,
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function creates the snow and shelf sheilding vectors based on two
 // rasters
@@ -3035,6 +3156,8 @@ void LSDCosmoBasin::populate_snow_and_self_eff_depth_vectors(LSDFlowInfo& FlowIn
   // update the vectors in the basin object
   self_shield_eff_depth = self_temp;
   snow_shield_eff_depth = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -3078,6 +3201,8 @@ void LSDCosmoBasin::populate_snow_and_self_eff_depth_vectors(LSDFlowInfo& FlowIn
   // update the vectors in the basin object
   self_shield_eff_depth = self_temp;
   snow_shield_eff_depth = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -3126,6 +3251,8 @@ void LSDCosmoBasin::populate_snow_and_self_eff_depth_vectors(LSDFlowInfo& FlowIn
   // update the vectors in the basin object
   self_shield_eff_depth = self_temp;
   snow_shield_eff_depth = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -3147,6 +3274,8 @@ void LSDCosmoBasin::populate_snow_and_self_eff_depth_vectors(double snow_eff_dep
   // update the vectors in the basin object
   self_shield_eff_depth = self_temp;
   snow_shield_eff_depth = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -3162,6 +3291,8 @@ void LSDCosmoBasin::reset_snow_and_self_eff_depth_vectors()
   // update the vectors in the basin object
   self_shield_eff_depth = self_temp;
   snow_shield_eff_depth = snow_temp;
+  conc_kernel.is_valid = false;
+  nested_kernel.is_valid = false;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -3395,6 +3526,164 @@ vector<double> LSDCosmoBasin::full_CRN_erosion_analysis(double Nuclide_conc, str
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+// This function propagates the uncertainty by Monte Carlo sampling.
+// The pixel scaling is held in the concentration kernel so each draw is a
+// root find on four terms. The production and shielding perturbations scale
+// the basin production: for the CRONUS production uncertainty this is what
+// set_P0_CRONUS_uncertainty_plus does, for the shielding it neglects the
+// small shift in the muon fractions that scale_F_values would make. The
+// attenuation perturbation changes the spallation attenuation length in the
+// erosion term; depth integration factors stay at their nominal values.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<double> LSDCosmoBasin::MonteCarlo_CRN_erosion_analysis(double Nuclide_conc,
+                              string Nuclide, double Nuclide_conc_err,
+                              double prod_uncert_factor, string Muon_scaling,
+                              int n_draws, double shielding_uncert,
+                              double attenuation_uncert, RandomStream& rng)
+{
+  // use the same shielding as predict_CRN_erosion
+  bool data_from_outlet_only = false;
+  bool is_depth_integrated = true;
+  if(self_shield_eff_depth.size() < 1 && snow_shield_eff_depth.size() < 1)
+  {
+    is_depth_integrated = false;
+  }
+  update_CRN_conc_kernel(Nuclide, prod_uncert_factor, Muon_scaling,
+                         data_from_outlet_only, false, false, is_depth_integrated);
+
+  // get the fractional CRONUS production uncertainty
+  LSDCRNParameters LSDCRNP;
+  vector<double> F, Gamma_vec;
+  double lambda, St_P0, St_P0_plus;
+  LSDCRNP.get_steady_state_parameters(Nuclide, F, Gamma_vec, lambda, St_P0);
+  LSDCRNP.set_P0_CRONUS_uncertainty_plus();
+  LSDCRNP.get_steady_state_parameters(Nuclide, F, Gamma_vec, lambda, St_P0_plus);
+  double prod_fraction_uncert = St_P0_plus/St_P0-1.0;
+
+  // each draw uses four normal deviates, whether or not it is valid
+  unsigned long long draws_per_sample = 16;
+
+  vector<double> erate_draws(n_draws,NoDataValue);
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i<n_draws; i++)
+  {
+    RandomStream draw_rng = rng;
+    draw_rng.discard((unsigned long long)(i)*draws_per_sample);
+
+    double this_conc = Nuclide_conc+Nuclide_conc_err*draw_rng.normal_double();
+    double prod_factor = 1.0+prod_fraction_uncert*draw_rng.normal_double();
+    double shield_factor = 1.0+shielding_uncert*draw_rng.normal_double();
+    double atten_factor = 1.0+attenuation_uncert*draw_rng.normal_double();
+    if (this_conc <= 0 || prod_factor <= 0 || shield_factor <= 0 || atten_factor <= 0)
+    {
+      continue;
+    }
+
+    double this_Gamma[4];
+    for (int j = 0; j<4; j++)
+    {
+      this_Gamma[j] = conc_kernel.Gamma[j];
+    }
+    this_Gamma[0] = this_Gamma[0]*atten_factor;
+    double scale = prod_factor*shield_factor*conc_kernel.St_P0/
+                   double(conc_kernel.n_pixels);
+
+    // the concentration and its derivative at the erosion rate E
+    double E = 0;
+    double conc, dconc_dE, term;
+    double target = 1.0/this_conc;
+    double E_change;
+    int iterations = 0;
+    bool is_valid = true;
+    do
+    {
+      conc = 0;
+      dconc_dE = 0;
+      for (int j = 0; j<4; j++)
+      {
+        term = conc_kernel.F_sum[j]*this_Gamma[j]/(E+this_Gamma[j]*conc_kernel.lambda);
+        conc += term;
+        dconc_dE -= term/(E+this_Gamma[j]*conc_kernel.lambda);
+      }
+      conc = conc*scale;
+      dconc_dE = dconc_dE*scale;
+
+      // no steady erosion rate gives more than the zero erosion concentration
+      if (iterations == 0 && this_conc >= conc)
+      {
+        is_valid = false;
+        break;
+      }
+
+      // Newton-Raphson on 1/concentration, which is nearly linear in E.
+      // It is concave so from E = 0 the iterations approach the root
+      // from below without overshooting.
+      E_change = (target-1.0/conc)*conc*conc/(-dconc_dE);
+      E += E_change;
+      iterations++;
+    } while (fabs(E_change) > 1e-12*E && iterations < 100);
+
+    if (is_valid)
+    {
+      erate_draws[i] = E;
+    }
+  }
+
+  // collect the valid draws
+  vector<double> valid_erates;
+  for (int i = 0; i<n_draws; i++)
+  {
+    if (erate_draws[i] != NoDataValue)
+    {
+      valid_erates.push_back(erate_draws[i]);
+    }
+  }
+  int n_valid = int(valid_erates.size());
+
+  vector<double> MC_results;
+  MC_results.push_back(double(n_valid));
+  if (n_valid == 0)
+  {
+    for (int i = 0; i<7; i++)
+    {
+      MC_results.push_back(NoDataValue);
+    }
+    return MC_results;
+  }
+
+  double sum = 0;
+  for (int i = 0; i<n_valid; i++)
+  {
+    sum += valid_erates[i];
+  }
+  double mean = sum/double(n_valid);
+  double sum_sq = 0;
+  for (int i = 0; i<n_valid; i++)
+  {
+    sum_sq += (valid_erates[i]-mean)*(valid_erates[i]-mean);
+  }
+  double stdev = (n_valid > 1) ? sqrt(sum_sq/double(n_valid-1)) : 0;
+  MC_results.push_back(mean);
+  MC_results.push_back(stdev);
+
+  // percentiles interpolated between the sorted draws
+  sort(valid_erates.begin(),valid_erates.end());
+  double percentiles[5] = {2.5,16,50,84,97.5};
+  for (int i = 0; i<5; i++)
+  {
+    double position = percentiles[i]*0.01*double(n_valid-1);
+    int below = int(floor(position));
+    int above = (below+1 < n_valid) ? below+1 : below;
+    double weight = position-double(below);
+    MC_results.push_back((1-weight)*valid_erates[below]+weight*valid_erates[above]);
+  }
+
+  return MC_results;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //
 // This function wraps the erosion rate calculations with formal error analysis
@@ -4236,67 +4525,11 @@ double LSDCosmoBasin::predict_mean_CRN_conc(double eff_erosion_rate, string Nucl
     prod_uncert_factor = 1;
   }
 
-  // these parameters give the average production rate of the entore basin,
-  // along with the magnitude of the production uncertainty
-  double cumulative_production_rate = 0;
-  double average_production_rate;
-  double average_production_uncertainty;
-
-  // the average atoms per gram of the nuclide
-  double BasinAverage;
-
-  // the total shielding. A product of snow, topographic and production scaling
-  double total_shielding;
-  double total_shielding_no_uncert;
-
-  // the total atomic concentration of the nuclude in question
-  double Total_N = 0;
-
-  int count_samples = 0;
-
-  // initiate a particle. We'll just repeatedly call this particle
-  // for the sample.
-  int startType = 0;
-  double Xloc = 0;
-  double Yloc = 0;
-  double  startdLoc = 0.0;
-  double  start_effdloc = 0.0;
-  double startzLoc = 0.0;
-
-  // create a particle at zero depth
-  LSDCRNParticle eroded_particle(startType, Xloc, Yloc,
-                               startdLoc, start_effdloc, startzLoc);
-
-  // now create the CRN parameters object
-  LSDCRNParameters LSDCRNP;
-
-  // set a special case if the outlet flag is true
-  int end_node;
-  if (data_from_outlet_only)
-  {
-    end_node = 1;
-  }
-  else
-  {
-    end_node =  int(BasinNodes.size());
-  }
-
-  // set the scaling vector
-  vector<bool> nuclide_scaling_switches(4,false);
-  if (Nuclide == "Be10")
-  {
-    nuclide_scaling_switches[0] = true;
-  }
-  else if (Nuclide == "Al26")
-  {
-    nuclide_scaling_switches[1] = true;
-  }
-  else
+  if (Nuclide != "Be10" && Nuclide != "Al26")
   {
-    cout << "LSDBasin line 1583, You didn't choos a valid nuclide. Defaulting"
+    cout << "LSDBasin line 1583, You didn't choose a valid nuclide. Defaulting"
          << " to 10Be." << endl;
     Nuclide = "Be10";
-    nuclide_scaling_switches[0] = true;
   }
 
   // check the production uncertainty bools
@@ -4310,112 +4543,22 @@ double LSDCosmoBasin::predict_mean_CRN_conc(double eff_erosion_rate, string Nucl
     }
   }
 
+  // The scaling and shielding of every pixel is independent of the erosion
+  // rate, so it is folded into the kernel once and reused by every call
+  // (for example by every Newton-Raphson iteration of predict_CRN_erosion)
+  update_CRN_conc_kernel(Nuclide, prod_uncert_factor, Muon_scaling,
+                         data_from_outlet_only,
+                         is_production_uncertainty_plus_on,
+                         is_production_uncertainty_minus_on, false);
 
-  // loop through the elevation data
-  for (int q = 0; q < end_node; ++q)
-  {
-
-    //exclude NDV from average
-    if(topographic_shielding[q] != NoDataValue)
-    {
-      count_samples++;
-
-      // reset scaling parameters. This is necessary since the F values are
-      // reset for local scaling
-      if (Muon_scaling == "Schaller" )
-      {
-        LSDCRNP.set_Schaller_parameters();
-      }
-      else if (Muon_scaling == "Braucher" )
-      {
-        LSDCRNP.set_Braucher_parameters();
-      }
-      else if (Muon_scaling == "Granger" )
-      {
-        LSDCRNP.set_Granger_parameters();
-      }
-      else if (Muon_scaling == "newCRONUS" )
-      {
-        LSDCRNP.set_newCRONUS_parameters();
-      }
-      else
-      {
-        cout << "You didn't set the muon scaling." << endl
-             << "Options are Schaller, Braucher, newCRONUS, and Granger." << endl
-             << "You chose: " << Muon_scaling << endl
-             << "Defaulting to Braucher et al (2009) scaling" << endl;
-        LSDCRNP.set_Braucher_parameters();
-      }
-
-      // set the scaling to the correct production uncertainty
-      vector<double> test_uncert;
-      if(is_production_uncertainty_plus_on)
-      {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_plus();
-      }
-      else if(is_production_uncertainty_minus_on)
-      {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_minus();
-      }
-
-      // the elevation, snow shielding, topographic shielding
-      // and production scaling are all independent of the erosion rate
-      // and are calculated seperately.
-      if(  production_scaling.size() < 1 )
-      {
-        cout << "LSDCosmoBasin, trying to precalculate erosion rate." << endl
-             << "Scaling vectors have not been set! You are about to get a seg fault" << endl;
-      }
-
-      // now you need logic to test if you are accounting for self shielding
-      if ( self_shielding.size() < 1 )
-      {
-        total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q]*
-                                  snow_shielding[q];
-        total_shielding = prod_uncert_factor*total_shielding_no_uncert;
-        cumulative_production_rate += total_shielding_no_uncert;
-      }
-      else
-      {
-        total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q]*
-                                  snow_shielding[q]*self_shielding[q];
-        total_shielding = prod_uncert_factor*total_shielding_no_uncert;
-        cumulative_production_rate += total_shielding_no_uncert;
-      }
-
-      LSDCRNP.scale_F_values(total_shielding,nuclide_scaling_switches);
-
-      // get the nuclide concentration from this node
-      if (Nuclide == "Be10")
-      {
-
-        eroded_particle.update_10Be_SSfull(eff_erosion_rate,LSDCRNP);
-        Total_N+=eroded_particle.getConc_10Be();
-      }
-      else if (Nuclide == "Al26")
-      {
-        eroded_particle.update_26Al_SSfull(eff_erosion_rate,LSDCRNP);
-        Total_N+=eroded_particle.getConc_26Al();
-      }
-      else
-      {
-        cout << "You didn't give a valid nuclide. You chose: " << Nuclide << endl;
-        cout << "Choices are 10Be, 26Al.  Note these case sensitive and cannot" << endl;
-        cout << "contain spaces or control characters. Defaulting to 10Be." << endl;
-        eroded_particle.update_10Be_SSfull(eff_erosion_rate,LSDCRNP);
-        Total_N+=eroded_particle.getConc_10Be();
-      }
-
-      //cout << endl << endl << "LINE 2052, total shield: " << total_shielding
-      //     << " erosion: " << eff_erosion_rate << " erosion in cm/kyr with rho = 2650: "
-      //     << eff_erosion_rate*1e6/2650.0 << " and N: " << eroded_particle.getConc_10Be() << endl;
-
-    }
-  }
+  // the average atoms per gram of the nuclide
+  double BasinAverage = evaluate_CRN_conc_kernel(eff_erosion_rate);
 
-  BasinAverage = Total_N/double(count_samples);
-  average_production_rate = cumulative_production_rate/double(count_samples);
-  average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
+  // these parameters give the average production rate of the entore basin,
+  // along with the magnitude of the production uncertainty
+  double average_production_rate = conc_kernel.cumulative_production_rate/
+                                   double(conc_kernel.n_pixels);
+  double average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
 
   // replace the production uncertanty
   production_uncertainty = average_production_uncertainty;
@@ -4452,228 +4595,370 @@ double LSDCosmoBasin::predict_mean_CRN_conc_with_snow_and_self(double eff_erosio
     prod_uncert_factor = 1;
   }
 
-  // these parameters give the average production rate of the entore basin,
-  // along with the magnitude of the production uncertainty
-  double cumulative_production_rate = 0;
-  double average_production_rate;
-  double average_production_uncertainty;
-
-  // the average atoms per gram of the nuclide
-  double BasinAverage;
-
-  // the total shielding. A product of snow, topographic and production scaling
-  double total_shielding;
-  double total_shielding_no_uncert;
+  if (Nuclide != "Be10" && Nuclide != "Al26")
+  {
+    cout << "LSDBasin line 1583, You didn't choose a valid nuclide. Defaulting"
+         << " to 10Be." << endl;
+    Nuclide = "Be10";
+  }
 
-  // the total atomic concentration of the nuclude in question
-  double Total_N = 0;
+  // check the production uncertainty bools
+  if(is_production_uncertainty_plus_on)
+  {
+    if(is_production_uncertainty_minus_on)
+    {
+      cout << "You can't have both plus and minus production uncertainty on" << endl;
+      cout << "Setting minus uncertainty to false" << endl;
+      is_production_uncertainty_minus_on = false;
+    }
+  }
 
-  int count_samples = 0;
+  // The scaling and shielding of every pixel is independent of the erosion
+  // rate, so it is folded into the kernel once and reused by every call
+  // (for example by every Newton-Raphson iteration of predict_CRN_erosion)
+  update_CRN_conc_kernel(Nuclide, prod_uncert_factor, Muon_scaling,
+                         data_from_outlet_only,
+                         is_production_uncertainty_plus_on,
+                         is_production_uncertainty_minus_on, true);
 
-  // initiate a particle. We'll just repeatedly call this particle
-  // for the sample.
-  int startType = 0;
-  double Xloc = 0;
-  double Yloc = 0;
-  double  startdLoc = 0.0;
-  double  start_effdloc = 0.0;
-  double startzLoc = 0.0;
+  // the average atoms per gram of the nuclide
+  double BasinAverage = evaluate_CRN_conc_kernel(eff_erosion_rate);
 
-  // create a particle at zero depth
-  LSDCRNParticle eroded_particle(startType, Xloc, Yloc,
-                               startdLoc, start_effdloc, startzLoc);
+  // these parameters give the average production rate of the entore basin,
+  // along with the magnitude of the production uncertainty
+  double average_production_rate = conc_kernel.cumulative_production_rate/
+                                   double(conc_kernel.n_pixels);
+  double average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
 
-  // now create the CRN parameters object
-  LSDCRNParameters LSDCRNP;
+  // replace the production uncertanty
+  production_uncertainty = average_production_uncertainty;
 
-  // set a special case if the outlet flag is true
-  int end_node;
-  if (data_from_outlet_only)
+  // replace the average production rate
+  average_production = average_production_rate;
+
+  return BasinAverage;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This scales the F values of a list of pixels (indices into BasinNodes) to
+// their shielding. It is shared by the concentration kernels: the F values
+// come back by pathway, one element per pixel, and the callers sum them in
+// pixel order.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoBasin::scale_CRN_kernel_pixels(vector<int>& pixels, string Nuclide,
+                                double prod_uncert_factor, string Muon_scaling,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on,
+                                bool is_depth_integrated,
+                                vector<double>& F0, vector<double>& F1,
+                                vector<double>& F2, vector<double>& F3,
+                                vector<double>& pixel_production,
+                                vector<double>& Gamma_vec,
+                                double& lambda, double& St_P0)
+{
+  // resolve the muon scaling once
+  int muon_scheme;
+  if (Muon_scaling == "Schaller" )
   {
-    end_node = 1;
+    muon_scheme = 0;
+  }
+  else if (Muon_scaling == "Braucher" )
+  {
+    muon_scheme = 1;
+  }
+  else if (Muon_scaling == "Granger" )
+  {
+    muon_scheme = 2;
+  }
+  else if (Muon_scaling == "newCRONUS" )
+  {
+    muon_scheme = 3;
   }
   else
   {
-    end_node =  int(BasinNodes.size());
+    cout << "You didn't set the muon scaling." << endl
+         << "Options are Schaller, Braucher, newCRONUS, and Granger." << endl
+         << "You chose: " << Muon_scaling << endl
+         << "Defaulting to Braucher et al (2009) scaling" << endl;
+    muon_scheme = 1;
   }
 
   // set the scaling vector
   vector<bool> nuclide_scaling_switches(4,false);
-  if (Nuclide == "Be10")
-  {
-    nuclide_scaling_switches[0] = true;
-  }
-  else if (Nuclide == "Al26")
+  if (Nuclide == "Al26")
   {
     nuclide_scaling_switches[1] = true;
   }
   else
   {
-    cout << "LSDBasin line 1583, You didn't choose a valid nuclide. Defaulting"
-         << " to 10Be." << endl;
-    Nuclide = "Be10";
     nuclide_scaling_switches[0] = true;
   }
 
-  // check the production uncertainty bools
-  if(is_production_uncertainty_plus_on)
+  // the elevation, snow shielding, topographic shielding
+  // and production scaling are all independent of the erosion rate
+  // and are calculated seperately.
+  if(  production_scaling.size() < 1 )
   {
-    if(is_production_uncertainty_minus_on)
-    {
-      cout << "You can't have both plus and minus production uncertainty on" << endl;
-      cout << "Setting minus uncertainty to false" << endl;
-      is_production_uncertainty_minus_on = false;
-    }
+    cout << "LSDCosmoBasin, trying to precalculate erosion rate." << endl
+         << "Scaling vectors have not been set! You are about to get a seg fault" << endl;
   }
 
-  // parameters for the shielding
-  double this_top_eff_depth;
-  double this_bottom_eff_depth;
+  int n_pixels = int(pixels.size());
 
-  // loop through the elevation data
-  for (int q = 0; q < end_node; ++q)
+  // the scaled F values of each pathway and the production of each pixel
+  F0.assign(n_pixels,0.0);
+  F1.assign(n_pixels,0.0);
+  F2.assign(n_pixels,0.0);
+  F3.assign(n_pixels,0.0);
+  pixel_production.assign(n_pixels,0.0);
+
+  // the parameters that do not vary between pixels
+  Gamma_vec.assign(4,0.0);
+  lambda = 0;
+  St_P0 = 0;
+
+  #pragma omp parallel
   {
+    LSDCRNParameters LSDCRNP;
+    vector<double> F, this_Gamma;
+    double this_lambda, this_St_P0;
+    double total_shielding, total_shielding_no_uncert;
+    double this_top_eff_depth, this_bottom_eff_depth;
+    double depth_factor[4];
 
-    //exclude NDV from average
-    if(topographic_shielding[q] != NoDataValue)
+    #pragma omp for schedule(static)
+    for (int p = 0; p < n_pixels; p++)
     {
-      count_samples++;
+      int q = pixels[p];
 
       // reset scaling parameters. This is necessary since the F values are
       // reset for local scaling
-      if (Muon_scaling == "Schaller" )
-      {
-        LSDCRNP.set_Schaller_parameters();
-      }
-      else if (Muon_scaling == "Braucher" )
+      switch(muon_scheme)
       {
-        LSDCRNP.set_Braucher_parameters();
-      }
-      else if (Muon_scaling == "Granger" )
-      {
-        LSDCRNP.set_Granger_parameters();
-      }
-      else if (Muon_scaling == "newCRONUS" )
-      {
-        LSDCRNP.set_newCRONUS_parameters();
-      }
-      else
-      {
-        cout << "You didn't set the muon scaling." << endl
-             << "Options are Schaller, Braucher, newCRONUS, and Granger." << endl
-             << "You chose: " << Muon_scaling << endl
-             << "Defaulting to Braucher et al (2009) scaling" << endl;
-        LSDCRNP.set_Braucher_parameters();
+        case 0:
+          LSDCRNP.set_Schaller_parameters();
+          break;
+        case 2:
+          LSDCRNP.set_Granger_parameters();
+          break;
+        case 3:
+          LSDCRNP.set_newCRONUS_parameters();
+          break;
+        default:
+          LSDCRNP.set_Braucher_parameters();
+          break;
       }
 
       // set the scaling to the correct production uncertainty
-      vector<double> test_uncert;
       if(is_production_uncertainty_plus_on)
       {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_plus();
+        LSDCRNP.set_P0_CRONUS_uncertainty_plus();
       }
       else if(is_production_uncertainty_minus_on)
       {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_minus();
-      }
-
-      // the elevation, snow shielding, topographic shielding
-      // and production scaling are all independent of the erosion rate
-      // and are calculated seperately.
-      if(  production_scaling.size() < 1 )
-      {
-        cout << "LSDCosmoBasin, trying to precalculate erosion rate." << endl
-             << "Scaling vectors have not been set! You are about to get a seg fault" << endl;
+        LSDCRNP.set_P0_CRONUS_uncertainty_minus();
       }
 
-      // now you need logic to test if you are accounting for self shielding
-      total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q];
-      total_shielding = prod_uncert_factor*total_shielding_no_uncert;
-      cumulative_production_rate += total_shielding_no_uncert;
-
-      // scale the F values
-      LSDCRNP.scale_F_values(total_shielding,nuclide_scaling_switches);
-
-      // check to see if the shielding data exist and if so get the top and bottom
-      // effective depths
-
-
-      // first get snow shielding (as implemented by and effective depth of snow)
-      if (snow_shield_eff_depth.size() < 1)
+      if (is_depth_integrated)
       {
-        this_top_eff_depth = 0;
+        // snow and self shielding come from the effective depths
+        total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q];
       }
-      else if (snow_shield_eff_depth.size() == 1)
+      else if ( self_shielding.size() < 1 )
       {
-        this_top_eff_depth = snow_shield_eff_depth[0];
-        //cout << "\n\nSnow shield depth: " <<   this_top_eff_depth << endl;
+        total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q]*
+                                  snow_shielding[q];
       }
       else
       {
-        this_top_eff_depth = snow_shield_eff_depth[q];
-        //cout << "\n\nSnow shield depth: " <<   this_top_eff_depth << endl;
+        total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q]*
+                                  snow_shielding[q]*self_shielding[q];
       }
+      total_shielding = prod_uncert_factor*total_shielding_no_uncert;
+      pixel_production[p] = total_shielding_no_uncert;
 
-      // now get the self shielding. This is the thickness of the removed
-      // layer
-      if (self_shield_eff_depth.size() < 1)
-      {
-        this_bottom_eff_depth = this_top_eff_depth;
-      }
-      else if (self_shield_eff_depth.size() == 1)
-      {
-        this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[0];
-        //cout << "\n\n Self shield depth: " << self_shield_eff_depth[0]  << endl;
-      }
-      else
-      {
-        this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[q];
-        //cout << "\n\n Self shield depth: " << self_shield_eff_depth[q]  << endl;
-      }
+      LSDCRNP.scale_F_values(total_shielding,nuclide_scaling_switches);
+      LSDCRNP.get_steady_state_parameters(Nuclide, F, this_Gamma, this_lambda, this_St_P0);
 
-      // get the nuclide concentration from this node
-      if (Nuclide == "Be10")
+      // the particle sits at the surface unless the shielding is depth integrated
+      for (int i = 0; i<4; i++)
       {
-        //cout << "LInE 2271, 10Be" << endl;
-        eroded_particle.update_10Be_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                           this_top_eff_depth, this_bottom_eff_depth);
-        Total_N+=eroded_particle.getConc_10Be();
+        depth_factor[i] = 1.0;
       }
-      else if (Nuclide == "Al26")
+      if (is_depth_integrated)
       {
-        //cout << "LINE 2278, 26Al" << endl;
-        eroded_particle.update_26Al_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                           this_top_eff_depth, this_bottom_eff_depth);
-        Total_N+=eroded_particle.getConc_26Al();
-      }
-      else
-      {
-        cout << "You didn't give a valid nuclide. You chose: " << Nuclide << endl;
-        cout << "Choices are 10Be, 26Al.  Note these case sensitive and cannot" << endl;
-        cout << "contain spaces or control characters. Defaulting to 10Be." << endl;
-        eroded_particle.update_10Be_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                           this_top_eff_depth, this_bottom_eff_depth);
-        Total_N+=eroded_particle.getConc_10Be();
+        // first get snow shielding (as implemented by and effective depth of snow)
+        if (snow_shield_eff_depth.size() < 1)
+        {
+          this_top_eff_depth = 0;
+        }
+        else if (snow_shield_eff_depth.size() == 1)
+        {
+          this_top_eff_depth = snow_shield_eff_depth[0];
+        }
+        else
+        {
+          this_top_eff_depth = snow_shield_eff_depth[q];
+        }
+
+        // now get the self shielding. This is the thickness of the removed
+        // layer
+        if (self_shield_eff_depth.size() < 1)
+        {
+          this_bottom_eff_depth = this_top_eff_depth;
+        }
+        else if (self_shield_eff_depth.size() == 1)
+        {
+          this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[0];
+        }
+        else
+        {
+          this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[q];
+        }
+        if (this_top_eff_depth > this_bottom_eff_depth)
+        {
+          double temp_eff_depth = this_bottom_eff_depth;
+          this_bottom_eff_depth = this_top_eff_depth;
+          this_top_eff_depth = temp_eff_depth;
+        }
+
+        // the mean production over the removed layer, relative to the
+        // surface (see LSDCRNParticle::update_10Be_SSfull_depth_integrated)
+        for (int i = 0; i<4; i++)
+        {
+          if (this_top_eff_depth == this_bottom_eff_depth)
+          {
+            depth_factor[i] = exp(-this_top_eff_depth/this_Gamma[i]);
+          }
+          else
+          {
+            depth_factor[i] = (exp(-this_top_eff_depth/this_Gamma[i])
+                              -exp(-this_bottom_eff_depth/this_Gamma[i]))*this_Gamma[i]/
+                              (this_bottom_eff_depth-this_top_eff_depth);
+          }
+        }
       }
 
-      //cout << endl << endl << "LINE 2052, total shield: " << total_shielding
-      //     << " erosion: " << eff_erosion_rate << " erosion in cm/kyr with rho = 2650: "
-      //     << eff_erosion_rate*1e6/2650.0 << " and N: " << eroded_particle.getConc_10Be() << endl;
+      F0[p] = F[0]*depth_factor[0];
+      F1[p] = F[1]*depth_factor[1];
+      F2[p] = F[2]*depth_factor[2];
+      F3[p] = F[3]*depth_factor[3];
 
+      if (p == 0)
+      {
+        Gamma_vec = this_Gamma;
+        lambda = this_lambda;
+        St_P0 = this_St_P0;
+      }
     }
   }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-  BasinAverage = Total_N/double(count_samples);
-  average_production_rate = cumulative_production_rate/double(count_samples);
-  average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This builds the concentration kernel. Each pixel gets its F values scaled
+// to its shielding exactly as the particle based calculation did, but this
+// happens once per set of settings rather than once per concentration.
+// The scaled F values are held by pathway (F0, F1, ...) over the pixels
+// and then summed in pixel order, so the result does not depend on the
+// number of threads.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoBasin::update_CRN_conc_kernel(string Nuclide, double prod_uncert_factor,
+                                string Muon_scaling, bool data_from_outlet_only,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on,
+                                bool is_depth_integrated)
+{
+  if (conc_kernel.is_valid &&
+      conc_kernel.Nuclide == Nuclide &&
+      conc_kernel.Muon_scaling == Muon_scaling &&
+      conc_kernel.prod_uncert_factor == prod_uncert_factor &&
+      conc_kernel.is_production_uncertainty_plus_on == is_production_uncertainty_plus_on &&
+      conc_kernel.is_production_uncertainty_minus_on == is_production_uncertainty_minus_on &&
+      conc_kernel.data_from_outlet_only == data_from_outlet_only &&
+      conc_kernel.is_depth_integrated == is_depth_integrated)
+  {
+    return;
+  }
 
-  // replace the production uncertanty
-  production_uncertainty = average_production_uncertainty;
+  // set a special case if the outlet flag is true
+  int end_node;
+  if (data_from_outlet_only)
+  {
+    end_node = 1;
+  }
+  else
+  {
+    end_node =  int(BasinNodes.size());
+  }
 
-  // replace the average production rate
-  average_production = average_production_rate;
+  //exclude NDV from average
+  vector<int> pixels;
+  for (int q = 0; q < end_node; ++q)
+  {
+    if(topographic_shielding[q] != NoDataValue)
+    {
+      pixels.push_back(q);
+    }
+  }
+  int n_pixels = int(pixels.size());
+
+  // the scaled F values of each pathway and the production of each pixel
+  vector<double> F0, F1, F2, F3;
+  vector<double> pixel_production;
+  vector<double> Gamma_vec;
+  double lambda, St_P0;
+  scale_CRN_kernel_pixels(pixels, Nuclide, prod_uncert_factor, Muon_scaling,
+                          is_production_uncertainty_plus_on,
+                          is_production_uncertainty_minus_on, is_depth_integrated,
+                          F0, F1, F2, F3, pixel_production,
+                          Gamma_vec, lambda, St_P0);
+
+  // now sum over the pixels, in order
+  double F_sum[4] = {0,0,0,0};
+  double cumulative_production_rate = 0;
+  for (int p = 0; p < n_pixels; p++)
+  {
+    F_sum[0] += F0[p];
+    F_sum[1] += F1[p];
+    F_sum[2] += F2[p];
+    F_sum[3] += F3[p];
+    cumulative_production_rate += pixel_production[p];
+  }
+
+  conc_kernel.Nuclide = Nuclide;
+  conc_kernel.Muon_scaling = Muon_scaling;
+  conc_kernel.prod_uncert_factor = prod_uncert_factor;
+  conc_kernel.is_production_uncertainty_plus_on = is_production_uncertainty_plus_on;
+  conc_kernel.is_production_uncertainty_minus_on = is_production_uncertainty_minus_on;
+  conc_kernel.data_from_outlet_only = data_from_outlet_only;
+  conc_kernel.is_depth_integrated = is_depth_integrated;
+  for (int i = 0; i<4; i++)
+  {
+    conc_kernel.F_sum[i] = F_sum[i];
+    conc_kernel.Gamma[i] = Gamma_vec[i];
+  }
+  conc_kernel.lambda = lambda;
+  conc_kernel.St_P0 = St_P0;
+  conc_kernel.n_pixels = n_pixels;
+  conc_kernel.cumulative_production_rate = cumulative_production_rate;
+  conc_kernel.is_valid = true;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-  return BasinAverage;
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The basin averaged concentration from the kernel
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+double LSDCosmoBasin::evaluate_CRN_conc_kernel(double eff_erosion_rate)
+{
+  double sum_term = 0;
+  for (int i = 0; i<4; i++)
+  {
+    sum_term += conc_kernel.F_sum[i]*conc_kernel.Gamma[i]/
+                (eff_erosion_rate+conc_kernel.Gamma[i]*conc_kernel.lambda);
+  }
+  return conc_kernel.St_P0*sum_term/double(conc_kernel.n_pixels);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -4702,63 +4987,11 @@ double LSDCosmoBasin::predict_mean_CRN_conc_with_snow_and_self_nested(double eff
     prod_uncert_factor = 1;
   }
 
-  int end_node;
-  end_node =  int(BasinNodes.size());
-
-
-  // these parameters give the average production rate of the entore basin,
-  // along with the magnitude of the production uncertainty
-  double cumulative_production_rate = 0;
-  double average_production_rate;
-  double average_production_uncertainty;
-
-  // the average atoms per gram of the nuclide
-  double BasinAverage;
-
-  // the total shielding. A product of snow, topographic and production scaling
-  double total_shielding;
-  double total_shielding_no_uncert;
-
-  // the total atomic concentration of the nuclude in question
-  double Total_N = 0;
-  double Total_Mass = 0;
-
-  int count_samples = 0;
-
-  // initiate a particle. We'll just repeatedly call this particle
-  // for the sample.
-  int startType = 0;
-  double Xloc = 0;
-  double Yloc = 0;
-  double  startdLoc = 0.0;
-  double  start_effdloc = 0.0;
-  double startzLoc = 0.0;
-
-  int row,col;    // these are for getting the row and column from the know erosion rate raster
-
-  // create a particle at zero depth
-  LSDCRNParticle eroded_particle(startType, Xloc, Yloc,
-                               startdLoc, start_effdloc, startzLoc);
-
-  // now create the CRN parameters object
-  LSDCRNParameters LSDCRNP;
-
-  // set the scaling vector
-  vector<bool> nuclide_scaling_switches(4,false);
-  if (Nuclide == "Be10")
-  {
-    nuclide_scaling_switches[0] = true;
-  }
-  else if (Nuclide == "Al26")
-  {
-    nuclide_scaling_switches[1] = true;
-  }
-  else
+  if (Nuclide != "Be10" && Nuclide != "Al26")
   {
     cout << "LSDBasin line 1583, You didn't choose a valid nuclide. Defaulting"
          << " to 10Be." << endl;
     Nuclide = "Be10";
-    nuclide_scaling_switches[0] = true;
   }
 
   // check the production uncertainty bools
@@ -4772,197 +5005,154 @@ double LSDCosmoBasin::predict_mean_CRN_conc_with_snow_and_self_nested(double eff
     }
   }
 
-  // parameters for the shielding
-  double this_top_eff_depth;
-  double this_bottom_eff_depth;
-
-  // loop through the elevation data
-  for (int q = 0; q < end_node; ++q)
-  {
-
-    //exclude NDV from average
-    if(topographic_shielding[q] != NoDataValue)
-    {
-      count_samples++;
-
-      // reset scaling parameters. This is necessary since the F values are
-      // reset for local scaling
-      if (Muon_scaling == "Schaller" )
-      {
-        LSDCRNP.set_Schaller_parameters();
-      }
-      else if (Muon_scaling == "Braucher" )
-      {
-        LSDCRNP.set_Braucher_parameters();
-      }
-      else if (Muon_scaling == "Granger" )
-      {
-        LSDCRNP.set_Granger_parameters();
-      }
-      else if (Muon_scaling == "newCRONUS" )
-      {
-        LSDCRNP.set_newCRONUS_parameters();
-      }
-      else
-      {
-        cout << "You didn't set the muon scaling." << endl
-             << "Options are Schaller, Braucher, newCRONUS, and Granger." << endl
-             << "You chose: " << Muon_scaling << endl
-             << "Defaulting to Braucher et al (2009) scaling" << endl;
-        LSDCRNP.set_Braucher_parameters();
-      }
-
-      // set the scaling to the correct production uncertainty
-      vector<double> test_uncert;
-      if(is_production_uncertainty_plus_on)
-      {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_plus();
-      }
-      else if(is_production_uncertainty_minus_on)
-      {
-        test_uncert = LSDCRNP.set_P0_CRONUS_uncertainty_minus();
-      }
+  // The pixels with a known erosion rate (those of the nested sub-basins)
+  // contribute the same nuclide and mass flux whatever the erosion rate of
+  // the rest of the basin, so they are summed once into the nested kernel
+  // and only the unknown pixels depend on eff_erosion_rate
+  update_CRN_nested_kernel(known_effective_erosion, FlowInfo, Nuclide,
+                           prod_uncert_factor, Muon_scaling,
+                           is_production_uncertainty_plus_on,
+                           is_production_uncertainty_minus_on);
 
-      // the elevation, snow shielding, topographic shielding
-      // and production scaling are all independent of the erosion rate
-      // and are calculated seperately.
-      if(  production_scaling.size() < 1 )
-      {
-        cout << "LSDCosmoBasin, trying to precalculate erosion rate." << endl
-             << "Scaling vectors have not been set! You are about to get a seg fault" << endl;
-      }
-
-      // now you need logic to test if you are accounting for self shielding
-      total_shielding_no_uncert = production_scaling[q]*topographic_shielding[q];
-      total_shielding = prod_uncert_factor*total_shielding_no_uncert;
-      cumulative_production_rate += total_shielding_no_uncert;
-
-      // scale the F values
-      LSDCRNP.scale_F_values(total_shielding,nuclide_scaling_switches);
-
-      // check to see if the shielding data exist and if so get the top and bottom
-      // effective depths
-      // first get snow shielding (as implemented by and effective depth of snow)
-      if (snow_shield_eff_depth.size() < 1)
-      {
-        this_top_eff_depth = 0;
-      }
-      else if (snow_shield_eff_depth.size() == 1)
-      {
-        this_top_eff_depth = snow_shield_eff_depth[0];
-        //cout << "\n\nSnow shield depth: " <<   this_top_eff_depth << endl;
-      }
-      else
-      {
-        this_top_eff_depth = snow_shield_eff_depth[q];
-        //cout << "\n\nSnow shield depth: " <<   this_top_eff_depth << endl;
-      }
+  // the average atoms per gram of the nuclide
+  double BasinAverage = evaluate_CRN_nested_kernel(eff_erosion_rate);
 
-      // now get the self shielding. This is the thickness of the removed
-      // layer
-      if (self_shield_eff_depth.size() < 1)
-      {
-        this_bottom_eff_depth = this_top_eff_depth;
-      }
-      else if (self_shield_eff_depth.size() == 1)
-      {
-        this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[0];
-        //cout << "\n\n Self shield depth: " << self_shield_eff_depth[0]  << endl;
-      }
-      else
-      {
-        this_bottom_eff_depth = this_top_eff_depth+self_shield_eff_depth[q];
-        //cout << "\n\n Self shield depth: " << self_shield_eff_depth[q]  << endl;
-      }
+  // these parameters give the average production rate of the entore basin,
+  // along with the magnitude of the production uncertainty
+  double average_production_rate = nested_kernel.cumulative_production_rate/
+                                   double(nested_kernel.n_pixels);
+  double average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
 
-      // get the nuclide concentration from this node
-      // get the row and column of the node
-      FlowInfo.retrieve_current_row_and_col(BasinNodes[q], row, col);
+  // replace the production uncertanty
+  production_uncertainty = average_production_uncertainty;
 
-      // get the erosion rate from the raster
-      float this_erosion_rate = known_effective_erosion.get_data_element(row,col);
+  // replace the average production rate
+  average_production = average_production_rate;
 
-      // check if there is a data value in the raster, if this is the case then
-      // calculate the concentration based on the erosion from this raster
-      if( this_erosion_rate != NoDataValue)
-      {
-        //cout << "This pixel at " << row << "," << col << " has an erate of: " << this_erosion_rate << endl;
+  return BasinAverage;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-        if (Nuclide == "Be10")
-        {
-          //cout << "LInE 2271, 10Be" << endl;
-          eroded_particle.update_10Be_SSfull_depth_integrated(this_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-           Total_N+=this_erosion_rate*eroded_particle.getConc_10Be();
-           Total_Mass+=this_erosion_rate;
-        }
-        else if (Nuclide == "Al26")
-        {
-          //cout << "LINE 2278, 26Al" << endl;
-          eroded_particle.update_26Al_SSfull_depth_integrated(this_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-          Total_N+=this_erosion_rate*eroded_particle.getConc_26Al();
-          Total_Mass+=this_erosion_rate;
-        }
-        else
-        {
-          cout << "You didn't give a valid nuclide. You chose: " << Nuclide << endl;
-          cout << "Choices are 10Be, 26Al.  Note these case sensitive and cannot" << endl;
-          cout << "contain spaces or control characters. Defaulting to 10Be." << endl;
-          eroded_particle.update_10Be_SSfull_depth_integrated(this_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-          Total_N+=this_erosion_rate*eroded_particle.getConc_10Be();
-          Total_Mass+=this_erosion_rate;
-        }
-      }
-      else  // this is the erosion rate not previously calculated (i.e., not in the raster)
-      {
-        if (Nuclide == "Be10")
-        {
-          //cout << "LInE 2271, 10Be" << endl;
-          eroded_particle.update_10Be_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-           Total_N+=eff_erosion_rate*eroded_particle.getConc_10Be();
-           Total_Mass+=eff_erosion_rate;
-        }
-        else if (Nuclide == "Al26")
-        {
-          //cout << "LINE 2278, 26Al" << endl;
-          eroded_particle.update_26Al_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-          Total_N+=eff_erosion_rate*eroded_particle.getConc_26Al();
-          Total_Mass+=eff_erosion_rate;
-        }
-        else
-        {
-          cout << "You didn't give a valid nuclide. You chose: " << Nuclide << endl;
-          cout << "Choices are 10Be, 26Al.  Note these case sensitive and cannot" << endl;
-          cout << "contain spaces or control characters. Defaulting to 10Be." << endl;
-          eroded_particle.update_10Be_SSfull_depth_integrated(eff_erosion_rate,LSDCRNP,
-                                             this_top_eff_depth, this_bottom_eff_depth);
-          Total_N+=eff_erosion_rate*eroded_particle.getConc_10Be();
-          Total_Mass+=eff_erosion_rate;
-        }
-      }
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This builds the nested concentration kernel. The pixels are scaled as for
+// the depth integrated concentration kernel and then split using the raster
+// of known erosion rates. Pixels with a known rate are reduced to their
+// nuclide flux (E*N) and mass flux (E); the rest are summed into F_sum.
+// All sums are in pixel order.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoBasin::update_CRN_nested_kernel(LSDRaster& known_effective_erosion,
+                                LSDFlowInfo& FlowInfo, string Nuclide,
+                                double prod_uncert_factor, string Muon_scaling,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on)
+{
+  if (nested_kernel.is_valid &&
+      nested_kernel.known_effective_erosion == &known_effective_erosion &&
+      nested_kernel.Nuclide == Nuclide &&
+      nested_kernel.Muon_scaling == Muon_scaling &&
+      nested_kernel.prod_uncert_factor == prod_uncert_factor &&
+      nested_kernel.is_production_uncertainty_plus_on == is_production_uncertainty_plus_on &&
+      nested_kernel.is_production_uncertainty_minus_on == is_production_uncertainty_minus_on)
+  {
+    return;
+  }
 
+  //exclude NDV from average
+  int end_node =  int(BasinNodes.size());
+  vector<int> pixels;
+  for (int q = 0; q < end_node; ++q)
+  {
+    if(topographic_shielding[q] != NoDataValue)
+    {
+      pixels.push_back(q);
     }
   }
+  int n_pixels = int(pixels.size());
+
+  // the nested calculation is always depth integrated
+  vector<double> F0, F1, F2, F3;
+  vector<double> pixel_production;
+  vector<double> Gamma_vec;
+  double lambda, St_P0;
+  scale_CRN_kernel_pixels(pixels, Nuclide, prod_uncert_factor, Muon_scaling,
+                          is_production_uncertainty_plus_on,
+                          is_production_uncertainty_minus_on, true,
+                          F0, F1, F2, F3, pixel_production,
+                          Gamma_vec, lambda, St_P0);
+
+  // now sum over the pixels, in order
+  double F_sum[4] = {0,0,0,0};
+  double cumulative_production_rate = 0;
+  double known_N_sum = 0;
+  double known_mass_sum = 0;
+  int n_unknown_pixels = 0;
+  int row,col;
+  for (int p = 0; p < n_pixels; p++)
+  {
+    cumulative_production_rate += pixel_production[p];
 
+    // get the erosion rate from the raster
+    FlowInfo.retrieve_current_row_and_col(BasinNodes[pixels[p]], row, col);
+    float this_erosion_rate = known_effective_erosion.get_data_element(row,col);
 
-  BasinAverage = Total_N/Total_Mass;
-  average_production_rate = cumulative_production_rate/double(count_samples);
-  average_production_uncertainty = average_production_rate*fabs(1-prod_uncert_factor);
-
-  //cout << "Basin average is: " << BasinAverage << " and effective erosion: " << eff_erosion_rate << endl;
-
-
-  // replace the production uncertanty
-  production_uncertainty = average_production_uncertainty;
+    if( this_erosion_rate != NoDataValue)
+    {
+      double E = this_erosion_rate;
+      double this_conc = St_P0*(F0[p]*Gamma_vec[0]/(E+Gamma_vec[0]*lambda)+
+                                F1[p]*Gamma_vec[1]/(E+Gamma_vec[1]*lambda)+
+                                F2[p]*Gamma_vec[2]/(E+Gamma_vec[2]*lambda)+
+                                F3[p]*Gamma_vec[3]/(E+Gamma_vec[3]*lambda));
+      known_N_sum += E*this_conc;
+      known_mass_sum += E;
+    }
+    else
+    {
+      F_sum[0] += F0[p];
+      F_sum[1] += F1[p];
+      F_sum[2] += F2[p];
+      F_sum[3] += F3[p];
+      n_unknown_pixels++;
+    }
+  }
 
-  // replace the average production rate
-  average_production = average_production_rate;
+  nested_kernel.known_effective_erosion = &known_effective_erosion;
+  nested_kernel.Nuclide = Nuclide;
+  nested_kernel.Muon_scaling = Muon_scaling;
+  nested_kernel.prod_uncert_factor = prod_uncert_factor;
+  nested_kernel.is_production_uncertainty_plus_on = is_production_uncertainty_plus_on;
+  nested_kernel.is_production_uncertainty_minus_on = is_production_uncertainty_minus_on;
+  for (int i = 0; i<4; i++)
+  {
+    nested_kernel.F_sum[i] = F_sum[i];
+    nested_kernel.Gamma[i] = Gamma_vec[i];
+  }
+  nested_kernel.lambda = lambda;
+  nested_kernel.St_P0 = St_P0;
+  nested_kernel.known_N_sum = known_N_sum;
+  nested_kernel.known_mass_sum = known_mass_sum;
+  nested_kernel.n_unknown_pixels = n_unknown_pixels;
+  nested_kernel.n_pixels = n_pixels;
+  nested_kernel.cumulative_production_rate = cumulative_production_rate;
+  nested_kernel.is_valid = true;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-  return BasinAverage;
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The mass weighted concentration of a nested basin from the nested kernel
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+double LSDCosmoBasin::evaluate_CRN_nested_kernel(double eff_erosion_rate)
+{
+  double sum_term = 0;
+  for (int i = 0; i<4; i++)
+  {
+    sum_term += nested_kernel.F_sum[i]*nested_kernel.Gamma[i]/
+                (eff_erosion_rate+nested_kernel.Gamma[i]*nested_kernel.lambda);
+  }
+  double Total_N = nested_kernel.known_N_sum+
+                   eff_erosion_rate*nested_kernel.St_P0*sum_term;
+  double Total_Mass = nested_kernel.known_mass_sum+
+                      eff_erosion_rate*double(nested_kernel.n_unknown_pixels);
+  return Total_N/Total_Mass;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -6310,4 +6500,138 @@ void LSDCosmoBasin::print_particle_csv(string path_to_file, string filename,
 }
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Zonal statistics
+// These calculate the statistics of many rasters within many basins. Each node
+// is visited once per basin and all the rasters are read at that visit.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector< vector<basin_zonal_stats> > calculate_basin_zonal_stats(LSDFlowInfo& FlowInfo,
+                                        vector<int>& outlet_nodes, vector<LSDRaster*>& Data,
+                                        vector<float>& percentiles, bool calculate_median)
+{
+  int n_basins = int(outlet_nodes.size());
+  vector< vector<basin_zonal_stats> > stats_of_basins(n_basins);
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for (int b = 0; b < n_basins; b++)
+  {
+    vector<int> basin_nodes = FlowInfo.get_upslope_nodes(outlet_nodes[b]);
+    stats_of_basins[b] = calculate_zonal_stats_of_nodes(FlowInfo, basin_nodes, Data,
+                                                        percentiles, calculate_median);
+  }
+
+  return stats_of_basins;
+}
+
+vector<basin_zonal_stats> calculate_zonal_stats_of_nodes(LSDFlowInfo& FlowInfo, vector<int>& nodes,
+                                        vector<LSDRaster*>& Data, vector<float>& percentiles,
+                                        bool calculate_median)
+{
+  int n_rasters = int(Data.size());
+  int n_nodes = int(nodes.size());
+  int n_percentiles = int(percentiles.size());
+
+  // each raster is checked against, and reports missing statistics with, its own nodata value
+  vector<float> NoDataValues(n_rasters);
+  for (int r = 0; r < n_rasters; r++)
+  {
+    NoDataValues[r] = Data[r]->get_NoDataValue();
+  }
+
+  // running moments (Welford) and extremes for each raster. The values are only
+  // kept if they are needed for the median and percentiles.
+  bool keep_values = (calculate_median || n_percentiles > 0);
+  vector<int> count(n_rasters,0);
+  vector<double> mean(n_rasters,0.0);
+  vector<double> M2(n_rasters,0.0);
+  vector<float> minimum(n_rasters,0.0);
+  vector<float> maximum(n_rasters,0.0);
+  vector< vector<float> > values(n_rasters);
+  if (keep_values)
+  {
+    for (int r = 0; r < n_rasters; r++)
+    {
+      values[r].reserve(n_nodes);
+    }
+  }
+
+  int row,col;
+  for (int q = 0; q < n_nodes; q++)
+  {
+    FlowInfo.retrieve_current_row_and_col(nodes[q], row, col);
+    for (int r = 0; r < n_rasters; r++)
+    {
+      float this_value = Data[r]->get_data_element(row,col);
+      if (this_value != NoDataValues[r])
+      {
+        count[r]++;
+        double delta = double(this_value)-mean[r];
+        mean[r] += delta/double(count[r]);
+        M2[r] += delta*(double(this_value)-mean[r]);
+        if (count[r] == 1 || this_value < minimum[r])
+        {
+          minimum[r] = this_value;
+        }
+        if (count[r] == 1 || this_value > maximum[r])
+        {
+          maximum[r] = this_value;
+        }
+        if (keep_values)
+        {
+          values[r].push_back(this_value);
+        }
+      }
+    }
+  }
+
+  vector<basin_zonal_stats> stats(n_rasters);
+  for (int r = 0; r < n_rasters; r++)
+  {
+    basin_zonal_stats& these_stats = stats[r];
+    float NoDataValue = NoDataValues[r];
+    these_stats.n_data = count[r];
+    these_stats.percentiles.assign(n_percentiles,NoDataValue);
+    if (count[r] == 0)
+    {
+      these_stats.mean = NoDataValue;
+      these_stats.std_dev = NoDataValue;
+      these_stats.std_error = NoDataValue;
+      these_stats.minimum = NoDataValue;
+      these_stats.maximum = NoDataValue;
+      these_stats.range = NoDataValue;
+      these_stats.median = NoDataValue;
+      continue;
+    }
+
+    // the population standard deviation, as in get_standard_deviation
+    double variance = M2[r]/double(count[r]);
+    these_stats.mean = float(mean[r]);
+    these_stats.std_dev = float(sqrt(variance));
+    these_stats.std_error = float(sqrt(variance)/sqrt(double(count[r])));
+    these_stats.minimum = minimum[r];
+    these_stats.maximum = maximum[r];
+    these_stats.range = maximum[r]-minimum[r];
+
+    // the median and percentiles interpolate between the ranked values
+    these_stats.median = NoDataValue;
+    if (not keep_values)
+    {
+      continue;
+    }
+    vector<float>& these_values = values[r];
+    sort(these_values.begin(),these_values.end());
+    if (calculate_median)
+    {
+      these_stats.median = get_percentile(these_values,50.0);
+    }
+    for (int p = 0; p < n_percentiles; p++)
+    {
+      these_stats.percentiles[p] = get_percentile(these_values,percentiles[p]);
+    }
+  }
+
+  return stats;
+}
+
+
 #endif
@@ -19,6 +19,25 @@
 using namespace std;
 using namespace TNT;
 
+///@brief The statistics of one raster within one basin, as calculated by the
+/// zonal statistics functions.
+///@details All the statistics ignore nodata. If the basin has no data in the
+/// raster the statistics are set to NoData.
+struct basin_zonal_stats
+{
+  /// The number of basin nodes that have data
+  int n_data;
+  float mean;
+  float std_dev;
+  float std_error;
+  float minimum;
+  float maximum;
+  float range;
+  float median;
+  /// One value for each of the requested percentiles
+  vector<float> percentiles;
+};
+
 ///@brief Object to store information about drainage basins and generate basin average metrics..
 class LSDBasin
 {
@@ -154,7 +173,7 @@ class LSDBasin
   /// @return Mean value.
   /// @author SWDG
   /// @date 11/12/13
-  float CalculateBasinMean(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinMean(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the max value of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -162,7 +181,7 @@ class LSDBasin
   /// @return Max value.
   /// @author SWDG
   /// @date 11/12/13
-  float CalculateBasinMax(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinMax(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the min value of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -170,7 +189,7 @@ class LSDBasin
   /// @return Min value.
   /// @author SWDG
   /// @date 17/2/14
-  float CalculateBasinMin(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinMin(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the median value of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -178,7 +197,7 @@ class LSDBasin
   /// @return Median value.
   /// @author SWDG
   /// @date 17/2/14
-  float CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the percentile value of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -186,7 +205,25 @@ class LSDBasin
   /// @return Percentile value.
   /// @author SWDG
   /// @date 5/2/17
-  float CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster Data, int Percentile);
+  float CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster& Data, int Percentile);
+
+  /// @brief Calculate the median or a percentile of an LSDRaster inside a basin,
+  /// optionally estimated from a QuantileSketch so the basin data is neither copied nor sorted.
+  /// @param FlowInfo Flowinfo object.
+  /// @param Data Values to find the percentile of.
+  /// @param Percentile The percentile (0 to 100).
+  /// @param sketch_compression The compression of the sketch. If this is 0 or
+  /// less the legacy exact functions are used.
+  /// @return Percentile value.
+  float CalculateBasinMedian(LSDFlowInfo& FlowInfo, LSDRaster& Data, float sketch_compression);
+  float CalculateBasinPercentile(LSDFlowInfo& FlowInfo, LSDRaster& Data, int Percentile, float sketch_compression);
+
+  /// @brief Build a QuantileSketch of the values of an LSDRaster inside the basin.
+  /// @param FlowInfo Flowinfo object.
+  /// @param Data The raster.
+  /// @param sketch_compression The compression of the sketch.
+  /// @return The sketch, which can be merged with the sketches of other basins.
+  QuantileSketch BuildBasinQuantileSketch(LSDFlowInfo& FlowInfo, LSDRaster& Data, float sketch_compression);
 
   /// @brief Calculate the Standard Deviation of values of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -194,7 +231,7 @@ class LSDBasin
   /// @return Standard deviation value.
   /// @author SWDG
   /// @date 17/2/14
-  float CalculateBasinStdDev(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinStdDev(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the Standard error of values of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -202,7 +239,7 @@ class LSDBasin
   /// @return Standard error value.
   /// @author SWDG
   /// @date 17/2/14
-  float CalculateBasinStdError(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinStdError(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the range of values of an LSDRaster which falls inside a basin.
   /// @param FlowInfo Flowinfo object.
@@ -210,7 +247,7 @@ class LSDBasin
   /// @return Range value.
   /// @author SWDG
   /// @date 17/2/14
-  float CalculateBasinRange(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  float CalculateBasinRange(LSDFlowInfo& FlowInfo, LSDRaster& Data);
 
   /// @brief Calculate the number of data points of an LSDRaster which fall inside a basin.
   ///
@@ -220,77 +257,91 @@ class LSDBasin
   /// @return Number of data points.
   /// @author SWDG
   /// @date 17/2/14
-  int CalculateNumDataPoints(LSDFlowInfo& FlowInfo, LSDRaster Data);
+  int CalculateNumDataPoints(LSDFlowInfo& FlowInfo, LSDRaster& Data);
+
+  /// @brief Calculate the statistics of several rasters within the basin in
+  /// a single scan of the basin nodes.
+  /// @details This replaces calling CalculateBasinMean, CalculateBasinMax etc.
+  /// once for each raster and statistic.
+  /// @param FlowInfo Flowinfo object.
+  /// @param Data Pointers to the rasters to calculate statistics for.
+  /// @param percentiles The percentiles (between 0 and 100) wanted for each raster.
+  /// Leave this empty to skip the percentiles.
+  /// @param calculate_median If false the median is set to NoData. With no
+  /// percentiles either, the values are then neither kept nor sorted.
+  /// @return The statistics of each raster, in the order of Data.
+  vector<basin_zonal_stats> CalculateBasinZonalStats(LSDFlowInfo& FlowInfo, vector<LSDRaster*>& Data,
+                                                     vector<float>& percentiles, bool calculate_median);
 
   /// @brief Set the mean slope of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param Slope Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_SlopeMean(LSDFlowInfo& FlowInfo, LSDRaster Slope){ SlopeMean = CalculateBasinMean(FlowInfo, Slope); }
+  void set_SlopeMean(LSDFlowInfo& FlowInfo, LSDRaster& Slope){ SlopeMean = CalculateBasinMean(FlowInfo, Slope); }
 
   /// @brief Set the mean Elevation of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param Elevation Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_ElevationMean(LSDFlowInfo& FlowInfo, LSDRaster Elevation) { ElevationMean = CalculateBasinMean(FlowInfo, Elevation); }
+  void set_ElevationMean(LSDFlowInfo& FlowInfo, LSDRaster& Elevation) { ElevationMean = CalculateBasinMean(FlowInfo, Elevation); }
 
   /// @brief Set the mean Relief of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param Relief Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_ReliefMean(LSDFlowInfo& FlowInfo, LSDRaster Relief) { ReliefMean = CalculateBasinMean(FlowInfo, Relief); }
+  void set_ReliefMean(LSDFlowInfo& FlowInfo, LSDRaster& Relief) { ReliefMean = CalculateBasinMean(FlowInfo, Relief); }
 
   /// @brief Set the mean PlanCurve of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param PlanCurv Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_PlanCurvMean(LSDFlowInfo& FlowInfo, LSDRaster PlanCurv) { PlanCurvMean = CalculateBasinMean(FlowInfo, PlanCurv); }
+  void set_PlanCurvMean(LSDFlowInfo& FlowInfo, LSDRaster& PlanCurv) { PlanCurvMean = CalculateBasinMean(FlowInfo, PlanCurv); }
 
   /// @brief Set the mean ProfCurv of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param ProfileCurv Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_ProfileCurvMean(LSDFlowInfo& FlowInfo, LSDRaster ProfileCurv) { ProfileCurvMean = CalculateBasinMean(FlowInfo, ProfileCurv); }
+  void set_ProfileCurvMean(LSDFlowInfo& FlowInfo, LSDRaster& ProfileCurv) { ProfileCurvMean = CalculateBasinMean(FlowInfo, ProfileCurv); }
 
   /// @brief Set the mean TotalCurv of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param TotalCurv Values to find the mean of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_TotalCurvMean(LSDFlowInfo& FlowInfo, LSDRaster TotalCurv) { TotalCurvMean = CalculateBasinMean(FlowInfo, TotalCurv); }
+  void set_TotalCurvMean(LSDFlowInfo& FlowInfo, LSDRaster& TotalCurv) { TotalCurvMean = CalculateBasinMean(FlowInfo, TotalCurv); }
 
   /// @brief Set the max PlanCurve of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param PlanCurv Values to find the max of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_PlanCurvMax(LSDFlowInfo& FlowInfo, LSDRaster PlanCurv) { PlanCurvMax = CalculateBasinMax(FlowInfo, PlanCurv); }
+  void set_PlanCurvMax(LSDFlowInfo& FlowInfo, LSDRaster& PlanCurv) { PlanCurvMax = CalculateBasinMax(FlowInfo, PlanCurv); }
 
   /// @brief Set the max ProfCurv of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param ProfileCurv Values to find the max of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_ProfileCurvMax(LSDFlowInfo& FlowInfo, LSDRaster ProfileCurv) { ProfileCurvMax = CalculateBasinMax(FlowInfo, ProfileCurv); }
+  void set_ProfileCurvMax(LSDFlowInfo& FlowInfo, LSDRaster& ProfileCurv) { ProfileCurvMax = CalculateBasinMax(FlowInfo, ProfileCurv); }
 
   /// @brief Set the max TotalCurv of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param TotalCurv Values to find the max of.
   /// @author SWDG
   /// @date 11/12/13
-  void set_TotalCurvMax(LSDFlowInfo& FlowInfo, LSDRaster TotalCurv) { TotalCurvMax = CalculateBasinMax(FlowInfo, TotalCurv); }
+  void set_TotalCurvMax(LSDFlowInfo& FlowInfo, LSDRaster& TotalCurv) { TotalCurvMax = CalculateBasinMax(FlowInfo, TotalCurv); }
 
   /// @brief Set the mean hilltop curvature of a basin.
   /// @param FlowInfo Flowinfo object.
   /// @param CHT Values to find the mean of.
   /// @author SWDG
   /// @date 12/12/13
-  void set_CHTMean(LSDFlowInfo& FlowInfo, LSDRaster CHT) { CHTMean = CalculateBasinMean(FlowInfo, CHT); }
+  void set_CHTMean(LSDFlowInfo& FlowInfo, LSDRaster& CHT) { CHTMean = CalculateBasinMean(FlowInfo, CHT); }
 
   /// @brief Set the Cosmogenic erosion rate.
   /// @param ErosionRate Erosion rate - No sanity check on this value.
@@ -327,7 +378,7 @@ class LSDBasin
   /// @param HillslopeLengths Values to find the mean of.
   /// @author SWDG
   /// @date 12/12/13
-  void set_HillslopeLength_HFR(LSDFlowInfo& FlowInfo, LSDRaster HillslopeLengths) { HillslopeLength_HFR = CalculateBasinMean(FlowInfo, HillslopeLengths); }
+  void set_HillslopeLength_HFR(LSDFlowInfo& FlowInfo, LSDRaster& HillslopeLengths) { HillslopeLength_HFR = CalculateBasinMean(FlowInfo, HillslopeLengths); }
 
   /// @brief Set mean HillslopeLengths from boomerang plots from both splines and binned data.
   /// @param Slope LSDRaster of slope.
@@ -348,9 +399,9 @@ class LSDBasin
   /// @brief Set the Rock Exposure fraction of the basin
   /// @author DTM
   /// @date 14/07/15
-  void set_BedrockFraction(LSDFlowInfo& FlowInfo, LSDRaster RockExposure) { BedrockFraction = CalculateBasinMean(FlowInfo, RockExposure); }
+  void set_BedrockFraction(LSDFlowInfo& FlowInfo, LSDRaster& RockExposure) { BedrockFraction = CalculateBasinMean(FlowInfo, RockExposure); }
 
-  void set_Biomass(LSDFlowInfo& FlowInfo, LSDRaster BiomassRaster) { Biomass = CalculateBasinMean(FlowInfo, BiomassRaster); }
+  void set_Biomass(LSDFlowInfo& FlowInfo, LSDRaster& BiomassRaster) { Biomass = CalculateBasinMean(FlowInfo, BiomassRaster); }
 
   void set_AlternativeIndex(LSDFlowInfo& FlowInfo, LSDIndexRaster& AltIndex);
 
@@ -375,7 +426,7 @@ class LSDBasin
   /// @param Aspect Values to find the mean of.
   /// @author SWDG
   /// @date 17/2/14
-  void set_AspectMean(LSDFlowInfo& FlowInfo, LSDRaster Aspect);
+  void set_AspectMean(LSDFlowInfo& FlowInfo, LSDRaster& Aspect);
 
   /// @brief Set the perimeter pixels using a simple edge detection algorithm.
   ///
@@ -459,7 +510,7 @@ class LSDBasin
   /// @param Hilltops a raster of hilltop data.
   /// @author SWDG
   /// @date 18/6/15
-  void set_HilltopPx(LSDFlowInfo& FlowInfo, LSDRaster Hilltops);
+  void set_HilltopPx(LSDFlowInfo& FlowInfo, LSDRaster& Hilltops);
 
   /// @brief Cookie cut data from an LSDIndexRaster into the shape of the basin.
   /// @param Data LSDIndexRaster data to be written.
@@ -946,6 +997,114 @@ vector<int> get_source_node_from_perimeter(vector<int> perimeter, LSDFlowInfo& f
 };
 
 
+/// @brief Calculate the statistics of several rasters within many basins.
+/// @details Each basin is the set of nodes upslope of its outlet node, taken
+/// from the stack of the FlowInfo object so basins may be nested. Each basin
+/// is scanned once for all the rasters, and the basins are done in parallel.
+/// @param FlowInfo Flowinfo object.
+/// @param outlet_nodes The outlet node of each basin.
+/// @param Data Pointers to the rasters to calculate statistics for.
+/// @param percentiles The percentiles (between 0 and 100) wanted for each raster.
+/// Leave this empty to skip the percentiles.
+/// @param calculate_median If false the median is set to NoData.
+/// @return The statistics indexed by [basin][raster].
+vector< vector<basin_zonal_stats> > calculate_basin_zonal_stats(LSDFlowInfo& FlowInfo,
+                                        vector<int>& outlet_nodes, vector<LSDRaster*>& Data,
+                                        vector<float>& percentiles, bool calculate_median);
+
+/// @brief Calculate the statistics of several rasters over a list of nodes.
+/// @details This is the scan used by the basin zonal statistics functions.
+/// The percentiles are exact, interpolating linearly between ranked values.
+/// The values are only kept and sorted if the median or percentiles are wanted,
+/// otherwise the scan only updates the running moments and extremes.
+/// @param FlowInfo Flowinfo object.
+/// @param nodes The node indices to calculate the statistics over.
+/// @param Data Pointers to the rasters to calculate statistics for.
+/// @param percentiles The percentiles (between 0 and 100) wanted for each raster.
+/// @param calculate_median If false the median is set to NoData.
+/// @return The statistics of each raster, in the order of Data. Each raster's
+/// own nodata value is skipped and is used for the statistics it cannot give.
+vector<basin_zonal_stats> calculate_zonal_stats_of_nodes(LSDFlowInfo& FlowInfo, vector<int>& nodes,
+                                        vector<LSDRaster*>& Data, vector<float>& percentiles,
+                                        bool calculate_median);
+
+/// @brief The basin sums behind the basin averaged steady state concentration
+///  of a nuclide.
+/// @details The mean concentration of a basin eroding at an effective rate E
+///  (g/cm^2/yr) is St_P0*sum_i F_sum[i]*Gamma[i]/(E+Gamma[i]*lambda)/n_pixels.
+///  F_sum[i] is the sum over the basin of each pixel's F values, scaled for
+///  the pixel's shielding and, for depth integrated shielding, multiplied by
+///  the pixel's depth integration factor. None of this depends on E, so it is
+///  calculated once and every concentration after that costs four terms.
+struct CRN_conc_kernel
+{
+  /// false until the kernel is built, and again whenever the shielding changes
+  bool is_valid;
+
+  /// The settings the kernel was built with
+  string Nuclide;
+  string Muon_scaling;
+  double prod_uncert_factor;
+  bool is_production_uncertainty_plus_on;
+  bool is_production_uncertainty_minus_on;
+  bool data_from_outlet_only;
+  bool is_depth_integrated;
+
+  /// The basin sums of the scaled F values of the four production pathways
+  double F_sum[4];
+
+  /// The attenuation lengths (g/cm^2), decay constant (yr^-1) and S_t*P0 (a/g/yr)
+  double Gamma[4];
+  double lambda;
+  double St_P0;
+
+  /// The number of pixels in the sums and the sum of their production scaling
+  int n_pixels;
+  double cumulative_production_rate;
+};
+
+/// @brief The kernel of the nested basin concentration. Pixels with an erosion
+///  rate in the raster of known rates (the nested sub-basins) have a fixed
+///  nuclide flux, so they are summed once into known_N_sum (sum of E*N) and
+///  known_mass_sum (sum of E). The concentration at erosion rate E is then
+///  (known_N_sum + E*St_P0*sum_i F_sum[i]*Gamma[i]/(E+Gamma[i]*lambda))/
+///  (known_mass_sum + E*n_unknown_pixels), where F_sum holds only the pixels
+///  without a known rate.
+struct CRN_nested_kernel
+{
+  /// false until the kernel is built, and again whenever the shielding changes
+  bool is_valid;
+
+  /// The raster of known erosion rates the kernel was built from. It is
+  ///  compared by address, so the raster must not be changed in place.
+  const LSDRaster* known_effective_erosion;
+
+  /// The settings the kernel was built with
+  string Nuclide;
+  string Muon_scaling;
+  double prod_uncert_factor;
+  bool is_production_uncertainty_plus_on;
+  bool is_production_uncertainty_minus_on;
+
+  /// The sums of the scaled F values of the pixels without a known rate
+  double F_sum[4];
+
+  /// The attenuation lengths (g/cm^2), decay constant (yr^-1) and S_t*P0 (a/g/yr)
+  double Gamma[4];
+  double lambda;
+  double St_P0;
+
+  /// The nuclide and mass fluxes of the pixels with a known rate
+  double known_N_sum;
+  double known_mass_sum;
+
+  /// The number of pixels without a known rate, the total number of pixels
+  ///  and the sum of their production scaling
+  int n_unknown_pixels;
+  int n_pixels;
+  double cumulative_production_rate;
+};
+
 /// @brief A derived class that is used to compute erosion rates based on
 ///  concentrations of in-situ cosmogenic nuclides such as 10Be and 26Al
 class LSDCosmoBasin: public LSDBasin
@@ -1002,6 +1161,22 @@ class LSDCosmoBasin: public LSDBasin
                                   LSDRaster& Topo_Shield, LSDRaster& Snow_shield,
                                   string path_to_atmospheric_data);
 
+    /// @brief This function populates the scaling vectors from a production
+    ///  scaling array that has been calculated for the whole DEM.
+    ///
+    /// @details The values are the same as those from the version that takes
+    ///  the path to the atmospheric data, but they are gathered from
+    ///  the array rather than calculated for each pixel. The array usually
+    ///  comes from LSDCosmoData::get_production_scaling_cache.
+    ///  Snow shielding is set to 1.
+    /// @param FlowInfo the LSDFlowInfo object
+    /// @param Elevation_Data the DEM, used to find nodata
+    /// @param Topo_Shield an LSDRaster with the topographic shielding
+    /// @param Production_scaling the production scaling of every pixel in the DEM
+    void populate_scaling_vectors(LSDFlowInfo& FlowInfo, LSDRaster& Elevation_Data,
+                                  LSDRaster& Topo_Shield,
+                                  Array2D<double>& Production_scaling);
+
     /// @brief This function sets the basin vectors for snow and shelf sheilding
     ///  if the effective depth method is to be used.
     ///
@@ -1110,6 +1285,33 @@ class LSDCosmoBasin: public LSDBasin
                             double Nuclide_conc_err, double prod_uncert_factor,
                             string Muon_scaling);
 
+    /// @brief Monte Carlo uncertainty propagation for the erosion rate.
+    ///  Each draw perturbs the concentration, the CRONUS production rate,
+    ///  the basin shielding and the spallation attenuation length, and then
+    ///  inverts for the erosion rate using the concentration kernel, so the
+    ///  pixel scaling is only calculated once however many draws there are.
+    ///  Draw i uses the numbers that follow 16*i draws of the sample's stream,
+    ///  so the results do not depend on the number of threads.
+    /// @param Nuclide_conc Concetration of the nuclide
+    /// @param Nuclide Be10 or Al26
+    /// @param Nuclide_conc_err The instrument error in the nuclide concentration
+    /// @param prod_uncert_factor The production uncertainty factor
+    /// @param Muon_scaling Schaller, Braucher, newCRONUS or Granger
+    /// @param n_draws The number of draws
+    /// @param shielding_uncert The relative (1 sigma) uncertainty in the shielding
+    /// @param attenuation_uncert The relative (1 sigma) uncertainty in the
+    ///  spallation attenuation length
+    /// @param rng The stream of this sample. It is not advanced.
+    /// @return A vector with the number of valid draws and then the mean,
+    ///  standard deviation and the 2.5, 16, 50, 84 and 97.5 percentiles
+    ///  of the erosion rate (g/cm^2/yr). Draws with a concentration
+    ///  that no steady erosion rate can produce are dropped.
+    vector<double> MonteCarlo_CRN_erosion_analysis(double Nuclide_conc, string Nuclide,
+                            double Nuclide_conc_err, double prod_uncert_factor,
+                            string Muon_scaling, int n_draws,
+                            double shielding_uncert, double attenuation_uncert,
+                            RandomStream& rng);
+
     /// @brief This function wraps the erosion rate calculator, and returns
     ///  both the erosion rate as well as the uncertainties  ^
     /// @param known_eff_erosion a raster containing known effective erosion rates (g/cm2/yr)
@@ -1545,6 +1747,86 @@ class LSDCosmoBasin: public LSDBasin
     /// in g/cm^2
     vector<double> snow_shield_eff_depth;
 
+    /// The kernel used by predict_mean_CRN_conc and
+    /// predict_mean_CRN_conc_with_snow_and_self. It is rebuilt when the
+    /// settings change and invalidated when the shielding vectors change.
+    CRN_conc_kernel conc_kernel;
+
+    /// @brief Build conc_kernel for a set of settings, unless it already
+    ///  holds them. The scaling of each pixel is done once here, in parallel,
+    ///  rather than on every evaluation of the concentration.
+    /// @param Nuclide Be10 or Al26
+    /// @param prod_uncert_factor the production uncertainty factor
+    /// @param Muon_scaling Schaller, Braucher, newCRONUS or Granger
+    /// @param data_from_outlet_only only use the outlet
+    /// @param is_production_uncertainty_plus_on CRONUS production uncertainty (+)
+    /// @param is_production_uncertainty_minus_on CRONUS production uncertainty (-)
+    /// @param is_depth_integrated true if the snow and self shielding come from
+    ///  the effective depth vectors, as in predict_mean_CRN_conc_with_snow_and_self
+    void update_CRN_conc_kernel(string Nuclide, double prod_uncert_factor,
+                                string Muon_scaling, bool data_from_outlet_only,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on,
+                                bool is_depth_integrated);
+
+    /// @brief The basin averaged concentration from conc_kernel
+    /// @param eff_erosion_rate The erosion rate in g/cm^2/yr
+    /// @return The basin averaged concentration in atoms/g
+    double evaluate_CRN_conc_kernel(double eff_erosion_rate);
+
+    /// The kernel used by predict_mean_CRN_conc_with_snow_and_self_nested.
+    CRN_nested_kernel nested_kernel;
+
+    /// @brief Scale the F values of a list of pixels to their shielding.
+    ///  This is the per pixel work shared by the concentration kernels.
+    /// @param pixels the indices (into BasinNodes) of the pixels
+    /// @param Nuclide Be10 or Al26
+    /// @param prod_uncert_factor the production uncertainty factor
+    /// @param Muon_scaling Schaller, Braucher, newCRONUS or Granger
+    /// @param is_production_uncertainty_plus_on CRONUS production uncertainty (+)
+    /// @param is_production_uncertainty_minus_on CRONUS production uncertainty (-)
+    /// @param is_depth_integrated true if the snow and self shielding come from
+    ///  the effective depth vectors
+    /// @param F0 replaced with the scaled F value of the first pathway of each pixel
+    /// @param F1 as F0, for the second pathway
+    /// @param F2 as F0, for the third pathway
+    /// @param F3 as F0, for the fourth pathway
+    /// @param pixel_production replaced with the production scaling of each pixel
+    /// @param Gamma_vec replaced with the attenuation lengths
+    /// @param lambda replaced with the decay constant
+    /// @param St_P0 replaced with S_t*P0
+    void scale_CRN_kernel_pixels(vector<int>& pixels, string Nuclide,
+                                double prod_uncert_factor, string Muon_scaling,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on,
+                                bool is_depth_integrated,
+                                vector<double>& F0, vector<double>& F1,
+                                vector<double>& F2, vector<double>& F3,
+                                vector<double>& pixel_production,
+                                vector<double>& Gamma_vec,
+                                double& lambda, double& St_P0);
+
+    /// @brief Build nested_kernel for a raster of known erosion rates and a
+    ///  set of settings, unless it already holds them.
+    /// @param known_effective_erosion the known effective erosion rates
+    ///  (g/cm^2/yr), NoDataValue where the rate is unknown
+    /// @param FlowInfo the LSDFlowInfo object
+    /// @param Nuclide Be10 or Al26
+    /// @param prod_uncert_factor the production uncertainty factor
+    /// @param Muon_scaling Schaller, Braucher, newCRONUS or Granger
+    /// @param is_production_uncertainty_plus_on CRONUS production uncertainty (+)
+    /// @param is_production_uncertainty_minus_on CRONUS production uncertainty (-)
+    void update_CRN_nested_kernel(LSDRaster& known_effective_erosion,
+                                LSDFlowInfo& FlowInfo, string Nuclide,
+                                double prod_uncert_factor, string Muon_scaling,
+                                bool is_production_uncertainty_plus_on,
+                                bool is_production_uncertainty_minus_on);
+
+    /// @brief The mass weighted concentration of the basin from nested_kernel
+    /// @param eff_erosion_rate The erosion rate of the unknown pixels in g/cm^2/yr
+    /// @return The basin averaged concentration in atoms/g
+    double evaluate_CRN_nested_kernel(double eff_erosion_rate);
+
   private:
     void create(int JunctionNumber, LSDFlowInfo& FlowInfo,
                            LSDJunctionNetwork& ChanNet,
@@ -54,6 +54,7 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include <fstream>
 #include <math.h>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <map>
@@ -74,6 +75,12 @@ using namespace TNT;
 void LSDCRNParameters::create()
 {
   version = "1.0";
+
+  // the NCEP data are shared and only loaded when needed
+  NCEP_data = NULL;
+
+  // there is no muon table until one is loaded
+  muon_table = NULL;
   
   S_t = 1;
   neutron_S_t = 1;
@@ -123,149 +130,256 @@ void LSDCRNParameters::create()
   F_36Cl[3] = 0.0;
 }
 
+// The NCEP tables that have been loaded, keyed by the path to the data.
+// They are never freed: each one is read once and then shared by every
+// LSDCRNParameters object in the process.
+static map<string, NCEP_table*> loaded_NCEP_tables;
+
 // this function gets the parameters used to convert elevation to 
 // pressure
 void LSDCRNParameters::load_parameters_for_atmospheric_scaling(string path_to_data)
 {
-  cout.precision(8);
-  
-  // first load the levels
-  levels.push_back(1000);
-  levels.push_back(925);
-  levels.push_back(850);
-  levels.push_back(700);
-  levels.push_back(600);
-  levels.push_back(500);
-  levels.push_back(400);
-  levels.push_back(300);
-  
-  // the dimensions of the data
-  int n_levels = 8;
-  int NRows = 73;
-  int NCols = 145;
-  Array2D<double> new_slp(NRows,NCols,0.0);
-  Array2D<double> new_meant(NRows,NCols,0.0);
-    
-  // now load the mean sea level pressure
-  string filename = "NCEP2.bin";
-  filename = path_to_data+filename;
-  //cout << "Loading mean sea level, file is: " << endl << filename << endl;
-
-  ifstream ifs_data(filename.c_str(), ios::in | ios::binary);
-  if( ifs_data.fail() )
+  #pragma omp critical(LSDCRNParameters_NCEP_tables)
   {
-    cout << "\nFATAL ERROR: the data file \"" << filename
-         << "\" doesn't exist" << endl;
-    exit(EXIT_FAILURE);
-  }  
-  
+    cout.precision(8);
 
-  double temp;
-  //cout << "The size of a double is: " << sizeof(temp) << endl;
-  for (int i=0; i<NCols; ++i)
-  {
-    for (int j=0; j<NRows; ++j)
+    map<string, NCEP_table*>::iterator table_iter = loaded_NCEP_tables.find(path_to_data);
+    if (table_iter != loaded_NCEP_tables.end())
     {
-      ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-      new_slp[j][i] = temp;
-      //cout << "new_slp["<<j+1<<"]["<<i+1<<"]: " << new_slp[j][i] << endl;
+      NCEP_data = table_iter->second;
     }
-  }
-  
-  for (int i=0; i<NCols; ++i)
-  {
-    for (int j=0; j<NRows; ++j)
+    else
     {
-      ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-      new_meant[j][i] = temp;
-      //cout << "new_meant100["<<j+1<<"]["<<i+1<<"]: " << new_meant[j][i] << endl;
+      NCEP_table* new_table = new NCEP_table;
+
+      // first load the levels
+      new_table->levels.push_back(1000);
+      new_table->levels.push_back(925);
+      new_table->levels.push_back(850);
+      new_table->levels.push_back(700);
+      new_table->levels.push_back(600);
+      new_table->levels.push_back(500);
+      new_table->levels.push_back(400);
+      new_table->levels.push_back(300);
+
+      // the dimensions of the data
+      int n_levels = 8;
+      int NRows = 73;
+      int NCols = 145;
+      new_table->meanslp.assign(NRows*NCols,0.0);
+      new_table->meant1000.assign(NRows*NCols,0.0);
+
+      // now load the mean sea level pressure
+      string filename = "NCEP2.bin";
+      filename = path_to_data+filename;
+      //cout << "Loading mean sea level, file is: " << endl << filename << endl;
+
+      ifstream ifs_data(filename.c_str(), ios::in | ios::binary);
+      if( ifs_data.fail() )
+      {
+        cout << "\nFATAL ERROR: the data file \"" << filename
+             << "\" doesn't exist" << endl;
+        exit(EXIT_FAILURE);
+      }
+
+      // the files are stored column by column
+      double temp;
+      for (int i=0; i<NCols; ++i)
+      {
+        for (int j=0; j<NRows; ++j)
+        {
+          ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+          new_table->meanslp[j*NCols+i] = temp;
+        }
+      }
+
+      for (int i=0; i<NCols; ++i)
+      {
+        for (int j=0; j<NRows; ++j)
+        {
+          ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+          new_table->meant1000[j*NCols+i] = temp;
+        }
+      }
+
+      // now get the indices
+      new_table->lat.assign(NRows,0.0);
+      for (int i=0; i<NRows; ++i)
+      {
+        ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+        new_table->lat[i] = temp;
+      }
+      new_table->lon.assign(NCols,0.0);
+      for (int i=0; i<NCols; ++i)
+      {
+        ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+        new_table->lon[i] = temp;
+      }
+
+      ifs_data.close();
+
+      // now the data with levels
+      filename = "NCEP_hgt.bin";
+      filename = path_to_data+filename;
+      //cout << "Loading hgt, file is: " << endl << filename << endl;
+
+      ifstream ifs_data2(filename.c_str(), ios::in | ios::binary);
+      if( ifs_data2.fail() )
+      {
+        cout << "\nFATAL ERROR: the data file \"" << filename
+             << "\" doesn't exist" << endl;
+        exit(EXIT_FAILURE);
+      }
+
+      // get the gm heights
+      vector< vector<double> > vec_hgt_gm;
+      for (int lvl = 0; lvl < n_levels; lvl++)
+      {
+        vector<double> current_hgt(NRows*NCols,0.0);
+        for (int i=0; i<NCols; ++i)
+        {
+          for (int j=0; j<NRows; ++j)
+          {
+            ifs_data2.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+            current_hgt[j*NCols+i] = temp;
+          }
+        }
+        vec_hgt_gm.push_back(current_hgt);
+      }
+
+      // now the gp heights
+      vector< vector<double> > vec_hgt_gp;
+      for (int lvl = 0; lvl < n_levels; lvl++)
+      {
+        vector<double> current_hgt(NRows*NCols,0.0);
+        for (int i=0; i<NCols; ++i)
+        {
+          for (int j=0; j<NRows; ++j)
+          {
+            ifs_data2.read(reinterpret_cast<char*>(&temp), sizeof(temp));
+            current_hgt[j*NCols+i] = temp;
+          }
+        }
+        vec_hgt_gp.push_back(current_hgt);
+      }
+      ifs_data2.close();
+
+      // the gm heights have always been set to the gp heights
+      new_table->gp_hgt = vec_hgt_gp;
+      new_table->gm_hgt = vec_hgt_gp;
+
+      // the ascending copies of the coordinates used for the lookup
+      new_table->lat_ascending = new_table->lat;
+      new_table->is_lat_reversed = (new_table->lat[0] > new_table->lat[1]);
+      if (new_table->is_lat_reversed)
+      {
+        reverse(new_table->lat_ascending.begin(),new_table->lat_ascending.end());
+      }
+      new_table->lon_ascending = new_table->lon;
+      new_table->is_lon_reversed = (new_table->lon[0] > new_table->lon[1]);
+      if (new_table->is_lon_reversed)
+      {
+        reverse(new_table->lon_ascending.begin(),new_table->lon_ascending.end());
+      }
+
+      loaded_NCEP_tables[path_to_data] = new_table;
+      NCEP_data = new_table;
     }
-  }  
-  
-  // now get the indices
-  vector<double> temp_lat(NRows,0.0);
-  for (int i=0; i<NRows; ++i)
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This finds the index of the first coordinate that is not less than a value
+// in an ascending, evenly spaced vector. The spacing gives the index
+// directly and the two loops only correct for rounding, so the result is
+// the same as stepping up through the vector from the start.
+// The value must be within the range of the vector.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static int NCEP_find_upper_index(const vector<double>& ascending, double value)
+{
+  int n = int(ascending.size());
+  double spacing = (ascending[n-1]-ascending[0])/double(n-1);
+  int i = int((value-ascending[0])/spacing)+1;
+  if (i < 1)
   {
-    ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-    temp_lat[i] = temp;
-    //cout << "Lat["<<i+1<<"]: " << temp_lat[i] << endl;
+    i = 1;
   }
-  vector<double> temp_long(NCols,0.0);
-  for (int i=0; i<NCols; ++i)
+  if (i > n-1)
   {
-    ifs_data.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-    temp_long[i] = temp;
-    //cout << "Long["<<i+1<<"]: " << temp_long[i] << endl;
-  }  
-  
-  ifs_data.close();
-  
-  
-  // now the data with levels
-  filename = "NCEP_hgt.bin";
-  filename = path_to_data+filename;
-  //cout << "Loading hgt, file is: " << endl << filename << endl;
-
-  ifstream ifs_data2(filename.c_str(), ios::in | ios::binary);
-  if( ifs_data2.fail() )
+    i = n-1;
+  }
+  while (i > 1 && value <= ascending[i-1])
   {
-    cout << "\nFATAL ERROR: the data file \"" << filename
-         << "\" doesn't exist" << endl;
-    exit(EXIT_FAILURE);
-  }  
-  
+    i--;
+  }
+  while (value > ascending[i])
+  {
+    i++;
+  }
+  return i;
+}
 
-  // get the gm heights
-  vector< Array2D<double> > vec_hgt_gm_array;
-  for (int lvl = 0; lvl < n_levels; lvl++)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This interpolates the sea level pressure and the 1000 mb temperature at
+// a site. It uses the same arithmetic as interp2D_bilinear so the results
+// are identical, but it finds the grid cell once for both tables and does
+// not touch the shared data.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static bool NCEP_interpolate_slp_and_T(const NCEP_table& table, double site_lat,
+                                       double site_lon, double& site_slp, double& site_T)
+{
+  const vector<double>& lat = table.lat_ascending;
+  const vector<double>& lon = table.lon_ascending;
+  int n_lat = int(lat.size());
+  int n_lon = int(lon.size());
+
+  if(site_lat < lat[0] || site_lat > lat[n_lat-1] ||
+     site_lon < lon[0] || site_lon > lon[n_lon-1])
   {
-    Array2D<double> current_hgt_array(NRows,NCols,0.0);
-    for (int i=0; i<NCols; ++i)
-    {
-      for (int j=0; j<NRows; ++j)
-      {
-        ifs_data2.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-        current_hgt_array[j][i] = temp;
-        //cout << "new_slp["<<lvl<<"]["<<j+1<<"]["<<i+1<<"]: " << current_hgt_array[j][i] << endl;
-      }
-    }
-    //cout << "new_slp["<<j+1<<"]["<<i+1<<"]: " << new_slp[j][i] << endl;
-    vec_hgt_gm_array.push_back(current_hgt_array.copy());
+    cout << "Site is outside of the NCEP data, lat: " << site_lat
+         << " long: " << site_lon << ", defaulting to ndv" << endl;
+    site_slp = -9999;
+    site_T = -9999;
+    return false;
   }
 
-  // now the gp heights
-  vector< Array2D<double> > vec_hgt_gp_array;
-  for (int lvl = 0; lvl < n_levels; lvl++)
+  // get the indices in the order of the file
+  int x_index = NCEP_find_upper_index(lat, site_lat);
+  if (table.is_lat_reversed)
   {
-    Array2D<double> current_hgt_array(NRows,NCols,0.0);
-    for (int i=0; i<NCols; ++i)
-    {
-      for (int j=0; j<NRows; ++j)            
-      {
-        ifs_data2.read(reinterpret_cast<char*>(&temp), sizeof(temp));
-        current_hgt_array[j][i] = temp;
-        //cout << "new_slp["<<lvl<<"]["<<j+1<<"]["<<i+1<<"]: " << current_hgt_array[j][i] << endl;
-      }
-    }
-    //cout << "new_slp["<<j+1<<"]["<<i+1<<"]: " << new_slp[j][i] << endl;
-    vec_hgt_gp_array.push_back(current_hgt_array.copy());
+    x_index = n_lat-x_index;
   }
-  ifs_data2.close();
-  
-  // now update the data elements
-  NCEPlat = temp_lat;
-  NCEPlon = temp_long;
-  
-  meanslp = new_slp.copy();
-  meant1000 = new_meant.copy();
-  gp_hgt = vec_hgt_gp_array;
-  gm_hgt = vec_hgt_gp_array;  
-  
-  //cout << "Size lat: " << NCEPlat.size() << " size long: " << NCEPlon.size() << endl;
-  //cout << "size slp:" << meanslp.dim1() << " " << meanslp.dim2() << endl;
-  //cout << "size t1000: " << meant1000.dim1() << " " << meant1000.dim2() << endl;
-  
+  int y_index = NCEP_find_upper_index(lon, site_lon);
+  if (table.is_lon_reversed)
+  {
+    y_index = n_lon-y_index;
+  }
+
+  double x2 = table.lat[x_index];
+  double x1 = table.lat[x_index-1];
+  double y2 = table.lon[y_index];
+  double y1 = table.lon[y_index-1];
+  int xib = x_index;
+  int xis = x_index-1;
+  int yib = y_index;
+  int yis = y_index-1;
+
+  double xw1 = (x2-site_lat)/(x2-x1);
+  double xw2 = (site_lat-x1)/(x2-x1);
+  double yw1 = (y2-site_lon)/(y2-y1);
+  double yw2 = (site_lon-y1)/(y2-y1);
 
+  const vector<double>& slp = table.meanslp;
+  double R1 = xw1*slp[xis*n_lon+yis] + xw2*slp[xib*n_lon+yis];
+  double R2 = xw1*slp[xis*n_lon+yib] + xw2*slp[xib*n_lon+yib];
+  site_slp = yw1*R1 + yw2*R2;
+
+  const vector<double>& T = table.meant1000;
+  R1 = xw1*T[xis*n_lon+yis] + xw2*T[xib*n_lon+yis];
+  R2 = xw1*T[xis*n_lon+yib] + xw2*T[xib*n_lon+yib];
+  site_T = yw1*R1 + yw2*R2;
+
+  return true;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -520,6 +634,489 @@ vector<double> LSDCRNParameters::calculate_muon_production_CRONUS(double z, doub
   
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The muon tables that have been loaded, keyed by file name.
+// They are never freed: each one is read (or built) once and then shared by
+// every LSDCRNParameters object in the process.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static map<string, CRONUS_muon_table*> loaded_CRONUS_muon_tables;
+
+// The range/momentum relation used by LZ:
+// table for muons in standard rock in Groom and others 2001
+// units are range in g cm-2 (column 2)
+// momentum in MeV/c (column 1)
+static const int CRONUS_LZ_n_points = 30;
+static const double CRONUS_LZ_momentum[CRONUS_LZ_n_points] = {
+  4.704e1, 5.616e1, 6.802e1, 8.509e1, 1.003e2, 1.527e2,
+  1.764e2, 2.218e2, 2.868e2, 3.917e2, 0.945e2, 8.995e2,
+  1.101e3, 1.502e3, 2.103e3, 3.104e3, 4.104e3, 8.105e3,
+  1.011e4, 1.411e4, 2.011e4, 3.011e4, 4.011e4, 8.011e4,
+  1.001e5, 1.401e5, 2.001e5, 3.001e5, 4.001e5, 8.001e5 };
+static const double CRONUS_LZ_range[CRONUS_LZ_n_points] = {
+  8.516e-1, 1.542e0, 2.866e0, 5.698e0, 9.145e0, 2.676e1,
+  3.696e1, 5.879e1, 9.332e1, 1.524e2, 2.115e2, 4.418e2,
+  5.534e2, 7.712e2, 1.088e3, 1.599e3, 2.095e3, 3.998e3,
+  4.920e3, 6.724e3, 9.360e3, 1.362e4, 1.776e4, 3.343e4,
+  4.084e4, 5.495e4, 7.459e4, 1.040e5, 1.302e5, 2.129e5 };
+
+// The range of the muon tables. The depths go to the end of the flux
+// integration and the pressures cover 300 to 1100 hPa.
+static const double CRONUS_muon_table_max_z = 2.0e5;
+static const double CRONUS_muon_table_min_H = (1013.25-1100.0)*1.019716;
+static const double CRONUS_muon_table_max_H = (1013.25-300.0)*1.019716;
+static const double CRONUS_muon_table_target_error = 1e-6;
+
+// this is written at the start of the table files
+static const int CRONUS_muon_table_version = 1;
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the segment boundaries of a muon table, as s = log10(z+1000).
+// LZ is constant above 1 g/cm^2 and changes slope at each range in the
+// Groom et al. table.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static vector<double> CRONUS_muon_table_segments()
+{
+  vector<double> segment_s;
+  segment_s.push_back(log10(0.0+1000.0));
+  segment_s.push_back(log10(1.0+1000.0));
+  for (int i = 0; i<CRONUS_LZ_n_points; i++)
+  {
+    if (CRONUS_LZ_range[i] > 1.0 && CRONUS_LZ_range[i] < CRONUS_muon_table_max_z)
+    {
+      segment_s.push_back(log10(CRONUS_LZ_range[i]+1000.0));
+    }
+  }
+  segment_s.push_back(log10(CRONUS_muon_table_max_z+1000.0));
+  return segment_s;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets s at every depth node of a muon table
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static vector<double> CRONUS_muon_table_node_s(const CRONUS_muon_table& table)
+{
+  vector<double> node_s(table.n_z);
+  int n_segments = int(table.segment_s.size())-1;
+  for (int seg = 0; seg<n_segments; seg++)
+  {
+    int n_intervals = table.segment_node[seg+1]-table.segment_node[seg];
+    double spacing = (table.segment_s[seg+1]-table.segment_s[seg])/double(n_intervals);
+    for (int j = 0; j<n_intervals; j++)
+    {
+      node_s[table.segment_node[seg]+j] = table.segment_s[seg]+double(j)*spacing;
+    }
+  }
+  node_s[table.n_z-1] = table.segment_s[n_segments];
+  return node_s;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The weights of cubic (four point Lagrange) interpolation at position p,
+// measured in node spacings from the first of the four nodes
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static void CRONUS_cubic_weights(double p, double weights[4])
+{
+  weights[0] = -(p-1.0)*(p-2.0)*(p-3.0)/6.0;
+  weights[1] = p*(p-2.0)*(p-3.0)/2.0;
+  weights[2] = -p*(p-1.0)*(p-3.0)/2.0;
+  weights[3] = p*(p-1.0)*(p-2.0)/6.0;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the first of the four nodes used to interpolate at a position
+// (in node spacings) along a run of evenly spaced intervals, and replaces
+// the position with the position relative to that node
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static int CRONUS_cubic_stencil(double& position, int n_intervals)
+{
+  int first_node = int(position)-1;
+  if (first_node > n_intervals-3)
+  {
+    first_node = n_intervals-3;
+  }
+  if (first_node < 0)
+  {
+    first_node = 0;
+  }
+  position = position-double(first_node);
+  return first_node;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This interpolates the site flux of vertical muons from a muon table.
+// It returns false if the site is outside of the table.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static bool CRONUS_interpolate_muon_flux(const CRONUS_muon_table& table, double z,
+                                         double H, double& phi_vert_site)
+{
+  if (z < 0 || H < table.min_H || H > table.max_H)
+  {
+    return false;
+  }
+  double s = log10(z+1000.0);
+  int n_segments = int(table.segment_s.size())-1;
+  if (s < table.segment_s[0] || s > table.segment_s[n_segments])
+  {
+    return false;
+  }
+
+  // find the segment
+  int seg = int(upper_bound(table.segment_s.begin(), table.segment_s.end(), s)
+                - table.segment_s.begin())-1;
+  if (seg >= n_segments)
+  {
+    seg = n_segments-1;
+  }
+  int n_intervals_s = table.segment_node[seg+1]-table.segment_node[seg];
+  double p_s = (s-table.segment_s[seg])*double(n_intervals_s)/
+               (table.segment_s[seg+1]-table.segment_s[seg]);
+  int first_s = table.segment_node[seg]+CRONUS_cubic_stencil(p_s, n_intervals_s);
+
+  double p_H = (H-table.min_H)*double(table.n_H-1)/(table.max_H-table.min_H);
+  int first_H = CRONUS_cubic_stencil(p_H, table.n_H-1);
+
+  double w_s[4], w_H[4];
+  CRONUS_cubic_weights(p_s, w_s);
+  CRONUS_cubic_weights(p_H, w_H);
+
+  double ln_phi = 0;
+  for (int i = 0; i<4; i++)
+  {
+    const double* row = &table.ln_phi[(first_H+i)*table.n_z+first_s];
+    ln_phi += w_H[i]*(w_s[0]*row[0]+w_s[1]*row[1]+w_s[2]*row[2]+w_s[3]*row[3]);
+  }
+  phi_vert_site = exp(ln_phi);
+  return true;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This integrates the muon stopping rate between two depths. It uses
+// Simpson's rule, doubling the number of intervals until the result
+// converges to about 1 part in 10^10 of the flux below the top of the
+// panel (the flux below the bottom is flux_below), and then takes the
+// Richardson extrapolation of the last two results.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static double CRONUS_integrate_muon_panel(LSDCRNParameters& LSDCRNP, double top,
+                                          double bottom, double H, double flux_below)
+{
+  int n_intervals = 2;
+  double last_sum = 0;
+  double sum = 0;
+  double spacing, a, b;
+  do
+  {
+    last_sum = sum;
+    n_intervals = n_intervals*2;
+    spacing = (bottom-top)/double(n_intervals);
+    sum = 0;
+    for (int i = 0; i< n_intervals; i++)
+    {
+      a = top+double(i)*spacing;
+      b = a+spacing;
+      sum += (spacing/6.0)*(LSDCRNP.Rv0(a)*exp(H/LSDCRNP.LZ(a))
+                            +4.0*LSDCRNP.Rv0((a+b)/2.0)*exp(H/LSDCRNP.LZ((a+b)/2.0))
+                            +LSDCRNP.Rv0(b)*exp(H/LSDCRNP.LZ(b)));
+    }
+  } while ( (n_intervals == 4 || fabs(sum-last_sum) > 1e-10*(fabs(sum)+flux_below))
+            && n_intervals < 65536);
+
+  return sum+(sum-last_sum)/15.0;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This calculates the log of the site flux of vertical muons at the nodes
+// of a muon table. Each row of atmospheric depth is integrated from the
+// bottom up, so the flux at every depth comes from a single sweep. The rows
+// are independent so they are calculated in parallel.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static void CRONUS_calculate_muon_table(CRONUS_muon_table& table)
+{
+  vector<double> node_s = CRONUS_muon_table_node_s(table);
+  int n_z = table.n_z;
+  int n_H = table.n_H;
+  double dH = (table.max_H-table.min_H)/double(n_H-1);
+
+  // invariant flux at 2e5 g/cm2 depth, as in P_mu_total
+  double a = 258.5*(pow(100,2.66));
+  double b = 75*(pow(100,1.66));
+  double phi_200k = (a/((2.0e5+21000.0)*((pow((2.0e5+1000.0),1.66)) + b)))
+                      *exp(-5.5e-6 * 2.0e5);
+
+  vector<double> ln_phi(n_z*n_H);
+  #pragma omp parallel
+  {
+    LSDCRNParameters LSDCRNP;
+
+    #pragma omp for schedule(dynamic)
+    for (int h = 0; h<n_H; h++)
+    {
+      double H = table.min_H+double(h)*dH;
+      double cumulative_flux = 0;
+      double bottom = 2.0e5+1.0;
+      for (int i = n_z-1; i>=0; i--)
+      {
+        double z = pow(10.0,node_s[i])-1000.0;
+        if (z < 0)
+        {
+          z = 0;
+        }
+        cumulative_flux += CRONUS_integrate_muon_panel(LSDCRNP, z, bottom, H,
+                                                       cumulative_flux+phi_200k);
+        bottom = z;
+        ln_phi[h*n_z+i] = log(cumulative_flux+phi_200k);
+      }
+    }
+  }
+  table.ln_phi = ln_phi;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This sets the nodes of a muon table from the number of intervals in each
+// depth segment and the number of atmospheric depths
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static void CRONUS_set_muon_table_nodes(CRONUS_muon_table& table,
+                                        vector<int>& segment_intervals, int n_H)
+{
+  int n_segments = int(segment_intervals.size());
+  table.segment_node.assign(n_segments+1,0);
+  for (int seg = 0; seg<n_segments; seg++)
+  {
+    table.segment_node[seg+1] = table.segment_node[seg]+segment_intervals[seg];
+  }
+  table.n_z = table.segment_node[n_segments]+1;
+  table.n_H = n_H;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This builds a muon table. A table with twice the resolution is
+// calculated and the table (every other node) is checked against the
+// nodes in between. The table is refined in the directions that fail
+// until the relative error is below the target.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static void CRONUS_build_muon_table(CRONUS_muon_table& table)
+{
+  table.segment_s = CRONUS_muon_table_segments();
+  table.min_H = CRONUS_muon_table_min_H;
+  table.max_H = CRONUS_muon_table_max_H;
+  table.target_relative_error = CRONUS_muon_table_target_error;
+
+  // start with nodes about 0.02 apart in s, and at least three intervals
+  // in each segment
+  int n_segments = int(table.segment_s.size())-1;
+  vector<int> segment_intervals(n_segments);
+  for (int seg = 0; seg<n_segments; seg++)
+  {
+    segment_intervals[seg] = max(3,int(ceil((table.segment_s[seg+1]-table.segment_s[seg])/0.02)));
+  }
+  int n_H = 9;
+  int max_n_z = 16385;
+  int max_n_H = 1025;
+
+  CRONUS_muon_table fine_table = table;
+  bool is_converged = false;
+  do
+  {
+    // the table and the table with twice the resolution
+    vector<int> fine_segment_intervals = segment_intervals;
+    for (int seg = 0; seg<n_segments; seg++)
+    {
+      fine_segment_intervals[seg] = 2*segment_intervals[seg];
+    }
+    CRONUS_set_muon_table_nodes(table, segment_intervals, n_H);
+    CRONUS_set_muon_table_nodes(fine_table, fine_segment_intervals, 2*n_H-1);
+    CRONUS_calculate_muon_table(fine_table);
+
+    // every other node of the fine table
+    int n_fine_z = fine_table.n_z;
+    table.ln_phi.assign(table.n_z*table.n_H,0.0);
+    for (int h = 0; h<table.n_H; h++)
+    {
+      for (int i = 0; i<table.n_z; i++)
+      {
+        table.ln_phi[h*table.n_z+i] = fine_table.ln_phi[(2*h)*n_fine_z+2*i];
+      }
+    }
+
+    // check the nodes between the table nodes
+    vector<double> fine_node_s = CRONUS_muon_table_node_s(fine_table);
+    double dH = (table.max_H-table.min_H)/double(fine_table.n_H-1);
+    double max_error_z = 0;
+    double max_error_H = 0;
+    double max_error_both = 0;
+    double phi, exact_phi, this_error;
+    for (int h = 0; h<fine_table.n_H; h++)
+    {
+      for (int i = 0; i<n_fine_z; i++)
+      {
+        if (h%2 == 0 && i%2 == 0)
+        {
+          continue;
+        }
+        double z = pow(10.0,fine_node_s[i])-1000.0;
+        double H = table.min_H+double(h)*dH;
+        if (CRONUS_interpolate_muon_flux(table, max(z,0.0), H, phi) == false)
+        {
+          continue;
+        }
+        exact_phi = exp(fine_table.ln_phi[h*n_fine_z+i]);
+        this_error = fabs(phi-exact_phi)/exact_phi;
+        if (h%2 == 0)
+        {
+          max_error_z = max(max_error_z,this_error);
+        }
+        else if (i%2 == 0)
+        {
+          max_error_H = max(max_error_H,this_error);
+        }
+        else
+        {
+          max_error_both = max(max_error_both,this_error);
+        }
+      }
+    }
+    table.max_relative_error = max(max_error_z,max(max_error_H,max_error_both));
+
+    bool refine_z = (max_error_z > table.target_relative_error);
+    bool refine_H = (max_error_H > table.target_relative_error);
+    if (!refine_z && !refine_H && max_error_both > table.target_relative_error)
+    {
+      refine_z = true;
+      refine_H = true;
+    }
+    if (refine_z && n_fine_z > max_n_z)
+    {
+      refine_z = false;
+    }
+    if (refine_H && n_H >= max_n_H)
+    {
+      refine_H = false;
+    }
+
+    if (table.max_relative_error <= table.target_relative_error)
+    {
+      is_converged = true;
+    }
+    else if (!refine_z && !refine_H)
+    {
+      cout << "Warning: the muon table has reached its maximum size with a relative"
+           << endl << "error of " << table.max_relative_error << endl;
+      is_converged = true;
+    }
+    else
+    {
+      if (refine_z)
+      {
+        segment_intervals = fine_segment_intervals;
+      }
+      if (refine_H)
+      {
+        n_H = 2*n_H-1;
+      }
+    }
+  } while (!is_converged);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This loads a muon table, building and saving it if the file does not
+// exist or was built for a different range
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCRNParameters::load_CRONUS_muon_table(string filename)
+{
+  #pragma omp critical(LSDCRNParameters_muon_tables)
+  {
+    map<string, CRONUS_muon_table*>::iterator table_iter
+                                 = loaded_CRONUS_muon_tables.find(filename);
+    if (table_iter != loaded_CRONUS_muon_tables.end())
+    {
+      muon_table = table_iter->second;
+    }
+    else
+    {
+      CRONUS_muon_table* new_table = new CRONUS_muon_table;
+      vector<double> segment_s = CRONUS_muon_table_segments();
+      int n_segments = int(segment_s.size())-1;
+      bool is_loaded = false;
+
+      // see if there is a table in the file. The file holds the version, the
+      // number of segments, the number of atmospheric depths, the segment
+      // boundaries and their nodes, the range of atmospheric depths, the
+      // target and measured errors and then the data.
+      ifstream ifs_table(filename.c_str(), ios::in | ios::binary);
+      if( ifs_table.good() )
+      {
+        int header[3];
+        ifs_table.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (ifs_table.good() && header[0] == CRONUS_muon_table_version &&
+            header[1] == n_segments && header[2] >= 4)
+        {
+          new_table->n_H = header[2];
+          new_table->segment_s.resize(n_segments+1);
+          new_table->segment_node.resize(n_segments+1);
+          double H_and_errors[4];
+          ifs_table.read(reinterpret_cast<char*>(&new_table->segment_s[0]),
+                         sizeof(double)*(n_segments+1));
+          ifs_table.read(reinterpret_cast<char*>(&new_table->segment_node[0]),
+                         sizeof(int)*(n_segments+1));
+          ifs_table.read(reinterpret_cast<char*>(H_and_errors), sizeof(H_and_errors));
+          new_table->min_H = H_and_errors[0];
+          new_table->max_H = H_and_errors[1];
+          new_table->target_relative_error = H_and_errors[2];
+          new_table->max_relative_error = H_and_errors[3];
+          new_table->n_z = new_table->segment_node[n_segments]+1;
+
+          if (ifs_table.good() && new_table->segment_s == segment_s &&
+              new_table->min_H == CRONUS_muon_table_min_H &&
+              new_table->max_H == CRONUS_muon_table_max_H &&
+              new_table->target_relative_error == CRONUS_muon_table_target_error)
+          {
+            new_table->ln_phi.resize(new_table->n_z*new_table->n_H);
+            ifs_table.read(reinterpret_cast<char*>(&new_table->ln_phi[0]),
+                           sizeof(double)*new_table->ln_phi.size());
+            is_loaded = ifs_table.good();
+          }
+        }
+        ifs_table.close();
+      }
+
+      // if not, build it
+      if (!is_loaded)
+      {
+        cout << "Building the muon table, this only needs to be done once." << endl;
+        CRONUS_build_muon_table(*new_table);
+        cout << "The muon table has " << new_table->n_z << " depths and "
+             << new_table->n_H << " atmospheric depths. Relative error: "
+             << new_table->max_relative_error << endl;
+
+        ofstream ofs_table(filename.c_str(), ios::out | ios::binary);
+        if( ofs_table.fail() )
+        {
+          cout << "Warning: could not write the muon table to " << filename << endl;
+        }
+        else
+        {
+          int header[3] = {CRONUS_muon_table_version, n_segments, new_table->n_H};
+          double H_and_errors[4] = {new_table->min_H, new_table->max_H,
+                                    new_table->target_relative_error,
+                                    new_table->max_relative_error};
+          ofs_table.write(reinterpret_cast<char*>(header), sizeof(header));
+          ofs_table.write(reinterpret_cast<char*>(&new_table->segment_s[0]),
+                          sizeof(double)*(n_segments+1));
+          ofs_table.write(reinterpret_cast<char*>(&new_table->segment_node[0]),
+                          sizeof(int)*(n_segments+1));
+          ofs_table.write(reinterpret_cast<char*>(H_and_errors), sizeof(H_and_errors));
+          ofs_table.write(reinterpret_cast<char*>(&new_table->ln_phi[0]),
+                          sizeof(double)*new_table->ln_phi.size());
+          ofs_table.close();
+        }
+      }
+
+      loaded_CRONUS_muon_tables[filename] = new_table;
+      muon_table = new_table;
+    }
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //  
 // This function sets CRONUS muon production paramteters
@@ -605,30 +1202,36 @@ void LSDCRNParameters::P_mu_total(double z,double h)
   //cout << "R_vert_slhl: " << R_vert_slhl << " R_vert_site: " << R_vert_site << endl;
 
   // find the flux of vertical muons at site
+  // if there is a muon table, interpolate it, otherwise
   // integrate
-  // ends at 200,001 g/cm2 to avoid being asked for an zero
-  // range of integration -- 
-  // get integration tolerance -- want relative tolerance around
-  // 1 part in 10^4. 
-  double tol = phi_vert_slhl*1e-4;
-  double phi_vert_site = integrate_muon_flux(z, H, tol);
-  
-  //=====================
-  // I THINK below here is an error in Balco's code
-  // The below equation uses a which is calculated above, 
-  // but in balco's code a is then used as an index, so the below
-  // equation takes the index value rather than the precalculated 
-  // value of a
-  //=======================
-  
-  // invariant flux at 2e5 g/cm2 depth - constant of integration
-  // calculated using commented-out formula above
-  double phi_200k = (a/((2.0e5+21000.0)*((pow((2.0e5+1000.0),1.66)) + b)))
-                      *exp(-5.5e-6 * 2.0e5);
-  //double test_balco_error = (1.0/((2.0e5+21000.0)*((pow((2.0e5+1000.0),1.66)) + b)))
-  //                    *exp(-5.5e-6 * 2.0e5);
+  double phi_vert_site;
+  if (muon_table == NULL ||
+      CRONUS_interpolate_muon_flux(*muon_table, z, H, phi_vert_site) == false)
+  {
+    // ends at 200,001 g/cm2 to avoid being asked for an zero
+    // range of integration -- 
+    // get integration tolerance -- want relative tolerance around
+    // 1 part in 10^4. 
+    double tol = phi_vert_slhl*1e-4;
+    phi_vert_site = integrate_muon_flux(z, H, tol);
+  
+    //=====================
+    // I THINK below here is an error in Balco's code
+    // The below equation uses a which is calculated above, 
+    // but in balco's code a is then used as an index, so the below
+    // equation takes the index value rather than the precalculated 
+    // value of a
+    //=======================
+  
+    // invariant flux at 2e5 g/cm2 depth - constant of integration
+    // calculated using commented-out formula above
+    double phi_200k = (a/((2.0e5+21000.0)*((pow((2.0e5+1000.0),1.66)) + b)))
+                        *exp(-5.5e-6 * 2.0e5);
+    //double test_balco_error = (1.0/((2.0e5+21000.0)*((pow((2.0e5+1000.0),1.66)) + b)))
+    //                    *exp(-5.5e-6 * 2.0e5);
                       
-  phi_vert_site = phi_vert_site + phi_200k;
+    phi_vert_site = phi_vert_site + phi_200k;
+  }
   
   // find the total flux of muons at site
   // angular distribution exponent
@@ -868,70 +1471,10 @@ double LSDCRNParameters::LZ(double z)
 
   //define range/momentum relation
   // table for muons in standard rock in Groom and others 2001
-  // units are range in g cm-2 (column 2)
-  //momentum in MeV/c (column 1)
-  vector<double> data_for_LZ_range;
-  vector<double> data_for_LZ_momentum;
-  data_for_LZ_momentum.push_back(4.704e1);
-  data_for_LZ_range.push_back(8.516e-1);
-  data_for_LZ_momentum.push_back(5.616e1); 
-  data_for_LZ_range.push_back(1.542e0);
-  data_for_LZ_momentum.push_back(6.802e1); 
-  data_for_LZ_range.push_back(2.866e0);
-  data_for_LZ_momentum.push_back(8.509e1);
-  data_for_LZ_range.push_back(5.698e0);
-  data_for_LZ_momentum.push_back(1.003e2);
-  data_for_LZ_range.push_back(9.145e0);
-  data_for_LZ_momentum.push_back(1.527e2);
-  data_for_LZ_range.push_back(2.676e1);
-  data_for_LZ_momentum.push_back(1.764e2); 
-  data_for_LZ_range.push_back(3.696e1);
-  data_for_LZ_momentum.push_back(2.218e2);
-  data_for_LZ_range.push_back(5.879e1);
-  data_for_LZ_momentum.push_back(2.868e2);
-  data_for_LZ_range.push_back(9.332e1);
-  data_for_LZ_momentum.push_back(3.917e2);
-  data_for_LZ_range.push_back(1.524e2);
-  data_for_LZ_momentum.push_back(0.945e2);
-  data_for_LZ_range.push_back(2.115e2);
-  data_for_LZ_momentum.push_back(8.995e2);
-  data_for_LZ_range.push_back(4.418e2);
-  data_for_LZ_momentum.push_back(1.101e3);
-  data_for_LZ_range.push_back(5.534e2);
-  data_for_LZ_momentum.push_back(1.502e3);
-  data_for_LZ_range.push_back(7.712e2);
-  data_for_LZ_momentum.push_back(2.103e3);
-  data_for_LZ_range.push_back(1.088e3);
-  data_for_LZ_momentum.push_back(3.104e3);
-  data_for_LZ_range.push_back(1.599e3);
-  data_for_LZ_momentum.push_back(4.104e3);
-  data_for_LZ_range.push_back(2.095e3);
-  data_for_LZ_momentum.push_back(8.105e3);
-  data_for_LZ_range.push_back(3.998e3);
-  data_for_LZ_momentum.push_back(1.011e4);
-  data_for_LZ_range.push_back(4.920e3);
-  data_for_LZ_momentum.push_back(1.411e4);
-  data_for_LZ_range.push_back(6.724e3);
-  data_for_LZ_momentum.push_back(2.011e4);
-  data_for_LZ_range.push_back(9.360e3);
-  data_for_LZ_momentum.push_back(3.011e4);
-  data_for_LZ_range.push_back(1.362e4);
-  data_for_LZ_momentum.push_back(4.011e4);
-  data_for_LZ_range.push_back(1.776e4);
-  data_for_LZ_momentum.push_back(8.011e4);
-  data_for_LZ_range.push_back(3.343e4);
-  data_for_LZ_momentum.push_back(1.001e5);
-  data_for_LZ_range.push_back(4.084e4);
-  data_for_LZ_momentum.push_back(1.401e5);
-  data_for_LZ_range.push_back(5.495e4);
-  data_for_LZ_momentum.push_back(2.001e5);
-  data_for_LZ_range.push_back(7.459e4);
-  data_for_LZ_momentum.push_back(3.001e5); 
-  data_for_LZ_range.push_back(1.040e5);
-  data_for_LZ_momentum.push_back(4.001e5);
-  data_for_LZ_range.push_back(1.302e5);
-  data_for_LZ_momentum.push_back(8.001e5);
-  data_for_LZ_range.push_back(2.129e5);
+  // (see CRONUS_LZ_momentum and CRONUS_LZ_range)
+  vector<double> data_for_LZ_range(CRONUS_LZ_range, CRONUS_LZ_range+CRONUS_LZ_n_points);
+  vector<double> data_for_LZ_momentum(CRONUS_LZ_momentum,
+                                      CRONUS_LZ_momentum+CRONUS_LZ_n_points);
 
   // deal with zero situation
   if(z < 1)
@@ -1850,6 +2393,64 @@ void LSDCRNParameters::scale_F_values(double single_scaling)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the parameters of the steady state concentration of 10Be or 26Al
+// so that it can be calculated without a particle
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCRNParameters::get_steady_state_parameters(string Nuclide, vector<double>& F,
+                                   vector<double>& Gamma_vec, double& lambda,
+                                   double& St_P0)
+{
+  F.resize(4);
+  Gamma_vec.resize(4);
+  if (Nuclide == "Al26")
+  {
+    for (int i = 0; i<4; i++)
+    {
+      F[i] = F_26Al[i];
+      Gamma_vec[i] = Gamma[i];
+    }
+    lambda = lambda_26Al;
+    St_P0 = S_t*P0_26Al;
+  }
+  else
+  {
+    for (int i = 0; i<4; i++)
+    {
+      F[i] = F_10Be[i];
+      Gamma_vec[i] = Gamma[i];
+    }
+    lambda = lambda_10Be;
+    St_P0 = S_t*P0_10Be;
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the parts of the transient 10Be, 14C and 21Ne updates that only
+// depend on the timestep and erosion rate. They are written exactly as in
+// LSDCRNParticle::update_10Be_conc, update_14C_conc and update_21Ne_conc
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+CRN_exposure_factors LSDCRNParameters::get_3CRN_exposure_factors(double dt,
+                                                       double erosion_rate)
+{
+  CRN_exposure_factors factors;
+  factors.dt = dt;
+  factors.erosion_rate = erosion_rate;
+  factors.decay_10Be = exp(-dt*lambda_10Be);
+  factors.decay_14C = exp(-dt*lambda_14C);
+  for (int i = 0; i<4; i++)
+  {
+    factors.time_10Be[i] = exp(dt*erosion_rate/Gamma[i])-exp(-dt*lambda_10Be);
+    factors.denom_10Be[i] = erosion_rate+Gamma[i]*lambda_10Be;
+    factors.time_14C[i] = exp(dt*erosion_rate/Gamma[i])-exp(-dt*lambda_14C);
+    factors.denom_14C[i] = erosion_rate+Gamma[i]*lambda_14C;
+  }
+  factors.time_21Ne = exp(dt*erosion_rate/Gamma[0]) - 1;
+  return factors;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //
 // This function is similar to the scaling function for total nuclides but
@@ -2272,7 +2873,7 @@ double LSDCRNParameters::NCEPatm_2(double site_lat, double site_lon, double site
   //cout << "LSDCRNP, line 1618, Site lat: " << site_lat << " and long: " << site_lon << endl;
   
   // check to see if data is loaded:
-  if (int(gm_hgt.size()) != 8)
+  if (NCEP_data == NULL)
   {
     string path_to_data;
     cout << "You didn't load the NCEP data. Doing that now. " << endl;
@@ -2282,13 +2883,8 @@ double LSDCRNParameters::NCEPatm_2(double site_lat, double site_lon, double site
   }
   
   // now, interpolate sea level pressure and temperature
-  //cout << "interpolating pressure " << endl;
-  double site_slp = interp2D_bilinear(NCEPlat, NCEPlon, meanslp, 
-                        site_lat, site_lon);
-  //cout << "Did pressure, now temp:" << endl;                      
-  double site_T = interp2D_bilinear(NCEPlat, NCEPlon, meant1000, 
-                        site_lat, site_lon);
-  //cout << "Did temp" << endl;                      
+  double site_slp, site_T;
+  NCEP_interpolate_slp_and_T(*NCEP_data, site_lat, site_lon, site_slp, site_T);
   
   
   double site_T_degK = site_T + 273.15;
@@ -2313,6 +2909,30 @@ double LSDCRNParameters::NCEPatm_2(double site_lat, double site_lon, double site
 }
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This is the vectorised version of NCEPatm_2, as in the original m code.
+// The sites are processed in order and each gets exactly the pressure
+// the single site version would give.
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDCRNParameters::NCEPatm_2(vector<double>& site_lat, vector<double>& site_lon,
+                                 vector<double>& site_elev, vector<double>& site_pressure)
+{
+  int n_sites = int(site_lat.size());
+  if (int(site_lon.size()) != n_sites || int(site_elev.size()) != n_sites)
+  {
+    cout << "LSDCRNParameters::NCEPatm_2, the site vectors are not the same size!" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vector<double> pressure(n_sites);
+  for (int i = 0; i<n_sites; i++)
+  {
+    pressure[i] = NCEPatm_2(site_lat[i], site_lon[i], site_elev[i]);
+  }
+  site_pressure = pressure;
+}
+//-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // This function gets the spallation attenuation lenth in g/cm^2
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -62,6 +62,114 @@ using namespace TNT;
 #ifndef LSDCRNParameters_H
 #define LSDCRNParameters_H
 
+/// @brief The NCEP reanalysis data used for atmospheric scaling.
+/// @details A table is loaded once for each data path and is then shared,
+///  read only, by every LSDCRNParameters object in the process. The data
+///  are held row major (latitude, longitude) in the order of the files.
+///  The grids are regular, so the cell containing a point is found directly
+///  from its coordinates rather than by searching.
+struct NCEP_table
+{
+  /// the levels for the atmospheric scaling of pressure
+  vector<double> levels;
+
+  /// the latitudes of the grid, as in the file (north to south)
+  vector<double> lat;
+
+  /// the longitudes of the grid (0 to 360)
+  vector<double> lon;
+
+  /// the latitudes in ascending order
+  vector<double> lat_ascending;
+
+  /// the longitudes in ascending order
+  vector<double> lon_ascending;
+
+  /// true if the latitudes in the file are in descending order
+  bool is_lat_reversed;
+
+  /// true if the longitudes in the file are in descending order
+  bool is_lon_reversed;
+
+  /// the mean sea level pressure
+  vector<double> meanslp;
+
+  /// the mean 1000 mb temperature
+  vector<double> meant1000;
+
+  /// the gp heights at each level
+  vector< vector<double> > gp_hgt;
+
+  /// the gm heights at each level
+  vector< vector<double> > gm_hgt;
+};
+
+/// @brief The parts of the transient 10Be, 14C and 21Ne concentration updates
+///  (LSDCRNParticle::update_10Be_conc, update_14C_conc and update_21Ne_conc)
+///  that depend only on the timestep and the erosion rate.
+/// @details Every particle in a column sees the same timestep and erosion
+///  rate, so these are calculated once and shared by the particles, which
+///  then only need the depth terms (see LSDCRNParticle::update_3CRN_conc).
+struct CRN_exposure_factors
+{
+  /// the timestep in years and the erosion rate in g/cm^2/yr
+  double dt;
+  double erosion_rate;
+
+  /// exp(-dt*lambda) for 10Be and 14C
+  double decay_10Be;
+  double decay_14C;
+
+  /// exp(dt*erosion_rate/Gamma[i])-exp(-dt*lambda) for each production pathway
+  double time_10Be[4];
+  double time_14C[4];
+
+  /// erosion_rate+Gamma[i]*lambda for each production pathway
+  double denom_10Be[4];
+  double denom_14C[4];
+
+  /// exp(dt*erosion_rate/Gamma[0])-1, for 21Ne (which is stable)
+  double time_21Ne;
+};
+
+/// @brief A lookup table of the site flux of vertically travelling muons
+///  (phi_vert_site in P_mu_total) as a function of depth and atmospheric depth.
+/// @details The log of the flux is held on a grid of s = log10(z+1000) and
+///  atmospheric depth H. The attenuation length (LZ) is linear between the
+///  ranges of the Groom et al. table, so the depths are split into segments
+///  at those ranges and the nodes are evenly spaced within each segment.
+///  The flux is interpolated with cubic polynomials in both directions
+///  (never across a segment boundary). When the table is built the
+///  interpolated values are checked against accurately integrated values
+///  half way between all of the nodes, and the grid is refined until the
+///  relative error is below the target.
+struct CRONUS_muon_table
+{
+  /// the number of depth nodes
+  int n_z;
+
+  /// the number of atmospheric depth nodes
+  int n_H;
+
+  /// the values of s at the segment boundaries
+  vector<double> segment_s;
+
+  /// the depth node at each segment boundary
+  vector<int> segment_node;
+
+  /// the first and last atmospheric depths in g/cm^2
+  double min_H, max_H;
+
+  /// the relative error the table was built to
+  double target_relative_error;
+
+  /// the largest relative error found when the table was checked
+  double max_relative_error;
+
+  /// the log of phi_vert_site (muons/cm2/s/sr), indexed [i_H*n_z+i_z]
+  vector<double> ln_phi;
+};
+
 /// @brief This class contains parameters used in cosmogenic nuclide calculations
 /// It sits seperately from the particle object since it applies to an
 /// entire environment and not just an individual particle. 
@@ -78,6 +186,9 @@ class LSDCRNParameters
 
   /// @brief function for loading parameters that allow pressure calculation
   /// from elevation
+  /// @details The data are read from disk the first time a path is used;
+  ///  after that every object using the path shares the same table, so
+  ///  this is cheap and can be called from several threads.
   /// @author SMM
   /// @date 02/12/2014
   void load_parameters_for_atmospheric_scaling(string path_to_params);
@@ -143,6 +254,20 @@ class LSDCRNParameters
   /// @author SMM
   /// @date 06/12/2014
   void P_mu_total(double z,double h);
+
+  /// @brief This loads the table of muon fluxes used by P_mu_total
+  /// @details If the file does not exist, or was built for a different
+  ///  range, the table is generated (in parallel) and written to the file.
+  ///  Each file is only read once per process and the table is shared by all
+  ///  the parameter objects that load it. Once a table is loaded P_mu_total
+  ///  interpolates the muon flux from it, going back to integrating the
+  ///  flux for sites outside of the table.
+  /// @param filename the name of the table file, with path and extension
+  void load_CRONUS_muon_table(string filename);
+
+  /// @brief This stops P_mu_total from using the muon table, so the muon
+  ///  flux is integrated for every call
+  void unload_CRONUS_muon_table()  { muon_table = NULL; }
  
   /// @brief A wrapper for the P_mu_total function that replaces 
   ///  total production for 10Be and 26Al due to muons
@@ -398,6 +523,15 @@ class LSDCRNParameters
   /// @author SMM
   /// @date 04/12/2014
   double NCEPatm_2(double site_lat, double site_lon, double site_elev);
+
+  /// @brief This calculates the atmospheric pressure of many sites
+  /// @details The same as calling NCEPatm_2 on each site in turn
+  /// @param site_lat latitudes (DD)
+  /// @param site_lon longitudes (DD)
+  /// @param site_elev elevations (m)
+  /// @param site_pressure replaced with the site pressures in hPa
+  void NCEPatm_2(vector<double>& site_lat, vector<double>& site_lon,
+                 vector<double>& site_elev, vector<double>& site_pressure);
   
   /// @brief This gets the attenuation depth in g/cm^2
   ///  You tell it if you want the CRONUS values
@@ -519,6 +653,27 @@ class LSDCRNParameters
   /// @author SMM
   /// @date 18/02/2016
   void Print_10Beproduction_csv(string filename, string path_to_atmospheric_data);
+
+  /// @brief Get the parameters of the steady state concentration of 10Be or 26Al
+  /// @details The steady state concentration at effective depth d below a
+  ///  surface eroding at E (g/cm^2/yr) is
+  ///  St_P0*sum_i F[i]*Gamma[i]*exp(-d/Gamma[i])/(E+Gamma[i]*lambda),
+  ///  which is what LSDCRNParticle::update_10Be_SSfull calculates.
+  /// @param Nuclide "Be10" or "Al26"
+  /// @param F replaced with the four F values (as scaled by scale_F_values)
+  /// @param Gamma replaced with the four attenuation lengths in g/cm^2
+  /// @param lambda replaced with the decay constant in yr^-1
+  /// @param St_P0 replaced with S_t times the production rate P0 in a/g/yr
+  void get_steady_state_parameters(string Nuclide, vector<double>& F,
+                                   vector<double>& Gamma_vec, double& lambda,
+                                   double& St_P0);
+
+  /// @brief Get the parts of the 10Be, 14C and 21Ne concentration updates
+  ///  that are shared by all particles for a timestep and erosion rate
+  /// @param dt the timestep in years
+  /// @param erosion_rate the erosion rate in g/cm^2/yr
+  /// @return the factors, for LSDCRNParticle::update_3CRN_conc
+  CRN_exposure_factors get_3CRN_exposure_factors(double dt, double erosion_rate);
   
   private:
   /// @brief This is called by the default constructor. 
@@ -594,26 +749,13 @@ class LSDCRNParameters
   /// This is a data map used for storing CRONUS muon parameters
   map<string,double> CRONUS_muon_data;
   
-  /// levels: the levels for the atmospheric scaling of pressure
-  vector<double> levels;
-  
-  /// This is an index for the latitudes for atmospheric scaling
-  vector<double> NCEPlat;
-  
-  /// This is an index for the longitudes for atmospheric scaling
-  vector<double> NCEPlon;
-  
-  /// This is an array holding sea level perssures
-  Array2D<double> meanslp;
-  
-  /// This is an array healing mean temperatures
-  Array2D<double> meant1000;
-  
-  /// This is a vector of arrays holding something called gp_hgt;
-  vector< Array2D<double> > gp_hgt;
-  
-  /// This is a vector of arrays holding something called gp_hgt;
-  vector< Array2D<double> > gm_hgt;  
+  /// The NCEP data used for atmospheric scaling. This is shared between
+  /// objects and must not be changed.
+  const NCEP_table* NCEP_data;
+
+  /// The table of muon fluxes used by P_mu_total. It is NULL if no table
+  /// has been loaded. This is shared between objects and must not be changed.
+  const CRONUS_muon_table* muon_table;
   
   
 };
@@ -94,7 +94,7 @@ using namespace TNT;
 // SMM 01/03/2013
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void LSDChiNetwork::create(string channel_network_fname)
+void LSDChiNetwork::create(string channel_network_fname, long stream_id)
 {
   ifstream channel_data_in;
   channel_data_in.open(channel_network_fname.c_str());
@@ -210,6 +210,7 @@ void LSDChiNetwork::create(string channel_network_fname)
   channel_data_in.close();
   
   I_should_calculate_chi = true;
+  random_stream.reset(get_random_master_seed(),"chi_channels",stream_id);
   
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -220,7 +221,7 @@ void LSDChiNetwork::create(string channel_network_fname)
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiNetwork::create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
-                           LSDRaster& FlowDistance, LSDRaster& DrainageArea)
+                           LSDRaster& FlowDistance, LSDRaster& DrainageArea, long stream_id)
 {
   int current_node, reciever_node;
   int row;
@@ -308,6 +309,7 @@ void LSDChiNetwork::create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode
   receiver_channel.push_back(0);
   
   I_should_calculate_chi = true;
+  random_stream.reset(get_random_master_seed(),"chi_channels",stream_id);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -320,7 +322,7 @@ void LSDChiNetwork::create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiNetwork::create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
                            LSDRaster& FlowDistance, LSDRaster& DrainageArea, 
-                           LSDRaster& Chi)
+                           LSDRaster& Chi, long stream_id)
 {
   int current_node, reciever_node;
   int row;
@@ -411,6 +413,7 @@ void LSDChiNetwork::create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode
   //cout << "I got chi from a raster, DUDE!" << endl;
   
   I_should_calculate_chi = false;
+  random_stream.reset(get_random_master_seed(),"chi_channels",stream_id);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -1751,7 +1754,7 @@ void LSDChiNetwork::find_most_likeley_segments_monte_carlo(int channel, int mini
   //int n_nodes = reverse_Chi.size();
 
   // now thin the data, preserving the data (not interpolating)
-  channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference);
+  channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference, random_stream);
   //n_nodes = node_reference.size();
 
   // now create a single sigma value vector
@@ -1807,7 +1810,7 @@ void LSDChiNetwork::find_most_likeley_segments_monte_carlo_dchi(int channel, int
   //int n_nodes = reverse_Chi.size();
 
   // now thin the data, preserving the data (not interpolating)
-  channel_MLE_finder.thin_data_monte_carlo_dchi(mean_dchi, variation_dchi, node_reference);
+  channel_MLE_finder.thin_data_monte_carlo_dchi(mean_dchi, variation_dchi, node_reference, random_stream);
   //n_nodes = node_reference.size();
 
   // now create a single sigma value vector
@@ -2337,7 +2340,7 @@ void LSDChiNetwork::monte_carlo_split_channel(float A_0, float m_over_n, int n_i
         LSDMostLikelyPartitionsFinder channel_MLE_finder(minimum_segment_length, br_chi, br_elev);
 
         // now thin the data, preserving the data (not interpolating)
-        channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference);
+        channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference, random_stream);
         n_data_nodes = node_reference.size();
 
         // now create a single sigma value vector
@@ -2652,7 +2655,7 @@ void LSDChiNetwork::monte_carlo_split_channel_colinear(float A_0, float m_over_n
         LSDMostLikelyPartitionsFinder channel_MLE_finder(minimum_segment_length, br_chi, br_elev);
 
         // now thin the data, preserving the data (not interpolating)
-        channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference);
+        channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference, random_stream);
         n_data_nodes = node_reference.size();
 
         //cout << "n data Nodes: " << n_data_nodes << endl;
@@ -3096,7 +3099,7 @@ vector<float> LSDChiNetwork::calculate_AICc_after_breaks_monte_carlo(float A_0,
       LSDMostLikelyPartitionsFinder channel_MLE_finder(minimum_segment_length, br_chi, br_elev);
 
       // now thin the data, preserving the data (not interpolating)
-      channel_MLE_finder.thin_data_monte_carlo_skip(target_skip, skip_range, node_reference);
+      channel_MLE_finder.thin_data_monte_carlo_skip(target_skip, skip_range, node_reference, random_stream);
       n_data_nodes = node_reference.size();
 
       // now create a single sigma value vector
@@ -3418,7 +3421,7 @@ vector<float> LSDChiNetwork::calculate_AICc_after_breaks_colinear_monte_carlo(fl
       LSDMostLikelyPartitionsFinder channel_MLE_finder(minimum_segment_length, br_chi, br_elev);
 
       // now thin the data, preserving the data (not interpolating)
-      channel_MLE_finder.thin_data_monte_carlo_skip(skip, skip_range, node_reference);
+      channel_MLE_finder.thin_data_monte_carlo_skip(skip, skip_range, node_reference, random_stream);
       n_data_nodes = node_reference.size();
 
       // now create a single sigma value vector
@@ -3967,7 +3970,7 @@ void LSDChiNetwork::monte_carlo_sample_river_network_for_best_fit_after_breaks(f
         LSDMostLikelyPartitionsFinder channel_MLE_finder(minimum_segment_length, br_chi, br_elev);
 
         // now thin the data, preserving the data (not interpolating)
-        channel_MLE_finder.thin_data_monte_carlo_skip(skip, skip_range, node_reference);
+        channel_MLE_finder.thin_data_monte_carlo_skip(skip, skip_range, node_reference, random_stream);
         n_data_nodes = node_reference.size();
         //cout << "n_data_nodes after skip" << n_data_nodes << " and before: " << br_chi.size() << endl;
 
@@ -4899,7 +4902,7 @@ float LSDChiNetwork::search_for_best_fit_m_over_n_colinearity_test(float A_0, in
 
       vector<int> node_reference;
       // now thin the data, preserving the data (not interpolating)
-      channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference);
+      channel_MLE_finder.thin_data_monte_carlo_skip(mean_skip, skip_range, node_reference, random_stream);
       //cout << "The thinned number of nodes is: " << node_reference.size() << " and overall nodes: " << reverse_Chi.size() << endl;
 
       // now create a single sigma value vector
@@ -71,6 +71,7 @@
 #include "TNT/tnt.h"
 #include "LSDRaster.hpp"
 #include "LSDFlowInfo.hpp"
+#include "LSDStatsTools.hpp"
 using namespace std;
 using namespace TNT;
 
@@ -83,18 +84,22 @@ class LSDChiNetwork
   public:
     /// @brief Crate routine to make a LSDChiNetwork object.
     /// @param channel_network_fname Filename.
-    LSDChiNetwork(string channel_network_fname)
-                 { create( channel_network_fname ); }
+    /// @param stream_id The random stream of the monte carlo fitting routines.
+    /// Networks fitted in parallel need different ids, e.g. their channel index,
+    /// so that the fits do not depend on the number of threads.
+    LSDChiNetwork(string channel_network_fname, long stream_id)
+                 { create( channel_network_fname, stream_id ); }
     
     LSDChiNetwork(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
-                           LSDRaster& FlowDistance, LSDRaster& DrainageArea)
+                           LSDRaster& FlowDistance, LSDRaster& DrainageArea, long stream_id)
                  {create(FlowInfo, SourceNode, OutletNode, Elevation,
-                         FlowDistance, DrainageArea); }
+                         FlowDistance, DrainageArea, stream_id); }
                          
     LSDChiNetwork(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
-                           LSDRaster& FlowDistance, LSDRaster& DrainageArea, LSDRaster& Chi)
+                           LSDRaster& FlowDistance, LSDRaster& DrainageArea, LSDRaster& Chi,
+                           long stream_id)
                  {create(FlowInfo, SourceNode, OutletNode, Elevation,
-                         FlowDistance, DrainageArea, Chi); }
+                         FlowDistance, DrainageArea, Chi, stream_id); }
 
 
     /// @return Number of channels.
@@ -863,6 +868,7 @@ class LSDChiNetwork
       { return chis; }
 
 
+
   protected:
 
     ///Number of rows.
@@ -941,13 +947,16 @@ class LSDChiNetwork
     /// This vector holds the vectors containing the node locations of breaks in the segments.
     vector< vector<int> > break_nodes_vecvec;
 
+    /// The random stream the monte carlo fitting routines draw from.
+    RandomStream random_stream;
+
   private:
-    void create(string channel_network_fname);
+    void create(string channel_network_fname, long stream_id);
     void create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
-                           LSDRaster& FlowDistance, LSDRaster& DrainageArea);
+                           LSDRaster& FlowDistance, LSDRaster& DrainageArea, long stream_id);
     void create(LSDFlowInfo& FlowInfo, int SourceNode, int OutletNode, LSDRaster& Elevation,
                            LSDRaster& FlowDistance, LSDRaster& DrainageArea, 
-                           LSDRaster& Chi);
+                           LSDRaster& Chi, long stream_id);
 };
 
 #endif
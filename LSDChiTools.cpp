@@ -103,6 +103,8 @@ void LSDChiTools::create(LSDRaster& ThisRaster)
   DataResolution = ThisRaster.get_DataResolution();
   NoDataValue = ThisRaster.get_NoDataValue();
   GeoReferencingStrings = ThisRaster.get_GeoReferencingStrings();
+  basin_key_offset = 0;
+  source_key_offset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -118,6 +120,8 @@ void LSDChiTools::create(LSDIndexRaster& ThisRaster)
   DataResolution = ThisRaster.get_DataResolution();
   NoDataValue = ThisRaster.get_NoDataValue();
   GeoReferencingStrings = ThisRaster.get_GeoReferencingStrings();
+  basin_key_offset = 0;
+  source_key_offset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -133,6 +137,8 @@ void LSDChiTools::create(LSDFlowInfo& ThisFI)
   DataResolution = ThisFI.get_DataResolution();
   NoDataValue = ThisFI.get_NoDataValue();
   GeoReferencingStrings = ThisFI.get_GeoReferencingStrings();
+  basin_key_offset = 0;
+  source_key_offset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -148,6 +154,8 @@ void LSDChiTools::create(LSDJunctionNetwork& ThisJN)
   DataResolution = ThisJN.get_DataResolution();
   NoDataValue = ThisJN.get_NoDataValue();
   GeoReferencingStrings = ThisJN.get_GeoReferencingStrings();
+  basin_key_offset = 0;
+  source_key_offset = 0;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -158,16 +166,58 @@ void LSDChiTools::create(LSDJunctionNetwork& ThisJN)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::reset_data_maps()
 {
-  map<int,float> empty_map;
+  vector<float> empty_float_vec;
   vector<int> empty_vec;
 
-  M_chi_data_map = empty_map;
-  b_chi_data_map = empty_map;
-  elev_data_map = empty_map;
-  chi_data_map = empty_map;
-  flow_distance_data_map = empty_map;
-  drainage_area_data_map = empty_map;
+  M_chi_data = empty_float_vec;
+  b_chi_data = empty_float_vec;
+  elev_data = empty_float_vec;
+  chi_data = empty_float_vec;
+  flow_distance_data = empty_float_vec;
+  drainage_area_data = empty_float_vec;
+  segmented_elevation_data = empty_float_vec;
+  source_keys_data = empty_vec;
+  baselevel_keys_data = empty_vec;
   node_sequence = empty_vec;
+  node_sequence_index = empty_vec;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+//
+// This indexes the node sequence. The channel data are stored in vectors
+// aligned with node_sequence, so the index is all that is needed to get the
+// data of a node. The knickpoint vectors are sized and set to zero here.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::index_node_sequence(LSDFlowInfo& FlowInfo)
+{
+  int n_nodes = int(node_sequence.size());
+
+  vector<int> this_node_sequence_index(FlowInfo.get_NDataNodes(),NoDataValue);
+  for (int n = 0; n< n_nodes; n++)
+  {
+    this_node_sequence_index[ node_sequence[n] ] = n;
+  }
+  node_sequence_index = this_node_sequence_index;
+
+  vector<float> zero_vec(n_nodes,0.0);
+  lumped_m_chi_data = zero_vec;
+  TVD_m_chi_data = zero_vec;
+  TVD_b_chi_data = zero_vec;
+  TVD_segelev_diff_data = zero_vec;
+  segelev_diff_data = zero_vec;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Gets the position of a node in node_sequence
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+int LSDChiTools::get_node_sequence_index(int node_index)
+{
+  if (node_index < 0 || node_index >= int(node_sequence_index.size()))
+  {
+    return NoDataValue;
+  }
+  return node_sequence_index[node_index];
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -351,7 +401,7 @@ void LSDChiTools::get_UTM_information(int& UTM_zone, bool& is_North)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::update_chi_data_map(LSDFlowInfo& FlowInfo, LSDRaster& Chi_coord)
 {
-  if (chi_data_map.size() == 0)
+  if (chi_data.size() == 0)
   {
     cout << "Trying to update chi but you have not run the automator yet to" << endl;
     cout << "organise the sources and channels. LSDChiTools::update_chi_data_map" << endl;
@@ -366,7 +416,7 @@ void LSDChiTools::update_chi_data_map(LSDFlowInfo& FlowInfo, LSDRaster& Chi_coor
       this_node = node_sequence[node];
       FlowInfo.retrieve_current_row_and_col(this_node,row,col);
       updated_chi = Chi_coord.get_data_element(row,col);
-      chi_data_map[this_node] = updated_chi;
+      chi_data[node] = updated_chi;
     }
   }
 
@@ -377,7 +427,7 @@ void LSDChiTools::update_chi_data_map(LSDFlowInfo& FlowInfo, LSDRaster& Chi_coor
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::update_chi_data_map(LSDFlowInfo& FlowInfo, float A_0, float movern)
 {
-  if (chi_data_map.size() == 0)
+  if (chi_data.size() == 0)
   {
     cout << "Trying to update chi but you have not run the automator yet to" << endl;
     cout << "organise the sources and channels. LSDChiTools::update_chi_data_map" << endl;
@@ -398,7 +448,7 @@ void LSDChiTools::update_chi_data_map(LSDFlowInfo& FlowInfo, float A_0, float mo
       this_node = node_sequence[node];
       FlowInfo.retrieve_current_row_and_col(this_node,row,col);
       updated_chi = this_chi_coordinate.get_data_element(row,col);
-      chi_data_map[this_node] = updated_chi;
+      chi_data[node] = updated_chi;
     }
   }
 }
@@ -414,7 +464,7 @@ void LSDChiTools::update_chi_data_map_for_single_basin(LSDFlowInfo& FlowInfo, fl
                                      int minimum_contributing_pixels, int basin_key,
                                      map<int,int> outlet_node_from_basin_key_map)
 {
-  if (chi_data_map.size() == 0)
+  if (chi_data.size() == 0)
   {
     cout << "Trying to update chi but you have not run the automator yet to" << endl;
     cout << "organise the sources and channels. LSDChiTools::update_chi_data_map_for_single_basin" << endl;
@@ -440,8 +490,12 @@ void LSDChiTools::update_chi_data_map_for_single_basin(LSDFlowInfo& FlowInfo, fl
     map<int,float>::iterator iter = new_chi_map.begin();
     while(iter != new_chi_map.end())
     {
-      //cout << "node is: " << iter->first << endl;
-      chi_data_map[iter->first] = iter->second;
+      // only nodes in the channel network are stored
+      int this_index = get_node_sequence_index(iter->first);
+      if (this_index != NoDataValue)
+      {
+        chi_data[this_index] = iter->second;
+      }
       iter++;
     }
   }
@@ -457,7 +511,7 @@ void LSDChiTools::update_chi_data_map_for_single_basin(LSDFlowInfo& FlowInfo, fl
                                      int minimum_contributing_pixels, int basin_key,
                                      map<int,int> outlet_node_from_basin_key_map, LSDRaster& Discharge)
 {
-  if (chi_data_map.size() == 0)
+  if (chi_data.size() == 0)
   {
     cout << "Trying to update chi but you have not run the automator yet to" << endl;
     cout << "organise the sources and channels. LSDChiTools::update_chi_data_map_for_single_basin" << endl;
@@ -482,7 +536,12 @@ void LSDChiTools::update_chi_data_map_for_single_basin(LSDFlowInfo& FlowInfo, fl
     map<int,float>::iterator iter = new_chi_map.begin();
     while(iter != new_chi_map.end())
     {
-      chi_data_map[iter->first] = iter->second;
+      // only nodes in the channel network are stored
+      int this_index = get_node_sequence_index(iter->first);
+      if (this_index != NoDataValue)
+      {
+        chi_data[this_index] = iter->second;
+      }
       iter++;
     }
   }
@@ -765,20 +824,24 @@ void LSDChiTools::chi_map_automator_chi_only(LSDFlowInfo& FlowInfo,
   vector<float> these_chi_coordinates;
   vector<int> these_chi_node_indices;
 
-  // these are maps that will store the data
-  map<int,float> chi_coord_map;
-  map<int,float> elev_map;
-  map<int,float> area_map;
-  map<int,float> flow_distance_map;
+  // these are vectors that will store the data. They are aligned with
+  // node_sequence_vec
+  vector<float> chi_coord_vec;
+  vector<float> elev_vec;
+  vector<float> area_vec;
+  vector<float> flow_distance_vec;
   vector<int> node_sequence_vec;
 
   // these are vectors that will store information about the individual nodes
   // that allow us to map the nodes to specific channels during data visualisation
 
-  // These two maps have each node in the channel (the index)
-  // linked to a key (either the baselevel key or source key)
-  map<int,int> these_source_keys;
-  map<int,int> these_baselevel_keys;
+  // These two vectors have each node in the channel linked to a key
+  // (either the baselevel key or source key)
+  vector<int> these_source_keys;
+  vector<int> these_baselevel_keys;
+
+  // this flags the nodes that have already been found
+  vector<bool> node_is_found(FlowInfo.get_NDataNodes(),false);
 
   // These two maps link keys, which are incrmented by one, to the
   // junction or node of the baselevel or source
@@ -843,7 +906,8 @@ void LSDChiTools::chi_map_automator_chi_only(LSDFlowInfo& FlowInfo,
 
     // get this particular channel (it is a chi network with only one channel)
     LSDChiNetwork ThisChiChannel(FlowInfo, source_nodes[chan], outlet_nodes[chan],
-                                Elevation, FlowDistance, DrainageArea,chi_coordinate);
+                                Elevation, FlowDistance, DrainageArea,chi_coordinate,
+                                source_key_offset+chan);
 
     // okay the ChiNetwork has all the data about the m vales at this stage.
     // Get these vales and print them to a raster
@@ -873,19 +937,20 @@ void LSDChiTools::chi_map_automator_chi_only(LSDFlowInfo& FlowInfo,
       //cout << "This node is " << this_node << endl;
 
       // only take the nodes that have not been found
-      if (chi_coord_map.find(this_node) == chi_coord_map.end() )
+      if (node_is_found[this_node] == false)
       {
         FlowInfo.retrieve_current_row_and_col(this_node,row,col);
 
         //cout << "This is a new node; " << this_node << endl;
-        chi_coord_map[this_node] = these_chi_coordinates[node];
-        elev_map[this_node] = Elevation.get_data_element(row,col);
-        area_map[this_node] = DrainageArea.get_data_element(row,col);
-        flow_distance_map[this_node] = FlowDistance.get_data_element(row,col);
+        node_is_found[this_node] = true;
+        chi_coord_vec.push_back(these_chi_coordinates[node]);
+        elev_vec.push_back(Elevation.get_data_element(row,col));
+        area_vec.push_back(DrainageArea.get_data_element(row,col));
+        flow_distance_vec.push_back(FlowDistance.get_data_element(row,col));
         node_sequence_vec.push_back(this_node);
 
-        these_source_keys[this_node] = source_node_tracker;
-        these_baselevel_keys[this_node] = baselevel_tracker;
+        these_source_keys.push_back(source_node_tracker);
+        these_baselevel_keys.push_back(baselevel_tracker);
       }
       else
       {
@@ -896,15 +961,22 @@ void LSDChiTools::chi_map_automator_chi_only(LSDFlowInfo& FlowInfo,
 
   //cout << "I am all finished segmenting the channels!" << endl;
 
-  // set the object data members
-  elev_data_map = elev_map;
-  chi_data_map = chi_coord_map;
-  flow_distance_data_map = flow_distance_map;
-  drainage_area_data_map = area_map;
+  // set the object data members. The segments are not fitted so M_chi and
+  // b_chi are zero
+  vector<float> zero_vec(node_sequence_vec.size(),0.0);
+  vector<float> empty_vec_float;
+  M_chi_data = zero_vec;
+  b_chi_data = zero_vec;
+  elev_data = elev_vec;
+  chi_data = chi_coord_vec;
+  flow_distance_data = flow_distance_vec;
+  drainage_area_data = area_vec;
+  segmented_elevation_data = empty_vec_float;
   node_sequence = node_sequence_vec;
+  index_node_sequence(FlowInfo);
 
-  source_keys_map = these_source_keys;
-  baselevel_keys_map = these_baselevel_keys;
+  source_keys_data = these_source_keys;
+  baselevel_keys_data = these_baselevel_keys;
   key_to_source_map = this_key_to_source_map;
   key_to_baselevel_map = this_key_to_baselevel_map;
   //cout << "BUG TRACKER" << endl; exit(EXIT_FAILURE);
@@ -936,34 +1008,32 @@ void LSDChiTools::chi_map_automator(LSDFlowInfo& FlowInfo,
   float A_0 = 1;
   float m_over_n = 0.5;
 
-  // These elements access the chi data
-  vector< vector<float> > chi_m_means;
-  vector< vector<float> > chi_b_means;
-  vector< vector<float> > chi_coordinates;
-  vector< vector<int> > chi_node_indices;
-
   // these are for the individual channels
   vector<float> these_chi_m_means;
   vector<float> these_chi_b_means;
   vector<float> these_chi_coordinates;
   vector<int> these_chi_node_indices;
 
-  // these are maps that will store the data
-  map<int,float> m_means_map;
-  map<int,float> b_means_map;
-  map<int,float> chi_coord_map;
-  map<int,float> elev_map;
-  map<int,float> area_map;
-  map<int,float> flow_distance_map;
+  // these are vectors that will store the data. They are aligned with
+  // node_sequence_vec
+  vector<float> m_means_vec;
+  vector<float> b_means_vec;
+  vector<float> chi_coord_vec;
+  vector<float> elev_vec;
+  vector<float> area_vec;
+  vector<float> flow_distance_vec;
   vector<int> node_sequence_vec;
 
   // these are vectors that will store information about the individual nodes
   // that allow us to map the nodes to specific channels during data visualisation
 
-  // These two maps have each node in the channel (the index)
-  // linked to a key (either the baselevel key or source key)
-  map<int,int> these_source_keys;
-  map<int,int> these_baselevel_keys;
+  // These two vectors have each node in the channel linked to a key
+  // (either the baselevel key or source key)
+  vector<int> these_source_keys;
+  vector<int> these_baselevel_keys;
+
+  // this flags the nodes that have already been found
+  vector<bool> node_is_found(FlowInfo.get_NDataNodes(),false);
 
   // These two maps link keys, which are incrmented by one, to the
   // junction or node of the baselevel or source
@@ -979,6 +1049,77 @@ void LSDChiTools::chi_map_automator(LSDFlowInfo& FlowInfo,
   int baselevel_tracker = -1;
   int ranked_source_node_tracker = -1;
   int n_channels = int(source_nodes.size());
+
+  // The channels are fitted independently so this is done in parallel. The
+  // longest channels (by flow distance from source to outlet) are handed out
+  // first so that the trunk channels do not hold up the end of the run. Each
+  // channel writes into its own slot and the slots are merged below in the
+  // original channel order, so the maps do not depend on the number of threads.
+  vector< pair<float,int> > channels_by_length(n_channels);
+  for(int chan = 0; chan<n_channels; chan++)
+  {
+    int source_row,source_col,outlet_row,outlet_col;
+    FlowInfo.retrieve_current_row_and_col(source_nodes[chan],source_row,source_col);
+    FlowInfo.retrieve_current_row_and_col(outlet_nodes[chan],outlet_row,outlet_col);
+    float channel_length = FlowDistance.get_data_element(source_row,source_col)
+                          -FlowDistance.get_data_element(outlet_row,outlet_col);
+    channels_by_length[chan] = make_pair(-channel_length,chan);
+  }
+  sort(channels_by_length.begin(),channels_by_length.end());
+
+  vector< vector<float> > m_means_of_channel(n_channels);
+  vector< vector<float> > b_means_of_channel(n_channels);
+  vector< vector<float> > chi_coordinates_of_channel(n_channels);
+  vector< vector<int> > node_indices_of_channel(n_channels);
+
+  // each channel draws its monte carlo samples from its own random stream,
+  // numbered by the channel
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int rank = 0; rank<n_channels; rank++)
+  {
+    int chan = channels_by_length[rank].second;
+    //cout << "Sampling channel " << chan+1 << " of " << n_channels << endl;
+
+    // get this particular channel (it is a chi network with only one channel)
+    LSDChiNetwork ThisChiChannel(FlowInfo, source_nodes[chan], outlet_nodes[chan],
+                                Elevation, FlowDistance, DrainageArea,chi_coordinate,
+                                source_key_offset+chan);
+
+    // split the channel
+    //cout << "Splitting channels" << endl;
+    ThisChiChannel.split_all_channels(A_0, m_over_n, n_iterations, skip, target_nodes, minimum_segment_length, sigma);
+
+    // monte carlo sample all channels
+    //cout << "Entering the monte carlo sampling" << endl;
+    ThisChiChannel.monte_carlo_sample_river_network_for_best_fit_after_breaks(A_0, m_over_n, n_iterations, skip, minimum_segment_length, sigma);
+
+    // okay the ChiNetwork has all the data about the m vales at this stage.
+    // Get these vales and print them to a raster
+    vector< vector<float> > chi_m_means = ThisChiChannel.get_m_means();
+    vector< vector<float> > chi_b_means = ThisChiChannel.get_b_means();
+    vector< vector<float> > chi_coordinates = ThisChiChannel.get_chis();
+    vector< vector<int> > chi_node_indices = ThisChiChannel.get_node_indices();
+
+    // now get the number of channels. This should be 1!
+    int n_channels_in_network = int(chi_m_means.size());
+    if (n_channels_in_network != 1)
+    {
+      #pragma omp critical
+      {
+        cout << "Whoa there, I am trying to make a chi map but something seems to have gone wrong with the channel extraction."  << endl;
+        cout << "I should only have one channel per look but I have " << n_channels_in_network << " channels." << endl;
+      }
+    }
+
+    // now get the m_means out
+    m_means_of_channel[chan] = chi_m_means[0];
+    b_means_of_channel[chan] = chi_b_means[0];
+    chi_coordinates_of_channel[chan] = chi_coordinates[0];
+    node_indices_of_channel[chan] = chi_node_indices[0];
+  }
+
+  // now merge the channels in their original order
   for(int chan = 0; chan<n_channels; chan++)
   {
     //cout << "Sampling channel " << chan+1 << " of " << n_channels << endl;
@@ -1019,38 +1160,11 @@ void LSDChiTools::chi_map_automator(LSDFlowInfo& FlowInfo,
 
     //cout << "The source key is: " << source_node_tracker << " and basin key is: " << baselevel_tracker << endl;
 
-    // get this particular channel (it is a chi network with only one channel)
-    LSDChiNetwork ThisChiChannel(FlowInfo, source_nodes[chan], outlet_nodes[chan],
-                                Elevation, FlowDistance, DrainageArea,chi_coordinate);
-
-    // split the channel
-    //cout << "Splitting channels" << endl;
-    ThisChiChannel.split_all_channels(A_0, m_over_n, n_iterations, skip, target_nodes, minimum_segment_length, sigma);
-
-    // monte carlo sample all channels
-    //cout << "Entering the monte carlo sampling" << endl;
-    ThisChiChannel.monte_carlo_sample_river_network_for_best_fit_after_breaks(A_0, m_over_n, n_iterations, skip, minimum_segment_length, sigma);
-
-    // okay the ChiNetwork has all the data about the m vales at this stage.
-    // Get these vales and print them to a raster
-    chi_m_means = ThisChiChannel.get_m_means();
-    chi_b_means = ThisChiChannel.get_b_means();
-    chi_coordinates = ThisChiChannel.get_chis();
-    chi_node_indices = ThisChiChannel.get_node_indices();
-
-    // now get the number of channels. This should be 1!
-    int n_channels = int(chi_m_means.size());
-    if (n_channels != 1)
-    {
-      cout << "Whoa there, I am trying to make a chi map but something seems to have gone wrong with the channel extraction."  << endl;
-      cout << "I should only have one channel per look but I have " << n_channels << " channels." << endl;
-    }
-
-    // now get the m_means out
-    these_chi_m_means = chi_m_means[0];
-    these_chi_b_means = chi_b_means[0];
-    these_chi_coordinates = chi_coordinates[0];
-    these_chi_node_indices = chi_node_indices[0];
+    // get the fitted channel
+    these_chi_m_means.swap(m_means_of_channel[chan]);
+    these_chi_b_means.swap(b_means_of_channel[chan]);
+    these_chi_coordinates.swap(chi_coordinates_of_channel[chan]);
+    these_chi_node_indices.swap(node_indices_of_channel[chan]);
 
     //cout << "I have " << these_chi_m_means.size() << " nodes." << endl;
 
@@ -1063,21 +1177,22 @@ void LSDChiTools::chi_map_automator(LSDFlowInfo& FlowInfo,
       //cout << "This node is " << this_node << endl;
 
       // only take the nodes that have not been found
-      if (m_means_map.find(this_node) == m_means_map.end() )
+      if (node_is_found[this_node] == false)
       {
         FlowInfo.retrieve_current_row_and_col(this_node,row,col);
 
         //cout << "This is a new node; " << this_node << endl;
-        m_means_map[this_node] = these_chi_m_means[node];
-        b_means_map[this_node] = these_chi_b_means[node];
-        chi_coord_map[this_node] = these_chi_coordinates[node];
-        elev_map[this_node] = Elevation.get_data_element(row,col);
-        area_map[this_node] = DrainageArea.get_data_element(row,col);
-        flow_distance_map[this_node] = FlowDistance.get_data_element(row,col);
+        node_is_found[this_node] = true;
+        m_means_vec.push_back(these_chi_m_means[node]);
+        b_means_vec.push_back(these_chi_b_means[node]);
+        chi_coord_vec.push_back(these_chi_coordinates[node]);
+        elev_vec.push_back(Elevation.get_data_element(row,col));
+        area_vec.push_back(DrainageArea.get_data_element(row,col));
+        flow_distance_vec.push_back(FlowDistance.get_data_element(row,col));
         node_sequence_vec.push_back(this_node);
 
-        these_source_keys[this_node] = source_node_tracker;
-        these_baselevel_keys[this_node] = baselevel_tracker;
+        these_source_keys.push_back(source_node_tracker);
+        these_baselevel_keys.push_back(baselevel_tracker);
 
       }
       else
@@ -1090,16 +1205,17 @@ void LSDChiTools::chi_map_automator(LSDFlowInfo& FlowInfo,
   //cout << "I am all finished segmenting the channels!" << endl;
 
   // set the object data members
-  M_chi_data_map =m_means_map;
-  b_chi_data_map = b_means_map;
-  elev_data_map = elev_map;
-  chi_data_map = chi_coord_map;
-  flow_distance_data_map = flow_distance_map;
-  drainage_area_data_map = area_map;
+  M_chi_data = m_means_vec;
+  b_chi_data = b_means_vec;
+  elev_data = elev_vec;
+  chi_data = chi_coord_vec;
+  flow_distance_data = flow_distance_vec;
+  drainage_area_data = area_vec;
   node_sequence = node_sequence_vec;
+  index_node_sequence(FlowInfo);
 
-  source_keys_map = these_source_keys;
-  baselevel_keys_map = these_baselevel_keys;
+  source_keys_data = these_source_keys;
+  baselevel_keys_data = these_baselevel_keys;
   key_to_source_map = this_key_to_source_map;
   key_to_baselevel_map = this_key_to_baselevel_map;
 
@@ -1317,14 +1433,33 @@ void LSDChiTools::chi_map_automator_rudimentary(LSDFlowInfo& FlowInfo,
     }          // This finishes the regression segment loop
   }            // This finishes the channel and resets channel start and end nodes
 
-  // set the data objects
-  M_chi_data_map = gradient_data_map;
-  b_chi_data_map = intercept_data_map;
-  elev_data_map = elevation_data_map;
-  chi_data_map = chi_coordinate_data_map;
-  flow_distance_data_map = flow_distance_map;
-  drainage_area_data_map = area_map;
+  // set the data objects. These are stored in the order of the nodes.
+  // The rudimentary automator does not track source and baselevel keys
+  // so these are set to zero.
+  int n_nodes = int(node_order.size());
+  vector<float> empty_vec_float;
+  vector<int> zero_vec_int(n_nodes,0);
+  M_chi_data = empty_vec_float;
+  b_chi_data = empty_vec_float;
+  elev_data = empty_vec_float;
+  chi_data = empty_vec_float;
+  flow_distance_data = empty_vec_float;
+  drainage_area_data = empty_vec_float;
+  for (int n = 0; n< n_nodes; n++)
+  {
+    this_node = node_order[n];
+    M_chi_data.push_back(gradient_data_map[this_node]);
+    b_chi_data.push_back(intercept_data_map[this_node]);
+    elev_data.push_back(elevation_data_map[this_node]);
+    chi_data.push_back(chi_coordinate_data_map[this_node]);
+    flow_distance_data.push_back(flow_distance_map[this_node]);
+    drainage_area_data.push_back(area_map[this_node]);
+  }
+  segmented_elevation_data = empty_vec_float;
+  source_keys_data = zero_vec_int;
+  baselevel_keys_data = zero_vec_int;
   node_sequence = node_order;
+  index_node_sequence(FlowInfo);
 
 
 }
@@ -1337,42 +1472,11 @@ void LSDChiTools::chi_map_automator_rudimentary(LSDFlowInfo& FlowInfo,
 LSDIndexRaster LSDChiTools::get_basin_raster(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JunctionNetwork,
                                vector<int> Junctions)
 {
-  int N_Juncs = Junctions.size();
-  LSDCoordinateConverterLLandUTM Converter;
-
-
-  // Get some data members for holding basins and the raster
-  vector<LSDBasin> AllTheBasins;
-  map<int,int> drainage_of_other_basins;
-  LSDIndexRaster BasinMasterRaster;
-
-  //cout << "I am trying to print basins, found " << N_BaseLevelJuncs << " base levels." << endl;
-  // Loop through the junctions
-  for(int BN = 0; BN<N_Juncs; BN++)
-  {
-    //cout << "Getting basin " << BN << " and the junction is: "  << BaseLevelJunctions[BN] << endl;
-    LSDBasin thisBasin(Junctions[BN],FlowInfo, JunctionNetwork);
-    //cout << "...got it!" << endl;
-    AllTheBasins.push_back(thisBasin);
-
-    // This is required if the basins are nested--test the code which numbers
-    // to be overwritten by a smaller basin
-    drainage_of_other_basins[Junctions[BN]] = thisBasin.get_NumberOfCells();
-
-  }
-
-  // now loop through everything again getting the raster
-  if (N_Juncs > 0)     // this gets the first raster
-  {
-    BasinMasterRaster = AllTheBasins[0].write_integer_data_to_LSDIndexRaster(Junctions[0], FlowInfo);
-  }
-
-  // now add on the subsequent basins
-  for(int BN = 1; BN<N_Juncs; BN++)
-  {
-    AllTheBasins[BN].add_basin_to_LSDIndexRaster(BasinMasterRaster, FlowInfo,
-                              drainage_of_other_basins, Junctions[BN]);
-  }
+  // get the outlets of the basins. The basins are then labelled in a single
+  // sweep through the S vector; if basins are nested the smaller basin
+  // keeps its label so you can still see the larger basins around it
+  vector<int> outlet_nodes = JunctionNetwork.get_basin_outlet_nodes_from_junction_vector(Junctions, FlowInfo);
+  LSDIndexRaster BasinMasterRaster = FlowInfo.label_basins_from_outlet_nodes(outlet_nodes, Junctions, 1);
 
   return BasinMasterRaster;
 
@@ -1440,16 +1544,16 @@ void LSDChiTools::segment_counter(LSDFlowInfo& FlowInfo, float maximum_segment_l
   else
   {
     this_node = node_sequence[0];
-    last_M_chi =  M_chi_data_map[this_node];
-    last_flow_length = flow_distance_data_map[this_node];
+    last_M_chi =  M_chi_data[0];
+    last_flow_length = flow_distance_data[0];
 
     for (int n = 0; n< n_nodes; n++)
     {
 
       // Get the M_chi and flow_length from the current node
       this_node = node_sequence[n];
-      this_M_chi = M_chi_data_map[this_node];
-      this_flow_length = flow_distance_data_map[this_node];
+      this_M_chi = M_chi_data[n];
+      this_flow_length = flow_distance_data[n];
 
       // update the current segment length
       segment_length = fabs(this_flow_length-last_flow_length);
@@ -1508,8 +1612,8 @@ LSDIndexRaster LSDChiTools::segment_mapping(LSDFlowInfo& FlowInfo, float maximum
     this_node = node_sequence[0];
     FlowInfo.retrieve_current_row_and_col(this_node,row,col);
 
-    last_M_chi =  M_chi_data_map[this_node];
-    last_flow_length = flow_distance_data_map[this_node];
+    last_M_chi =  M_chi_data[0];
+    last_flow_length = flow_distance_data[0];
 
     for (int n = 0; n< n_nodes; n++)
     {
@@ -1517,8 +1621,8 @@ LSDIndexRaster LSDChiTools::segment_mapping(LSDFlowInfo& FlowInfo, float maximum
       // Get the M_chi from the current node
       this_node = node_sequence[n];
       FlowInfo.retrieve_current_row_and_col(this_node,row,col);
-      this_M_chi = M_chi_data_map[this_node];
-      this_flow_length = flow_distance_data_map[this_node];
+      this_M_chi = M_chi_data[n];
+      this_flow_length = flow_distance_data[n];
 
       // update the current segment length
       segment_length = fabs(this_flow_length-last_flow_length);
@@ -1595,7 +1699,7 @@ void LSDChiTools::segment_counter_knickpoint(LSDFlowInfo& FlowInfo, float thresh
   else
   {
     this_node = node_sequence[0];
-    last_M_chi =  M_chi_data_map[this_node];
+    last_M_chi =  M_chi_data[0];
 
     for (int n = 0; n< n_nodes; n++)
     {
@@ -1607,7 +1711,7 @@ void LSDChiTools::segment_counter_knickpoint(LSDFlowInfo& FlowInfo, float thresh
       }
       this_node = node_sequence[n];
       // Get the M_chi from the current node
-      this_M_chi = M_chi_data_map[this_node];
+      this_M_chi = M_chi_data[n];
       // increment the segment node counter
       n_nodes_segment++;
 
@@ -1994,37 +2098,51 @@ void LSDChiTools::get_previous_mchi_for_all_sources(LSDFlowInfo& Flowinfo)
   }
   else
   {
-    int working_source = source_keys_map[node_sequence[0]]; // This is the working source key, the one you already have extracted the information
-    int current_source = source_keys_map[node_sequence[0]]; // this is the currently tested source_key that will become the working key is different than previous key
+    int working_source = source_keys_data[0]; // This is the working source key, the one you already have extracted the information
+    int current_source = source_keys_data[0]; // this is the currently tested source_key that will become the working key is different than previous key
     int starting_node_of_source_key = get_ending_node_of_source(Flowinfo ,working_source); // This store the starting node of the river with this source_key
     
     // Now getting the receiving node of the river with this source
     int receiving_node_of_source_key, temp_row, temp_col;
     Flowinfo.retrieve_receiver_information(starting_node_of_source_key, receiving_node_of_source_key, temp_row,temp_col);
 
-    //Finally getting the 
-    float m_chi_receiving_river = M_chi_data_map[receiving_node_of_source_key];
+    //Finally getting the m_chi and source key of the receiver. These are 0 if the
+    // receiver is not in the channel network
+    float m_chi_receiving_river = 0;
+    int source_key_receiving_river = 0;
+    int receiver_index = get_node_sequence_index(receiving_node_of_source_key);
+    if (receiver_index != NoDataValue)
+    {
+      m_chi_receiving_river = M_chi_data[receiver_index];
+      source_key_receiving_river = source_keys_data[receiver_index];
+    }
     
     // Creating temp data_map to save everything
     map<int,int> this_map_source_key_receiver; // 
     map<int,float> this_map_source_key_receiver_mchi;
-    this_map_source_key_receiver[working_source] = source_keys_map[receiving_node_of_source_key];
+    this_map_source_key_receiver[working_source] = source_key_receiving_river;
     this_map_source_key_receiver_mchi[working_source] = m_chi_receiving_river;
 
     // done initializing, let's do it for all the rivers
 
     for (int n = 0; n< n_nodes; n++)
     {
-      current_source = source_keys_map[node_sequence[n]];
-      //cout << source_keys_map[node_sequence[starting_node_of_source_key]] << "||" << node_sequence[source_keys_map[receiving_node_of_source_key]] << endl;
+      current_source = source_keys_data[n];
       if(current_source != working_source && current_source != -9999)
       {
         // cout << "changing sources" << endl;
         working_source = current_source;
         starting_node_of_source_key = get_ending_node_of_source(Flowinfo, working_source);
         Flowinfo.retrieve_receiver_information(starting_node_of_source_key, receiving_node_of_source_key, temp_row,temp_col);
-        m_chi_receiving_river = M_chi_data_map[receiving_node_of_source_key];
-        this_map_source_key_receiver[working_source] = source_keys_map[receiving_node_of_source_key];
+        m_chi_receiving_river = 0;
+        source_key_receiving_river = 0;
+        receiver_index = get_node_sequence_index(receiving_node_of_source_key);
+        if (receiver_index != NoDataValue)
+        {
+          m_chi_receiving_river = M_chi_data[receiver_index];
+          source_key_receiving_river = source_keys_data[receiver_index];
+        }
+        this_map_source_key_receiver[working_source] = source_key_receiving_river;
         this_map_source_key_receiver_mchi[working_source] = m_chi_receiving_river;
       }  
 
@@ -2138,16 +2256,34 @@ void LSDChiTools::ksn_knickpoint_detection_new(LSDFlowInfo& FlowInfo)
 
   // preparing the needed iterators
   map<int,vector<int> >::iterator SK;
-  // Initializing some variables
-  int this_SK;
-  vector<int> vecnode;
 
-  // Looping through all the sources key
+  // Gathering the rivers so they can be processed in parallel
+  vector<int> these_SK;
+  vector< vector<int>* > these_vecnodes;
   for(SK = map_node_source_key.begin(); SK != map_node_source_key.end(); SK++)
   {
-    this_SK = SK->first;
-    vecnode = SK->second; // getting the vector of river node to check
-    ksn_knickpoint_raw_river(this_SK,vecnode);
+    these_SK.push_back(SK->first);
+    these_vecnodes.push_back(&(SK->second));
+  }
+  int n_rivers = int(these_SK.size());
+
+  // Detecting the knickpoints of each river. This only reads the TVDed ksn.
+  vector< vector<int> > kp_nodes(n_rivers);
+  vector< vector<float> > kp_dksn(n_rivers);
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int r = 0; r<n_rivers; r++)
+  {
+    get_raw_ksn_knickpoints_of_river(*(these_vecnodes[r]), kp_nodes[r], kp_dksn[r]);
+  }
+
+  // The global maps are incremented in source key order
+  for(int r = 0; r<n_rivers; r++)
+  {
+    for(int k = 0; k<int(kp_nodes[r].size()); k++)
+    {
+      raw_ksn_kp_map[kp_nodes[r][k]] = kp_dksn[r][k];
+    }
+    map_node_source_key_kp[these_SK[r]] = kp_nodes[r];
   }
 
 }
@@ -2157,6 +2293,35 @@ void LSDChiTools::ksn_knickpoint_detection_new(LSDFlowInfo& FlowInfo)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::ksn_knickpoint_raw_river(int SK, vector<int> vecnode)
 {
+  vector<int> vecdif;
+  vector<float> these_dksn;
+  get_raw_ksn_knickpoints_of_river(vecnode, vecdif, these_dksn);
+
+  // saving the values in the global raw_ksn_kp map
+  for(int k = 0; k<int(vecdif.size()); k++)
+  {
+    raw_ksn_kp_map[vecdif[k]] = these_dksn[k];
+  }
+
+  // implementing the global map
+  map_node_source_key_kp[SK] = vecdif;
+
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Detect the knickpoints in one river without touching the global maps
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::get_raw_ksn_knickpoints_of_river(vector<int>& vecnode, vector<int>& kp_nodes, vector<float>& kp_dksn)
+{
+  kp_nodes.clear();
+  kp_dksn.clear();
+
+  // a river needs two nodes to have a change in ksn
+  if(vecnode.size() < 2)
+  {
+    return;
+  }
+
   // Setting the iterator(s)
   vector<int>::iterator node = vecnode.begin(); // first node of the river -> the source
 
@@ -2164,41 +2329,31 @@ void LSDChiTools::ksn_knickpoint_raw_river(int SK, vector<int> vecnode)
   int last_node = *node; // last node is the first node
   node++; // switching to the second node
   int this_node = *node; // this node is the second one 
-  // vector that will contain the nodes having a knickpoint
-  vector<int> vecdif;
   // Bunch of floats
-  //float dkdc = 0;     // Don't seem to need these (SMM)
-  //float dchi = 0;     // Don't seem to need these (SMM)
   float dksn = 0;
-  float this_ksn = TVD_m_chi_map[this_node];
-  float last_ksn = TVD_m_chi_map[last_node]; // Setting last and this ksn
+  float this_ksn = TVD_m_chi_data[node_sequence_index[this_node]];
+  float last_ksn = TVD_m_chi_data[node_sequence_index[last_node]]; // Setting last and this ksn
 
   // Looping through the nodes from the second one
   for( ; node != vecnode.end(); node++) // the first ";" is normal: it states that I have no initial conditions 
   {
     // initializing the variables for this run
     this_node = *node;
-    this_ksn = TVD_m_chi_map[this_node];
-    // dsegelev = segelev_diff[this_node];
+    this_ksn = TVD_m_chi_data[node_sequence_index[this_node]];
     // if ksn has change, Implementing a raw knickpoint, quantifying it with delta ksn
     if((this_ksn != last_ksn) && this_ksn != -9999 && last_ksn != -9999 )
     {
       // deta ksn from bottom to top
       dksn = last_ksn - this_ksn;
-      // saving the value in the global raw_ksn_kp map
-      raw_ksn_kp_map[this_node] =  dksn;
-      // saving the node to get the vector of ksn knickpoints per source, for later grouping purpose for example
-      vecdif.push_back(this_node);
+      // saving the node and its delta ksn, for later grouping purpose for example
+      kp_nodes.push_back(this_node);
+      kp_dksn.push_back(dksn);
     }
     // setting the next last variables
     last_node = this_node;
     last_ksn = this_ksn;
 
   }
-
-  // implementing the global map
-  map_node_source_key_kp[SK] = vecdif;
-
 }
 
 
@@ -2215,32 +2370,43 @@ void LSDChiTools::stepped_knickpoints_detection_v2(LSDFlowInfo& Flowinfo, int wi
   vector<int> vecnode;
   int HW = int(window/2);
 
-  // Looping through all the sources key
+  // the rivers long enough for the window
+  vector< vector<int>* > these_vecnodes;
   for(SK = map_node_source_key.begin(); SK != map_node_source_key.end(); SK++)
   {
-    
-    // the source key
-    //this_SK = SK->first;       // This doens't seem to be used (SMM)
-    
+    if(int(SK->second.size()) > window)
+    {
+      these_vecnodes.push_back(&(SK->second));
+    }
+  }
+  int n_rivers = int(these_vecnodes.size());
+
+  // first step is to get the windowed stats, the moving window will gather informations across the vector of nodes
+  // Each river is independent so this is done in parallel
+  vector< map<string,vector<float> > > stats_of_river(n_rivers);
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int r = 0; r<n_rivers; r++)
+  {
+    stats_of_river[r] = get_windowed_stats_for_knickpoints(*(these_vecnodes[r]),HW);
+  }
+
+  // Looping through all the sources key in order to fill the global maps
+  for(int r = 0; r<n_rivers; r++)
+  {
     // the vector containing the river nodes
-    vecnode = SK->second;
-    // first check if the size is over the window
-    if(int(vecnode.size()) > window)
-    { 
-      // first step is to get the windowed stats, the moving window will gather informations across the vector of nodes 
-      map<string,vector<float> > these_stats = get_windowed_stats_for_knickpoints(vecnode,HW);
-
-      for(size_t it = 0; it< vecnode.size(); it++)
-      {
-        int this_node = vecnode[it];
-        float this_std = these_stats["std_dev"][it], this_mean = these_stats["mean"][it];
-        mean_for_kp[this_node] = this_mean;
-        std_for_kp[this_node] = this_std;
+    vecnode = *(these_vecnodes[r]);
+    map<string,vector<float> >& these_stats = stats_of_river[r];
 
-        if(segelev_diff[this_node] >= (n_std_dev * this_std))
-        {
-          kp_segdrop[this_node] = segelev_diff[this_node];
-        }
+    for(size_t it = 0; it< vecnode.size(); it++)
+    {
+      int this_node = vecnode[it];
+      float this_std = these_stats["std_dev"][it], this_mean = these_stats["mean"][it];
+      mean_for_kp[this_node] = this_mean;
+      std_for_kp[this_node] = this_std;
+
+      if(segelev_diff_data[node_sequence_index[this_node]] >= (n_std_dev * this_std))
+      {
+        kp_segdrop[this_node] = segelev_diff_data[node_sequence_index[this_node]];
       }
     }
   }
@@ -2261,8 +2427,8 @@ map<string,vector<float> > LSDChiTools::get_windowed_stats_for_knickpoints(vecto
   for(vector<int>::iterator it = vecnode.begin(); it != vecnode.end(); it ++)
   {
     int this_node = *it;
-    if(chi_data_map[this_node] != -9999){
-      vecval.push_back(segelev_diff[this_node]);
+    if(chi_data[node_sequence_index[this_node]] != -9999){
+      vecval.push_back(segelev_diff_data[node_sequence_index[this_node]]);
     }
   }
   // Vecval is now implemented with the values
@@ -2292,7 +2458,8 @@ map<string,vector<float> > LSDChiTools::get_windowed_stats_for_knickpoints(vecto
     else if (it < (vecnode.size()-HW))
     {
       vector<float> this_vecval;
-      for(size_t o = it; o < (it+window) ; o++ )
+      // the window is centred on this node
+      for(size_t o = it-HW; o < (it-HW+window) ; o++ )
       {
         this_vecval.push_back(vecval[o]);
       }
@@ -2345,21 +2512,21 @@ void LSDChiTools::raw_stepped_knickpoint_detection(int SK, vector<int> vecnode)
   // vector that will contain the nodes having a knickpoint
   vector<int> vecdif;
   // Bunch of floats
-  float this_TVD_b_chi = TVD_b_chi_map[this_node], last_TVD_b_chi = TVD_b_chi_map[last_node]; // Setting last and this segmented elevation change
+  float this_TVD_b_chi = TVD_b_chi_data[node_sequence_index[this_node]], last_TVD_b_chi = TVD_b_chi_data[node_sequence_index[last_node]]; // Setting last and this segmented elevation change
 
   // Looping through the nodes from the second one
   for( ; node != vecnode.end(); node++) // the first ";" is normal: it states that I have no initial conditions 
   {
     // initializing the variables for this run
     this_node = *node;
-    this_TVD_b_chi = TVD_b_chi_map[this_node];
+    this_TVD_b_chi = TVD_b_chi_data[node_sequence_index[this_node]];
    
     // if b_chi has change, Implementing a raw knickpoint and calculating the d|ksn|/dchi
-    if(this_TVD_b_chi != last_TVD_b_chi || TVD_m_chi_map[last_node] != TVD_m_chi_map[this_node])
+    if(this_TVD_b_chi != last_TVD_b_chi || TVD_m_chi_data[node_sequence_index[last_node]] != TVD_m_chi_data[node_sequence_index[this_node]])
     {
-      raw_delta_segelev_from_TVDb_chi[this_node] = segelev_diff[this_node]; 
+      raw_delta_segelev_from_TVDb_chi[this_node] = segelev_diff_data[node_sequence_index[this_node]]; 
       // testing something here
-      // float this_segdiff = (TVD_m_chi_map[last_node] * chi_data_map[last_node] + TVD_b_chi_map[last_node]) - (TVD_m_chi_map[this_node] * chi_data_map[this_node] + TVD_b_chi_map[this_node]);
+      // float this_segdiff = (TVD_m_chi_data[node_sequence_index[last_node]] * chi_data[node_sequence_index[last_node]] + TVD_b_chi_data[node_sequence_index[last_node]]) - (TVD_m_chi_data[node_sequence_index[this_node]] * chi_data[node_sequence_index[this_node]] + TVD_b_chi_data[node_sequence_index[this_node]]);
       // raw_delta_segelev_from_TVDb_chi[this_node] = this_segdiff;
       vecdif.push_back(this_node);
     }
@@ -2389,16 +2556,38 @@ void LSDChiTools::ksn_knickpoints_combining(LSDFlowInfo& Flowinfo, int kp_node_s
   // saaving an ID for each knickpoints
   id_kp = 0;
 
+  // Grouping the knickpoints of each river is independent of the other
+  // rivers, so it is done in parallel first. The global maps and the ids
+  // are then filled in source key order as before.
+  vector< vector<int>* > these_vecnode_kp;
+  vector< vector<int>* > these_vecnode_river;
   for(henri = map_node_source_key_kp.begin(); henri != map_node_source_key_kp.end(); henri ++)
+  {
+    these_vecnode_kp.push_back(&(henri->second));
+    these_vecnode_river.push_back(&(map_node_source_key[henri->first]));
+  }
+  int n_rivers = int(these_vecnode_kp.size());
+  vector< vector<vector<int> > > grouped_kp_of_river(n_rivers);
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int r = 0; r<n_rivers; r++)
+  {
+    if(these_vecnode_kp[r]->size()>0)
+    {
+      grouped_kp_of_river[r] = group_local_kp(*(these_vecnode_kp[r]),*(these_vecnode_river[r]),Flowinfo, kp_node_search);
+    }
+  }
+
+  int r = 0;
+  for(henri = map_node_source_key_kp.begin(); henri != map_node_source_key_kp.end(); henri ++, r++)
   {
     // Now looping through the node for each rivers
-    int this_SK = henri -> first;
     // Getting the vector of node per river AND vector of ksn knickpoints nodes per river
-    vector<int> vecnode_kp = henri->second, vecnode_river = map_node_source_key[this_SK];
+    vector<int>& vecnode_kp = henri->second;
+    vector<int>& vecnode_river = *(these_vecnode_river[r]);
     if(vecnode_kp.size()>0)
     {
-      // getting the groups of vector depending on your combination window
-      vector<vector<int> > grouped_kp = group_local_kp(vecnode_kp,vecnode_river,Flowinfo, kp_node_search);
+      // the groups of vector depending on your combination window
+      vector<vector<int> >& grouped_kp = grouped_kp_of_river[r];
 
       // We have the group of vector now lets run through it to get the requested values
       for(vector<vector<int> >::iterator vlad = grouped_kp.begin(); vlad != grouped_kp.end(); vlad ++)
@@ -2422,7 +2611,7 @@ void LSDChiTools::ksn_knickpoints_combining(LSDFlowInfo& Flowinfo, int kp_node_s
           // finally getting the ID of my kp and its location (It is not relevant in this case, but we need to implement the maps)
           ksn_kp_ID[this_node] = id_kp;
           nearest_node_centroid_kp[this_node] = this_node;
-          flow_distance_kp_centroid_map[this_node] = flow_distance_data_map[this_node];
+          flow_distance_kp_centroid_map[this_node] = flow_distance_data[node_sequence_index[this_node]];
           id_kp ++;
         }
 
@@ -2443,7 +2632,7 @@ void LSDChiTools::ksn_knickpoints_combining(LSDFlowInfo& Flowinfo, int kp_node_s
           // The neirest node from the centre of the knickpoint (in regards to chi distance)
           int nearnode = get_ksn_centroid_coordinates(Flowinfo, this_vecnode, vecnode_river,ksn_kp_map[this_node]); // get the weighted x and y of the centroid.
 
-          flow_distance_kp_centroid_map[this_node] = flow_distance_data_map[nearnode];
+          flow_distance_kp_centroid_map[this_node] = flow_distance_data[node_sequence_index[nearnode]];
           // getting the Flow dist at the weighted distance
           float this_x = 0,this_y = 0;
           Flowinfo.get_x_and_y_from_current_node(nearnode, this_x, this_y);
@@ -2502,7 +2691,7 @@ float LSDChiTools::get_kp_sharpness_length(vector<int> vecnode, LSDFlowInfo& Flo
   for(vector<int>::iterator gog = vecnode.begin(); gog!= vecnode.end(); gog++)
   {
     int this_node = *gog;
-    total_distance += abs(flow_distance_data_map[last_node] - flow_distance_data_map[this_node]);
+    total_distance += abs(flow_distance_data[node_sequence_index[last_node]] - flow_distance_data[node_sequence_index[this_node]]);
   }
 
   return total_distance;
@@ -2519,6 +2708,11 @@ int LSDChiTools::get_ksn_centroid_coordinates(LSDFlowInfo& Flowinfo, vector<int>
   pair<float,float> out_pair; // x,y coordinates
 
   vector<int> this_vecnode_river = get_vecnode_river_from_extent(vecnode[0], vecnode.back(), vecnode_river);
+  // the grouped knickpoints are not on this stretch of river
+  if(this_vecnode_river.empty())
+  {
+    return vecnode[0];
+  }
 
   // first, let's get the chi, the dksn and the weighted distance of each nodes
   vector<float> chi_vec , dksn_vec;
@@ -2526,7 +2720,7 @@ int LSDChiTools::get_ksn_centroid_coordinates(LSDFlowInfo& Flowinfo, vector<int>
   // looping through each nodes to group, and getting the info in the same order that the original vector of nodes
   for(size_t iter = 0; iter < this_vecnode_river.size(); iter++)
   {
-    chi_vec.push_back(chi_data_map[this_vecnode_river[iter]]);
+    chi_vec.push_back(chi_data[node_sequence_index[this_vecnode_river[iter]]]);
     if (raw_ksn_kp_map.count(this_vecnode_river[iter]) != 0)
     {
       dksn_vec.push_back(abs(raw_ksn_kp_map[this_vecnode_river[iter]])); // I am using the raw map, that host the values before combining
@@ -2557,12 +2751,12 @@ int LSDChiTools::get_ksn_centroid_coordinates(LSDFlowInfo& Flowinfo, vector<int>
 
   // then looping from bottom to top of nodes to get the boundary nodes of this last
   bool found_it = false;
-  int ninf = 0, nsup = 0, this_node = 0, last_node = 0 ;
-  for(vector<int>::iterator hibou = this_vecnode_river.begin(); found_it == false; hibou ++)
+  int ninf = this_vecnode_river[0], nsup = this_vecnode_river[0], this_node = 0, last_node = this_vecnode_river[0];
+  for(vector<int>::iterator hibou = this_vecnode_river.begin(); found_it == false && hibou != this_vecnode_river.end(); hibou ++)
   {
     this_node = *hibou;
     // cout << this_node << " || " << this_vecnode_river.back() << endl ;
-    if((chi_data_map[this_node] > chi_center )|| ( this_node == this_vecnode_river.back()))
+    if((chi_data[node_sequence_index[this_node]] > chi_center )|| ( this_node == this_vecnode_river.back()))
     {
       found_it = true;
       ninf = last_node;
@@ -2574,8 +2768,8 @@ int LSDChiTools::get_ksn_centroid_coordinates(LSDFlowInfo& Flowinfo, vector<int>
   // now getting the distance between nodes
   int centre_node = 0;
 
-  float up_chi_diff = abs(chi_data_map[nsup] - chi_center);
-  float down_chi_diff = abs(chi_data_map[ninf] - chi_center);
+  float up_chi_diff = abs(chi_data[node_sequence_index[nsup]] - chi_center);
+  float down_chi_diff = abs(chi_data[node_sequence_index[ninf]] - chi_center);
 
   if(up_chi_diff<=down_chi_diff)
   {
@@ -2595,8 +2789,8 @@ vector<int> LSDChiTools::get_vecnode_river_from_extent(int first_node, int last_
 {
 
   // first_node is bottom node and last node is the upper node inb term of elevation
-        // cout << endl << elev_data_map[vecnode_river[0]] << " || " << elev_data_map[vecnode_river.back()] << endl;
-        // cout <<  elev_data_map[first_node] << " || " << elev_data_map[last_node] << endl;
+        // cout << endl << elev_data[node_sequence_index[vecnode_river[0]]] << " || " << elev_data[node_sequence_index[vecnode_river.back()]] << endl;
+        // cout <<  elev_data[node_sequence_index[first_node]] << " || " << elev_data[node_sequence_index[last_node]] << endl;
 
 
         // exit(EXIT_FAILURE);
@@ -2663,7 +2857,7 @@ void LSDChiTools::stepped_knickpoints_combining(LSDFlowInfo& Flowinfo, int kp_no
           stepped_centroid[this_node] = make_pair(this_x,this_y);
           
           nearest_node_centroid_kp_stepped[this_node] = this_node;
-          flow_distance_stepped_kp_centroid_map[this_node] = flow_distance_data_map[this_node];
+          flow_distance_stepped_kp_centroid_map[this_node] = flow_distance_data[node_sequence_index[this_node]];
         }
         else if(this_vecnode.size() > 1)
         {
@@ -2685,7 +2879,7 @@ void LSDChiTools::stepped_knickpoints_combining(LSDFlowInfo& Flowinfo, int kp_no
           // TO SORT, NOT ADAPTED TO THAT  -> TODO NEXT WEEK BORIS
           int nearnode = get_ksn_centroid_coordinates(Flowinfo, this_vecnode, vecnode_river,kp_segdrop[this_node]); // get the weighted x and y of the centroid.
 
-          flow_distance_stepped_kp_centroid_map[this_node] = flow_distance_data_map[nearnode];
+          flow_distance_stepped_kp_centroid_map[this_node] = flow_distance_data[node_sequence_index[nearnode]];
           // getting the 
           float this_x = 0,this_y = 0;
           Flowinfo.get_x_and_y_from_current_node(nearnode, this_x, this_y);
@@ -2788,21 +2982,18 @@ vector<vector<int> > LSDChiTools::group_local_kp(vector<int> vecnode_kp, vector<
   int HW = kp_node_search;
   // cout << "DEBUG_1" << endl;
   // getting the index of each knickpoint in the node vector
+  // The knickpoints are stored in river order, so the search for each one
+  // carries on from where the previous one was found.
   size_t iced_t =0;
+  size_t yh = 0;
   vector<int> corresponding_index;
   for(; iced_t < vecnode_kp.size(); iced_t++)
   {
-    int idx =0;
-    bool found_it = false;
-    for (size_t yh =0; found_it == false; yh++)
+    while(vecnode_river[yh] != vecnode_kp[iced_t])
     {
-      if(vecnode_kp[iced_t] == vecnode_river[yh])
-      {
-        idx = yh; // corresponding index
-        found_it = true;
-      }
+      yh++;
     }
-    corresponding_index.push_back(idx);
+    corresponding_index.push_back(int(yh));
   }
 
 
@@ -2854,7 +3045,8 @@ vector<vector<int> > LSDChiTools::group_local_kp(vector<int> vecnode_kp, vector<
       {
         // cout << n_node_to_next[it] << endl;
         // cout << "DEBUG_4" << endl;
-        float this_kp = raw_ksn_kp_map[vecnode_river[this_idx]], next_kp = raw_ksn_kp_map[vecnode_river[this_idx+n_node_to_next[it]]] ;
+        // both nodes are knickpoints so they are already in the map; find() keeps this read only
+        float this_kp = raw_ksn_kp_map.find(vecnode_river[this_idx])->second, next_kp = raw_ksn_kp_map.find(vecnode_river[this_idx+n_node_to_next[it]])->second ;
         // cout << "DEBUG_5" << endl;
         // Check if they are both the same polarity
         // cout << this_idx << " || " << n_node_to_next[it] << " || " << vecnode_river.size()-1 << endl;
@@ -2900,73 +3092,81 @@ vector<vector<int> > LSDChiTools::group_local_kp(vector<int> vecnode_kp, vector<
 
 void  LSDChiTools::TVD_on_my_ksn( float lambda, float lambda_TVD_b_chi)
 {
-  // Set the variables
+  if(lambda == 0 || lambda_TVD_b_chi == 0)
+  {
+    cout << "Lambda = 0, TVD will only be a minimization by the sum of squares" << endl ;
+  }
+
+  // Gather the rivers long enough to be denoised. Each source key owns its
+  // own run of nodes so the rivers can be denoised independently.
+  vector< vector<int>* > rivers;
   map<int,vector<int> >::iterator chirac;
-  vector<int> this_vec;
-  // int max_node = 500;
-  // Looping through the source key and getting the associated vector of river nodes
   for(chirac = map_node_source_key.begin(); chirac != map_node_source_key.end() ; chirac ++)
   {
-    // int this_SK = chirac->first; // we don't need it, but maybe at some points
-    this_vec = chirac->second; // the vector of node
-    vector<float> gros_test; // Debugging purposes
-    // this next function Apply the TVD on the vector. It directly save the results in a global map and return general informations for debugging
-    if(this_vec.size()>20){
-      gros_test = TVD_this_vec(this_vec, lambda, lambda_TVD_b_chi);
+    if(chirac->second.size()>20)
+    {
+      rivers.push_back(&(chirac->second));
     }
+  }
+  int n_rivers = int(rivers.size());
 
-
-    // I am planning a test -> TO KEEP it would be an improvment of the denoising
-    // if(int(this_vec.size()) <= max_node)
-    // {
-    
-    //   gros_test = TVD_this_vec(this_vec, lambda, lambda_TVD_b_chi);
-
-    // }
-    // else
-    // {
-    //   //testing here a TVD improvement 
-    //   int n_nodes_processed = 0, threshold_node_to_end = this_vec.size()-int(0.4*max_node);
-    //   vector<float> intermediate_values;
-    //   // Setting the first vector and the last one
-    //   vector<int>::const_iterator first = this_vec.begin() + max_node, last = this_vec.end() - max_node, begin = this_vec.begin(),ending = this_vec.end();
-      
-    //   vector<int> first_vec(begin, first), last_vec(last,ending);
-
-
-    //   // processing to a first TVD
-    //   while(n_nodes_processed<this_vec.size())
-    //   {
-    //     if(n_nodes_processed == 0)
-    //     {
-    //       TVD_this_vec_v2(first_vec, lambda, lambda_TVD_b_chi, max_node, "begin");
-    //     }
-    //     else if(n_nodes_processed < (threshold_node_to_end))
-    //     {
-    //       int slider = (n_nodes_processed - int(( 0.2 * n_nodes_processed)));
-    //       vector<int>::const_iterator beg = this_vec.begin() + slider;
-    //       slider += max_node ;
-    //       vector<int>::const_iterator  end = this_vec.begin() + slider;
-    //       vector<int> interm_vec(beg,end);
-    //       TVD_this_vec_v2(interm_vec, lambda, lambda_TVD_b_chi, max_node, "middle");
-    //     }
-    //     else if(n_nodes_processed >= (threshold_node_to_end))
-    //     {
-    //       TVD_this_vec_v2(last_vec, lambda, lambda_TVD_b_chi, max_node, "end");
-
-    //     }
-    //     else
-    //     {
-    //       cout << "Something went wrong during the TVD segmentation, I am aborting. Contact Boris if this happens to you twice on a row" << endl;
-    //       exit(EXIT_FAILURE);
-    //     }
-
-    //     n_nodes_processed += 0.6 * max_node;
-
-    //   }
-    // }
+  // the TVD is linear in the number of nodes so the rivers are handed out
+  // dynamically: a few long trunks and many short tributaries
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int r = 0; r<n_rivers; r++)
+  {
+    TVD_this_vec(*(rivers[r]), lambda, lambda_TVD_b_chi);
   }
 
+  // I am planning a test -> TO KEEP it would be an improvment of the denoising
+  // if(int(this_vec.size()) <= max_node)
+  // {
+  
+  //   gros_test = TVD_this_vec(this_vec, lambda, lambda_TVD_b_chi);
+
+  // }
+  // else
+  // {
+  //   //testing here a TVD improvement 
+  //   int n_nodes_processed = 0, threshold_node_to_end = this_vec.size()-int(0.4*max_node);
+  //   vector<float> intermediate_values;
+  //   // Setting the first vector and the last one
+  //   vector<int>::const_iterator first = this_vec.begin() + max_node, last = this_vec.end() - max_node, begin = this_vec.begin(),ending = this_vec.end();
+    
+  //   vector<int> first_vec(begin, first), last_vec(last,ending);
+
+
+  //   // processing to a first TVD
+  //   while(n_nodes_processed<this_vec.size())
+  //   {
+  //     if(n_nodes_processed == 0)
+  //     {
+  //       TVD_this_vec_v2(first_vec, lambda, lambda_TVD_b_chi, max_node, "begin");
+  //     }
+  //     else if(n_nodes_processed < (threshold_node_to_end))
+  //     {
+  //       int slider = (n_nodes_processed - int(( 0.2 * n_nodes_processed)));
+  //       vector<int>::const_iterator beg = this_vec.begin() + slider;
+  //       slider += max_node ;
+  //       vector<int>::const_iterator  end = this_vec.begin() + slider;
+  //       vector<int> interm_vec(beg,end);
+  //       TVD_this_vec_v2(interm_vec, lambda, lambda_TVD_b_chi, max_node, "middle");
+  //     }
+  //     else if(n_nodes_processed >= (threshold_node_to_end))
+  //     {
+  //       TVD_this_vec_v2(last_vec, lambda, lambda_TVD_b_chi, max_node, "end");
+
+  //     }
+  //     else
+  //     {
+  //       cout << "Something went wrong during the TVD segmentation, I am aborting. Contact Boris if this happens to you twice on a row" << endl;
+  //       exit(EXIT_FAILURE);
+  //     }
+
+  //     n_nodes_processed += 0.6 * max_node;
+
+  //   }
+  // }
 }
 
 
@@ -2978,40 +3178,48 @@ void  LSDChiTools::TVD_on_my_ksn( float lambda, float lambda_TVD_b_chi)
 vector<float>  LSDChiTools::TVD_this_vec(vector<int> this_vec, float lambda, float lambda_TVD_b_chi)
 {
 
-  // Creating the containers I will need for the denoising
+  // Creating the containers I will need for the denoising. Each signal is a
+  // contiguous array in river order.
   vector<double> this_val_mchi, this_val_bchi, this_val_segelev; //TVD_segelev_diff
-  // this iterator will iterate through the vector of node you want to denoise
-  vector<int>::iterator chirac = this_vec.begin();
+  // the positions in node_sequence of the nodes that went into the signals
+  vector<int> these_positions;
+  int n_river_nodes = int(this_vec.size());
+  this_val_mchi.reserve(n_river_nodes);
+  this_val_bchi.reserve(n_river_nodes);
+  this_val_segelev.reserve(n_river_nodes);
+  these_positions.reserve(n_river_nodes);
 
   // Loop through the data to gather the vector we want to TVD
-  for( ; chirac != this_vec.end() ; chirac++)
+  for(int i = 0; i<n_river_nodes; i++)
   {
-    int this_node = *chirac;
-    if(chi_data_map[this_node] != -9999){ //  Checking if there are no data
+    int this_pos = node_sequence_index[this_vec[i]];
+    if(chi_data[this_pos] != -9999){ //  Checking if there are no data
 
-
-      this_val_mchi.push_back((double)M_chi_data_map[this_node]);
-      this_val_bchi.push_back((double)b_chi_data_map[this_node]);
-      this_val_segelev.push_back((double)segelev_diff[this_node]);
+      this_val_mchi.push_back((double)M_chi_data[this_pos]);
+      this_val_bchi.push_back((double)b_chi_data[this_pos]);
+      this_val_segelev.push_back((double)segelev_diff_data[this_pos]);
+      these_positions.push_back(this_pos);
       // NOTE: We recast everythin to double, floating points somehow generate bugs, in rare cases.
     }
-
-
   }
 
-  // Calling the actual denoising coded in Stat tools
+  // Calling the actual denoising coded in Stat tools. The three signals share the workspace.
   double clambda = lambda, dlamda = lambda_TVD_b_chi;
-  vector<double> this_val_mchi_TVDed = TV1D_denoise_v2(this_val_mchi, clambda);
-  vector<double> this_val_bchi_TVDed = TV1D_denoise_v2(this_val_bchi, dlamda);
-  vector<double> this_val_segelev_TVDed = TV1D_denoise_v2(this_val_segelev, 5);
+  vector<double> this_val_mchi_TVDed, this_val_bchi_TVDed, this_val_segelev_TVDed;
+  vector<unsigned int> indstart_low, indstart_up;
+  TV1D_denoise_v2(this_val_mchi, this_val_mchi_TVDed, clambda, indstart_low, indstart_up);
+  TV1D_denoise_v2(this_val_bchi, this_val_bchi_TVDed, dlamda, indstart_low, indstart_up);
+  TV1D_denoise_v2(this_val_segelev, this_val_segelev_TVDed, 5, indstart_low, indstart_up);
 
-  // Our data is Denoised, yaaaay. Let's implement the global map to save it.
-  for(size_t plo = 0; plo < this_vec.size() ; plo++ )
+  // Our data is Denoised, yaaaay. Let's put it back where it came from.
+  // Only the nodes with data went into the signals so only they are updated.
+  int n_denoised = int(these_positions.size());
+  for(int plo = 0; plo < n_denoised ; plo++ )
   {
-    int this_node = this_vec[plo];
-    TVD_m_chi_map[this_node] = (float)this_val_mchi_TVDed[plo];
-    TVD_b_chi_map[this_node] = (float)this_val_bchi_TVDed[plo];
-    TVD_segelev_diff[this_node] = (float)this_val_segelev_TVDed[plo];
+    int this_pos = these_positions[plo];
+    TVD_m_chi_data[this_pos] = (float)this_val_mchi_TVDed[plo];
+    TVD_b_chi_data[this_pos] = (float)this_val_bchi_TVDed[plo];
+    TVD_segelev_diff_data[this_pos] = (float)this_val_segelev_TVDed[plo];
   }
 
   // Formatting a debugging vector that I sometime use. Ignore that.
@@ -3032,10 +3240,10 @@ void  LSDChiTools::TVD_this_vec_v2(vector<int> this_vec, float lambda, float lam
   for( ; chirac != this_vec.end() ; chirac++)
   {
     int this_node = *chirac;
-    if(chi_data_map[this_node] != -9999){
-      this_val_mchi.push_back((double)M_chi_data_map[this_node]);
-      this_val_bchi.push_back((double)b_chi_data_map[this_node]);
-      this_val_segelev.push_back((double)segelev_diff[this_node]);
+    if(chi_data[node_sequence_index[this_node]] != -9999){
+      this_val_mchi.push_back((double)M_chi_data[node_sequence_index[this_node]]);
+      this_val_bchi.push_back((double)b_chi_data[node_sequence_index[this_node]]);
+      this_val_segelev.push_back((double)segelev_diff_data[node_sequence_index[this_node]]);
     }
 
   }
@@ -3079,9 +3287,9 @@ void  LSDChiTools::TVD_this_vec_v2(vector<int> this_vec, float lambda, float lam
   {
     // to switch to intermediate after test
     int this_node = *plo;
-    TVD_m_chi_map[this_node] = (float)this_val_mchi_TVDed[beginning_index];
-    TVD_b_chi_map[this_node] = (float)this_val_bchi_TVDed[beginning_index];
-    TVD_segelev_diff[this_node] = (float)this_val_segelev_TVDed[beginning_index];
+    TVD_m_chi_data[node_sequence_index[this_node]] = (float)this_val_mchi_TVDed[beginning_index];
+    TVD_b_chi_data[node_sequence_index[this_node]] = (float)this_val_bchi_TVDed[beginning_index];
+    TVD_segelev_diff_data[node_sequence_index[this_node]] = (float)this_val_segelev_TVDed[beginning_index];
 
     // TVD_m_chi_map_non_corrected[this_node] = (float)this_val_TVDed[plo];
   }
@@ -3168,7 +3376,7 @@ void LSDChiTools::lump_this_vec(vector<int> this_vec, int n_nodlump)
   for(tnode = this_vec.begin(); tnode != this_vec.end() ; tnode ++)
   {
     this_node = *tnode;
-    this_val.push_back(M_chi_data_map[this_node]);
+    this_val.push_back(M_chi_data[node_sequence_index[this_node]]);
   }
 
   
@@ -3199,7 +3407,7 @@ void LSDChiTools::lump_this_vec(vector<int> this_vec, int n_nodlump)
 
     }
 
-    lumped_m_chi_map[this_node] = this_mean;
+    lumped_m_chi_data[node_sequence_index[this_node]] = this_mean;
   }
 
 
@@ -3233,13 +3441,13 @@ void LSDChiTools::derive_the_segmented_elevation()
         {
           // i derive if this is not the last node
           this_node = *nonode;
-          segelev_diff[this_node] = (segmented_elevation_map[last_node] - segmented_elevation_map[this_node]); // ---> to had if we derive it to chi (chi_data_map[last_node] - chi_data_map[this_node]); 
+          segelev_diff_data[node_sequence_index[this_node]] = (segmented_elevation_data[node_sequence_index[last_node]] - segmented_elevation_data[node_sequence_index[this_node]]); // ---> to had if we derive it to chi (chi_data[node_sequence_index[last_node]] - chi_data[node_sequence_index[this_node]]); 
           segelev_diff_second[this_node] = segelev_diff_second[last_node] - segelev_diff_second[this_node];
         }
         else
         {
           // the first derivative is 0
-          segelev_diff[this_node] = 0;
+          segelev_diff_data[node_sequence_index[this_node]] = 0;
           segelev_diff_second[this_node] = 0;
           
 
@@ -3264,17 +3472,37 @@ void LSDChiTools::ksn_kp_KDE()
   // first setting the main iterator
   map<int,vector<int> >::iterator jacques;
 
-  // function variables
-  int this_SK = 0;
-  vector<int> vecnode;
-
+  // gathering the values of each river
+  vector<int> these_SK;
+  vector< vector<int> > these_vecnodes;
+  vector< vector<float> > these_values;
   for(jacques = map_node_source_key_kp.begin(); jacques != map_node_source_key_kp.end(); jacques++)
   {
-    this_SK = jacques->first;
-    vecnode = jacques->second;
-    if(vecnode.size()>0)
-     {KDE_vec_node_mchi(vecnode,this_SK);}
+    if(jacques->second.size()>0)
+    {
+      these_SK.push_back(jacques->first);
+      these_vecnodes.push_back(jacques->second);
+      these_values.push_back(get_value_from_map_and_node(jacques->second,raw_dksndchi_kp_map));
+    }
+  }
+  int n_rivers = int(these_SK.size());
+
+  // the binned KDE of each river is independent of the others
+  vector< pair<float,vector<float> > > these_KDE(n_rivers);
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int r = 0; r<n_rivers; r++)
+  {
+    these_KDE[r] = binned_auto_KDE(these_values[r]);
+  }
 
+  for(int r = 0; r<n_rivers; r++)
+  {
+    KDE_bandwidth_per_source_key[these_SK[r]] = these_KDE[r].first;
+    vector<float>& veKDE = these_KDE[r].second;
+    for(size_t uip = 0; uip < veKDE.size(); uip++)
+    {
+      raw_KDE_kp_map[these_vecnodes[r][uip]] = veKDE[uip];
+    }
   }
 
 }
@@ -3282,37 +3510,27 @@ void LSDChiTools::ksn_kp_KDE()
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Calculate the KDE using the mchi value corresponding to a vector of node index
+// The density is binned (see binned_auto_KDE in LSDStatsTools) so this is
+// linear in the number of nodes
 // BG
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 void LSDChiTools::KDE_vec_node_mchi(vector<int> vecnode, int SK)
 {
-  // setting the iterator
-  vector<int>::iterator valachie = vecnode.begin();
-
   // first getting the corresponding vector of values
-  vector<float> veksn, veKDE;
-  int this_node = 0;
-  for(;valachie != vecnode.end(); valachie++)
-  {
-    this_node = *valachie;
-    veksn.push_back(raw_dksndchi_kp_map[this_node]);
-  }
+  vector<float> veksn = get_value_from_map_and_node(vecnode,raw_dksndchi_kp_map), veKDE;
 
   // now getting the KDE corresponding vector
-  pair<float,vector<float> > pagul = auto_KDE(veksn);
+  pair<float,vector<float> > pagul = binned_auto_KDE(veksn);
 
   // incrementing the bandwidth map
   KDE_bandwidth_per_source_key[SK] = pagul.first;
 
   // dealing with retrieving the KDE per nodes
   veKDE = pagul.second;
-  float this_KDE = 0;
   for(size_t uip = 0; uip < veKDE.size(); uip++)
   {
-    this_node = vecnode[uip];
-    this_KDE = veKDE[uip];
-    raw_KDE_kp_map[this_node] = this_KDE;
+    raw_KDE_kp_map[vecnode[uip]] = veKDE[uip];
   }
 
 }
@@ -3390,7 +3608,7 @@ void LSDChiTools::print_bandwidth_ksn_knickpoint(string filename)
   {
     this_source_key = OL->first;
     this_node = OL->second[0];
-    this_basin_key = baselevel_keys_map[this_node];
+    this_basin_key = baselevel_keys_data[node_sequence_index[this_node]];
     this_bandwidth = KDE_bandwidth_per_source_key[this_source_key];
     file_out << this_source_key << ","
              << this_basin_key << ","
@@ -3438,6 +3656,7 @@ void LSDChiTools::print_raw_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filenam
     for (iter = raw_ksn_kp_map.begin(); iter != raw_ksn_kp_map.end(); iter++)
     {
         this_node = iter->first;
+        int this_index = node_sequence_index[this_node];
         this_kp = iter->second;
         FlowInfo.retrieve_current_row_and_col(this_node,row,col);
         get_lat_and_long_locations(row, col, latitude, longitude, Converter);
@@ -3448,16 +3667,16 @@ void LSDChiTools::print_raw_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filenam
         chi_data_out << latitude << ","
                      << longitude << ",";
         chi_data_out.precision(5);
-        chi_data_out << elev_data_map[this_node] << ","
-                     << flow_distance_data_map[this_node] << ","
-                     << chi_data_map[this_node] << ","
-                     << drainage_area_data_map[this_node] << ","
+        chi_data_out << elev_data[this_index] << ","
+                     << flow_distance_data[this_index] << ","
+                     << chi_data[this_index] << ","
+                     << drainage_area_data[this_index] << ","
                      << this_kp << ","
                      << raw_dksndchi_kp_map[this_node] << ","
                      << raw_KDE_kp_map[this_node] << ","
-                     << baselevel_keys_map[this_node]<< ","
+                     << baselevel_keys_data[this_index]<< ","
                      << map_outlier_MZS_dksndchi[this_node] << ","
-                     << source_keys_map[this_node];
+                     << source_keys_data[this_index];
 
         chi_data_out << endl;
     }
@@ -3503,8 +3722,10 @@ void LSDChiTools::print_final_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filen
     for (iter = ksn_kp_map.begin(); iter != ksn_kp_map.end(); iter++)
     {
         this_node = iter->first;
+        int this_index = node_sequence_index[this_node];
         this_kp = iter->second;
         int nearnode = nearest_node_centroid_kp[this_node];
+        int near_index = node_sequence_index[nearnode];
         // int nearnode_stepped = nearest_node_centroid_kp_stepped[this_node];    // not used (SMM)
         float this_segelev = 0;
 
@@ -3533,17 +3754,17 @@ void LSDChiTools::print_final_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filen
                      << longitude << ",";
         chi_data_out.precision(5);
         // NOTE: The IDENTIFYING NODE on the knickpoint map is the first of a knickpoint group - On the global map it provide the nearest node to get the coordinates of the centroid
-        chi_data_out << elev_data_map[nearnode] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
-                     << flow_distance_data_map[nearnode] << ","
-                     << chi_data_map[nearnode] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
-                     << drainage_area_data_map[nearnode] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+        chi_data_out << elev_data[near_index] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+                     << flow_distance_data[near_index] << ","
+                     << chi_data[near_index] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+                     << drainage_area_data[near_index] << "," // NOTE -> nearnode is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
                      << this_kp << ","
                      << this_segelev << ","
                      << sharpness_ksn_length[this_node] << ","
                      << this_sign << ","
                      << map_outlier_MZS_combined[this_node] << ","
-                     << baselevel_keys_map[this_node]<< ","
-                     << source_keys_map[this_node];
+                     << baselevel_keys_data[this_index]<< ","
+                     << source_keys_data[this_index];
 
         chi_data_out << endl;
     }
@@ -3554,20 +3775,21 @@ void LSDChiTools::print_final_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filen
     for (iter = kp_segdrop.begin(); iter != kp_segdrop.end(); iter++)
     {
         this_node = iter->first;
+        int this_index = node_sequence_index[this_node];
         float this_segelev = iter->second;
         // int nearnode = nearest_node_centroid_kp_stepped[this_node];
         float this_kp = 0; // All the ksn knickpoints have been written, these one only have a segelev component
 
-        // if(chi_data_map[this_node] == 0)
+        // if(chi_data[this_index] == 0)
         // {
         //   cout << "This node is screwed" <<endl;
         // }
-        // if(chi_data_map[nearnode] == 0)
+        // if(chi_data[node_sequence_index[nearnode]] == 0)
         // {
         //   cout << "nearnode is screwed" <<endl ;
         // }
 
-        if(is_done.count(this_node) != 1 && chi_data_map[this_node] != 0)
+        if(is_done.count(this_node) != 1 && chi_data[this_index] != 0)
         {
           // cout << "Tbg 45b" << endl;
           // get the centroid location
@@ -3588,17 +3810,17 @@ void LSDChiTools::print_final_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filen
                        << longitude << ",";
           chi_data_out.precision(5);
           // NOTE: The IDENTIFYING NODE on the knickpoint map is the first of a knickpoint group - On the global map it provide the nearest node to get the coordinates of the centroid
-          chi_data_out << elev_data_map[this_node] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
-                       << flow_distance_data_map[this_node] << ","
-                       << chi_data_map[this_node] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
-                       << drainage_area_data_map[this_node] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+          chi_data_out << elev_data[this_index] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+                       << flow_distance_data[this_index] << ","
+                       << chi_data[this_index] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
+                       << drainage_area_data[this_index] << "," // NOTE -> this_node is the centroid node, however the knickpoint info are stored in this node. I am still working on the centroidisation of the node
                        << this_kp << ","
                        << this_segelev << ","
                        << sharpness_ksn_length[this_node] << ","
                        << this_sign << ","
                        << map_outlier_MZS_combined[this_node] << ","
-                       << baselevel_keys_map[this_node]<< ","
-                       << source_keys_map[this_node];
+                       << baselevel_keys_data[this_index]<< ","
+                       << source_keys_data[this_index];
 
           chi_data_out << endl;
         }
@@ -3682,11 +3904,11 @@ void LSDChiTools::print_mchisegmented_knickpoint_version(LSDFlowInfo& FlowInfo,
           ksnkp = -1;
         }
 
-        if(segelev_diff[this_node]>0)
+        if(segelev_diff_data[n]>0)
         {
           segelevkp = 1;
         }
-        if(segelev_diff[this_node]>0)
+        if(segelev_diff_data[n]>0)
         {
           segelevkp = -1;
         }
@@ -3703,27 +3925,27 @@ void LSDChiTools::print_mchisegmented_knickpoint_version(LSDFlowInfo& FlowInfo,
       chi_data_out << latitude << ","
                    << longitude << ",";
       chi_data_out.precision(5);
-      chi_data_out << chi_data_map[this_node] << ","
-                   << elev_data_map[this_node] << ","
-                   << flow_distance_data_map[this_node] << ","
-                   << drainage_area_data_map[this_node] << ","
-                   << M_chi_data_map[this_node] << ","
-                   << lumped_m_chi_map[this_node] << ","
-                   << TVD_m_chi_map[this_node] << ","
-                   << TVD_segelev_diff[this_node] << ","
-                   << b_chi_data_map[this_node] << ","
-                   << TVD_b_chi_map[this_node] << ","
+      chi_data_out << chi_data[n] << ","
+                   << elev_data[n] << ","
+                   << flow_distance_data[n] << ","
+                   << drainage_area_data[n] << ","
+                   << M_chi_data[n] << ","
+                   << lumped_m_chi_data[n] << ","
+                   << TVD_m_chi_data[n] << ","
+                   << TVD_segelev_diff_data[n] << ","
+                   << b_chi_data[n] << ","
+                   << TVD_b_chi_data[n] << ","
                    << ksnkp << ","
                    << segelevkp << ","                  
-                   << source_keys_map[this_node] << ","
-                   << baselevel_keys_map[this_node];
+                   << source_keys_data[n] << ","
+                   << baselevel_keys_data[n];
 
       if(have_segmented_elevation)
       {
-        chi_data_out << "," << segmented_elevation_map[this_node];
+        chi_data_out << "," << segmented_elevation_data[n];
         chi_data_out << "," << mean_for_kp[this_node];
         chi_data_out << "," << std_for_kp[this_node];
-        chi_data_out << "," << segelev_diff[this_node];
+        chi_data_out << "," << segelev_diff_data[n];
 
 
       }
@@ -3745,7 +3967,7 @@ void LSDChiTools::set_map_of_source_and_node(LSDFlowInfo& FlowInfo, int n_node_d
 {
   // find the number of nodes
   // setting the initilal condition
-  int n_nodes = (node_sequence.size()), last_SK = source_keys_map[node_sequence[0]], this_SK = source_keys_map[node_sequence[0]], this_node = node_sequence[0], temp_receiver_node = 0, last_node = 0;
+  int n_nodes = (node_sequence.size()), last_SK = source_keys_data[0], this_SK = source_keys_data[0], this_node = node_sequence[0], temp_receiver_node = 0, last_node = 0;
   if (n_nodes <= 0)
   {
     cout << "Cannot calculate segments since you have not calculated channel properties yet." << endl;
@@ -3762,7 +3984,7 @@ void LSDChiTools::set_map_of_source_and_node(LSDFlowInfo& FlowInfo, int n_node_d
     {
       // getting each nodes information
       this_node = node_sequence[n];
-      this_SK = source_keys_map[this_node];
+      this_SK = source_keys_data[n];
       if(this_SK == last_SK)
       {
         // If the source key is the same than the previous one ---> incrementing the vector of node for each river
@@ -3815,8 +4037,8 @@ void LSDChiTools::compute_basic_matrics_per_source_keys(LSDFlowInfo& FlowInfo)
   {
     this_SK = valachie->first;
     vecval = valachie->second;
-    chi_dist = abs(chi_data_map[vecval[0]] - chi_data_map[vecval.back()]);
-    dist = abs(flow_distance_data_map[vecval[0]] - flow_distance_data_map[vecval.back()]);
+    chi_dist = abs(chi_data[node_sequence_index[vecval[0]]] - chi_data[node_sequence_index[vecval.back()]]);
+    dist = abs(flow_distance_data[node_sequence_index[vecval[0]]] - flow_distance_data[node_sequence_index[vecval.back()]]);
     map_flow_length_source_key[this_SK] = dist;
     map_chi_length_source_key[this_SK] = chi_dist;
   }
@@ -3877,13 +4099,13 @@ void LSDChiTools::ksn_knickpoint_detection(LSDFlowInfo& FlowInfo)
     set_map_of_source_and_node(FlowInfo, 20);
     for (int n = 0; n< n_nodes; n++)
     {
-      if(elev_data_map[node_sequence[n]] > max_elev)
+      if(elev_data[n] > max_elev)
       {
-        max_elev = elev_data_map[node_sequence[n]];
+        max_elev = elev_data[n];
       }
-      if(chi_data_map[node_sequence[n]] > max_chi)
+      if(chi_data[n] > max_chi)
       {
-        max_chi = chi_data_map[node_sequence[n]];
+        max_chi = chi_data[n];
       }
     }
 
@@ -3897,7 +4119,7 @@ void LSDChiTools::ksn_knickpoint_detection(LSDFlowInfo& FlowInfo)
 
     // Initializing the first node
     this_node = node_sequence[0];
-    last_M_chi =  M_chi_data_map[this_node];
+    last_M_chi =  M_chi_data[0];
 
     // Engaging the loop through the rivers nodes
     for (int n = 0; n< n_nodes; n++)
@@ -3908,18 +4130,18 @@ void LSDChiTools::ksn_knickpoint_detection(LSDFlowInfo& FlowInfo)
 
 
       // Get the M_chi from the current node
-      this_M_chi = M_chi_data_map[this_node];
-      last_M_chi = M_chi_data_map[last_node];
+      this_M_chi = M_chi_data[n];
+      last_M_chi = M_chi_data[node_sequence_index[last_node]];
 
       // recasting if negative M_Chi. These negative values are artifact for really flat segments, recasting it to 0 is then inconsequential
       if(this_M_chi < 0 && n>0){this_M_chi = 0;} // getting rid of the negative values because we don't want it, I don't want the n = 0 to avoid detecting fake knickpoint if the first value is actually negative
 
       // If the M_chi has changed I increment the knickpoints, I also check if the two point are on the same channel to avoid stange unrelated knickpoints
-      if (this_M_chi != last_M_chi && source_keys_map[this_node] == source_keys_map[last_node])
+      if (this_M_chi != last_M_chi && source_keys_data[n] == source_keys_data[node_sequence_index[last_node]])
       {
         // If this condition is satisfied, we change segment and the knickpoint will be saved
         // -> first thing to do is to save the node into the map of knickpoint per river
-        this_node_kp_per_source_key[source_keys_map[this_node]].push_back(this_node);
+        this_node_kp_per_source_key[source_keys_data[n]].push_back(this_node);
        
 
         // Calculation of the arctan of the M_Chi to get angle of M_chi segment, We want the absolute value, atan can have some sign issue. Uses of atan2 solve this quadrant issue, however require the x/y value that would be painful to get here
@@ -4099,7 +4321,7 @@ void LSDChiTools::knickzone_weighting_completion(map<pair<int,int>, vector<int>
     for(size_t ity = 0; ity!= working_nodes.size();ity ++)
     {
       //I am letting this typical debug statement to check if I am in a ascending mode or not. It can be consufing depending How I looped before 
-      // cout << elev_data_map[Dwarf_epauletted_fruit_bat->second[ity]] << "||" << ity << endl;
+      // cout << elev_data[node_sequence_index[Dwarf_epauletted_fruit_bat->second[ity]]] << "||" << ity << endl;
       // I am in an ascending node mode
 
       // Just A quick note why I am note using iterator for this vector iteration, I find iterator really useful but slightly less clear when we want to use previous or next element in a vector or array
@@ -4116,13 +4338,13 @@ void LSDChiTools::knickzone_weighting_completion(map<pair<int,int>, vector<int>
       // Checking if the knickzone does have 
       if(begining_node != ending_node)
       {
-        chi_size = chi_data_map[ending_node]-chi_data_map[begining_node]; 
+        chi_size = chi_data[node_sequence_index[ending_node]]-chi_data[node_sequence_index[begining_node]]; 
         weighter_coeff = 1;
         // second iteration through the knickzone
         for(size_t frutbat = ity; frutbat != working_nodes.size(); frutbat ++)
         {
           ending_node = working_nodes[frutbat];
-          weighter = (exp((-(chi_data_map[ending_node]-chi_data_map[begining_node])) / (chi_size * weighter_coeff) ) );
+          weighter = (exp((-(chi_data[node_sequence_index[ending_node]]-chi_data[node_sequence_index[begining_node]])) / (chi_size * weighter_coeff) ) );
           weighted_sum_ksn += (ksn_diff_knickpoint_map[ending_node] * weighter);
           weighted_sum_rksn += (ksn_ratio_knickpoint_map[ending_node] * weighter);
           weighted_sum_rad += (ksn_rad_knickpoint_map[ending_node] * weighter);
@@ -4214,14 +4436,14 @@ void LSDChiTools::print_knickzone_to_csv(LSDFlowInfo& FlowInfo, string filename)
                      << Blatitude << ","
                      << Blongitude << ",";
         chi_data_out.precision(5);
-        chi_data_out << elev_data_map[A_node] << ","
-                     << elev_data_map[B_node] << ","
-                     << flow_distance_data_map[A_node] << ","
-                     << flow_distance_data_map[B_node] << ","
-                     << chi_data_map[A_node] << ","
-                     << chi_data_map[B_node] << ","
-                     << drainage_area_data_map[A_node] << ","
-                     << drainage_area_data_map[B_node] << ","
+        chi_data_out << elev_data[node_sequence_index[A_node]] << ","
+                     << elev_data[node_sequence_index[B_node]] << ","
+                     << flow_distance_data[node_sequence_index[A_node]] << ","
+                     << flow_distance_data[node_sequence_index[B_node]] << ","
+                     << chi_data[node_sequence_index[A_node]] << ","
+                     << chi_data[node_sequence_index[B_node]] << ","
+                     << drainage_area_data[node_sequence_index[A_node]] << ","
+                     << drainage_area_data[node_sequence_index[B_node]] << ","
                      << knickzone_raw_cumul_ksn[iter->first] << ","
                      << knickzone_raw_cumul_rksn[iter->first] << ","
                      << ksn_sign_knickpoint_map[A_node] << ","
@@ -4229,10 +4451,10 @@ void LSDChiTools::print_knickzone_to_csv(LSDFlowInfo& FlowInfo, string filename)
                      << knickzone_WP_ksn[iter->first] << ","
                      << knickzone_WP_rksn[iter->first] << ","
                      << knickzone_WP_rad[iter->first] << ","
-                     << source_keys_map[A_node] << ","
-                     << baselevel_keys_map[A_node]<< ","
+                     << source_keys_data[node_sequence_index[A_node]] << ","
+                     << baselevel_keys_data[node_sequence_index[A_node]]<< ","
                      << knickzone_ID[iter->first] << ","
-                     << (chi_data_map[B_node]-chi_data_map[A_node]);
+                     << (chi_data[node_sequence_index[B_node]]-chi_data[node_sequence_index[A_node]]);
         chi_data_out << endl;
     }
   }
@@ -4280,6 +4502,7 @@ void LSDChiTools::print_knickpoint_to_csv(LSDFlowInfo& FlowInfo, string filename
     for (iter = ksn_diff_knickpoint_map.begin(); iter != ksn_diff_knickpoint_map.end(); iter++)
     {
         this_node = iter->first;
+        int this_index = node_sequence_index[this_node];
         FlowInfo.retrieve_current_row_and_col(this_node,row,col);
         get_lat_and_long_locations(row, col, latitude, longitude, Converter);
         get_x_and_y_locations(row, col, this_x, this_y);
@@ -4290,10 +4513,10 @@ void LSDChiTools::print_knickpoint_to_csv(LSDFlowInfo& FlowInfo, string filename
                      << latitude << ","
                      << longitude << ",";
         chi_data_out.precision(5);
-        chi_data_out << elev_data_map[this_node] << ","
-                     << flow_distance_data_map[this_node] << ","
-                     << chi_data_map[this_node] << ","
-                     << drainage_area_data_map[this_node] << ","
+        chi_data_out << elev_data[this_index] << ","
+                     << flow_distance_data[this_index] << ","
+                     << chi_data[this_index] << ","
+                     << drainage_area_data[this_index] << ","
                      << ksn_diff_knickpoint_map[this_node] << ","
                      << ksn_ratio_knickpoint_map[this_node] << ","
                      << ksn_sign_knickpoint_map[this_node] << ","
@@ -4301,8 +4524,8 @@ void LSDChiTools::print_knickpoint_to_csv(LSDFlowInfo& FlowInfo, string filename
                      << ksn_cumul_knickpoint_map[this_node] << ","
                      << rksn_cumul_knickpoint_map[this_node] << ","
                      << rad_cumul_knickpoint_map[this_node] << ","
-                     << source_keys_map[this_node] << ","
-                     << baselevel_keys_map[this_node];
+                     << source_keys_data[this_index] << ","
+                     << baselevel_keys_data[this_index];
         chi_data_out << endl;
     }
   }
@@ -4321,8 +4544,7 @@ void LSDChiTools::print_knickpoint_to_csv(LSDFlowInfo& FlowInfo, string filename
 void LSDChiTools::calculate_segmented_elevation(LSDFlowInfo& FlowInfo)
 {
   // these are for extracting element-wise data from the channel profiles.
-  int this_node;
-  map<int,float> this_segmented_elevation_map;
+  vector<float> this_segmented_elevation_vec;
   float this_M_chi, this_b_chi, this_chi, this_segemented_elevation;
 
   // find the number of nodes
@@ -4333,24 +4555,24 @@ void LSDChiTools::calculate_segmented_elevation(LSDFlowInfo& FlowInfo)
   }
   else
   {
+    this_segmented_elevation_vec.resize(n_nodes);
     for (int n = 0; n< n_nodes; n++)
     {
 
       // Get the M_chi and b_chi from the current node
-      this_node = node_sequence[n];
-      this_M_chi = M_chi_data_map[this_node];
-      this_b_chi = b_chi_data_map[this_node];
-      this_chi = chi_data_map[this_node];
+      this_M_chi = M_chi_data[n];
+      this_b_chi = b_chi_data[n];
+      this_chi = chi_data[n];
 
       // calculate elevations simply based on the fact that we are fitting segments
       // with the equation z = M_chi*chi+b_chi
       this_segemented_elevation = this_M_chi*this_chi+this_b_chi;
 
-      // Print the segment counter to the data map
-      this_segmented_elevation_map[this_node]  = this_segemented_elevation;
+      // Print the segment counter to the data vector
+      this_segmented_elevation_vec[n]  = this_segemented_elevation;
     }
   }
-  segmented_elevation_map = this_segmented_elevation_map;
+  segmented_elevation_data = this_segmented_elevation_vec;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -4382,7 +4604,7 @@ void LSDChiTools::baselevel_and_source_splitter(vector<int>& n_sources_for_basel
   for (int i = 0; i< n_sources; i++)
   {
     // get the baselevel node of each of the sources
-    baselevel_node = baselevel_keys_map[ ordered_source_nodes[i] ];
+    baselevel_node = baselevel_keys_data[node_sequence_index[ordered_source_nodes[i]]];
 
     if(baselevel_node != this_baselevel_node)
     {
@@ -4411,7 +4633,7 @@ void LSDChiTools::baselevel_and_source_splitter(vector<int>& n_sources_for_basel
   {
     for(int i = 0; i< n_sources; i++)
    {
-      cout << "Source number is: " << ordered_source_nodes[i] << " and baselelvel: " << baselevel_keys_map[ ordered_source_nodes[i] ] << endl;
+      cout << "Source number is: " << ordered_source_nodes[i] << " and baselelvel: " << baselevel_keys_data[node_sequence_index[ordered_source_nodes[i]]] << endl;
     }
 
     int n_bl = int(starting_index_of_source_for_baselevel_node.size());
@@ -4448,7 +4670,7 @@ void LSDChiTools::print_basin_and_source_indexing_to_screen()
   int n_sources = int(ordered_source_nodes.size());
   for(int i = 0; i< n_sources; i++)
   {
-    cout << "Source number is: " << ordered_source_nodes[i] << " and baselelvel: " << baselevel_keys_map[ ordered_source_nodes[i] ] << endl;
+    cout << "Source number is: " << ordered_source_nodes[i] << " and baselelvel: " << baselevel_keys_data[node_sequence_index[ordered_source_nodes[i]]] << endl;
   }
 
   vector<int> n_sources_for_baselevel;
@@ -5113,6 +5335,136 @@ float LSDChiTools::test_all_segment_collinearity_by_basin_using_points(LSDFlowIn
 
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This tests the collinearity of the channels of a basin network. It does the
+// same comparisons as test_all_segment_collinearity_by_basin and
+// test_all_segment_collinearity_by_basin_using_points, but the channel nodes
+// come from the network and chi is passed in, so it does not touch the
+// data members.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float LSDChiTools::test_all_segment_collinearity_by_basin(movern_basin_network& network, vector<float>& these_chi,
+                                                 bool only_use_mainstem_as_reference,
+                                                 vector<int>& reference_source, vector<int>& test_source,
+                                                 vector<float>& MLE_values, vector<float>& RMSE_values,
+                                                 float sigma, bool use_points, vector<float>& chi_fractions_for_testing)
+{
+  // placeholder vectors: will replace the passed vectors
+  vector<int> this_reference_source;
+  vector<int> this_test_source;
+  vector<float> these_MLE_values;
+  vector<float> these_RMSE_values;
+
+  // Drop out if there is only a single channel in the basin
+  int n_channels = int(network.channel_positions.size());
+  if (n_channels < 2)
+  {
+    MLE_values = these_MLE_values;
+    RMSE_values = these_RMSE_values;
+    reference_source = this_reference_source;
+    test_source = this_test_source;
+    return 1.0;
+  }
+
+  // get the chi values of each channel
+  vector< vector<float> > channel_chi(n_channels);
+  for(int chan = 0; chan<n_channels; chan++)
+  {
+    int n_channel_nodes = int(network.channel_positions[chan].size());
+    for(int i = 0; i<n_channel_nodes; i++)
+    {
+      channel_chi[chan].push_back(these_chi[ network.node_indices[ network.channel_positions[chan][i] ] ]);
+    }
+  }
+
+  // the test points are set by the length of the mainstem
+  vector<float> chi_test_distances;
+  if (use_points)
+  {
+    int n_MS_nodes = int(channel_chi[0].size());
+    float MS_length = channel_chi[0][0]-channel_chi[0][n_MS_nodes-1];
+    int n_frac = int(chi_fractions_for_testing.size());
+    for(int f = 0; f<n_frac; f++)
+    {
+      chi_test_distances.push_back(chi_fractions_for_testing[f]*MS_length);
+    }
+  }
+
+  // now get all the possible two pair combinations of these channels
+  bool zero_indexed = true;
+  int k = 2;
+  vector< vector<int> > combo_vecvev = combinations(n_channels, k, zero_indexed);
+  int n_combinations = int(combo_vecvev.size());
+  if (only_use_mainstem_as_reference)
+  {
+    n_combinations = n_channels-1;
+  }
+
+  vector<float> residuals;
+  int n_residuals;
+  int chan0,chan1;
+  for (int combo = 0; combo < n_combinations; combo++)
+  {
+    chan0 = combo_vecvev[combo][0];
+    chan1 = combo_vecvev[combo][1];
+
+    if (use_points)
+    {
+      residuals = project_points_onto_reference_channel(channel_chi[chan0], network.channel_elevations[chan0],
+                                 channel_chi[chan1], network.channel_elevations[chan1], chi_test_distances);
+    }
+    else
+    {
+      residuals = project_data_onto_reference_channel(channel_chi[chan0], network.channel_elevations[chan0],
+                                 channel_chi[chan1], network.channel_elevations[chan1]);
+    }
+    n_residuals = int(residuals.size());
+
+    // Now get the MLE and RMSE for this channel pair. It only runs if
+    // there are residuals. Otherwise it means that the channels are non-overlapping
+    if (n_residuals > 0)
+    {
+      float MLE1 = calculate_MLE_from_residuals(residuals, sigma);
+      float RMSE = calculate_RMSE_from_residuals(residuals);
+
+      // If we are only using the mainstem channel, we only use the first channel
+      // as a reference channel.
+      if (only_use_mainstem_as_reference && chan0 > 0)
+      {
+        combo = n_combinations;
+      }
+      else
+      {
+        these_MLE_values.push_back(MLE1);
+        these_RMSE_values.push_back(RMSE);
+        this_reference_source.push_back(chan0+network.first_source_key);
+        this_test_source.push_back(chan1+network.first_source_key);
+      }
+    }
+    else
+    {
+      these_MLE_values.push_back(1.0);
+      these_RMSE_values.push_back(0.0);
+      this_reference_source.push_back(chan0+network.first_source_key);
+      this_test_source.push_back(chan1+network.first_source_key);
+    }
+  }
+
+  MLE_values = these_MLE_values;
+  RMSE_values = these_RMSE_values;
+  reference_source = this_reference_source;
+  test_source = this_test_source;
+
+  float tot_MLE = 1;
+  for (int res = 0; res < int(these_MLE_values.size()); res++)
+  {
+    tot_MLE = tot_MLE*these_MLE_values[res];
+  }
+  return tot_MLE;
+}
+
+
+
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function test the collinearity of all segments compared to a reference
 // segment
@@ -5120,8 +5472,6 @@ float LSDChiTools::test_all_segment_collinearity_by_basin_using_points(LSDFlowIn
 float LSDChiTools::test_collinearity_by_basin_disorder(LSDFlowInfo& FlowInfo,
                                                  int baselevel_key)
 {
-  float disorder_stat = -9999;
-  
   //cout << "Testing the segment collinearity for basin key " << baselevel_key << endl;
   // get some information about the number of basins
   int n_basins = int(ordered_baselevel_nodes.size());
@@ -5132,32 +5482,37 @@ float LSDChiTools::test_collinearity_by_basin_disorder(LSDFlowInfo& FlowInfo,
     exit(EXIT_FAILURE);
   }
 
-  
-  // Drop out if there is only a single channel in the basin
-  //if (n_channels == 1)
-  //{
-  //  cout << "This basin only has one channel." << endl;
-  //  return 1.0;
-  //}
-
-
   // This is a brute force way to get the complete chi data map
-  
-  vector<float> this_basin_chi;
-  vector<float> this_basin_elevation;
+  vector<int> basin_node_indices;
   int n_nodes = int(node_sequence.size());
-  int this_node;
   for (int n = 0; n< n_nodes; n++)
   {
-    this_node = node_sequence[n];
-
-    if (baselevel_keys_map[this_node] == baselevel_key)
+    if (baselevel_keys_data[n] == baselevel_key)
     {
-
-      this_basin_chi.push_back(chi_data_map[this_node]);
-      this_basin_elevation.push_back(elev_data_map[this_node]);
+      basin_node_indices.push_back(n);
     }
   }
+
+  return test_collinearity_by_basin_disorder(basin_node_indices, chi_data);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The disorder statistic of a list of nodes. The chi values are passed
+// rather than taken from chi_data so that many m/n values can be tested at once.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float LSDChiTools::test_collinearity_by_basin_disorder(vector<int>& basin_node_indices,
+                                                 vector<float>& these_chi)
+{
+  float disorder_stat = -9999;
+
+  vector<float> this_basin_chi;
+  vector<float> this_basin_elevation;
+  int n_basin_nodes = int(basin_node_indices.size());
+  for (int n = 0; n< n_basin_nodes; n++)
+  {
+    this_basin_chi.push_back(these_chi[basin_node_indices[n]]);
+    this_basin_elevation.push_back(elev_data[basin_node_indices[n]]);
+  }
   
   // now sort these vectors
     // initiate the sorted vectors
@@ -5219,8 +5574,6 @@ float LSDChiTools::test_collinearity_by_basin_disorder(LSDFlowInfo& FlowInfo,
 vector<float> LSDChiTools::test_collinearity_by_basin_disorder_with_uncert(LSDFlowInfo& FlowInfo,
                                                  int baselevel_key)
 {
-  vector<float> disorder_stat_vec;
-  
   //cout << "Testing the segment collinearity for basin key " << baselevel_key << endl;
   // get some information about the number of basins
   int n_basins = int(ordered_baselevel_nodes.size());
@@ -5231,6 +5584,28 @@ vector<float> LSDChiTools::test_collinearity_by_basin_disorder_with_uncert(LSDFl
     exit(EXIT_FAILURE);
   }
 
+  vector<int> basin_node_indices;
+  int n_nodes = int(node_sequence.size());
+  for (int n = 0; n< n_nodes; n++)
+  {
+    if (baselevel_keys_data[n] == baselevel_key)
+    {
+      basin_node_indices.push_back(n);
+    }
+  }
+
+  return test_collinearity_by_basin_disorder_with_uncert(basin_node_indices, chi_data);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The disorder statistic of every combination of tributaries in a list of
+// nodes. The chi values are passed rather than taken from chi_data.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<float> LSDChiTools::test_collinearity_by_basin_disorder_with_uncert(vector<int>& basin_node_indices,
+                                                 vector<float>& these_chi)
+{
+  vector<float> disorder_stat_vec;
+
   // this map will hold references to the sources. There are two of them
   // because the first has the sources as the keys and the second has the
   // combination index as the keys. 
@@ -5240,26 +5615,21 @@ vector<float> LSDChiTools::test_collinearity_by_basin_disorder_with_uncert(LSDFl
   vector<float> this_basin_chi;
   vector<float> this_basin_elevation;
   vector<int> this_basin_source;
-  int n_nodes = int(node_sequence.size());
-  int this_node;
+  int n_basin_nodes = int(basin_node_indices.size());
+  int n;
   int comboindex = 0;     // this is used to store an index into the combinations
-  for (int n = 0; n< n_nodes; n++)
+  for (int i = 0; i< n_basin_nodes; i++)
   {
-    this_node = node_sequence[n];
-
-    if (baselevel_keys_map[this_node] == baselevel_key)
-    {
-
-      this_basin_chi.push_back(chi_data_map[this_node]);
-      this_basin_elevation.push_back(elev_data_map[this_node]);
-      this_basin_source.push_back(source_keys_map[this_node]);
+    n = basin_node_indices[i];
+    this_basin_chi.push_back(these_chi[n]);
+    this_basin_elevation.push_back(elev_data[n]);
+    this_basin_source.push_back(source_keys_data[n]);
       
-      // if the key doesn't exist, add a source key counter
-      if ( sources_are_keys.find( source_keys_map[this_node] ) == sources_are_keys.end() )
-      {
-        sources_are_keys[ source_keys_map[this_node] ] = comboindex;
-        comboindex++;
-      }
+    // if the key doesn't exist, add a source key counter
+    if ( sources_are_keys.find( source_keys_data[n] ) == sources_are_keys.end() )
+    {
+      sources_are_keys[ source_keys_data[n] ] = comboindex;
+      comboindex++;
     }
   }
   
@@ -5281,7 +5651,8 @@ vector<float> LSDChiTools::test_collinearity_by_basin_disorder_with_uncert(LSDFl
   int n_elements = n_sources-1;
   int n_in_each_combo = 3;
   
-  if (n_sources < n_in_each_combo)
+  // the trunk is always included so we need n_in_each_combo tributaries on top of it
+  if (n_elements < n_in_each_combo)
   {
     cout << "Not enough channels in this basin! I am returning a nodata vector." << endl;
     disorder_stat_vec.push_back(-9999);
@@ -5569,126 +5940,26 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern(LSDFlowInfo&
                         bool only_use_mainstem_as_reference,
                         string file_prefix, float sigma)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
-
   cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
   cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
   float A_0 = 1;
-  //float thresh_area_for_chi = 0;      // This just gets chi from all pixels.
-
-  string filename_bstats = file_prefix+"_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
-
-  int n_basins = int(ordered_baselevel_nodes.size());
-
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-
-  cout << endl << endl << "==========================" << endl;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
     movern.push_back( float(i)*delta_movern+start_movern );
-    cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats.csv";
-    ofstream movern_stats_out;
-    movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    update_chi_data_map(FlowInfo, A_0, movern[i]);
-
-    // these are the vectors that will hold the information about the
-    // comparison between channels.
-    // the _all vectors are one of all the basins
-    // reference source is the source key of the reference channel
-    vector<int> reference_source, all_reference_source;
-    // test source is the source key of the test channel
-    vector<int> test_source, all_test_source;
-    // MLE the maximum liklihood estimator
-    vector<float> MLE_values, all_MLE_values;
-    // RMSE is the root mean square error
-    vector<float> RMSE_values, all_RMSE_values;
-
-    vector<float> tot_MLE_vec;
-    // basin keys
-    vector<int> all_basin_keys;
-
-    // now run the collinearity test
-    float tot_MLE;
-
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      tot_MLE = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,
-                                  reference_source, test_source, MLE_values, RMSE_values, sigma);
-      // concatenate the vectors to the "all" vectors
-      all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-      all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-      all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-      all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-      all_basin_keys.insert(all_basin_keys.end(), reference_source.size(), basin_key);
-
-      tot_MLE_vec.push_back(tot_MLE);
-      cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-    }
-
-    // add the data to the vecvecs
-    MLE_vecvec.push_back(all_MLE_values);
-    RMSE_vecvec.push_back(all_RMSE_values);
-    total_MLE_vecvec.push_back(tot_MLE_vec);
-    reference_keys = all_reference_source;
-    test_keys = all_test_source;
-
-    // now print the data to the file
-    movern_stats_out << "basin_key,reference_source_key,test_source_key,MLE,RMSE" << endl;
-    int n_rmse_vals = int(all_RMSE_values.size());
-    for(int i = 0; i<n_rmse_vals; i++)
-    {
-      movern_stats_out << all_basin_keys[i] << ","
-                       << all_reference_source[i] << ","
-                       << all_test_source[i] << ","
-                       << all_MLE_values[i] << ","
-                       << all_RMSE_values[i] << endl;
-    }
-    movern_stats_out.close();
-
   }
 
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",m_over_n = "<<movern[i];
-  }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<total_MLE_vecvec[i][basin_key];
-    }
-    stats_by_basin_out << endl;
-  }
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern);
 
-  stats_by_basin_out.close();
+  vector<float> chi_fractions_vector;
+  bool use_points = false;
+  bool print_basin_keys = true;
+  collinearity_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                file_prefix, sigma, use_points, chi_fractions_vector, print_basin_keys);
 
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
 }
 
 
@@ -5702,128 +5973,27 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
                         string file_prefix,
                         LSDRaster& Discharge, float sigma)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
-
-
   cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
   cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
   float A_0 = 1;
-  //float thresh_area_for_chi = 0;      // This just gets chi from all pixels.
+  vector<float> movern;
+  for(int i = 0; i< n_movern; i++)
+  {
+    movern.push_back( float(i)*delta_movern+start_movern );
+  }
 
-  string filename_bstats = file_prefix+"_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern, Discharge);
 
-  int n_basins = int(ordered_baselevel_nodes.size());
+  vector<float> chi_fractions_vector;
+  bool use_points = false;
+  bool print_basin_keys = false;
+  collinearity_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                file_prefix, sigma, use_points, chi_fractions_vector, print_basin_keys);
 
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-
-  cout << endl << endl << "==========================" << endl;
-  for(int i = 0; i< n_movern; i++)
-  {
-    // get the m over n value
-    movern.push_back( float(i)*delta_movern+start_movern );
-    cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats.csv";
-    ofstream movern_stats_out;
-    movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    float area_threshold = 0;
-
-    LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                 area_threshold, Discharge);
-    update_chi_data_map(FlowInfo, this_chi);
-
-    // these are the vectors that will hold the information about the
-    // comparison between channels.
-    // the _all vectors are one of all the basins
-    // reference source is the source key of the reference channel
-    vector<int> reference_source, all_reference_source;
-    // test source is the source key of the test channel
-    vector<int> test_source, all_test_source;
-    // MLE the maximum liklihood estimator
-    vector<float> MLE_values, all_MLE_values;
-    // RMSE is the root mean square error
-    vector<float> RMSE_values, all_RMSE_values;
-
-    vector<float> tot_MLE_vec;
-
-    // now run the collinearity test
-    float tot_MLE;
-
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      tot_MLE = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,
-                                  reference_source, test_source, MLE_values, RMSE_values, sigma);
-      // concatenate the vectors to the "all" vectors
-      all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-      all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-      all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-      all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-
-      tot_MLE_vec.push_back(tot_MLE);
-      cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-    }
-
-    // add the data to the vecvecs
-    MLE_vecvec.push_back(all_MLE_values);
-    RMSE_vecvec.push_back(all_RMSE_values);
-    total_MLE_vecvec.push_back(tot_MLE_vec);
-    reference_keys = all_reference_source;
-    test_keys = all_test_source;
-
-    // now print the data to the file
-    movern_stats_out << "reference_source_key,test_source_key,MLE,RMSE" << endl;
-    int n_rmse_vals = int(all_RMSE_values.size());
-    for(int i = 0; i<n_rmse_vals; i++)
-    {
-      movern_stats_out << all_reference_source[i] << ","
-                       << all_test_source[i] << ","
-                       << all_MLE_values[i] << ","
-                       << all_RMSE_values[i] << endl;
-    }
-    movern_stats_out.close();
-
-  }
-
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",m_over_n = "<<movern[i];
-  }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<total_MLE_vecvec[i][basin_key];
-    }
-    stats_by_basin_out << endl;
-  }
-
-  stats_by_basin_out.close();
-
-}
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
+}
 
 
 
@@ -5851,127 +6021,25 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_points
                         string file_prefix, float sigma,
                         vector<float> chi_fractions_vector)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
-
   cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
   cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
   float A_0 = 1;
-  //float thresh_area_for_chi = 0;      // This just gets chi from all pixels.
-
-  string filename_bstats = file_prefix+"_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
-
-  int n_basins = int(ordered_baselevel_nodes.size());
-
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-
-  cout << endl << endl << "==========================" << endl;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
     movern.push_back( float(i)*delta_movern+start_movern );
-    cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats.csv";
-    ofstream movern_stats_out;
-    movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    update_chi_data_map(FlowInfo, A_0, movern[i]);
-
-    // these are the vectors that will hold the information about the
-    // comparison between channels.
-    // the _all vectors are one of all the basins
-    // reference source is the source key of the reference channel
-    vector<int> reference_source, all_reference_source;
-    // test source is the source key of the test channel
-    vector<int> test_source, all_test_source;
-    // MLE the maximum liklihood estimator
-    vector<float> MLE_values, all_MLE_values;
-    // RMSE is the root mean square error
-    vector<float> RMSE_values, all_RMSE_values;
-
-    vector<float> tot_MLE_vec;
-    // basin keys
-    vector<int> all_basin_keys;
-
-    // now run the collinearity test
-    float tot_MLE;
-
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      tot_MLE = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,
-                                  reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                  chi_fractions_vector);
-      // concatenate the vectors to the "all" vectors
-      all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-      all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-      all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-      all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-      all_basin_keys.insert(all_basin_keys.end(), reference_source.size(), basin_key);
-
-      tot_MLE_vec.push_back(tot_MLE);
-      cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-    }
-
-    // add the data to the vecvecs
-    MLE_vecvec.push_back(all_MLE_values);
-    RMSE_vecvec.push_back(all_RMSE_values);
-    total_MLE_vecvec.push_back(tot_MLE_vec);
-    reference_keys = all_reference_source;
-    test_keys = all_test_source;
-
-    // now print the data to the file
-    movern_stats_out << "basin_key,reference_source_key,test_source_key,MLE,RMSE" << endl;
-    int n_rmse_vals = int(all_RMSE_values.size());
-    for(int i = 0; i<n_rmse_vals; i++)
-    {
-      movern_stats_out << all_basin_keys[i] << ","
-                       << all_reference_source[i] << ","
-                       << all_test_source[i] << ","
-                       << all_MLE_values[i] << ","
-                       << all_RMSE_values[i] << endl;
-    }
-    movern_stats_out.close();
-
   }
 
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",m_over_n = "<<movern[i];
-  }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<total_MLE_vecvec[i][basin_key];
-    }
-    stats_by_basin_out << endl;
-  }
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern);
 
-  stats_by_basin_out.close();
+  bool use_points = true;
+  bool print_basin_keys = true;
+  collinearity_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                file_prefix, sigma, use_points, chi_fractions_vector, print_basin_keys);
 
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
 }
 
 
@@ -5986,128 +6054,25 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
                         LSDRaster& Discharge, float sigma,
                         vector<float> chi_fractions_vector)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
-
-
   cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
   cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
   float A_0 = 1;
-  //float thresh_area_for_chi = 0;      // This just gets chi from all pixels.
-
-  string filename_bstats = file_prefix+"_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
-
-  int n_basins = int(ordered_baselevel_nodes.size());
-
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-
-  cout << endl << endl << "==========================" << endl;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
     movern.push_back( float(i)*delta_movern+start_movern );
-    cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats.csv";
-    ofstream movern_stats_out;
-    movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    float area_threshold = 0;
-
-    LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                 area_threshold, Discharge);
-    update_chi_data_map(FlowInfo, this_chi);
-
-    // these are the vectors that will hold the information about the
-    // comparison between channels.
-    // the _all vectors are one of all the basins
-    // reference source is the source key of the reference channel
-    vector<int> reference_source, all_reference_source;
-    // test source is the source key of the test channel
-    vector<int> test_source, all_test_source;
-    // MLE the maximum liklihood estimator
-    vector<float> MLE_values, all_MLE_values;
-    // RMSE is the root mean square error
-    vector<float> RMSE_values, all_RMSE_values;
-
-    vector<float> tot_MLE_vec;
-
-    // now run the collinearity test
-    float tot_MLE;
-
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      tot_MLE = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,
-                                  reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                  chi_fractions_vector);
-      // concatenate the vectors to the "all" vectors
-      all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-      all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-      all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-      all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-
-      tot_MLE_vec.push_back(tot_MLE);
-      cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-    }
-
-    // add the data to the vecvecs
-    MLE_vecvec.push_back(all_MLE_values);
-    RMSE_vecvec.push_back(all_RMSE_values);
-    total_MLE_vecvec.push_back(tot_MLE_vec);
-    reference_keys = all_reference_source;
-    test_keys = all_test_source;
-
-    // now print the data to the file
-    movern_stats_out << "reference_source_key,test_source_key,MLE,RMSE" << endl;
-    int n_rmse_vals = int(all_RMSE_values.size());
-    for(int i = 0; i<n_rmse_vals; i++)
-    {
-      movern_stats_out << all_reference_source[i] << ","
-                       << all_test_source[i] << ","
-                       << all_MLE_values[i] << ","
-                       << all_RMSE_values[i] << endl;
-    }
-    movern_stats_out.close();
-
   }
 
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",m_over_n = "<<movern[i];
-  }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<total_MLE_vecvec[i][basin_key];
-    }
-    stats_by_basin_out << endl;
-  }
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern, Discharge);
 
-  stats_by_basin_out.close();
+  bool use_points = true;
+  bool print_basin_keys = false;
+  collinearity_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                file_prefix, sigma, use_points, chi_fractions_vector, print_basin_keys);
 
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
 }
 
 
@@ -6127,234 +6092,152 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_points
                         int MC_iterations,
                         float max_frac)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > min_MLE, first_quartile_MLE, median_MLE, third_quartile_MLE, max_MLE;
-
-  // open the file that contains the basin stats
-  string filename_bstats = file_prefix+"_points_MC_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
-
-
-  // get the see for the random number generator
-  long seed = time(NULL);
-
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
-
   cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
   cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
   float A_0 = 1;
-
-  int n_basins = int(ordered_baselevel_nodes.size());
-
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-
-  cout << endl << endl << "==========================" << endl;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
     movern.push_back( float(i)*delta_movern+start_movern );
-    cout << "i: " << i << " and m over n: " << movern[i] << " ";
+  }
 
-    // calculate chi
-    update_chi_data_map(FlowInfo, A_0, movern[i]);
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern);
 
-    // get some vecvecs for storing information about the sources, MLEs, etc
-    // for each iteration
-    vector<int> master_reference_sources, master_test_sources, master_basin_keys;
-    vector< vector<float> > total_MLE_iteration;
+  collinearity_fxn_movern_sweep_MC(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                   file_prefix, sigma, n_fracs, MC_iterations, max_frac, "");
 
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
+}
 
-    for (int iteration = 0; iteration < MC_iterations; iteration++)
-    {
 
-      // these are the vectors that will hold the information about the
-      // comparison between channels.
-      // the _all vectors are one of all the basins
-      // reference source is the source key of the reference channel
-      vector<int> reference_source, all_reference_source;
-      // test source is the source key of the test channel
-      vector<int> test_source, all_test_source;
-      // MLE the maximum liklihood estimator
-      vector<float> MLE_values, all_MLE_values;
-      // RMSE is the root mean square error
-      vector<float> RMSE_values, all_RMSE_values;
 
-      vector<float> tot_MLE_vec;
-      // basin keys
-      vector<int> all_basin_keys;
 
-      // now run the collinearity test
-      float tot_MLE;
 
-      // here we need the logic for the chi_fractions
-      float partition_size = max_frac/float(n_fracs);
-      vector<float> chi_fractions_vector;
-      for(int partition = 0; partition < n_fracs; partition++)
-      {
-        float this_part = ran3(&seed)*partition_size;
-        //cout << "This part is: " << this_part << endl;
 
-        chi_fractions_vector.push_back( float(partition)*partition_size + this_part );
-        //cout << "Partion["<< partition << "]: " << chi_fractions_vector[partition] << endl;
-      }
 
 
-      for(int basin_key = 0; basin_key<n_basins; basin_key++)
-      {
-        //cout << "The sigma is: " << sigma << endl;
-        tot_MLE = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                    basin_key,
-                                    reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                    chi_fractions_vector);
-        // concatenate the vectors to the "all" vectors
-        all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-        all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-        all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-        all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-        all_basin_keys.insert(all_basin_keys.end(), reference_source.size(), basin_key);
-
-        tot_MLE_vec.push_back(tot_MLE);
-        //cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-      }
 
-      // so we end up with vectors containing the MLE values for each source,
-      // the RMSE, the reference and test sources, and the basin keys.
 
-      // add the data to the vecvecs
-      MLE_vecvec.push_back(all_MLE_values);
-      RMSE_vecvec.push_back(all_RMSE_values);
-      total_MLE_vecvec.push_back(tot_MLE_vec);
-      reference_keys = all_reference_source;
-      test_keys = all_test_source;
 
-      // if this is the first iteration, push the reference, test, and basin keys vector
-      // into the master vector
-      if(iteration == 0)
-      {
-        master_reference_sources = all_reference_source;
-        master_test_sources = all_test_source;
-        master_basin_keys = master_basin_keys;
-      }
-      else
-      {
-        // check to see if the sources vectors are the same size
-        if (master_reference_sources != all_reference_source)
-        {
-          cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_points_MC" << endl;
-          cout << "We have a problem with the source vector, buddy!" << endl;
-        }
-      }
 
-      // in this space we will need logic for storing all the MLE data and RMSE data
-      // for each iteration and each basin. I'll save that work for later.
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This function test the collinearity of all segments compared to a reference
+// segment
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_points_MC(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        float start_movern, float delta_movern, int n_movern,
+                        bool only_use_mainstem_as_reference,
+                        string file_prefix, float sigma,
+                        int n_fracs,
+                        int MC_iterations,
+                        float max_frac, LSDRaster& Discharge)
+{
+  float A_0 = 1;
+  vector<float> movern;
+  for(int i = 0; i< n_movern; i++)
+  {
+    movern.push_back( float(i)*delta_movern+start_movern );
+  }
 
-      // now get the total MLE vec for each iteration
-      total_MLE_iteration.push_back(tot_MLE_vec);
-    }
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern, Discharge);
 
-    // now for this m/n, we need to calculate the stats of the MLEs
-    // this is a little slow since we need to reorganise the data in vecotrs
-    // by repeatedly looping over the vecvec
-    vector<float> this_movern_min_MLE;
-    vector<float> this_movern_first_quartile_MLE;
-    vector<float> this_movern_median_MLE;
-    vector<float> this_movern_third_quartile_MLE;
-    vector<float> this_movern_max_MLE;
+  collinearity_fxn_movern_sweep_MC(FlowInfo, JN, movern, chi_of_movern, only_use_mainstem_as_reference,
+                                   file_prefix, sigma, n_fracs, MC_iterations, max_frac, "_Q");
 
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      vector<float> this_basins_MLE;
-      for(int iteration = 0; iteration < MC_iterations; iteration ++)
-      {
-        this_basins_MLE.push_back( total_MLE_iteration[iteration][basin_key] );
-      }
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
+}
 
-      vector<float> descriptive_stats_MLE =  calculate_descriptive_stats(this_basins_MLE);
 
-      this_movern_min_MLE.push_back(descriptive_stats_MLE[0]);
-      this_movern_first_quartile_MLE.push_back(descriptive_stats_MLE[1]);
-      this_movern_median_MLE.push_back(descriptive_stats_MLE[2]);
-      this_movern_third_quartile_MLE.push_back(descriptive_stats_MLE[3]);
-      this_movern_max_MLE.push_back(descriptive_stats_MLE[4]);
-    }
 
-    // push the data for this m/n into the vecvecs
-    min_MLE.push_back(this_movern_min_MLE);
-    first_quartile_MLE.push_back(this_movern_first_quartile_MLE);
-    median_MLE.push_back(this_movern_median_MLE);
-    third_quartile_MLE.push_back(this_movern_third_quartile_MLE);
-    max_MLE.push_back(this_movern_max_MLE);
 
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_pointsMC.csv";
-    ofstream movern_stats_out;
-    movern_stats_out.open(filename_fullstats.c_str());
 
-    // now print the data to the file
-    movern_stats_out << "basin_number,minimum_MLE,first_quartile_MLE,median_MLE,third_quartile_MLE,maximum_MLE" << endl;
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      movern_stats_out << basin_key << ","
-                       << this_movern_min_MLE[basin_key] << ","
-                       << this_movern_first_quartile_MLE[basin_key] << ","
-                       << this_movern_median_MLE[basin_key] << ","
-                       << this_movern_third_quartile_MLE[basin_key] << ","
-                       << this_movern_max_MLE[basin_key] << endl;
-    }
-    movern_stats_out.close();
-  }
 
 
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",median_MLE_m_over_n="<<movern[i];
-  }
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This functions test the goodness of fit for the m/n ratio using the 
+// disorder method propsoed by Hergarten et al 2016
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        float start_movern, float delta_movern, int n_movern,
+                        string file_prefix, bool use_uncert)
+{
+  cout << "I am now entering the disorder loop." << endl;
+  cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder" << endl;
+  cout << "I am defaulting to A_0 = 1." << endl;
+  float A_0 = 1;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    stats_by_basin_out << ",FQ_MLE_m_over_n="<<movern[i];
+    movern.push_back( float(i)*delta_movern+start_movern );
   }
+
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern);
+
+  disorder_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, chi_of_movern,
+                            file_prefix, use_uncert);
+
+  // leave chi_data as it would be after the last m/n value
+  chi_data = chi_of_movern[n_movern-1];
+}
+
+
+
+
+
+
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This functions test the goodness of fit for the concavity using the 
+// disorder method propsoed by Hergarten et al 2016
+// Uses a discharge raster
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_disorder(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        float start_movern, float delta_movern, int n_movern,
+                        string file_prefix, bool use_uncert, LSDRaster& Discharge)
+{
+  cout << "I am now entering the disorder loop." << endl;
+  cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder" << endl;
+  cout << "I am defaulting to A_0 = 1." << endl;
+  float A_0 = 1;
+  vector<float> movern;
   for(int i = 0; i< n_movern; i++)
   {
-    stats_by_basin_out << ",TQ_MLE_m_over_n="<<movern[i];
+    movern.push_back( float(i)*delta_movern+start_movern );
   }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
+
+  // get chi for every m/n value at once, then test all the basins
+  vector< vector<float> > chi_of_movern = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern, Discharge);
+
+  // The uncertainty combinations have always been tested with chi from
+  // drainage area rather than discharge. Keep that so the outputs do not change.
+  vector< vector<float> > chi_of_movern_for_uncert;
+  if (use_uncert)
   {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<median_MLE[i][basin_key];
-    }
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<first_quartile_MLE[i][basin_key];
-    }
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<third_quartile_MLE[i][basin_key];
-    }
-    stats_by_basin_out << endl;
+    chi_of_movern_for_uncert = get_chi_data_for_movern_sweep(FlowInfo, A_0, movern);
   }
 
-  stats_by_basin_out.close();
+  disorder_fxn_movern_sweep(FlowInfo, JN, movern, chi_of_movern, chi_of_movern_for_uncert,
+                            file_prefix, use_uncert);
 
+  // leave chi_data as it would be after the last m/n value
+  if (use_uncert)
+  {
+    chi_data = chi_of_movern_for_uncert[n_movern-1];
+  }
+  else
+  {
+    chi_data = chi_of_movern[n_movern-1];
+  }
 }
 
 
@@ -6366,47 +6249,185 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_points
 
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets chi of the channel network for a number of m/n values. The chi
+// values are the same as those from update_chi_data_map but chi is only
+// integrated over the channel nodes and the nodes downstream of them.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector< vector<float> > LSDChiTools::get_chi_data_for_movern_sweep(LSDFlowInfo& FlowInfo, float A_0,
+                        vector<float>& movern)
+{
+  vector<int> chi_nodes, receiver_positions, position_of_node_sequence;
+  vector<float> flow_lengths;
+  get_chi_integration_nodes(FlowInfo, chi_nodes, receiver_positions, flow_lengths,
+                            position_of_node_sequence);
 
+  float DataResolution = FlowInfo.get_DataResolution();
+  float pixel_area = DataResolution*DataResolution;
+  int n_chi_nodes = int(chi_nodes.size());
+  vector<float> drainage(n_chi_nodes);
+  for(int c = 0; c<n_chi_nodes; c++)
+  {
+    drainage[c] = float(FlowInfo.retrieve_contributing_pixels_of_node(chi_nodes[c]))*pixel_area;
+  }
 
+  return integrate_chi_data_for_movern_sweep(receiver_positions, flow_lengths, drainage,
+                                             position_of_node_sequence, A_0, movern);
+}
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This function test the collinearity of all segments compared to a reference
-// segment
+// Same as above but uses discharge
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_points_MC(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
-                        float start_movern, float delta_movern, int n_movern,
-                        bool only_use_mainstem_as_reference,
-                        string file_prefix, float sigma,
-                        int n_fracs,
-                        int MC_iterations,
-                        float max_frac, LSDRaster& Discharge)
+vector< vector<float> > LSDChiTools::get_chi_data_for_movern_sweep(LSDFlowInfo& FlowInfo, float A_0,
+                        vector<float>& movern, LSDRaster& Discharge)
 {
-  // these vectors store all the values which are then used for printing
-  vector< vector<float> > min_MLE, first_quartile_MLE, median_MLE, third_quartile_MLE, max_MLE;
+  vector<int> chi_nodes, receiver_positions, position_of_node_sequence;
+  vector<float> flow_lengths;
+  get_chi_integration_nodes(FlowInfo, chi_nodes, receiver_positions, flow_lengths,
+                            position_of_node_sequence);
 
-  // open the file that contains the basin stats
-  string filename_bstats = file_prefix+"_points_MC_basinstats_Q.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
+  int n_chi_nodes = int(chi_nodes.size());
+  int row,col;
+  vector<float> drainage(n_chi_nodes);
+  for(int c = 0; c<n_chi_nodes; c++)
+  {
+    FlowInfo.retrieve_current_row_and_col(chi_nodes[c],row,col);
+    drainage[c] = Discharge.get_data_element(row,col);
+  }
 
-  // get the see for the random number generator
-  long seed = time(NULL);
+  return integrate_chi_data_for_movern_sweep(receiver_positions, flow_lengths, drainage,
+                                             position_of_node_sequence, A_0, movern);
+}
 
-  vector< vector<float> > RMSE_vecvec;
-  vector< vector<float> > MLE_vecvec;
-  vector< vector<float> > total_MLE_vecvec;
-  vector<int> reference_keys;
-  vector<int> test_keys;
-  vector<int> outlet_jns;
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This collects the channel nodes and all the nodes downstream of them to the
+// edge of the DEM. Chi is measured from the edge of the DEM so these are all
+// the nodes needed to get chi of the channel network.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::get_chi_integration_nodes(LSDFlowInfo& FlowInfo, vector<int>& chi_nodes,
+                        vector<int>& receiver_positions, vector<float>& flow_lengths,
+                        vector<int>& position_of_node_sequence)
+{
+  vector<int> these_chi_nodes;
+  vector<int> these_receiver_positions;
+  vector<float> these_flow_lengths;
 
-  //cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern" << endl;
-  //cout << "I am defaulting to A_0 = 1." << endl;
-  vector<float> movern;
-  float A_0 = 1;
+  int n_nodes = int(node_sequence.size());
+  vector<int> these_positions(n_nodes,-1);
+
+  float DataResolution = FlowInfo.get_DataResolution();
+  float root2 = 1.41421356;
+  float diag_length = root2*DataResolution;
+
+  // the position in these_chi_nodes of every node in the DEM
+  vector<int> position_of_node(FlowInfo.get_NDataNodes(),-1);
+
+  vector<int> path;
+  int current_node,receiver_node,this_node;
+  for(int n = 0; n<n_nodes; n++)
+  {
+    // go downstream until you find a node that is already in the list
+    path.clear();
+    current_node = node_sequence[n];
+    while(position_of_node[current_node] == -1)
+    {
+      path.push_back(current_node);
+      FlowInfo.retrieve_receiver_information(current_node,receiver_node);
+      if (receiver_node == current_node)
+      {
+        break;
+      }
+      current_node = receiver_node;
+    }
+
+    // add the path from the bottom so that receivers come before their donors
+    for(int p = int(path.size())-1; p>=0; p--)
+    {
+      this_node = path[p];
+      position_of_node[this_node] = int(these_chi_nodes.size());
+      these_chi_nodes.push_back(this_node);
+
+      FlowInfo.retrieve_receiver_information(this_node,receiver_node);
+      if (receiver_node == this_node)
+      {
+        these_receiver_positions.push_back(-1);
+        these_flow_lengths.push_back(0.0);
+      }
+      else
+      {
+        these_receiver_positions.push_back(position_of_node[receiver_node]);
+        if (FlowInfo.retrieve_flow_length_code_of_node(this_node) == 2)
+        {
+          these_flow_lengths.push_back(diag_length);
+        }
+        else
+        {
+          these_flow_lengths.push_back(DataResolution);
+        }
+      }
+    }
+    these_positions[n] = position_of_node[node_sequence[n]];
+  }
+
+  chi_nodes = these_chi_nodes;
+  receiver_positions = these_receiver_positions;
+  flow_lengths = these_flow_lengths;
+  position_of_node_sequence = these_positions;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This integrates chi for each m/n value. The m/n values are independent so
+// they are done in parallel. The arithmetic is the same as in
+// LSDFlowInfo::get_upslope_chi so the chi values are identical.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector< vector<float> > LSDChiTools::integrate_chi_data_for_movern_sweep(vector<int>& receiver_positions,
+                        vector<float>& flow_lengths, vector<float>& drainage,
+                        vector<int>& position_of_node_sequence, float A_0, vector<float>& movern)
+{
+  int n_movern = int(movern.size());
+  int n_chi_nodes = int(receiver_positions.size());
+  int n_nodes = int(position_of_node_sequence.size());
+  vector< vector<float> > chi_of_movern(n_movern);
 
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int i = 0; i<n_movern; i++)
+  {
+    float m_over_n = movern[i];
+    vector<float> chi(n_chi_nodes,0.0);
+    for(int c = 0; c<n_chi_nodes; c++)
+    {
+      if (receiver_positions[c] != -1)
+      {
+        chi[c] = flow_lengths[c]*(pow( (A_0/ drainage[c]),m_over_n))
+                   + chi[receiver_positions[c]];
+      }
+    }
+
+    vector<float> these_chi(n_nodes);
+    for(int n = 0; n<n_nodes; n++)
+    {
+      these_chi[n] = chi[position_of_node_sequence[n]];
+    }
+    chi_of_movern[i].swap(these_chi);
+  }
+  return chi_of_movern;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This runs the collinearity test for every basin and m/n value. The channels
+// of each basin are only collected once, and the basin and m/n combinations
+// are tested in parallel. The files are then printed in order.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::collinearity_fxn_movern_sweep(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        bool only_use_mainstem_as_reference, string file_prefix, float sigma,
+                        bool use_points, vector<float> chi_fractions_vector, bool print_basin_keys)
+{
+  int n_movern = int(movern.size());
   int n_basins = int(ordered_baselevel_nodes.size());
 
   // get the outlet junction of each basin key
+  vector<int> outlet_jns;
   for (int basin_key = 0; basin_key < n_basins; basin_key++)
   {
     int outlet_node = ordered_baselevel_nodes[basin_key];
@@ -6414,148 +6435,159 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
     outlet_jns.push_back(outlet_jn);
   }
 
+  // the channels of each basin
+  vector<movern_basin_network> networks = get_movern_basin_networks(FlowInfo, 0, 0);
+
+  // the results of each basin and m/n. The index is movern_index*n_basins+basin_key
+  int n_tasks = n_movern*n_basins;
+  vector< vector<int> > reference_source(n_tasks);
+  vector< vector<int> > test_source(n_tasks);
+  vector< vector<float> > MLE_values(n_tasks);
+  vector< vector<float> > RMSE_values(n_tasks);
+  vector<float> tot_MLE(n_tasks);
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int task = 0; task<n_tasks; task++)
+  {
+    int i = task/n_basins;
+    int basin_key = task%n_basins;
+    tot_MLE[task] = test_all_segment_collinearity_by_basin(networks[basin_key], chi_of_movern[i],
+                                  only_use_mainstem_as_reference,
+                                  reference_source[task], test_source[task],
+                                  MLE_values[task], RMSE_values[task], sigma,
+                                  use_points, chi_fractions_vector);
+  }
+
   cout << endl << endl << "==========================" << endl;
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
-    movern.push_back( float(i)*delta_movern+start_movern );
     cout << "i: " << i << " and m over n: " << movern[i] << " ";
 
-    // calculate chi
-    float area_threshold = 0;
-    LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                 area_threshold, Discharge);
-    update_chi_data_map(FlowInfo, this_chi);
-
-    // get some vecvecs for storing information about the sources, MLEs, etc
-    // for each iteration
-    vector<int> master_reference_sources, master_test_sources, master_basin_keys;
-    vector< vector<float> > total_MLE_iteration;
+    // open the outfile
+    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats.csv";
+    ofstream movern_stats_out;
+    movern_stats_out.open(filename_fullstats.c_str());
 
-    for (int iteration = 0; iteration < MC_iterations; iteration++)
+    if (print_basin_keys)
     {
-
-      // these are the vectors that will hold the information about the
-      // comparison between channels.
-      // the _all vectors are one of all the basins
-      // reference source is the source key of the reference channel
-      vector<int> reference_source, all_reference_source;
-      // test source is the source key of the test channel
-      vector<int> test_source, all_test_source;
-      // MLE the maximum liklihood estimator
-      vector<float> MLE_values, all_MLE_values;
-      // RMSE is the root mean square error
-      vector<float> RMSE_values, all_RMSE_values;
-
-      vector<float> tot_MLE_vec;
-      // basin keys
-      vector<int> all_basin_keys;
-
-      // now run the collinearity test
-      float tot_MLE;
-
-      // here we need the logic for the chi_fractions
-      float partition_size = max_frac/float(n_fracs);
-      vector<float> chi_fractions_vector;
-      for(int partition = 0; partition < n_fracs; partition++)
+      movern_stats_out << "basin_key,";
+    }
+    movern_stats_out << "reference_source_key,test_source_key,MLE,RMSE" << endl;
+    for(int basin_key = 0; basin_key<n_basins; basin_key++)
+    {
+      int task = i*n_basins+basin_key;
+      int n_rmse_vals = int(RMSE_values[task].size());
+      for(int r = 0; r<n_rmse_vals; r++)
       {
-        float this_part = ran3(&seed)*partition_size;
-        //cout << "This part is: " << this_part << endl;
-
-        chi_fractions_vector.push_back( float(partition)*partition_size + this_part );
-        //cout << "Partion["<< partition << "]: " << chi_fractions_vector[partition] << endl;
+        if (print_basin_keys)
+        {
+          movern_stats_out << basin_key << ",";
+        }
+        movern_stats_out << reference_source[task][r] << ","
+                         << test_source[task][r] << ","
+                         << MLE_values[task][r] << ","
+                         << RMSE_values[task][r] << endl;
       }
+      cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE[task] << endl;
+    }
+    movern_stats_out.close();
+  }
 
+  string filename_bstats = file_prefix+"_basinstats.csv";
+  ofstream stats_by_basin_out;
+  stats_by_basin_out.open(filename_bstats.c_str());
 
-      for(int basin_key = 0; basin_key<n_basins; basin_key++)
-      {
-        //cout << "The sigma is: " << sigma << endl;
-        tot_MLE = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                    basin_key,
-                                    reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                    chi_fractions_vector);
-        // concatenate the vectors to the "all" vectors
-        all_reference_source.insert(all_reference_source.end(), reference_source.begin(), reference_source.end() );
-        all_test_source.insert(all_test_source.end(), test_source.begin(), test_source.end() );
-        all_MLE_values.insert(all_MLE_values.end(), MLE_values.begin(), MLE_values.end() );
-        all_RMSE_values.insert(all_RMSE_values.end(), RMSE_values.begin(), RMSE_values.end() );
-        all_basin_keys.insert(all_basin_keys.end(), reference_source.size(), basin_key);
-
-        tot_MLE_vec.push_back(tot_MLE);
-        //cout << "basin: " << basin_key << " and tot_MLE: " << tot_MLE << endl;
-      }
+  stats_by_basin_out << "basin_key,outlet_jn";
+  stats_by_basin_out.precision(4);
+  for(int i = 0; i< n_movern; i++)
+  {
+    stats_by_basin_out << ",m_over_n = "<<movern[i];
+  }
+  stats_by_basin_out << endl;
+  stats_by_basin_out.precision(9);
+  for(int basin_key = 0; basin_key<n_basins; basin_key++)
+  {
+    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
+    for(int i = 0; i< n_movern; i++)
+    {
+      stats_by_basin_out << "," <<tot_MLE[i*n_basins+basin_key];
+    }
+    stats_by_basin_out << endl;
+  }
 
-      // so we end up with vectors containing the MLE values for each source,
-      // the RMSE, the reference and test sources, and the basin keys.
+  stats_by_basin_out.close();
+}
 
-      // add the data to the vecvecs
-      MLE_vecvec.push_back(all_MLE_values);
-      RMSE_vecvec.push_back(all_RMSE_values);
-      total_MLE_vecvec.push_back(tot_MLE_vec);
-      reference_keys = all_reference_source;
-      test_keys = all_test_source;
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This runs the Monte Carlo points collinearity test for every basin and m/n
+// value. Each basin and m/n value draws its chi fractions from its own random
+// stream, so the results do not depend on the order the basins are tested in.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::collinearity_fxn_movern_sweep_MC(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        bool only_use_mainstem_as_reference, string file_prefix, float sigma,
+                        int n_fracs, int MC_iterations, float max_frac, string file_suffix)
+{
+  int n_movern = int(movern.size());
+  int n_basins = int(ordered_baselevel_nodes.size());
 
-      // if this is the first iteration, push the reference, test, and basin keys vector
-      // into the master vector
-      if(iteration == 0)
-      {
-        master_reference_sources = all_reference_source;
-        master_test_sources = all_test_source;
-        master_basin_keys = master_basin_keys;
-      }
-      else
-      {
-        // check to see if the sources vectors are the same size
-        if (master_reference_sources != all_reference_source)
-        {
-          cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_points_MC" << endl;
-          cout << "We have a problem with the source vector, buddy!" << endl;
-        }
-      }
+  // get the outlet junction of each basin key
+  vector<int> outlet_jns;
+  for (int basin_key = 0; basin_key < n_basins; basin_key++)
+  {
+    int outlet_node = ordered_baselevel_nodes[basin_key];
+    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
+    outlet_jns.push_back(outlet_jn);
+  }
 
-      // in this space we will need logic for storing all the MLE data and RMSE data
-      // for each iteration and each basin. I'll save that work for later.
+  long master_seed = get_random_master_seed();
+  float partition_size = max_frac/float(n_fracs);
 
+  // the channels of each basin
+  vector<movern_basin_network> networks = get_movern_basin_networks(FlowInfo, 0, 0);
 
-      // now get the total MLE vec for each iteration
-      total_MLE_iteration.push_back(tot_MLE_vec);
-    }
+  // the descriptive stats of the MLE of each basin and m/n.
+  // The index is movern_index*n_basins+basin_key
+  int n_tasks = n_movern*n_basins;
+  vector< vector<float> > MLE_stats(n_tasks);
 
-    // now for this m/n, we need to calculate the stats of the MLEs
-    // this is a little slow since we need to reorganise the data in vecotrs
-    // by repeatedly looping over the vecvec
-    vector<float> this_movern_min_MLE;
-    vector<float> this_movern_first_quartile_MLE;
-    vector<float> this_movern_median_MLE;
-    vector<float> this_movern_third_quartile_MLE;
-    vector<float> this_movern_max_MLE;
+  bool use_points = true;
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int task = 0; task<n_tasks; task++)
+  {
+    int i = task/n_basins;
+    int basin_key = task%n_basins;
+    RandomStream rng(master_seed,"movern_sweep",long(basin_key_offset+basin_key)*n_movern+i);
 
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
+    vector<int> reference_source, test_source;
+    vector<float> MLE_values, RMSE_values;
+    vector<float> this_basins_MLE;
+    for (int iteration = 0; iteration < MC_iterations; iteration++)
     {
-      vector<float> this_basins_MLE;
-      for(int iteration = 0; iteration < MC_iterations; iteration ++)
+      // get the chi fractions
+      vector<float> chi_fractions_vector;
+      for(int partition = 0; partition < n_fracs; partition++)
       {
-        this_basins_MLE.push_back( total_MLE_iteration[iteration][basin_key] );
+        float this_part = rng.uniform()*partition_size;
+        chi_fractions_vector.push_back( float(partition)*partition_size + this_part );
       }
 
-      vector<float> descriptive_stats_MLE =  calculate_descriptive_stats(this_basins_MLE);
-
-      this_movern_min_MLE.push_back(descriptive_stats_MLE[0]);
-      this_movern_first_quartile_MLE.push_back(descriptive_stats_MLE[1]);
-      this_movern_median_MLE.push_back(descriptive_stats_MLE[2]);
-      this_movern_third_quartile_MLE.push_back(descriptive_stats_MLE[3]);
-      this_movern_max_MLE.push_back(descriptive_stats_MLE[4]);
+      float tot_MLE = test_all_segment_collinearity_by_basin(networks[basin_key], chi_of_movern[i],
+                                  only_use_mainstem_as_reference,
+                                  reference_source, test_source, MLE_values, RMSE_values, sigma,
+                                  use_points, chi_fractions_vector);
+      this_basins_MLE.push_back(tot_MLE);
     }
+    MLE_stats[task] = calculate_descriptive_stats(this_basins_MLE);
+  }
 
-    // push the data for this m/n into the vecvecs
-    min_MLE.push_back(this_movern_min_MLE);
-    first_quartile_MLE.push_back(this_movern_first_quartile_MLE);
-    median_MLE.push_back(this_movern_median_MLE);
-    third_quartile_MLE.push_back(this_movern_third_quartile_MLE);
-    max_MLE.push_back(this_movern_max_MLE);
+  cout << endl << endl << "==========================" << endl;
+  for(int i = 0; i< n_movern; i++)
+  {
+    cout << "i: " << i << " and m over n: " << movern[i] << " ";
 
     // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_pointsMC_Q.csv";
+    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_pointsMC"+file_suffix+".csv";
     ofstream movern_stats_out;
     movern_stats_out.open(filename_fullstats.c_str());
 
@@ -6563,16 +6595,21 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
     movern_stats_out << "basin_number,minimum_MLE,first_quartile_MLE,median_MLE,third_quartile_MLE,maximum_MLE" << endl;
     for(int basin_key = 0; basin_key<n_basins; basin_key++)
     {
+      vector<float>& these_stats = MLE_stats[i*n_basins+basin_key];
       movern_stats_out << basin_key << ","
-                       << this_movern_min_MLE[basin_key] << ","
-                       << this_movern_first_quartile_MLE[basin_key] << ","
-                       << this_movern_median_MLE[basin_key] << ","
-                       << this_movern_third_quartile_MLE[basin_key] << ","
-                       << this_movern_max_MLE[basin_key] << endl;
+                       << these_stats[0] << ","
+                       << these_stats[1] << ","
+                       << these_stats[2] << ","
+                       << these_stats[3] << ","
+                       << these_stats[4] << endl;
     }
     movern_stats_out.close();
   }
 
+  // open the file that contains the basin stats
+  string filename_bstats = file_prefix+"_points_MC_basinstats"+file_suffix+".csv";
+  ofstream stats_by_basin_out;
+  stats_by_basin_out.open(filename_bstats.c_str());
 
   stats_by_basin_out << "basin_key,outlet_jn";
   stats_by_basin_out.precision(4);
@@ -6595,342 +6632,90 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
     stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
     for(int i = 0; i< n_movern; i++)
     {
-      stats_by_basin_out << "," <<median_MLE[i][basin_key];
+      stats_by_basin_out << "," <<MLE_stats[i*n_basins+basin_key][2];
     }
     for(int i = 0; i< n_movern; i++)
     {
-      stats_by_basin_out << "," <<first_quartile_MLE[i][basin_key];
+      stats_by_basin_out << "," <<MLE_stats[i*n_basins+basin_key][1];
     }
     for(int i = 0; i< n_movern; i++)
     {
-      stats_by_basin_out << "," <<third_quartile_MLE[i][basin_key];
+      stats_by_basin_out << "," <<MLE_stats[i*n_basins+basin_key][3];
     }
     stats_by_basin_out << endl;
   }
 
   stats_by_basin_out.close();
-
 }
 
-
-
-
-
-
-
-
-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This functions test the goodness of fit for the m/n ratio using the 
-// disorder method propsoed by Hergarten et al 2016
+// This runs the disorder test for every basin and m/n value in parallel, and
+// then finds the best fit m/n of each basin.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
-                        float start_movern, float delta_movern, int n_movern,
+void LSDChiTools::disorder_fxn_movern_sweep(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        vector< vector<float> >& chi_of_movern_for_uncert,
                         string file_prefix, bool use_uncert)
 {
-  cout << "I am now entering the disorder loop." << endl;
-
+  int n_movern = int(movern.size());
   int n_basins = int(ordered_baselevel_nodes.size());
-  
-  // some parameters to be stored in vectors
-  cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder" << endl;
-  cout << "I am defaulting to A_0 = 1." << endl;
+
+  // get the outlet junction of each basin key
   vector<int> outlet_jns;
-  vector<float> movern;
-  float A_0 = 1;  
-  
-  vector< vector<float> > disorder_vecvec;
-  
-
-  // get the outlet junction of each basin key
   for (int basin_key = 0; basin_key < n_basins; basin_key++)
   {
     int outlet_node = ordered_baselevel_nodes[basin_key];
     int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
     outlet_jns.push_back(outlet_jn);
   }
-  
-  
-  // We do the full disorder statistic first
-  cout << "I am calculating the disorder statistic!" << endl;
-  
-  vector<float> emptyvec;
-  for(int i = 0; i< n_movern; i++)
-  {
-    // get the m over n value
-    movern.push_back( float(i)*delta_movern+start_movern );
-    //cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    vector<float> these_disorders;
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstats_disorder.csv";
-    //ofstream movern_stats_out;
-    //movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    float area_threshold = 0;
-
-    LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                 area_threshold);
-    update_chi_data_map(FlowInfo, this_chi);
-
-    // these are the vectors that will hold the information about the disorder by basin
-    vector<float> tot_MLE_vec;
-
-    // now run the collinearity test
-    float disorder_stat;
-
-    //for(int basin_key = 0; basin_key<1; basin_key++)
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      //disorder_stat = test_all_segment_collinearity_by_basin_using_disorder(FlowInfo, basin_key);
-      disorder_stat = test_collinearity_by_basin_disorder(FlowInfo, basin_key);
-      cout << "basin: " << basin_key << " and m/n is: " << movern[i] << " and disorder stat is: " << disorder_stat << endl;
-      these_disorders.push_back(disorder_stat);
-    }
-    disorder_vecvec.push_back(these_disorders);
-    
-  }
-  
-  // now we need to loop through the vecvec getting the minimum disorder for each basin
-  map<int,float> best_fit_movern_disorder_map;
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    vector<float> these_disorders;
-    float min_disorder = 1000000000000; // a big number since the disorder needs to be smaller than this.  
-    best_fit_movern_disorder_map[basin_key] = -9999; 
-    for(int i = 0; i< n_movern; i++)
-    {
-      // check to see if this disorder is a minimum for this basin
-      if (disorder_vecvec[i][basin_key] < min_disorder)
-      {
-        min_disorder = disorder_vecvec[i][basin_key];
-        best_fit_movern_disorder_map[basin_key] = movern[i]; 
-      }
-    }
-  }
-  
 
-  // open the file that contains the basin stats
-  string filename_bstats = file_prefix+"_disorder_basinstats.csv";
-  ofstream stats_by_basin_out;
-  stats_by_basin_out.open(filename_bstats.c_str());
-
-  stats_by_basin_out << "basin_key,outlet_jn";
-  stats_by_basin_out.precision(4);
-  for(int i = 0; i< n_movern; i++)
-  {
-    stats_by_basin_out << ",m_over_n = "<<movern[i];
-  }
-  stats_by_basin_out << endl;
-  stats_by_basin_out.precision(9);
-  for(int basin_key = 0; basin_key<n_basins; basin_key++)
-  {
-    stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
-    for(int i = 0; i< n_movern; i++)
-    {
-      stats_by_basin_out << "," <<disorder_vecvec[i][basin_key];
-    }
-    stats_by_basin_out << endl;
-  }
-  stats_by_basin_out.close();
-  
-  
-  // Now if the use uncertainty flag is true, calculate the disorder statistics. 
-  if (use_uncert)
+  // get the nodes of each basin
+  vector< vector<int> > basin_node_indices(n_basins);
+  int n_nodes = int(node_sequence.size());
+  for (int n = 0; n< n_nodes; n++)
   {
-    // first initiate the vectors for holding the combination vecs.
-    // the key is the basin number. Each element will hold the m over n value
-    // with the lowest disorder
-    map<int, vector<float> > best_fit_movern_for_basins;
-    map<int, vector<float> > lowest_disorder_for_basins;
-
-    for(int i = 0; i< n_movern; i++)
+    if (baselevel_keys_data[n] >= 0 && baselevel_keys_data[n] < n_basins)
     {
-      // get the m over n value
-      float this_movern = float(i)*delta_movern+start_movern;
-      movern.push_back( this_movern );
-      cout << "i: " << i << " and m over n: " << movern[i] << endl;
-
-      // calculate chi
-      float area_threshold = 0;
-  
-      LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                   area_threshold);
-      update_chi_data_map(FlowInfo, this_chi);
-      
-      // now loop through basins
-      //for(int basin_key = 0; basin_key<1; basin_key++)
-      for(int basin_key = 0; basin_key<n_basins; basin_key++)
-      {
-        cout << "Testing uncert the basin key is " << basin_key << endl;
-        vector<float> disorder_stats = test_collinearity_by_basin_disorder_with_uncert(FlowInfo, basin_key);
-        
-        // if this is the first m over n value, then initiate the vectors for this basin key
-        if (i == 0)
-        {
-          lowest_disorder_for_basins[basin_key] = disorder_stats;
-          
-          int n_combos_this_basin = int(disorder_stats.size());
-          vector<float> best_fit_movern;
-          for(int bf = 0; bf < n_combos_this_basin; bf++)
-          {
-            best_fit_movern.push_back( this_movern );
-          }
-          best_fit_movern_for_basins[basin_key] = best_fit_movern;
-        }
-        else
-        {
-          // loop through all the combos and get the best fit movern
-          vector<float> existing_lowest_disorder = lowest_disorder_for_basins[basin_key];
-          vector<float> existing_best_fit_movern = best_fit_movern_for_basins[basin_key];
-          int n_combos_this_basin = int(disorder_stats.size());
-          
-          for(int bf = 0; bf < n_combos_this_basin; bf++)
-          {
-            if (existing_lowest_disorder[bf] > disorder_stats[bf] )
-            {
-              existing_lowest_disorder[bf] = disorder_stats[bf];
-              existing_best_fit_movern[bf] = this_movern;
-            }
-          }
-          lowest_disorder_for_basins[basin_key] = existing_lowest_disorder;
-          best_fit_movern_for_basins[basin_key] = existing_best_fit_movern;
-        }
-      }  // end basin loop
-    }    // end m/n loop
-    
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_fullstats_disorder_uncert.csv";
-    ofstream stats_by_basin_out;
-    stats_by_basin_out.open(filename_fullstats.c_str());
-  
-    stats_by_basin_out << "basin_key,N_combinations,minimum,first_quartile,median,third_quartile,maximum,mean,standard_deviation,standard_error,MAD, best_fit_for_all_tribs" << endl;
-    stats_by_basin_out.precision(8);
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      vector<float> these_movern = best_fit_movern_for_basins[basin_key];
-      int n_combinations =  int(these_movern.size());
-      
-      vector<float> these_stats = calculate_descriptive_stats(these_movern);
-      stats_by_basin_out << basin_key << ",";
-      stats_by_basin_out << n_combinations << ",";
-      stats_by_basin_out << these_stats[0] <<",";
-      stats_by_basin_out << these_stats[1] <<",";
-      stats_by_basin_out << these_stats[2] <<",";
-      stats_by_basin_out << these_stats[3] <<",";
-      stats_by_basin_out << these_stats[4] <<",";
-      stats_by_basin_out << these_stats[5] <<",";
-      stats_by_basin_out << these_stats[6] <<",";
-      stats_by_basin_out << these_stats[7] <<",";
-      stats_by_basin_out << these_stats[8] <<",";
-      stats_by_basin_out << best_fit_movern_disorder_map[basin_key] << endl;
+      basin_node_indices[ baselevel_keys_data[n] ].push_back(n);
     }
-    stats_by_basin_out.close();
   }
-}
-
-
-
-
-
-
-
-
-
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This functions test the goodness of fit for the concavity using the 
-// disorder method propsoed by Hergarten et al 2016
-// Uses a discharge raster
-//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_disorder(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
-                        float start_movern, float delta_movern, int n_movern,
-                        string file_prefix, bool use_uncert, LSDRaster& Discharge)
-{
-  cout << "I am now entering the disorder loop." << endl;
 
-  int n_basins = int(ordered_baselevel_nodes.size());
-  
-  // some parameters to be stored in vectors
-  cout << "LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_using_disorder" << endl;
-  cout << "I am defaulting to A_0 = 1." << endl;
-  vector<int> outlet_jns;
-  vector<float> movern;
-  float A_0 = 1;  
-  
-  vector< vector<float> > disorder_vecvec;
-  
-
-  // get the outlet junction of each basin key
-  for (int basin_key = 0; basin_key < n_basins; basin_key++)
-  {
-    int outlet_node = ordered_baselevel_nodes[basin_key];
-    int outlet_jn = JN.get_Junction_of_Node(outlet_node, FlowInfo);
-    outlet_jns.push_back(outlet_jn);
-  }
-  
-  
   // We do the full disorder statistic first
   cout << "I am calculating the disorder statistic!" << endl;
-  
-  vector<float> emptyvec;
+  int n_tasks = n_movern*n_basins;
+  vector<float> disorder(n_tasks);
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int task = 0; task<n_tasks; task++)
+  {
+    int i = task/n_basins;
+    int basin_key = task%n_basins;
+    disorder[task] = test_collinearity_by_basin_disorder(basin_node_indices[basin_key], chi_of_movern[i]);
+  }
   for(int i = 0; i< n_movern; i++)
   {
-    // get the m over n value
-    movern.push_back( float(i)*delta_movern+start_movern );
-    //cout << "i: " << i << " and m over n: " << movern[i] << " ";
-
-    vector<float> these_disorders;
-
-    // open the outfile
-    string filename_fullstats = file_prefix+"_"+dtoa(movern[i])+"_fullstatsq_disorder.csv";
-    //ofstream movern_stats_out;
-    //movern_stats_out.open(filename_fullstats.c_str());
-
-    // calculate chi
-    float area_threshold = 0;
-    LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                 area_threshold, Discharge);
-    update_chi_data_map(FlowInfo, this_chi);
-
-    // these are the vectors that will hold the information about the disorder by basin
-    vector<float> tot_MLE_vec;
-
-    // now run the collinearity test
-    float disorder_stat;
-
-    //for(int basin_key = 0; basin_key<1; basin_key++)
     for(int basin_key = 0; basin_key<n_basins; basin_key++)
     {
-      //disorder_stat = test_all_segment_collinearity_by_basin_using_disorder(FlowInfo, basin_key);
-      disorder_stat = test_collinearity_by_basin_disorder(FlowInfo, basin_key);
-      cout << "basin: " << basin_key << " and m/n is: " << movern[i] << " and disorder stat is: " << disorder_stat << endl;
-      these_disorders.push_back(disorder_stat);
+      cout << "basin: " << basin_key << " and m/n is: " << movern[i] << " and disorder stat is: "
+           << disorder[i*n_basins+basin_key] << endl;
     }
-    disorder_vecvec.push_back(these_disorders);
-    
   }
-  
-  // now we need to loop through the vecvec getting the minimum disorder for each basin
+
+  // now get the minimum disorder for each basin
   map<int,float> best_fit_movern_disorder_map;
   for(int basin_key = 0; basin_key<n_basins; basin_key++)
   {
-    vector<float> these_disorders;
-    float min_disorder = 1000000000000; // a big number since the disorder needs to be smaller than this.  
-    best_fit_movern_disorder_map[basin_key] = -9999; 
+    float min_disorder = 1000000000000; // a big number since the disorder needs to be smaller than this.
+    best_fit_movern_disorder_map[basin_key] = -9999;
     for(int i = 0; i< n_movern; i++)
     {
       // check to see if this disorder is a minimum for this basin
-      if (disorder_vecvec[i][basin_key] < min_disorder)
+      if (disorder[i*n_basins+basin_key] < min_disorder)
       {
-        min_disorder = disorder_vecvec[i][basin_key];
-        best_fit_movern_disorder_map[basin_key] = movern[i]; 
+        min_disorder = disorder[i*n_basins+basin_key];
+        best_fit_movern_disorder_map[basin_key] = movern[i];
       }
     }
   }
-  
 
   // open the file that contains the basin stats
   string filename_bstats = file_prefix+"_disorder_basinstats.csv";
@@ -6950,117 +6735,72 @@ void LSDChiTools::calculate_goodness_of_fit_collinearity_fxn_movern_with_dischar
     stats_by_basin_out << basin_key << "," << outlet_jns[basin_key];
     for(int i = 0; i< n_movern; i++)
     {
-      stats_by_basin_out << "," <<disorder_vecvec[i][basin_key];
+      stats_by_basin_out << "," <<disorder[i*n_basins+basin_key];
     }
     stats_by_basin_out << endl;
   }
   stats_by_basin_out.close();
-  
-  
-  // Now if the use uncertainty flag is true, calculate the disorder statistics. 
+
+  // Now if the use uncertainty flag is true, calculate the disorder statistics.
   if (use_uncert)
   {
-    // first initiate the vectors for holding the combination vecs.
-    // the key is the basin number. Each element will hold the m over n value
-    // with the lowest disorder
-    map<int, vector<float> > best_fit_movern_for_basins;
-    map<int, vector<float> > lowest_disorder_for_basins;
-
-    for(int i = 0; i< n_movern; i++)
+    vector< vector<float> > disorder_stats(n_tasks);
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int task = 0; task<n_tasks; task++)
     {
-      // get the m over n value
-      float this_movern = float(i)*delta_movern+start_movern;
-      movern.push_back( this_movern );
-      cout << "i: " << i << " and m over n: " << movern[i] << endl;
+      int i = task/n_basins;
+      int basin_key = task%n_basins;
+      disorder_stats[task] = test_collinearity_by_basin_disorder_with_uncert(basin_node_indices[basin_key],
+                                                     chi_of_movern_for_uncert[i]);
+    }
 
-      // calculate chi
-      float area_threshold = 0;
-  
-      LSDRaster this_chi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern[i], A_0,
-                                   area_threshold);
-      update_chi_data_map(FlowInfo, this_chi);
-      
-      // now loop through basins
-      //for(int basin_key = 0; basin_key<1; basin_key++)
-      for(int basin_key = 0; basin_key<n_basins; basin_key++)
+    // open the outfile
+    string filename_fullstats = file_prefix+"_fullstats_disorder_uncert.csv";
+    ofstream uncert_out;
+    uncert_out.open(filename_fullstats.c_str());
+
+    uncert_out << "basin_key,N_combinations,minimum,first_quartile,median,third_quartile,maximum,mean,standard_deviation,standard_error,MAD, best_fit_for_all_tribs" << endl;
+    uncert_out.precision(8);
+    for(int basin_key = 0; basin_key<n_basins; basin_key++)
+    {
+      // for each combination, get the m/n value with the lowest disorder
+      vector<float> lowest_disorder = disorder_stats[basin_key];
+      int n_combinations = int(lowest_disorder.size());
+      vector<float> these_movern(n_combinations,movern[0]);
+      for(int i = 1; i< n_movern; i++)
       {
-        cout << "Testing uncert the basin key is " << basin_key << endl;
-        vector<float> disorder_stats = test_collinearity_by_basin_disorder_with_uncert(FlowInfo, basin_key);
-        
-        // if this is the first m over n value, then initiate the vectors for this basin key
-        if (i == 0)
+        vector<float>& these_disorders = disorder_stats[i*n_basins+basin_key];
+        for(int bf = 0; bf < n_combinations; bf++)
         {
-          lowest_disorder_for_basins[basin_key] = disorder_stats;
-          
-          int n_combos_this_basin = int(disorder_stats.size());
-          vector<float> best_fit_movern;
-          for(int bf = 0; bf < n_combos_this_basin; bf++)
+          if (lowest_disorder[bf] > these_disorders[bf] )
           {
-            best_fit_movern.push_back( this_movern );
+            lowest_disorder[bf] = these_disorders[bf];
+            these_movern[bf] = movern[i];
           }
-          best_fit_movern_for_basins[basin_key] = best_fit_movern;
         }
-        else
-        {
-          // loop through all the combos and get the best fit movern
-          vector<float> existing_lowest_disorder = lowest_disorder_for_basins[basin_key];
-          vector<float> existing_best_fit_movern = best_fit_movern_for_basins[basin_key];
-          int n_combos_this_basin = int(disorder_stats.size());
-          
-          for(int bf = 0; bf < n_combos_this_basin; bf++)
-          {
-            if (existing_lowest_disorder[bf] > disorder_stats[bf] )
-            {
-              existing_lowest_disorder[bf] = disorder_stats[bf];
-              existing_best_fit_movern[bf] = this_movern;
-            }
-          }
-          lowest_disorder_for_basins[basin_key] = existing_lowest_disorder;
-          best_fit_movern_for_basins[basin_key] = existing_best_fit_movern;
-        }
-      }  // end basin loop
-    }    // end m/n loop
-    
+      }
 
-    // open the outfile
-    string filename_fullstats = file_prefix+"_fullstats_disorder_uncert.csv";
-    ofstream stats_by_basin_out;
-    stats_by_basin_out.open(filename_fullstats.c_str());
-  
-    stats_by_basin_out << "basin_key,N_combinations,minimum,first_quartile,median,third_quartile,maximum,mean,standard_deviation,standard_error,MAD, best_fit_for_all_tribs" << endl;
-    stats_by_basin_out.precision(8);
-    for(int basin_key = 0; basin_key<n_basins; basin_key++)
-    {
-      vector<float> these_movern = best_fit_movern_for_basins[basin_key];
-      int n_combinations =  int(these_movern.size());
-      
       vector<float> these_stats = calculate_descriptive_stats(these_movern);
-      stats_by_basin_out << basin_key << ",";
-      stats_by_basin_out << n_combinations << ",";
-      stats_by_basin_out << these_stats[0] <<",";
-      stats_by_basin_out << these_stats[1] <<",";
-      stats_by_basin_out << these_stats[2] <<",";
-      stats_by_basin_out << these_stats[3] <<",";
-      stats_by_basin_out << these_stats[4] <<",";
-      stats_by_basin_out << these_stats[5] <<",";
-      stats_by_basin_out << these_stats[6] <<",";
-      stats_by_basin_out << these_stats[7] <<",";
-      stats_by_basin_out << these_stats[8] <<",";
-      stats_by_basin_out << best_fit_movern_disorder_map[basin_key] << endl;
-    }
-    stats_by_basin_out.close();
+      uncert_out << basin_key << ",";
+      uncert_out << n_combinations << ",";
+      uncert_out << these_stats[0] <<",";
+      uncert_out << these_stats[1] <<",";
+      uncert_out << these_stats[2] <<",";
+      uncert_out << these_stats[3] <<",";
+      uncert_out << these_stats[4] <<",";
+      uncert_out << these_stats[5] <<",";
+      uncert_out << these_stats[6] <<",";
+      uncert_out << these_stats[7] <<",";
+      uncert_out << these_stats[8] <<",";
+      uncert_out << best_fit_movern_disorder_map[basin_key] << endl;
+    }
+    uncert_out.close();
   }
 }
 
 
 
 
-
-
-
-
-
-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This drives the m/n MCMC analysis
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -7231,173 +6971,705 @@ float LSDChiTools::MCMC_for_movern_tune_sigma(LSDFlowInfo& FlowInfo, int minimum
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-// This runs an MCMC chain on the goodness of fit for a basin
+// This runs an MCMC chain on the goodness of fit for a basin
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float LSDChiTools::MCMC_for_movern(string ChainFname, bool printChain, LSDFlowInfo& FlowInfo,
+                                 int minimum_contributing_pixels, int NIterations,
+                                 float sigma, float dmovern_stddev,
+                                 float movern_minimum, float movern_maximum,
+                                 int basin_key, bool use_points)
+{
+
+  map<int,int> outlet_node_from_basin_key_map = get_outlet_node_from_basin_key_map();
+
+  vector<float> chi_upslope_fracs;
+  float start_frac = 0.4;
+  float dfrac = 0.025;
+  for(int i = 0; i< 11; i++)
+  {
+    chi_upslope_fracs.push_back(start_frac - float(i)*dfrac);
+  }
+
+
+  //Declarations
+  float LastLikelihood;               //Last accepted likelihood
+  float NewLikelihood;                //New likelihood
+  float LikelihoodRatio;              //Ratio between last and new likelihoods
+  float AcceptanceProbability;        //New iteration is accepted if likelihood ratio exceeds
+
+  int NAccepted = 0;      //count accepted parameters
+  int NRejected = 0;      //count rejected parameters
+
+  // these are the vectors that will hold the information about the
+  // comparison between channels.
+  // the _all vectors are one of all the basins
+  // reference source is the source key of the reference channel
+  vector<int> reference_source, all_reference_source;
+  // test source is the source key of the test channel
+  vector<int> test_source, all_test_source;
+  // MLE the maximum liklihood estimator
+  vector<float> MLE_values, all_MLE_values;
+  // RMSE is the root mean square error
+  vector<float> RMSE_values, all_RMSE_values;
+
+  // the chain draws from a random stream of its own, keyed by the basin
+  RandomStream rng(get_random_master_seed(),"movern_mcmc",basin_key_offset+basin_key);
+
+  // these are numbers for the change in   chi
+  float gauss_mean = 0;
+  float std_dev = dmovern_stddev;
+  float gauss_minimum = -3.0*std_dev;   // the gaussian function implemented in statstools truncates at 3 standard deviations
+  bool allowNegative = true;
+
+  ofstream ChainFileOut(ChainFname.c_str());
+  if(printChain)
+  {
+    ChainFileOut  << "i,movern_New,movern_Old,NewLikelihood,LastLikelihood,NAccepted,NRejected" << endl;
+  }
+
+
+  // Caluclate initial chi
+  float A_0 = 1;
+  float dmovern, movern_old, movern_new, reflect;
+  movern_old = 0.5;
+  movern_new = 0.5;
+  update_chi_data_map(FlowInfo, A_0, movern_new);
+
+  // get the initial MLE
+  bool only_use_mainstem_as_reference = true;
+  if (use_points)
+  {
+    LastLikelihood = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
+                                  basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma,
+                                  chi_upslope_fracs);
+  }
+  else
+  {
+    LastLikelihood = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
+                                  basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma);
+  }
+
+  int print_interval = 100;
+
+  // Now do the metropolis hastings algorithm
+  for (int j = 0; j<NIterations; j++)
+  {
+    if (j%print_interval == 0)
+    {
+      cout << "Iteration " << j << " of " << NIterations << endl;
+    }
+
+    // Vary the movern value
+    dmovern = getGaussianRandom(gauss_minimum, gauss_mean, allowNegative, rng);
+    movern_new = movern_old + dmovern;
+    //cout << "dmovern is: " << dmovern << " and New m over n is: " <<  movern_new << endl;
+    // reflect the data if necessary
+    if ( movern_new < movern_minimum)
+    {
+      reflect = movern_minimum - movern_new;
+      movern_new = reflect+movern_minimum;
+    }
+    if ( movern_new > movern_maximum)
+    {
+      reflect = movern_new- movern_maximum;
+      movern_new = movern_maximum - reflect;
+    }
+
+    //cout << "After reflect New m over n is: " <<  movern_new << endl;
+
+    // run the model with the new parameters
+    update_chi_data_map_for_single_basin(FlowInfo, A_0, movern_new,
+                                     minimum_contributing_pixels, basin_key,
+                                     outlet_node_from_basin_key_map);
+    //cout << "Got chi " << endl;
+    if (use_points)
+    {
+      NewLikelihood = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
+                                    basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma,
+                                    chi_upslope_fracs);
+    }
+    else
+    {
+      NewLikelihood = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
+                                    basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma);
+    }
+    // get the likelihood ratio
+    LikelihoodRatio = NewLikelihood/LastLikelihood;
+
+    //cout << "Ratio: " << LikelihoodRatio << "New MLE: " << NewLikelihood << " and old MLE: " << LastLikelihood << endl;
+
+    // get the acceptance probability (this is set up so that occasional
+    // guesses that are worse than the lst one get accepted so that
+    // the chain can visit all of parameter space)
+    AcceptanceProbability = rng.uniform();
+
+    // if accepted
+    if (LikelihoodRatio > AcceptanceProbability)
+    {
+      NAccepted++;
+    }
+    else
+    {
+      NRejected++;
+    }
+
+    // Now print to the chain file
+    if(printChain)
+    {
+      ChainFileOut  << j << "," << movern_new << "," << movern_old << ","
+                    << NewLikelihood << "," << LastLikelihood << ","
+                    << NAccepted << "," << NRejected << endl;
+
+    // reset m over n old
+    if (LikelihoodRatio > AcceptanceProbability)
+    {
+      LastLikelihood = NewLikelihood;
+      movern_old = movern_new;
+    }
+    }
+  }
+
+
+  ChainFileOut.close();
+
+
+  float accept_percent = float(NAccepted)/ float(NAccepted+NRejected);
+  return accept_percent;
+
+
+
+}
+
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This drives the m/n MCMC analysis with several chains per basin
+// All of the chains in all of the basins run at once. The chains are advanced
+// in batches of links and the convergence of each basin is checked between
+// batches, so the chains (and the point at which they stop) are the same for
+// any number of threads.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDChiTools::MCMC_multichain_driver(LSDFlowInfo& FlowInfo, int minimum_contributing_pixels,
+                                float movern_minimum, float movern_maximum,
+                                int N_chain_links, int N_chains, int N_burn_in_links,
+                                float target_Rhat, float target_ESS,
+                                string OUT_DIR, string OUT_ID, bool use_points)
+{
+  float A_0 = 1;
+
+  // the chains move on a lattice of m/n values so that visited values can be cached
+  float movern_resolution = 0.001;
+  int n_lattice_points = int((movern_maximum-movern_minimum)/movern_resolution+0.5)+1;
+
+  // the fractions of the mainstem used by the point version of the collinearity test
+  vector<float> chi_upslope_fracs;
+  float start_frac = 0.4;
+  float dfrac = 0.025;
+  for(int i = 0; i< 11; i++)
+  {
+    chi_upslope_fracs.push_back(start_frac - float(i)*dfrac);
+  }
+
+  if (N_chains < 2)
+  {
+    cout << "LSDChiTools::MCMC_multichain_driver You need at least two chains to check convergence, I am using 2." << endl;
+    N_chains = 2;
+  }
+
+  cout << "Setting up the basin networks for the MCMC chains." << endl;
+  vector<movern_basin_network> networks = get_movern_basin_networks(FlowInfo,
+                                        minimum_contributing_pixels, n_lattice_points);
+  int n_basins = int(networks.size());
+
+  // each chain has its own random stream, and each basin has another for
+  // tuning sigma
+  long master_seed = get_random_master_seed();
+
+  // First tune sigma to get between 20 and 33% acceptance with a dmovern
+  // stddev of 0.1, as MCMC_for_movern_tune_sigma does
+  float initial_dmovern_stddev = 0.1;
+  float min_acceptance_rate = 0.2;
+  float max_acceptance_rate = 0.33;
+  vector<float> sigma_of_basin(n_basins);
+  cout << "Tuning sigma in " << n_basins << " basins." << endl;
+  #pragma omp parallel for schedule(dynamic,1)
+  for(int basin_key = 0; basin_key<n_basins; basin_key++)
+  {
+    RandomStream rng(master_seed,"movern_mcmc_tuning",basin_key_offset+basin_key);
+    float this_sigma = (use_points) ? 100 : 2000;
+    int NIterations = 2500;
+    vector<float> link_records;
+
+    for(int n_steps = 0; n_steps < 20; n_steps++)
+    {
+      int lattice_index = int((0.5-movern_minimum)/movern_resolution+0.5);
+      if (lattice_index < 0 || lattice_index >= n_lattice_points)
+      {
+        lattice_index = n_lattice_points/2;
+      }
+      link_records.clear();
+      int n_accepted = advance_movern_chain(networks[basin_key], NIterations, this_sigma,
+                                initial_dmovern_stddev, movern_minimum, movern_resolution, A_0,
+                                use_points, chi_upslope_fracs, lattice_index, rng, link_records);
+      float this_acceptance_rate = float(n_accepted)/float(NIterations);
+
+      if (this_acceptance_rate > max_acceptance_rate)
+      {
+        this_sigma = this_sigma*0.77;
+      }
+      else if (this_acceptance_rate < min_acceptance_rate)
+      {
+        this_sigma = this_sigma*1.45;
+      }
+      else
+      {
+        n_steps = 20;
+      }
+    }
+    sigma_of_basin[basin_key] = this_sigma;
+  }
+
+  // set up the chains. They start spread evenly across the m/n range so that
+  // the Gelman-Rubin statistic can tell if they have found the same distribution
+  int n_tasks = n_basins*N_chains;
+  vector<int> lattice_index_of_chain(n_tasks);
+  vector<float> dmovern_stddev_of_chain(n_tasks,initial_dmovern_stddev);
+  vector<int> accepted_in_batch(n_tasks,0);
+  vector< vector<float> > link_records_of_chain(n_tasks);
+  vector<RandomStream> rng_of_chain(n_tasks);
+  for(int task = 0; task<n_tasks; task++)
+  {
+    int basin_key = task/N_chains;
+    int chain = task%N_chains;
+    lattice_index_of_chain[task] = int( (float(chain)+0.5)*float(n_lattice_points)/float(N_chains) );
+    rng_of_chain[task].reset(master_seed,"movern_mcmc_chains",long(basin_key_offset+basin_key)*N_chains+chain);
+  }
+
+  float max_dmovern = (movern_maximum-movern_minimum)/3;
+  int batch_size = 100;
+  vector<bool> basin_is_finished(n_basins,false);
+  vector<int> links_in_basin(n_basins,0);
+  vector<float> Rhat_of_basin(n_basins,1e10);
+  vector<float> ESS_of_basin(n_basins,0);
+  vector<bool> basin_has_converged(n_basins,false);
+
+  int n_links = 0;
+  int n_finished = 0;
+  while(n_links < N_chain_links && n_finished < n_basins)
+  {
+    int this_batch = min(batch_size,N_chain_links-n_links);
+
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int task = 0; task<n_tasks; task++)
+    {
+      int basin_key = task/N_chains;
+      if (not basin_is_finished[basin_key])
+      {
+        accepted_in_batch[task] = advance_movern_chain(networks[basin_key], this_batch,
+                                sigma_of_basin[basin_key], dmovern_stddev_of_chain[task],
+                                movern_minimum, movern_resolution, A_0,
+                                use_points, chi_upslope_fracs, lattice_index_of_chain[task],
+                                rng_of_chain[task], link_records_of_chain[task]);
+      }
+    }
+    n_links += this_batch;
+    cout << "Finished " << n_links << " of " << N_chain_links << " links." << endl;
+
+    for(int basin_key = 0; basin_key<n_basins; basin_key++)
+    {
+      if (basin_is_finished[basin_key])
+      {
+        continue;
+      }
+      links_in_basin[basin_key] = n_links;
+
+      if (n_links <= N_burn_in_links)
+      {
+        // burn in: tune the step size of each chain using the acceptance
+        // rate of the last batch
+        for(int chain = 0; chain<N_chains; chain++)
+        {
+          int task = basin_key*N_chains+chain;
+          float this_acceptance_rate = float(accepted_in_batch[task])/float(this_batch);
+          if (this_acceptance_rate > max_acceptance_rate)
+          {
+            dmovern_stddev_of_chain[task] = dmovern_stddev_of_chain[task]*1.45;
+          }
+          else if (this_acceptance_rate < min_acceptance_rate)
+          {
+            dmovern_stddev_of_chain[task] = dmovern_stddev_of_chain[task]*0.77;
+          }
+          if (dmovern_stddev_of_chain[task] > max_dmovern)
+          {
+            dmovern_stddev_of_chain[task] = max_dmovern;
+          }
+          if (dmovern_stddev_of_chain[task] < movern_resolution)
+          {
+            dmovern_stddev_of_chain[task] = movern_resolution;
+          }
+        }
+      }
+      else
+      {
+        // after burn in, check if the chains have mixed
+        vector< vector<float> > samples(N_chains);
+        float pooled_ESS = 0;
+        for(int chain = 0; chain<N_chains; chain++)
+        {
+          vector<float>& records = link_records_of_chain[basin_key*N_chains+chain];
+          for(int link = N_burn_in_links; link<n_links; link++)
+          {
+            bool accepted = (records[5*link+4] > 0.5);
+            samples[chain].push_back( (accepted) ? records[5*link] : records[5*link+1] );
+          }
+          pooled_ESS += effective_sample_size(samples[chain]);
+        }
+        Rhat_of_basin[basin_key] = gelman_rubin_Rhat(samples);
+        ESS_of_basin[basin_key] = pooled_ESS;
+
+        if (Rhat_of_basin[basin_key] < target_Rhat && pooled_ESS >= target_ESS)
+        {
+          cout << "Basin " << basin_key << " has converged after " << n_links << " links. Rhat: "
+               << Rhat_of_basin[basin_key] << " ESS: " << pooled_ESS << endl;
+          basin_has_converged[basin_key] = true;
+          basin_is_finished[basin_key] = true;
+          n_finished++;
+        }
+      }
+    }
+  }
+
+  // now print the chains and the summary
+  string summary_fname = OUT_DIR+OUT_ID+"_MCMC_movern_summary.csv";
+  ofstream summary_out(summary_fname.c_str());
+  summary_out << "basin_key,sigma,N_links,Rhat,ESS,acceptance_rate,movern_mean,movern_stddev,movern_median,converged" << endl;
+  for(int basin_key = 0; basin_key<n_basins; basin_key++)
+  {
+    string chain_file = OUT_DIR+OUT_ID+"_Basin"+itoa(basin_key)+"_chain.csv";
+    ofstream ChainFileOut(chain_file.c_str());
+    ChainFileOut  << "i,movern_New,movern_Old,NewLikelihood,LastLikelihood,NAccepted,NRejected,chain" << endl;
+
+    vector<float> pooled_samples;
+    int total_accepted = 0;
+    int total_links = 0;
+    for(int chain = 0; chain<N_chains; chain++)
+    {
+      vector<float>& records = link_records_of_chain[basin_key*N_chains+chain];
+      int n_chain_links = int(records.size())/5;
+      int NAccepted = 0;
+      int NRejected = 0;
+      for(int link = 0; link<n_chain_links; link++)
+      {
+        bool accepted = (records[5*link+4] > 0.5);
+        if (accepted)
+        {
+          NAccepted++;
+        }
+        else
+        {
+          NRejected++;
+        }
+        ChainFileOut  << link << "," << records[5*link] << "," << records[5*link+1] << ","
+                      << records[5*link+2] << "," << records[5*link+3] << ","
+                      << NAccepted << "," << NRejected << "," << chain << endl;
+
+        if (link >= N_burn_in_links || n_chain_links <= N_burn_in_links)
+        {
+          pooled_samples.push_back( (accepted) ? records[5*link] : records[5*link+1] );
+        }
+      }
+      total_accepted += NAccepted;
+      total_links += n_chain_links;
+    }
+    ChainFileOut.close();
+
+    float movern_mean = get_mean(pooled_samples);
+    float movern_stddev = get_standard_deviation(pooled_samples, movern_mean);
+    float movern_median = get_median(pooled_samples);
+    float acceptance_rate = (total_links > 0) ? float(total_accepted)/float(total_links) : 0;
+
+    summary_out << basin_key << "," << sigma_of_basin[basin_key] << "," << links_in_basin[basin_key] << ","
+                << Rhat_of_basin[basin_key] << "," << ESS_of_basin[basin_key] << ","
+                << acceptance_rate << "," << movern_mean << "," << movern_stddev << ","
+                << movern_median << "," << basin_has_converged[basin_key] << endl;
+  }
+  summary_out.close();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This sets up the basin networks used by the multi-chain MCMC.
+// The chi integration uses the same flow lengths and drainage areas as
+// LSDFlowInfo::get_upslope_chi_return_map so the chi values are the same as
+// those from update_chi_data_map_for_single_basin.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-float LSDChiTools::MCMC_for_movern(string ChainFname, bool printChain, LSDFlowInfo& FlowInfo,
-                                 int minimum_contributing_pixels, int NIterations,
-                                 float sigma, float dmovern_stddev,
-                                 float movern_minimum, float movern_maximum,
-                                 int basin_key, bool use_points)
+vector<movern_basin_network> LSDChiTools::get_movern_basin_networks(LSDFlowInfo& FlowInfo,
+                                int minimum_contributing_pixels, int n_lattice_points)
 {
+  int n_basins = int(ordered_baselevel_nodes.size());
+  int n_nodes = int(node_sequence.size());
+  vector<movern_basin_network> networks(n_basins);
 
-  map<int,int> outlet_node_from_basin_key_map = get_outlet_node_from_basin_key_map();
-
-  vector<float> chi_upslope_fracs;
-  float start_frac = 0.4;
-  float dfrac = 0.025;
-  for(int i = 0; i< 11; i++)
+  // sort the nodes of each basin by flow distance. Receivers are always closer
+  // to the outlet than their donors.
+  vector< vector< pair<float,int> > > nodes_by_distance(n_basins);
+  for(int n = 0; n<n_nodes; n++)
   {
-    chi_upslope_fracs.push_back(start_frac - float(i)*dfrac);
+    int basin_key = baselevel_keys_data[n];
+    if (basin_key >= 0 && basin_key < n_basins)
+    {
+      nodes_by_distance[basin_key].push_back( make_pair(flow_distance_data[n],n) );
+    }
   }
 
+  float DataResolution = FlowInfo.get_DataResolution();
+  float root2 = 1.41421356;
+  float diag_length = root2*DataResolution;
+  float pixel_area = DataResolution*DataResolution;
 
-  //Declarations
-  float LastLikelihood;               //Last accepted likelihood
-  float NewLikelihood;                //New likelihood
-  float LikelihoodRatio;              //Ratio between last and new likelihoods
-  float AcceptanceProbability;        //New iteration is accepted if likelihood ratio exceeds
+  // the position of each node within its basin
+  vector<int> position_in_basin(n_nodes,-1);
 
-  int NAccepted = 0;      //count accepted parameters
-  int NRejected = 0;      //count rejected parameters
+  // get the sources of each basin
+  vector<int> start_node_for_baselevel;
+  vector<int> n_sources_in_basin;
+  baselevel_and_source_splitter(n_sources_in_basin, start_node_for_baselevel);
 
-  // these are the vectors that will hold the information about the
-  // comparison between channels.
-  // the _all vectors are one of all the basins
-  // reference source is the source key of the reference channel
-  vector<int> reference_source, all_reference_source;
-  // test source is the source key of the test channel
-  vector<int> test_source, all_test_source;
-  // MLE the maximum liklihood estimator
-  vector<float> MLE_values, all_MLE_values;
-  // RMSE is the root mean square error
-  vector<float> RMSE_values, all_RMSE_values;
+  for(int basin_key = 0; basin_key<n_basins; basin_key++)
+  {
+    movern_basin_network& network = networks[basin_key];
+    sort(nodes_by_distance[basin_key].begin(), nodes_by_distance[basin_key].end());
 
-  // you need a seed for the random number generator
-  long seed = time(NULL);
+    int n_basin_nodes = int(nodes_by_distance[basin_key].size());
+    for(int i = 0; i<n_basin_nodes; i++)
+    {
+      network.node_indices.push_back(nodes_by_distance[basin_key][i].second);
+      position_in_basin[network.node_indices[i]] = i;
+    }
 
-  // these are numbers for the change in   chi
-  float gauss_mean = 0;
-  float std_dev = dmovern_stddev;
-  float gauss_minimum = -3.0*std_dev;   // the gaussian function implemented in statstools truncates at 3 standard deviations
-  bool allowNegative = true;
+    for(int i = 0; i<n_basin_nodes; i++)
+    {
+      int this_node = node_sequence[network.node_indices[i]];
+      int receiver_node;
+      FlowInfo.retrieve_receiver_information(this_node,receiver_node);
+      int receiver_index = get_node_sequence_index(receiver_node);
 
-  ofstream ChainFileOut(ChainFname.c_str());
-  if(printChain)
-  {
-    ChainFileOut  << "i,movern_New,movern_Old,NewLikelihood,LastLikelihood,NAccepted,NRejected" << endl;
-  }
+      int receiver_position = -1;
+      if (receiver_node != this_node && receiver_index != NoDataValue
+          && baselevel_keys_data[receiver_index] == basin_key)
+      {
+        receiver_position = position_in_basin[receiver_index];
+      }
+      network.receiver_positions.push_back(receiver_position);
 
+      float dx = (FlowInfo.retrieve_flow_length_code_of_node(this_node) == 2) ? diag_length : DataResolution;
+      int contributing_pixels = FlowInfo.retrieve_contributing_pixels_of_node(this_node);
+      network.flow_lengths.push_back(dx);
+      network.drainage_areas.push_back(float(contributing_pixels)*pixel_area);
+      network.has_chi.push_back(contributing_pixels >= minimum_contributing_pixels);
+    }
 
-  // Caluclate initial chi
-  float A_0 = 1;
-  float dmovern, movern_old, movern_new, reflect;
-  movern_old = 0.5;
-  movern_new = 0.5;
-  update_chi_data_map(FlowInfo, A_0, movern_new);
+    // now the channels, mainstem first
+    network.first_source_key = NoDataValue;
+    if (basin_key < int(n_sources_in_basin.size()))
+    {
+      int channel_offset = start_node_for_baselevel[basin_key];
+      network.first_source_key = channel_offset;
+      for(int chan = 0; chan<n_sources_in_basin[basin_key]; chan++)
+      {
+        vector<int> channel_indices = get_node_sequence_indices_of_channel(FlowInfo, channel_offset+chan);
+        vector<int> channel_positions;
+        vector<float> channel_elevations;
+        for(int i = 0; i< int(channel_indices.size()); i++)
+        {
+          channel_positions.push_back(position_in_basin[channel_indices[i]]);
+          channel_elevations.push_back(elev_data[channel_indices[i]]);
+        }
+        network.channel_positions.push_back(channel_positions);
+        network.channel_elevations.push_back(channel_elevations);
+      }
+    }
 
-  // get the initial MLE
-  bool only_use_mainstem_as_reference = true;
-  if (use_points)
+    network.misfit_cache.assign(n_lattice_points,-1.0);
+  }
+  return networks;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets chi on a basin network and returns the misfit of the tributaries
+// against the mainstem. It is the sum of squared residuals that
+// test_all_segment_collinearity_by_basin(_using_points) turns into a likelihood
+// when only the mainstem is used as a reference.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+double LSDChiTools::calculate_movern_misfit_of_basin(movern_basin_network& network, float movern, float A_0,
+                                bool use_points, vector<float>& chi_fractions)
+{
+  int n_nodes = int(network.node_indices.size());
+  vector<float> chi(n_nodes,0.0);
+  for(int i = 0; i<n_nodes; i++)
   {
-    LastLikelihood = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                  chi_upslope_fracs);
+    int receiver_position = network.receiver_positions[i];
+    if (receiver_position != -1 && network.has_chi[i])
+    {
+      chi[i] = network.flow_lengths[i]*(pow( (A_0/ network.drainage_areas[i]),movern))
+                          + chi[receiver_position];
+    }
   }
-  else
+
+  int n_channels = int(network.channel_positions.size());
+  if (n_channels < 2)
   {
-    LastLikelihood = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
-                                  basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma);
+    return 0.0;
   }
 
-  int print_interval = 100;
+  vector<float> mainstem_chi;
+  for(int i = 0; i< int(network.channel_positions[0].size()); i++)
+  {
+    mainstem_chi.push_back(chi[network.channel_positions[0][i]]);
+  }
 
-  // Now do the metropolis hastings algorithm
-  for (int j = 0; j<NIterations; j++)
+  vector<float> chi_test_distances;
+  if (use_points)
   {
-    if (j%print_interval == 0)
+    int n_MS_nodes = int(mainstem_chi.size());
+    float MS_length = mainstem_chi[0]-mainstem_chi[n_MS_nodes-1];
+    for(int f = 0; f< int(chi_fractions.size()); f++)
     {
-      cout << "Iteration " << j << " of " << NIterations << endl;
+      chi_test_distances.push_back(chi_fractions[f]*MS_length);
     }
+  }
 
-    // Vary the movern value
-    dmovern = getGaussianRandom(gauss_minimum, gauss_mean, allowNegative);
-    movern_new = movern_old + dmovern;
-    //cout << "dmovern is: " << dmovern << " and New m over n is: " <<  movern_new << endl;
-    // reflect the data if necessary
-    if ( movern_new < movern_minimum)
-    {
-      reflect = movern_minimum - movern_new;
-      movern_new = reflect+movern_minimum;
-    }
-    if ( movern_new > movern_maximum)
+  double misfit = 0;
+  for(int chan = 1; chan<n_channels; chan++)
+  {
+    vector<float> trib_chi;
+    for(int i = 0; i< int(network.channel_positions[chan].size()); i++)
     {
-      reflect = movern_new- movern_maximum;
-      movern_new = movern_maximum - reflect;
+      trib_chi.push_back(chi[network.channel_positions[chan][i]]);
     }
 
-    //cout << "After reflect New m over n is: " <<  movern_new << endl;
-
-    // run the model with the new parameters
-    update_chi_data_map_for_single_basin(FlowInfo, A_0, movern_new,
-                                     minimum_contributing_pixels, basin_key,
-                                     outlet_node_from_basin_key_map);
-    //cout << "Got chi " << endl;
+    vector<float> residuals;
     if (use_points)
     {
-      NewLikelihood = test_all_segment_collinearity_by_basin_using_points(FlowInfo, only_use_mainstem_as_reference,
-                                    basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma,
-                                    chi_upslope_fracs);
+      residuals = project_points_onto_reference_channel(mainstem_chi, network.channel_elevations[0],
+                                 trib_chi, network.channel_elevations[chan], chi_test_distances);
     }
     else
     {
-      NewLikelihood = test_all_segment_collinearity_by_basin(FlowInfo, only_use_mainstem_as_reference,
-                                    basin_key,reference_source, test_source, MLE_values, RMSE_values, sigma);
+      residuals = project_data_onto_reference_channel(mainstem_chi, network.channel_elevations[0],
+                                 trib_chi, network.channel_elevations[chan]);
     }
-    // get the likelihood ratio
-    LikelihoodRatio = NewLikelihood/LastLikelihood;
 
-    //cout << "Ratio: " << LikelihoodRatio << "New MLE: " << NewLikelihood << " and old MLE: " << LastLikelihood << endl;
+    // points upstream of the end of the mainstem are flagged with -9999: skip them
+    for(int r = 0; r< int(residuals.size()); r++)
+    {
+      if (residuals[r] != -9999)
+      {
+        misfit += double(residuals[r])*double(residuals[r]);
+      }
+    }
+  }
+  return misfit;
+}
 
-    // get the acceptance probability (this is set up so that occasional
-    // guesses that are worse than the lst one get accepted so that
-    // the chain can visit all of parameter space)
-    AcceptanceProbability = ran3(&seed);
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Gets the misfit of a lattice point from the cache, calculating it if this is
+// the first visit. Two threads might both calculate a new point but they get
+// the same value so it does not matter which one is stored.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+double LSDChiTools::get_cached_movern_misfit(movern_basin_network& network, int lattice_index,
+                                float movern_minimum, float movern_resolution, float A_0,
+                                bool use_points, vector<float>& chi_fractions)
+{
+  double misfit;
+  #pragma omp critical(movern_misfit_cache)
+  {
+    misfit = network.misfit_cache[lattice_index];
+  }
 
-    // if accepted
-    if (LikelihoodRatio > AcceptanceProbability)
+  if (misfit < 0)
+  {
+    float movern = movern_minimum+float(lattice_index)*movern_resolution;
+    misfit = calculate_movern_misfit_of_basin(network, movern, A_0, use_points, chi_fractions);
+
+    #pragma omp critical(movern_misfit_cache)
     {
-      NAccepted++;
+      network.misfit_cache[lattice_index] = misfit;
     }
-    else
+  }
+  return misfit;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This adds links to a Metropolis chain on the m/n lattice. The proposals and
+// the reflection at the edges of the m/n range are the same as in
+// MCMC_for_movern; the proposed m/n is then rounded to the lattice.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+int LSDChiTools::advance_movern_chain(movern_basin_network& network, int N_links, float sigma, float dmovern_stddev,
+                                float movern_minimum, float movern_resolution, float A_0,
+                                bool use_points, vector<float>& chi_fractions,
+                                int& lattice_index, RandomStream& rng, vector<float>& link_records)
+{
+  int n_lattice_points = int(network.misfit_cache.size());
+  float movern_maximum = movern_minimum+float(n_lattice_points-1)*movern_resolution;
+
+  // these are numbers for the change in chi
+  float gauss_mean = 0;
+  float gauss_minimum = -3.0*dmovern_stddev;
+  bool allowNegative = true;
+  double two_sigma_sq = 2.0*double(sigma)*double(sigma);
+
+  double last_misfit = get_cached_movern_misfit(network, lattice_index, movern_minimum,
+                                movern_resolution, A_0, use_points, chi_fractions);
+  int n_accepted = 0;
+  for(int j = 0; j<N_links; j++)
+  {
+    float movern_old = movern_minimum+float(lattice_index)*movern_resolution;
+    float dmovern = getGaussianRandom(gauss_minimum, gauss_mean, allowNegative, rng);
+    float movern_new = movern_old + dmovern;
+
+    // reflect the data if necessary
+    if ( movern_new < movern_minimum)
     {
-      NRejected++;
+      movern_new = 2*movern_minimum - movern_new;
     }
-
-    // Now print to the chain file
-    if(printChain)
+    if ( movern_new > movern_maximum)
     {
-      ChainFileOut  << j << "," << movern_new << "," << movern_old << ","
-                    << NewLikelihood << "," << LastLikelihood << ","
-                    << NAccepted << "," << NRejected << endl;
+      movern_new = 2*movern_maximum - movern_new;
+    }
 
-    // reset m over n old
-    if (LikelihoodRatio > AcceptanceProbability)
+    int new_index = int(floor((movern_new-movern_minimum)/movern_resolution+0.5));
+    if (new_index < 0)
     {
-      LastLikelihood = NewLikelihood;
-      movern_old = movern_new;
+      new_index = 0;
     }
+    if (new_index >= n_lattice_points)
+    {
+      new_index = n_lattice_points-1;
     }
-  }
-
-
-  ChainFileOut.close();
-
+    movern_new = movern_minimum+float(new_index)*movern_resolution;
 
-  float accept_percent = float(NAccepted)/ float(NAccepted+NRejected);
-  return accept_percent;
+    double new_misfit = get_cached_movern_misfit(network, new_index, movern_minimum,
+                                movern_resolution, A_0, use_points, chi_fractions);
 
+    // the likelihood ratio is worked out from the misfits so it does not underflow
+    double LikelihoodRatio = exp(-(new_misfit-last_misfit)/two_sigma_sq);
+    float AcceptanceProbability = rng.uniform();
+    bool accepted = (LikelihoodRatio > AcceptanceProbability);
 
+    link_records.push_back(movern_new);
+    link_records.push_back(movern_old);
+    link_records.push_back(float(exp(-new_misfit/two_sigma_sq)));
+    link_records.push_back(float(exp(-last_misfit/two_sigma_sq)));
+    link_records.push_back( (accepted) ? 1.0 : 0.0 );
 
+    if (accepted)
+    {
+      n_accepted++;
+      lattice_index = new_index;
+      last_misfit = new_misfit;
+    }
+  }
+  return n_accepted;
 }
 
 
@@ -7415,7 +7687,6 @@ void LSDChiTools::print_profiles_as_fxn_movern(LSDFlowInfo& FlowInfo, string fil
   vector< vector<float> > chi_vecvec;
   vector<float> empty_vec;
   vector<float> this_chi_vec;
-  int this_node;
   int n_nodes = int(node_sequence.size());
 
   // loop through m over n values
@@ -7433,8 +7704,7 @@ void LSDChiTools::print_profiles_as_fxn_movern(LSDFlowInfo& FlowInfo, string fil
     // now get the chi values for each node and push them into the chi_vecvec
     for (int n = 0; n< n_nodes; n++)
     {
-      this_node = node_sequence[n];
-      this_chi_vec.push_back(chi_data_map[this_node]);
+      this_chi_vec.push_back(chi_data[n]);
     }
     chi_vecvec.push_back(this_chi_vec);
   }
@@ -7455,11 +7725,9 @@ void LSDChiTools::print_profiles_as_fxn_movern(LSDFlowInfo& FlowInfo, string fil
   chi_csv_out.precision(5);
   for (int n = 0; n< n_nodes; n++)
   {
-    this_node = node_sequence[n];
-
-    chi_csv_out << source_keys_map[this_node] << ","
-                 << baselevel_keys_map[this_node] << ","
-                 << elev_data_map[this_node];
+    chi_csv_out << source_keys_data[n] << ","
+                 << baselevel_keys_data[n] << ","
+                 << elev_data[n];
 
     for (int i = 0; i< n_movern; i++)
     {
@@ -7505,8 +7773,7 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_burned_raster(LSDFlowInfo& F
     // now get the chi values for each node and push them into the chi_vecvec
     for (int n = 0; n< n_nodes; n++)
     {
-      this_node = node_sequence[n];
-      this_chi_vec.push_back(chi_data_map[this_node]);
+      this_chi_vec.push_back(chi_data[n]);
     }
     chi_vecvec.push_back(this_chi_vec);
   }
@@ -7532,9 +7799,9 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_burned_raster(LSDFlowInfo& F
 
     FlowInfo.retrieve_current_row_and_col(this_node,curr_row,curr_col);
 
-    chi_csv_out << source_keys_map[this_node] << ","
-                 << baselevel_keys_map[this_node] << ","
-                 << elev_data_map[this_node];
+    chi_csv_out << source_keys_data[n] << ","
+                 << baselevel_keys_data[n] << ","
+                 << elev_data[n];
 
     for (int i = 0; i< n_movern; i++)
     {
@@ -7562,7 +7829,6 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_discharge(LSDFlowInfo& FlowI
   vector< vector<float> > chi_vecvec;
   vector<float> empty_vec;
   vector<float> this_chi_vec;
-  int this_node;
   int n_nodes = int(node_sequence.size());
 
   // loop through m over n values
@@ -7586,8 +7852,7 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_discharge(LSDFlowInfo& FlowI
     // now get the chi values for each node and push them into the chi_vecvec
     for (int n = 0; n< n_nodes; n++)
     {
-      this_node = node_sequence[n];
-      this_chi_vec.push_back(chi_data_map[this_node]);
+      this_chi_vec.push_back(chi_data[n]);
     }
     chi_vecvec.push_back(this_chi_vec);
   }
@@ -7608,11 +7873,9 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_discharge(LSDFlowInfo& FlowI
   chi_csv_out.precision(5);
   for (int n = 0; n< n_nodes; n++)
   {
-    this_node = node_sequence[n];
-
-    chi_csv_out << source_keys_map[this_node] << ","
-                 << baselevel_keys_map[this_node] << ","
-                 << elev_data_map[this_node];
+    chi_csv_out << source_keys_data[n] << ","
+                 << baselevel_keys_data[n] << ","
+                 << elev_data[n];
 
     for (int i = 0; i< n_movern; i++)
     {
@@ -7667,8 +7930,7 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_discharge_and_burned_raster(
     // now get the chi values for each node and push them into the chi_vecvec
     for (int n = 0; n< n_nodes; n++)
     {
-      this_node = node_sequence[n];
-      this_chi_vec.push_back(chi_data_map[this_node]);
+      this_chi_vec.push_back(chi_data[n]);
     }
     chi_vecvec.push_back(this_chi_vec);
   }
@@ -7694,9 +7956,9 @@ void LSDChiTools::print_profiles_as_fxn_movern_with_discharge_and_burned_raster(
     // get the row and column to use with the raster for burning
     FlowInfo.retrieve_current_row_and_col(this_node,curr_row,curr_col);
 
-    chi_csv_out << source_keys_map[this_node] << ","
-                 << baselevel_keys_map[this_node] << ","
-                 << elev_data_map[this_node];
+    chi_csv_out << source_keys_data[n] << ","
+                 << baselevel_keys_data[n] << ","
+                 << elev_data[n];
 
     for (int i = 0; i< n_movern; i++)
     {
@@ -7768,26 +8030,28 @@ int LSDChiTools::get_source_from_source_key(int source_key)
 int LSDChiTools::get_starting_node_of_source(int source_key)
 {
   int source_node = get_source_from_source_key(source_key);
-  int this_starting_node = -9999;
-
-  // Find the node sequence index of this node;
-  int this_ns_node = -1;
 
-  bool not_starting_node = true;
-  while (not_starting_node)
-  {
-    this_ns_node++;
-    if(node_sequence[this_ns_node] == source_node)
-    {
-      not_starting_node = false;
-      this_starting_node = this_ns_node;
-    }
-  }
+  // The node sequence index of this node. The source node is always
+  // the first node of its channel in the node sequence.
+  int this_starting_node = get_node_sequence_index(source_node);
   //cout << "The starting node in the sequence is: " << this_starting_node << endl;
 
   return this_starting_node;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Gets the source key of a node
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+int LSDChiTools::get_source_key_of_node(int node_index)
+{
+  int this_index = get_node_sequence_index(node_index);
+  if (this_index == NoDataValue || this_index >= int(source_keys_data.size()))
+  {
+    return NoDataValue;
+  }
+  return source_keys_data[this_index];
+}
+
 
 int LSDChiTools::get_ending_node_of_source(LSDFlowInfo& FlowInfo,int source_key)
 {
@@ -7798,7 +8062,7 @@ int LSDChiTools::get_ending_node_of_source(LSDFlowInfo& FlowInfo,int source_key)
 
   
 
-  while(source_keys_map[temp_node] == source_key && temp_node_index < n)
+  while(get_source_key_of_node(temp_node) == source_key && temp_node_index < n)
   {
 
     node_indenter ++;
@@ -7828,7 +8092,7 @@ int LSDChiTools::get_number_of_channels()
 // Extract the elevation and chi data from a channel
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::get_chi_elevation_data_of_channel(LSDFlowInfo& FlowInfo, int source_key,
-                                vector<float>& chi_data, vector<float>& elevation_data)
+                                vector<float>& channel_chi_data, vector<float>& elevation_data)
 {
   int n_channels = int(key_to_source_map.size());
   if (source_key>=n_channels)
@@ -7846,10 +8110,17 @@ void LSDChiTools::get_chi_elevation_data_of_channel(LSDFlowInfo& FlowInfo, int s
   vector<float> this_elevation;
 
   // add the source to the chi elevation vectors
-  this_chi.push_back(chi_data_map[starting_source]);
-  this_elevation.push_back(elev_data_map[starting_source]);
+  int source_index = get_node_sequence_index(starting_source);
+  if (source_index == NoDataValue)
+  {
+    cout << "LSDChiTools::get_chi_elevation_data_of_channel FATAL ERROR" << endl;
+    cout << "The source of this key is not in channel network" << endl;
+    exit(EXIT_FAILURE);
+  }
+  this_chi.push_back(chi_data[source_index]);
+  this_elevation.push_back(elev_data[source_index]);
 
-  //cout << "Starting chi is: " << chi_data_map[starting_source] << endl;
+  //cout << "Starting chi is: " << chi_data[source_index] << endl;
 
   // now work downstream until you get to a different source or
   // a baselevel node
@@ -7868,15 +8139,19 @@ void LSDChiTools::get_chi_elevation_data_of_channel(LSDFlowInfo& FlowInfo, int s
     }
     else
     {
-      this_source_key = source_keys_map[receiver_node];
+      this_source_key = get_source_key_of_node(receiver_node);
       if (this_source_key != source_key)
       {
+        // the receiver is in another channel, or has left the channel
+        // network, so this is the end of the channel
         //cout << "I made it to the end of this channel" << endl;
+        is_end = true;
       }
       else
       {
-        this_chi.push_back(chi_data_map[receiver_node]);
-        this_elevation.push_back(elev_data_map[receiver_node]);
+        int receiver_index = get_node_sequence_index(receiver_node);
+        this_chi.push_back(chi_data[receiver_index]);
+        this_elevation.push_back(elev_data[receiver_index]);
       }
     }
     // increment the node downstream
@@ -7885,17 +8160,55 @@ void LSDChiTools::get_chi_elevation_data_of_channel(LSDFlowInfo& FlowInfo, int s
   }
 
   elevation_data = this_elevation;
-  chi_data = this_chi;
-  //cout << "Starting chi is: " << chi_data[0] << " and ending chi is: " << chi_data[n_nodes-1] << endl;
+  channel_chi_data = this_chi;
+  //cout << "Starting chi is: " << channel_chi_data[0] << " and ending chi is: " << channel_chi_data[n_nodes-1] << endl;
 
   // For debugging
   //int n_nodes = int(elevation_data.size());
   //for(int i= 0; i<n_nodes; i++)
   //{
-  //  cout << chi_data[i] << "," << elevation_data[i] << endl;
+  //  cout << channel_chi_data[i] << "," << elevation_data[i] << endl;
   //}
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the node_sequence positions of the nodes of a channel, following
+// the channel downstream from its source until it joins another channel
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<int> LSDChiTools::get_node_sequence_indices_of_channel(LSDFlowInfo& FlowInfo, int source_key)
+{
+  int n_channels = int(key_to_source_map.size());
+  if (source_key>=n_channels)
+  {
+    cout << "LSDChiTools::get_node_sequence_indices_of_channel FATAL ERROR" << endl;
+    cout << "This source key is not in channel network" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vector<int> channel_indices;
+  int starting_source = get_source_from_source_key(source_key);
+  channel_indices.push_back(get_node_sequence_index(starting_source));
+
+  bool is_end = false;
+  int current_node = starting_source;
+  int receiver_node;
+  while(not is_end)
+  {
+    FlowInfo.retrieve_receiver_information(current_node,receiver_node);
+    if(current_node == receiver_node || get_source_key_of_node(receiver_node) != source_key)
+    {
+      // this is either a baselevel node or the junction with the receiver channel
+      is_end = true;
+    }
+    else
+    {
+      channel_indices.push_back(get_node_sequence_index(receiver_node));
+    }
+    current_node = receiver_node;
+  }
+  return channel_indices;
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Project data onto a reference chi-elevation profile
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -7991,8 +8304,9 @@ vector<float> LSDChiTools::project_data_onto_reference_channel(vector<float>& re
       {
         start_ref_index++;
         end_ref_index++;
+        // past the end of the reference channel the bounds collapse so nothing can match
         ref_chi_upstream = reference_chi[start_ref_index];
-        ref_chi_downstream =  reference_chi[end_ref_index];
+        ref_chi_downstream = (end_ref_index < n_ref_nodes) ? reference_chi[end_ref_index] : ref_chi_upstream;
         if (this_chi < ref_chi_upstream && this_chi > ref_chi_downstream)
         {
           found_ref_nodes = true;
@@ -8170,7 +8484,7 @@ vector<float> LSDChiTools::project_points_onto_reference_channel(vector<float>&
       else
       {
         // now you need to find the bounding nodes on the mainstem
-        bool found_joint_chi;
+        bool found_joint_chi = false;
         int start_ref_index = 0;
         int end_ref_index = 1;
         float ref_chi_upstream = reference_chi[start_ref_index];
@@ -8193,8 +8507,9 @@ vector<float> LSDChiTools::project_points_onto_reference_channel(vector<float>&
           {
             start_ref_index++;
             end_ref_index++;
+            // past the end of the reference channel the bounds collapse so nothing can match
             ref_chi_upstream = reference_chi[start_ref_index];
-            ref_chi_downstream =  reference_chi[end_ref_index];
+            ref_chi_downstream = (end_ref_index < n_ref_nodes) ? reference_chi[end_ref_index] : ref_chi_upstream;
            if (this_chi  < ref_chi_upstream && this_chi > ref_chi_downstream)
            {
 
@@ -8206,8 +8521,9 @@ vector<float> LSDChiTools::project_points_onto_reference_channel(vector<float>&
           // There is different logic if we reached the end of the reference vector
           if (end_ref_index == n_ref_nodes-1)
           {
+            // there is nothing left to test against: this is the last point
             //cout << "I am at the end of the reference vector" << endl;
-            i = n_trib_nodes-1;
+            i = n_points-1;
           }
         }
 
@@ -8308,14 +8624,6 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
 
   // used to calculate the S-A data
   float half_interval = vertical_interval*0.5;
-  //float midpoint_area;
-  float upstream_elevation;
-  float upstream_flow_distance;
-  float downstream_elevation = 0;  // need to set these to avoid compiler warning
-  float downstream_flow_distance = 0;
-  float midpoint_node;
-  float target_end_interval_elevation;
-  float target_midpoint_interval_elevation;
 
   // we loop through every source
   int n_sources = int(ordered_source_nodes.size());
@@ -8326,16 +8634,30 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
   }
 
 
-  int top_interval_node;
-  int search_node;
-  int this_source_node;
-  int this_source_key;
-  int row,col;
+  // The sources are independent so they are traced in parallel, each into its
+  // own vectors, which are joined in source order at the end
+  vector< vector<int> > SA_midpoint_node_of_source(n_sources);
+  vector< vector<float> > SA_slope_of_source(n_sources);
+  #pragma omp parallel for schedule(dynamic,1)
   for(int s = 0; s<n_sources; s++)
   {
+    //float midpoint_area;
+    float upstream_elevation;
+    float upstream_flow_distance;
+    float downstream_elevation = 0;  // need to set these to avoid compiler warning
+    float downstream_flow_distance = 0;
+    float midpoint_node;
+    float target_end_interval_elevation;
+    float target_midpoint_interval_elevation;
+    int top_interval_node;
+    int search_node;
+    int this_source_node;
+    int this_source_key;
+    int row,col;
+
     top_interval_node = ordered_source_nodes[s];
     this_source_node = top_interval_node;
-    this_source_key = source_keys_map[this_source_node];
+    this_source_key = get_source_key_of_node(this_source_node);
     // now trace downstream until you first get to the midpoint,
     // and then to the final node.
     bool is_this_final_node = false;
@@ -8359,9 +8681,15 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
     // the end point the loop exits
     while (not is_this_final_node)
     {
-      // get the upstream elevation and flow distance
-      upstream_elevation = elev_data_map[top_interval_node];
-      upstream_flow_distance = flow_distance_data_map[top_interval_node];
+      // get the upstream elevation and flow distance. Stop if the walk
+      // has left the channel network
+      int top_interval_index = get_node_sequence_index(top_interval_node);
+      if (top_interval_index == NoDataValue)
+      {
+        break;
+      }
+      upstream_elevation = elev_data[top_interval_index];
+      upstream_flow_distance = flow_distance_data[top_interval_index];
 
       target_end_interval_elevation = upstream_elevation-vertical_interval;
       target_midpoint_interval_elevation = upstream_elevation-half_interval;
@@ -8377,7 +8705,7 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
                      search_node, row, col);
 
       // check to see if this is the last element or in a tributary
-      if (search_node == top_interval_node || this_source_key != source_keys_map[search_node])
+      if (search_node == top_interval_node || this_source_key != get_source_key_of_node(search_node))
       {
         is_this_final_node = true;
       }
@@ -8392,11 +8720,17 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
         {
           //cout << "search_node: " << search_node << " elev: " << elevations[chan][search_node]
           //     << " and target mp, end: " << target_mp_interval_elevations << " " << target_end_interval_elevations << endl;
+          int search_index = get_node_sequence_index(search_node);
+          if (search_index == NoDataValue)
+          {
+            is_this_final_node = true;
+            break;
+          }
 
           // see if search node is the midpoint node
-          if ( elev_data_map[search_node] <= target_midpoint_interval_elevation && not is_midpoint_interval)
+          if ( elev_data[search_index] <= target_midpoint_interval_elevation && not is_midpoint_interval)
           {
-            //midpoint_area = drainage_area_data_map[search_node];
+            //midpoint_area = drainage_area_data[search_index];
             midpoint_node = search_node;
 
             // set midpoint flag so it doens't collect downstream nodes
@@ -8409,10 +8743,10 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
           }
 
           // see if the search node is the end node
-          if (elev_data_map[search_node] <= target_end_interval_elevation)
+          if (elev_data[search_index] <= target_end_interval_elevation)
           {
-            downstream_elevation = elev_data_map[search_node];
-            downstream_flow_distance = flow_distance_data_map[search_node];
+            downstream_elevation = elev_data[search_index];
+            downstream_flow_distance = flow_distance_data[search_index];
 
             // make sure the code knows this is the end, the only end, my friend.
             is_end_interval = true;;
@@ -8424,7 +8758,7 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
                      search_node, row, col);
 
           // test is this is the end
-          if (search_node == last_node || this_source_key != source_keys_map[search_node])
+          if (search_node == last_node || this_source_key != get_source_key_of_node(search_node))
           {
             is_this_final_node = true;
           }
@@ -8445,8 +8779,8 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
           if(slope > 0)
           {
             // record the data
-            SA_midpoint_node.push_back(midpoint_node);
-            SA_slope.push_back(slope);
+            SA_midpoint_node_of_source[s].push_back(midpoint_node);
+            SA_slope_of_source[s].push_back(slope);
           }
         }             // if statement for recording data on S-A to data containers
       }               // end check if tributary only has one node
@@ -8462,6 +8796,12 @@ void LSDChiTools::get_slope_area_data(LSDFlowInfo& FlowInfo, float vertical_inte
     }                 // check if this is the final node of the source trib
   }                   // end sources loop (at this point we go to the next source)
 
+  for(int s = 0; s<n_sources; s++)
+  {
+    SA_midpoint_node.insert(SA_midpoint_node.end(),SA_midpoint_node_of_source[s].begin(),SA_midpoint_node_of_source[s].end());
+    SA_slope.insert(SA_slope.end(),SA_slope_of_source[s].begin(),SA_slope_of_source[s].end());
+  }
+
   midpoint_nodes = SA_midpoint_node;
   slopes = SA_slope;
 
@@ -8516,8 +8856,14 @@ void LSDChiTools::bootstrap_slope_area_data(LSDFlowInfo& FlowInfo,
     {
       // get the source node
       this_node = SA_midpoint_node[n];
-      this_source_key = source_keys_map[this_node];
-      this_basin_key = baselevel_keys_map[this_node];
+      int this_index = get_node_sequence_index(this_node);
+      if (this_index == NoDataValue)
+      {
+        // this node is not in the channel network
+        continue;
+      }
+      this_source_key = source_keys_data[this_index];
+      this_basin_key = baselevel_keys_data[this_index];
       //cout << "This source key is: " << this_source_key << endl;
 
       // see if we have a vector for that source node
@@ -8535,13 +8881,13 @@ void LSDChiTools::bootstrap_slope_area_data(LSDFlowInfo& FlowInfo,
       // check if we have the basin of this source
       if (basin_key_of_this_source_map.find(this_source_key) == basin_key_of_this_source_map.end() )
       {
-        basin_key_of_this_source_map[this_source_key] = baselevel_keys_map[this_node];
+        basin_key_of_this_source_map[this_source_key] = baselevel_keys_data[this_index];
       }
 
       // add to this source's log S, log A data. We will later use these to bin
-      if(drainage_area_data_map[this_node] > 0 && SA_slope[n] > 0)
+      if(drainage_area_data[this_index] > 0 && SA_slope[n] > 0)
       {
-        l10_DA =  log10(drainage_area_data_map[this_node]);
+        l10_DA =  log10(drainage_area_data[this_index]);
         l10_S = log10(SA_slope[n]);
 
         log_area_map[this_source_key].push_back( l10_DA );
@@ -8550,7 +8896,7 @@ void LSDChiTools::bootstrap_slope_area_data(LSDFlowInfo& FlowInfo,
         log_area_map_by_basin[this_basin_key].push_back( l10_DA );
         log_slope_map_by_basin[this_basin_key].push_back( l10_S );
       }
-      //log_area_map[this_source_key].push_back( drainage_area_data_map[this_node] );
+      //log_area_map[this_source_key].push_back( drainage_area_data[this_index] );
       //log_slope_map[this_source_key].push_back( SA_slope[n] );
     }
   }
@@ -8575,19 +8921,22 @@ void LSDChiTools::bootstrap_slope_area_data(LSDFlowInfo& FlowInfo,
     int basin_key = iter->first;
     // get the mainstem source
     int mainstem_source_node = iter->second;
-    int this_source_key =  source_keys_map[mainstem_source_node];
+    int this_source_key =  get_source_key_of_node(mainstem_source_node);
 
     cout << "Bootstrapping, basin_key is: " << basin_key << endl;
 
+    // each basin is resampled from its own random stream
+    RandomStream rng(get_random_master_seed(),"slope_area_bootstrap",basin_key_offset+basin_key);
+
     // bootstrap the main stem
     vector<float> this_log_area_mainstem = log_area_map[this_source_key];
     vector<float> this_log_slope_mainstem = log_slope_map[this_source_key];
-    vector<float> MS_summary = bootstrap_linear_regression(this_log_area_mainstem, this_log_slope_mainstem, N_iterations,bootstrap_keep_data_prob);
+    vector<float> MS_summary = bootstrap_linear_regression(this_log_area_mainstem, this_log_slope_mainstem, N_iterations,bootstrap_keep_data_prob,rng);
 
 
     vector<float> this_log_area_all = log_area_map_by_basin[basin_key];
     vector<float> this_log_slope_all = log_slope_map_by_basin[basin_key];
-    vector<float> All_summary = bootstrap_linear_regression(this_log_area_all, this_log_slope_all, N_iterations,bootstrap_keep_data_prob);
+    vector<float> All_summary = bootstrap_linear_regression(this_log_area_all, this_log_slope_all, N_iterations,bootstrap_keep_data_prob,rng);
 
 
     // print results to file
@@ -8649,7 +8998,13 @@ void LSDChiTools::bin_slope_area_data(LSDFlowInfo& FlowInfo,
     {
       // get the source node
       this_node = SA_midpoint_node[n];
-      this_source_key = source_keys_map[this_node];
+      int this_index = get_node_sequence_index(this_node);
+      if (this_index == NoDataValue)
+      {
+        // this node is not in the channel network
+        continue;
+      }
+      this_source_key = source_keys_data[this_index];
       //cout << "This source key is: " << this_source_key << endl;
 
       // see if we have a vector for that source node
@@ -8661,13 +9016,13 @@ void LSDChiTools::bin_slope_area_data(LSDFlowInfo& FlowInfo,
       // check if we have the basin of this source
       if (basin_key_of_this_source_map.find(this_source_key) == basin_key_of_this_source_map.end() )
       {
-        basin_key_of_this_source_map[this_source_key] = baselevel_keys_map[this_node];
+        basin_key_of_this_source_map[this_source_key] = baselevel_keys_data[this_index];
       }
 
       // add to this source's log S, log A data. We will later use these to bin
-      if(drainage_area_data_map[this_node] > 0 && SA_slope[n] > 0)
+      if(drainage_area_data[this_index] > 0 && SA_slope[n] > 0)
       {
-        log_area_map[this_source_key].push_back( log10(drainage_area_data_map[this_node]) );
+        log_area_map[this_source_key].push_back( log10(drainage_area_data[this_index]) );
         log_slope_map[this_source_key].push_back( log10(SA_slope[n]) );
       }
     }
@@ -8826,7 +9181,13 @@ void LSDChiTools::segment_binned_slope_area_data(LSDFlowInfo& FlowInfo,
     {
       // get the source node
       this_node = SA_midpoint_node[n];
-      this_source_key = source_keys_map[this_node];
+      int this_index = get_node_sequence_index(this_node);
+      if (this_index == NoDataValue)
+      {
+        // this node is not in the channel network
+        continue;
+      }
+      this_source_key = source_keys_data[this_index];
       //cout << "This source key is: " << this_source_key << endl;
 
       // see if we have a vector for that source node
@@ -8838,11 +9199,11 @@ void LSDChiTools::segment_binned_slope_area_data(LSDFlowInfo& FlowInfo,
       // check if we have the basin of this source
       if (basin_key_of_this_source_map.find(this_source_key) == basin_key_of_this_source_map.end() )
       {
-        basin_key_of_this_source_map[this_source_key] = baselevel_keys_map[this_node];
+        basin_key_of_this_source_map[this_source_key] = baselevel_keys_data[this_index];
       }
 
       // add to this source's log S, log A data. We will later use these to bin
-      log_area_map[this_source_key].push_back( log10(drainage_area_data_map[this_node]) );
+      log_area_map[this_source_key].push_back( log10(drainage_area_data[this_index]) );
       log_slope_map[this_source_key].push_back( log10(SA_slope[n]) );
     }
   }
@@ -9112,6 +9473,12 @@ void LSDChiTools::print_slope_area_data_to_csv(LSDFlowInfo& FlowInfo,
     for (int n = 0; n< n_nodes; n++)
     {
       this_node = SA_midpoint_node[n];
+      int this_index = get_node_sequence_index(this_node);
+      if (this_index == NoDataValue)
+      {
+        // this node is not in the channel network
+        continue;
+      }
       FlowInfo.retrieve_current_row_and_col(this_node,row,col);
       get_lat_and_long_locations(row, col, latitude, longitude, Converter);
 
@@ -9119,13 +9486,13 @@ void LSDChiTools::print_slope_area_data_to_csv(LSDFlowInfo& FlowInfo,
       SA_out << latitude << ","
              << longitude << ",";
       SA_out.precision(5);
-      SA_out << chi_data_map[this_node] << ","
-             << elev_data_map[this_node] << ","
-             << flow_distance_data_map[this_node] << ","
-             << drainage_area_data_map[this_node] << ","
+      SA_out << chi_data[this_index] << ","
+             << elev_data[this_index] << ","
+             << flow_distance_data[this_index] << ","
+             << drainage_area_data[this_index] << ","
              << SA_slope[n] << ","
-             << source_keys_map[this_node] << ","
-             << baselevel_keys_map[this_node];
+             << source_keys_data[this_index] << ","
+             << baselevel_keys_data[this_index];
       SA_out << endl;
     }
   }
@@ -9169,12 +9536,12 @@ void LSDChiTools::print_chi_data_map_to_csv(LSDFlowInfo& FlowInfo, string filena
       chi_data_out << latitude << ","
                    << longitude << ",";
       chi_data_out.precision(5);
-      chi_data_out << chi_data_map[this_node] << ","
-                   << elev_data_map[this_node] << ","
-                   << flow_distance_data_map[this_node] << ","
-                   << drainage_area_data_map[this_node] << ","
-                   << source_keys_map[this_node] << ","
-                   << baselevel_keys_map[this_node];
+      chi_data_out << chi_data[n] << ","
+                   << elev_data[n] << ","
+                   << flow_distance_data[n] << ","
+                   << drainage_area_data[n] << ","
+                   << source_keys_data[n] << ","
+                   << baselevel_keys_data[n];
 
       chi_data_out << endl;
     }
@@ -9213,7 +9580,7 @@ void LSDChiTools::print_chi_data_map_to_csv_for_single_basin(LSDFlowInfo& FlowIn
     {
       this_node = node_sequence[n];
 
-      if (baselevel_keys_map[this_node] == basin_key)
+      if (baselevel_keys_data[n] == basin_key)
       {
 
         FlowInfo.retrieve_current_row_and_col(this_node,row,col);
@@ -9223,12 +9590,12 @@ void LSDChiTools::print_chi_data_map_to_csv_for_single_basin(LSDFlowInfo& FlowIn
         chi_data_out << latitude << ","
                    << longitude << ",";
         chi_data_out.precision(5);
-        chi_data_out << chi_data_map[this_node] << ","
-                   << elev_data_map[this_node] << ","
-                   << flow_distance_data_map[this_node] << ","
-                   << drainage_area_data_map[this_node] << ","
-                   << source_keys_map[this_node] << ","
-                   << baselevel_keys_map[this_node];
+        chi_data_out << chi_data[n] << ","
+                   << elev_data[n] << ","
+                   << flow_distance_data[n] << ","
+                   << drainage_area_data[n] << ","
+                   << source_keys_data[n] << ","
+                   << baselevel_keys_data[n];
 
         chi_data_out << endl;
       }
@@ -9263,7 +9630,7 @@ void LSDChiTools::print_data_maps_to_file_full(LSDFlowInfo& FlowInfo, string fil
 
   // test to see if the fitted elevations have been calculated
   bool have_segmented_elevation = false;
-  if( segmented_elevation_map.size() == node_sequence.size())
+  if( segmented_elevation_data.size() == node_sequence.size())
   {
     have_segmented_elevation = true;
   }
@@ -9306,18 +9673,18 @@ void LSDChiTools::print_data_maps_to_file_full(LSDFlowInfo& FlowInfo, string fil
       chi_data_out << latitude << ","
                    << longitude << ",";
       chi_data_out.precision(5);
-      chi_data_out << chi_data_map[this_node] << ","
-                   << elev_data_map[this_node] << ","
-                   << flow_distance_data_map[this_node] << ","
-                   << drainage_area_data_map[this_node] << ","
-                   << M_chi_data_map[this_node] << ","
-                   << b_chi_data_map[this_node] << ","
-                   << source_keys_map[this_node] << ","
-                   << baselevel_keys_map[this_node];
+      chi_data_out << chi_data[n] << ","
+                   << elev_data[n] << ","
+                   << flow_distance_data[n] << ","
+                   << drainage_area_data[n] << ","
+                   << M_chi_data[n] << ","
+                   << b_chi_data[n] << ","
+                   << source_keys_data[n] << ","
+                   << baselevel_keys_data[n];
 
       if(have_segmented_elevation)
       {
-        chi_data_out << "," << segmented_elevation_map[this_node];
+        chi_data_out << "," << segmented_elevation_data[n];
       }
       if (have_segments)
       {
@@ -9337,6 +9704,9 @@ void LSDChiTools::print_data_maps_to_file_full(LSDFlowInfo& FlowInfo, string fil
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Print data maps to file
+// Each row has one value per header column: the source key, the receiving
+// source key, the m_chi of the receiving river at the junction and the chi
+// at the source.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDChiTools::print_intersources_mchi_map( string filename)
 {
@@ -9350,12 +9720,13 @@ void LSDChiTools::print_intersources_mchi_map( string filename)
  
   for (map<int,int>::iterator alpaca = map_source_key_receiver.begin(); alpaca != map_source_key_receiver.end() ; alpaca++)
   {
+    // the chi is taken at the source node of the channel
+    int source_index = get_starting_node_of_source(alpaca->first);
     file_out_.precision(5);
     file_out_ << alpaca->first << ","
                  << alpaca->second << ","
-                 << map_source_key_receiver_mchi[alpaca->first]
-                 << M_chi_data_map[alpaca->first]
-                 << chi_data_map[alpaca->first];
+                 << map_source_key_receiver_mchi[alpaca->first] << ","
+                 << chi_data[source_index];
     file_out_ << endl;
   }
   
@@ -9391,7 +9762,7 @@ void LSDChiTools::print_data_maps_to_file_full_knickpoints(LSDFlowInfo& FlowInfo
 
   // test to see if the fitted elevations have been calculated
   bool have_segmented_elevation = false;
-  if( segmented_elevation_map.size() == node_sequence.size())
+  if( segmented_elevation_data.size() == node_sequence.size())
   {
     have_segmented_elevation = true;
   }
@@ -9428,18 +9799,18 @@ void LSDChiTools::print_data_maps_to_file_full_knickpoints(LSDFlowInfo& FlowInfo
       chi_data_out << latitude << ","
                    << longitude << ",";
       chi_data_out.precision(5);
-      chi_data_out << chi_data_map[this_node] << ","
-                   << elev_data_map[this_node] << ","
-                   << flow_distance_data_map[this_node] << ","
-                   << drainage_area_data_map[this_node] << ","
-                   << M_chi_data_map[this_node] << ","
-                   << b_chi_data_map[this_node] << ","
-                   << source_keys_map[this_node] << ","
-                   << baselevel_keys_map[this_node];
+      chi_data_out << chi_data[n] << ","
+                   << elev_data[n] << ","
+                   << flow_distance_data[n] << ","
+                   << drainage_area_data[n] << ","
+                   << M_chi_data[n] << ","
+                   << b_chi_data[n] << ","
+                   << source_keys_data[n] << ","
+                   << baselevel_keys_data[n];
 
       if(have_segmented_elevation)
       {
-        chi_data_out << "," << segmented_elevation_map[this_node];
+        chi_data_out << "," << segmented_elevation_data[n];
       }
       if (have_segments)
       {
@@ -9662,8 +10033,8 @@ void LSDChiTools::print_data_maps_to_file_basic(LSDFlowInfo& FlowInfo, string fi
       chi_data_out << latitude << ","
                    << longitude << ",";
       chi_data_out.precision(6);
-      chi_data_out << M_chi_data_map[this_node] << ","
-                   << b_chi_data_map[this_node] << "," << endl;
+      chi_data_out << M_chi_data[n] << ","
+                   << b_chi_data[n] << "," << endl;
     }
   }
 
@@ -87,6 +87,36 @@ using namespace std;
 using namespace TNT;
 
 
+/// @brief The channel network of one basin laid out so that chi, and the
+///  collinearity of the channels, can be recomputed for any m/n without
+///  touching the chi data of an LSDChiTools object. Used by the multi-chain
+///  MCMC so that many chains can run at once.
+struct movern_basin_network
+{
+  /// The positions in node_sequence of the nodes in the basin, ordered by flow
+  /// distance so that every receiver comes before its donors
+  vector<int> node_indices;
+  /// The index into node_indices of the receiver of each node, -1 at the outlet
+  vector<int> receiver_positions;
+  /// The flow length between each node and its receiver
+  vector<float> flow_lengths;
+  /// The drainage area of each node
+  vector<float> drainage_areas;
+  /// False for nodes with too few contributing pixels to get a chi value
+  vector<bool> has_chi;
+  /// The indices into node_indices of the nodes of each channel, from source
+  /// to the junction with the receiver channel. The mainstem is first.
+  vector< vector<int> > channel_positions;
+  /// The elevations of the nodes of each channel
+  vector< vector<float> > channel_elevations;
+  /// The source key of the mainstem. The channels have consecutive source keys.
+  int first_source_key;
+  /// The misfit of each m/n value on the lattice used by the chains. It is
+  /// negative until that m/n has been visited.
+  vector<double> misfit_cache;
+};
+
+
 /// @brief This object packages a number of tools for chi analysis
 class LSDChiTools
 {
@@ -121,6 +151,19 @@ class LSDChiTools
     /// :date 02/06/2016
     void reset_data_maps();
 
+    /// @brief This indexes the nodes in node_sequence so the node aligned data
+    ///  vectors can be looked up by FlowInfo node. It also sizes the vectors
+    ///  used by the knickpoint routines. Called whenever node_sequence is set.
+    /// @param FlowInfo an LSDFlowInfo object
+    void index_node_sequence(LSDFlowInfo& FlowInfo);
+
+    /// @brief Gets the position of a node in node_sequence, which is also its
+    ///  position in the node aligned data vectors (chi_data, elev_data, etc.)
+    /// @param node_index the FlowInfo node index
+    /// @return the position in node_sequence, or NoDataValue if the node is
+    ///  not in the channel network
+    int get_node_sequence_index(int node_index);
+
     /// @brief this gets the x and y location of a node at row and column
     /// @param row the row of the node
     /// @param col the column of the node
@@ -664,6 +707,141 @@ class LSDChiTools
                         LSDJunctionNetwork& JN, float start_movern, float delta_movern, int n_movern,
                         string file_prefix, bool use_uncert, LSDRaster& Discharge);
 
+    /// @brief Gets the chi value of every node in the channel network for a
+    ///  range of m/n values. The chi values are the same as those of
+    ///  update_chi_data_map(FlowInfo, A_0, movern), but chi is only integrated
+    ///  along the channel nodes and the paths from the basin outlets to
+    ///  the edge of the DEM, and all the m/n values are done in parallel.
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param A_0 the reference drainage area
+    /// @param movern the m/n values
+    /// @return A vector for each m/n value with the chi of each node in node_sequence
+    vector< vector<float> > get_chi_data_for_movern_sweep(LSDFlowInfo& FlowInfo, float A_0,
+                        vector<float>& movern);
+
+    /// @brief Same as above but chi is calculated with discharge rather than drainage area
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param A_0 the reference discharge
+    /// @param movern the m/n values
+    /// @param Discharge an LSDRaster with the discharge
+    /// @return A vector for each m/n value with the chi of each node in node_sequence
+    vector< vector<float> > get_chi_data_for_movern_sweep(LSDFlowInfo& FlowInfo, float A_0,
+                        vector<float>& movern, LSDRaster& Discharge);
+
+    /// @brief Gets the nodes needed to integrate chi for the channel network.
+    ///  These are the channel nodes and the nodes downstream of them to the
+    ///  edge of the DEM, ordered so receivers come before their donors.
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param chi_nodes The node indices. Replaced in function.
+    /// @param receiver_positions The position in chi_nodes of the receiver of each node,
+    ///  -1 for baselevel nodes. Replaced in function.
+    /// @param flow_lengths The flow length from each node to its receiver. Replaced in function.
+    /// @param position_of_node_sequence The position in chi_nodes of each node in
+    ///  node_sequence. Replaced in function.
+    void get_chi_integration_nodes(LSDFlowInfo& FlowInfo, vector<int>& chi_nodes,
+                        vector<int>& receiver_positions, vector<float>& flow_lengths,
+                        vector<int>& position_of_node_sequence);
+
+    /// @brief Integrates chi over the nodes from get_chi_integration_nodes for
+    ///  each m/n value, in parallel over the m/n values.
+    /// @param receiver_positions from get_chi_integration_nodes
+    /// @param flow_lengths from get_chi_integration_nodes
+    /// @param drainage The drainage area (or discharge) of each node
+    /// @param position_of_node_sequence from get_chi_integration_nodes
+    /// @param A_0 the reference drainage area
+    /// @param movern the m/n values
+    /// @return A vector for each m/n value with the chi of each node in node_sequence
+    vector< vector<float> > integrate_chi_data_for_movern_sweep(vector<int>& receiver_positions,
+                        vector<float>& flow_lengths, vector<float>& drainage,
+                        vector<int>& position_of_node_sequence, float A_0, vector<float>& movern);
+
+    /// @brief This computes a collinearity metric for all combinations of
+    ///  channels for a basin using a cached basin network and a vector of chi values.
+    ///  It gives the same results as test_all_segment_collinearity_by_basin and
+    ///  test_all_segment_collinearity_by_basin_using_points but does not use the
+    ///  chi data member, so many basins and m/n values can be tested at once.
+    /// @param network The basin network from get_movern_basin_networks
+    /// @param these_chi The chi value of every node in node_sequence
+    /// @param only_use_mainstem_as_reference True if you only want to use the mainstem
+    /// @param reference_source integer vector replaced in function that has the reference vector for each comparison
+    /// @param test_source integer vector replaced in function that has the test vector for each comparison
+    /// @param MLE_values the MLE for each comparison. Replaced in function.
+    /// @param RMSE_values the RMSE for each comparison. Replaced in function.
+    /// @param sigma The uncertainty for the MLE calculation.
+    /// @param use_points If true, the channels are compared at fractions of the mainstem length in chi
+    /// @param chi_fractions_for_testing The fractions of the mainstem length used if use_points is true
+    /// @return The product of the MLE values
+    float test_all_segment_collinearity_by_basin(movern_basin_network& network, vector<float>& these_chi,
+                                        bool only_use_mainstem_as_reference,
+                                        vector<int>& reference_source, vector<int>& test_source,
+                                        vector<float>& MLE_values, vector<float>& RMSE_values,
+                                        float sigma, bool use_points, vector<float>& chi_fractions_for_testing);
+
+    /// @brief The disorder metric of Hergarten et al 2016 for a list of nodes
+    /// @param basin_node_indices The positions in node_sequence of the nodes in the basin
+    /// @param these_chi The chi value of every node in node_sequence
+    /// @return The disorder statistic
+    float test_collinearity_by_basin_disorder(vector<int>& basin_node_indices, vector<float>& these_chi);
+
+    /// @brief The disorder metric of Hergarten et al 2016 for every combination
+    ///  of three tributaries and the mainstem of a list of nodes
+    /// @param basin_node_indices The positions in node_sequence of the nodes in the basin
+    /// @param these_chi The chi value of every node in node_sequence
+    /// @return The disorder statistic of each combination
+    vector<float> test_collinearity_by_basin_disorder_with_uncert(vector<int>& basin_node_indices,
+                                        vector<float>& these_chi);
+
+    /// @brief Runs the collinearity test on every basin for every m/n value in
+    ///  parallel and prints the _fullstats and _basinstats files.
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param JN an LSDJunctionNetwork object
+    /// @param movern the m/n values
+    /// @param chi_of_movern The chi data of each m/n value, from get_chi_data_for_movern_sweep
+    /// @param only_use_mainstem_as_reference a boolean, if true only compare channels to mainstem
+    /// @param file_prefix The file prefix for the data files
+    /// @param sigma The uncertainty for the MLE calculation.
+    /// @param use_points If true, the channels are compared at fractions of the mainstem length in chi
+    /// @param chi_fractions_vector The fractions of the mainstem length used if use_points is true
+    /// @param print_basin_keys If true the _fullstats files get a basin_key column
+    void collinearity_fxn_movern_sweep(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        bool only_use_mainstem_as_reference, string file_prefix, float sigma,
+                        bool use_points, vector<float> chi_fractions_vector, bool print_basin_keys);
+
+    /// @brief Runs the Monte Carlo points collinearity test on every basin for
+    ///  every m/n value in parallel and prints the _pointsMC and _points_MC_basinstats files.
+    /// @details Each basin and m/n value draws its chi fractions from its own
+    ///  random stream, so the results do not depend on the number of threads.
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param JN an LSDJunctionNetwork object
+    /// @param movern the m/n values
+    /// @param chi_of_movern The chi data of each m/n value, from get_chi_data_for_movern_sweep
+    /// @param only_use_mainstem_as_reference a boolean, if true only compare channels to mainstem
+    /// @param file_prefix The file prefix for the data files
+    /// @param sigma The uncertainty for the MLE calculation.
+    /// @param n_fracs The number of chi fractions to test in each iteration
+    /// @param MC_iterations The number of Monte Carlo iterations
+    /// @param max_frac The maximum chi fraction
+    /// @param file_suffix Added to the end of the file names ("_Q" for discharge)
+    void collinearity_fxn_movern_sweep_MC(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        bool only_use_mainstem_as_reference, string file_prefix, float sigma,
+                        int n_fracs, int MC_iterations, float max_frac, string file_suffix);
+
+    /// @brief Runs the disorder test on every basin for every m/n value in
+    ///  parallel and prints the disorder files.
+    /// @param FlowInfo an LSDFlowInfo object
+    /// @param JN an LSDJunctionNetwork object
+    /// @param movern the m/n values
+    /// @param chi_of_movern The chi data of each m/n value, from get_chi_data_for_movern_sweep
+    /// @param chi_of_movern_for_uncert The chi data used for the uncertainty combinations
+    /// @param file_prefix The file prefix for the data files
+    /// @param use_uncert a bool that if true triggers the uncertainty algorithms
+    void disorder_fxn_movern_sweep(LSDFlowInfo& FlowInfo, LSDJunctionNetwork& JN,
+                        vector<float>& movern, vector< vector<float> >& chi_of_movern,
+                        vector< vector<float> >& chi_of_movern_for_uncert,
+                        string file_prefix, bool use_uncert);
+
     /// @brief This function drives a Monte Carlo-Markov chain model It wraps
     /// the dmovern tuning and the main chain.
     /// @param FlowInfo An LSDFlowInfo object
@@ -741,6 +919,92 @@ class LSDChiTools
                           int minimum_contributing_pixels, int NIterations, float sigma, float dmovern_stddev,
                           float movern_minimum, float movern_maximum, int basin_key, bool use_points);
 
+    /// @brief This drives the m/n MCMC analysis with several chains per basin.
+    /// @detail All the chains of all the basins are run at once. The chains
+    ///  step on a lattice of m/n values (spacing 0.001) and the misfit of every
+    ///  m/n visited is cached, so chi and the collinearity test are computed
+    ///  at most once per m/n value per basin. sigma is tuned for each basin as in
+    ///  MCMC_driver, then the step size of each chain is tuned during burn in. After
+    ///  burn in the chains of a basin stop once the Gelman-Rubin statistic is below
+    ///  target_Rhat and the pooled effective sample size reaches target_ESS,
+    ///  or after N_chain_links. The results do not depend on the number of threads.
+    /// @param FlowInfo An LSDFlowInfo object
+    /// @param minimum_contributing_pixels chi is only calculated if the contributing pixels are bigger than this
+    /// @param movern_minimum The minimum movern value to be tested
+    /// @param movern_maximum The maximum movern value to be tested
+    /// @param N_chain_links The maximum number of links in each chain
+    /// @param N_chains The number of chains per basin
+    /// @param N_burn_in_links The number of links during which the step size is tuned.
+    ///  These are not used in the convergence diagnostics.
+    /// @param target_Rhat The Gelman-Rubin statistic below which the chains have mixed
+    /// @param target_ESS The pooled effective sample size the chains need to reach
+    /// @param OUT_DIR the output directory where you want the file
+    /// @param OUT_ID prefix of the output file
+    /// @param use_points a bool that if true means you use the point version of the collinearity test
+    /// @return No return but makes a _chain.csv file for each basin and a
+    ///  _MCMC_movern_summary.csv file
+    void MCMC_multichain_driver(LSDFlowInfo& FlowInfo, int minimum_contributing_pixels,
+                                float movern_minimum, float movern_maximum,
+                                int N_chain_links, int N_chains, int N_burn_in_links,
+                                float target_Rhat, float target_ESS,
+                                string OUT_DIR, string OUT_ID, bool use_points);
+
+    /// @brief Sets up the channel network of every basin for the multi-chain MCMC
+    /// @param FlowInfo An LSDFlowInfo object
+    /// @param minimum_contributing_pixels chi is only calculated if the contributing pixels are bigger than this
+    /// @param n_lattice_points The number of m/n values the misfit is cached for
+    /// @return A movern_basin_network for each basin key
+    vector<movern_basin_network> get_movern_basin_networks(LSDFlowInfo& FlowInfo,
+                                int minimum_contributing_pixels, int n_lattice_points);
+
+    /// @brief Computes chi of a basin network for one m/n and returns the sum
+    ///  of squared residuals of the tributaries projected onto the mainstem.
+    ///  The likelihood used by the MCMC routines is exp(-misfit/(2 sigma^2)).
+    /// @detail This does not touch the data members so it can be called from many threads.
+    /// @param network The basin network
+    /// @param movern The m/n value
+    /// @param A_0 The reference area
+    /// @param use_points If true, only the residuals at chi_fractions of the mainstem length are used
+    /// @param chi_fractions The fractions of the mainstem length (in chi) to test if use_points is true
+    /// @return The misfit
+    double calculate_movern_misfit_of_basin(movern_basin_network& network, float movern, float A_0,
+                                bool use_points, vector<float>& chi_fractions);
+
+    /// @brief Gets the misfit of a basin at a point on the m/n lattice, from the
+    ///  cache of the network if that m/n has been visited before. Safe to call
+    ///  from many threads.
+    /// @param network The basin network
+    /// @param lattice_index The index of the m/n value on the lattice
+    /// @param movern_minimum The m/n value of the first lattice point
+    /// @param movern_resolution The spacing of the lattice
+    /// @param A_0 The reference area
+    /// @param use_points If true, only the residuals at chi_fractions of the mainstem length are used
+    /// @param chi_fractions The fractions of the mainstem length (in chi) to test if use_points is true
+    /// @return The misfit
+    double get_cached_movern_misfit(movern_basin_network& network, int lattice_index,
+                                float movern_minimum, float movern_resolution, float A_0,
+                                bool use_points, vector<float>& chi_fractions);
+
+    /// @brief Advances a Metropolis chain on the m/n lattice of a basin network
+    /// @param network The basin network
+    /// @param N_links The number of links to add to the chain
+    /// @param sigma The sigma value for checking the MLE of chi
+    /// @param dmovern_stddev The standard deviation of the proposed changes in m/n
+    /// @param movern_minimum The m/n value of the first lattice point
+    /// @param movern_resolution The spacing of the lattice
+    /// @param A_0 The reference area
+    /// @param use_points If true, only the residuals at chi_fractions of the mainstem length are used
+    /// @param chi_fractions The fractions of the mainstem length (in chi) to test if use_points is true
+    /// @param lattice_index The current lattice index of the chain. Updated.
+    /// @param rng The random stream of the chain
+    /// @param link_records Five numbers are appended for each link: the proposed m/n,
+    ///  the current m/n, the likelihoods of both and 1 if the proposal was accepted
+    /// @return The number of accepted proposals
+    int advance_movern_chain(movern_basin_network& network, int N_links, float sigma, float dmovern_stddev,
+                                float movern_minimum, float movern_resolution, float A_0,
+                                bool use_points, vector<float>& chi_fractions,
+                                int& lattice_index, RandomStream& rng, vector<float>& link_records);
+
 
     /// @brief This prints a series of chi profiles as a function of m over n
     ///  for visualisation
@@ -823,24 +1087,45 @@ class LSDChiTools
     /// @date 04/05/2017
     int get_starting_node_of_source(int source_key);
 
+    /// @brief This gets the source key of a node
+    /// @param node_index the FlowInfo node index
+    /// @return the source key, or NoDataValue if the node is not in the channel network
+    int get_source_key_of_node(int node_index);
+
     /// @brief Gets the number of channels in the DEM
     /// @return number of channels
     /// @author SMM
     /// @date 05/05/2017
     int get_number_of_channels();
 
+    /// @brief Sets the keys that this object's first basin and first source
+    ///  have in a larger analysis. The random streams are numbered by basin or
+    ///  source key plus these offsets, so objects that each hold one basin of
+    ///  the analysis draw different numbers. Both are 0 unless set.
+    /// @param first_basin_key The key of this object's first basin
+    /// @param first_source_key The key of this object's first source
+    void set_random_stream_key_offsets(int first_basin_key, int first_source_key)
+      { basin_key_offset = first_basin_key; source_key_offset = first_source_key; }
+
     /// @brief This takes a source key and a flow info object and overwrites vectors
     ///  containing chi and elevation data from a channel tagged by a source
     ///  key. The idea is to use this in the MLE comparison between two channels
     ///  to check for collinearity
     /// @param FlowInfo and LSDFlowInfo object
     /// @param source_key The key of the source
-    /// @param chi_data A vector holding chi data of the channel. Will be overwritten
+    /// @param channel_chi_data A vector holding chi data of the channel. Will be overwritten
     /// @param elevation_data A vector holding elevation data of the channel. Will be overwritten
     /// @author SMM
     /// @date 06/05/2017
     void get_chi_elevation_data_of_channel(LSDFlowInfo& FlowInfo, int source_key,
-                                vector<float>& chi_data, vector<float>& elevation_data);
+                                vector<float>& channel_chi_data, vector<float>& elevation_data);
+
+    /// @brief This gets the positions in node_sequence of the nodes of the channel
+    ///  tagged by a source key, in the same order as get_chi_elevation_data_of_channel
+    /// @param FlowInfo and LSDFlowInfo object
+    /// @param source_key The key of the source
+    /// @return The indices into node_sequence of the channel nodes, source first
+    vector<int> get_node_sequence_indices_of_channel(LSDFlowInfo& FlowInfo, int source_key);
 
     /// @brief This takes the chi locations of a tributarry vector and then uses
     ///  linear interpolation to determine the elevation on a reference channel
@@ -1192,6 +1477,8 @@ class LSDChiTools
 
     /// @brief print a csv file with the receiver of each source and the corresponding source with the m_chi
     /// That is barely understable, however I have a cold so I am tired as F. Just ask me if you need more info about that
+    /// @details The columns are source_key, receiving_source_key, m_chi (the m_chi of
+    /// the receiving river at the junction) and chi (the chi at the source of the channel).
     /// @param string filename: the path/name.csv of your file
     /// @author BG
     /// @date 30/11/2017
@@ -1237,6 +1524,13 @@ class LSDChiTools
     /// @date 05/01/2018
     void ksn_knickpoint_raw_river(int SK, vector<int> vecnode);
 
+    /// @brief Get the knickpoints of one river without touching the global maps,
+    ///  so that several rivers can be processed at once
+    /// @param vecnode: a vector of the river nodes
+    /// @param kp_nodes: replaced with the nodes of the knickpoints
+    /// @param kp_dksn: replaced with the delta ksn of each knickpoint
+    void get_raw_ksn_knickpoints_of_river(vector<int>& vecnode, vector<int>& kp_nodes, vector<float>& kp_dksn);
+
     /// @brief write a file with the raw knickpoint informations
     /// @param FlowiInfo: a LSDFlowInfo object
     /// @param filename: string with path+name+.csv
@@ -1245,6 +1539,7 @@ class LSDChiTools
     void print_raw_ksn_knickpoint(LSDFlowInfo& FlowInfo, string filename);
 
     /// @brief Calculate KDE over the river system using the dksn/dchi map previously calculated through ksn_knickpoint_automator
+    ///  The rivers are processed in parallel with the binned KDE of LSDStatsTools
     /// @author BG
     /// @date 05/01/2018
     void ksn_kp_KDE();
@@ -1335,24 +1630,35 @@ class LSDChiTools
     /// A general incrementer for knickpoints. It has to be global for some reason
     int id_kp;
 
+    /// The key of the first basin and first source of this object in a larger
+    /// analysis, used to number the random streams
+    int basin_key_offset;
+    int source_key_offset;
+
     ///A map of strings for holding georeferencing information
     map<string,string> GeoReferencingStrings;
 
-    // Some maps to store the data
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float> M_chi_data_map;
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float> b_chi_data_map;
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float> elev_data_map;
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float> chi_data_map;
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float>  flow_distance_data_map;
-    /// A map of the M_chi values. The indices are node numbers from FlowInfo
-    map<int,float>  drainage_area_data_map;
-    /// A map that holds elevations regressed from fitted sections.
-    map<int,float> segmented_elevation_map;
+    // The per node channel data. These vectors are aligned with node_sequence:
+    // element n holds the data of node node_sequence[n]. Use
+    // node_sequence_index to find the element of a FlowInfo node.
+    /// The position of each FlowInfo node in node_sequence. Nodes that are not
+    /// in the channel network have NoDataValue.
+    vector<int> node_sequence_index;
+    /// The M_chi values, aligned with node_sequence
+    vector<float> M_chi_data;
+    /// The b_chi values (intercepts of the fitted segments), aligned with node_sequence
+    vector<float> b_chi_data;
+    /// The elevations, aligned with node_sequence
+    vector<float> elev_data;
+    /// The chi coordinates, aligned with node_sequence
+    vector<float> chi_data;
+    /// The flow distances, aligned with node_sequence
+    vector<float> flow_distance_data;
+    /// The drainage areas, aligned with node_sequence
+    vector<float> drainage_area_data;
+    /// The elevations regressed from fitted sections, aligned with node_sequence.
+    /// This is empty until calculate_segmented_elevation has been run.
+    vector<float> segmented_elevation_data;
     /// A map that holds segment numbers: used with skip = 0. Can be used to map
     /// distinct segments
     map<int,int> segment_counter_map;
@@ -1418,12 +1724,12 @@ class LSDChiTools
     map<int,float> map_chi_length_source_key;
     // Map[node_index] = 0 if not outlier, 1 if outlier according to a simple Modified z score on dksn/dchi
     map<int,int> map_outlier_MZS_dksndchi;
-    /// Map[node_index] = lumped m_chi
-    map<int,float> lumped_m_chi_map;
-        /// Map[node_index] = TVDed m_chi
-    map<int,float> TVD_m_chi_map;
-    /// Map[node_index] = TVDed m_chi
-    map<int,float> TVD_b_chi_map;
+    /// The lumped m_chi, aligned with node_sequence
+    vector<float> lumped_m_chi_data;
+    /// The TVDed m_chi, aligned with node_sequence
+    vector<float> TVD_m_chi_data;
+    /// The TVDed b_chi, aligned with node_sequence
+    vector<float> TVD_b_chi_data;
     /// Debugging map to check the TVD correctin (deprecated - I'll clean my code when I'll be sure I'll need it)
     map<int,float>TVD_m_chi_map_non_corrected;
     /// Grouped and processed knickpoints
@@ -1449,8 +1755,11 @@ class LSDChiTools
     map<int,int> map_outlier_MZS_combined;
     map<int,float> kp_segdrop;
     map<int,float> raw_segchange;
-    map<int,float> TVD_segelev_diff;
-    map<int,float> segelev_diff;
+    /// The TVDed change in segmented elevation, aligned with node_sequence
+    vector<float> TVD_segelev_diff_data;
+    /// The change in segmented elevation from the previous node in the river,
+    /// aligned with node_sequence
+    vector<float> segelev_diff_data;
     map<int,float> segelev_diff_second;
     map<int,float> raw_delta_segelev_from_TVDb_chi;
     map<int,vector<int> > map_node_source_key_kp_stepped;
@@ -1474,15 +1783,14 @@ class LSDChiTools
     /// In big DEMs the node numbers become huge so for printing efficiency we
     /// run a key that starts at 0
 
-    /// This map contains all the nodes. The key is the node index and the value
-    ///  is the source key (sorry I know this is confusing). It means if you
-    ///  have the node index you can look up the source key. Used for
-    ///  visualisation.
-    map<int,int> source_keys_map;
+    /// This has the source key of all the nodes, aligned with node_sequence.
+    ///  It means if you have the node index you can look up the source key
+    ///  through node_sequence_index. Used for visualisation.
+    vector<int> source_keys_data;
 
-    /// This has all the nodes. The key (in the map) is the node index, and the
-    ///  value is the baselevel key. Again used for visualisation
-    map<int,int> baselevel_keys_map;
+    /// This has the baselevel key of all the nodes, aligned with node_sequence.
+    ///  Again used for visualisation
+    vector<int> baselevel_keys_data;
 
     /// This has as many elements as there are sources. The key in the map is the
     ///  node index of the source, and the value is the source key.
@@ -54,6 +54,7 @@
 #include <string>
 #include <ctype.h>
 #include <sstream>
+#include <cstdio>
 #include <algorithm> 
 #include <vector>
 #include "LSDStatsTools.hpp"
@@ -177,6 +178,16 @@ void LSDCosmoData::initiate_default_parameters()
   write_TopoShield_raster = true;
   write_basin_index_raster = true;
   
+  // keep the production scaling of each DEM in a cache
+  use_scaling_cache = true;
+
+  // Monte Carlo uncertainty is off unless draws are asked for.
+  // A random seed of 0 takes the seed from the clock.
+  monte_carlo_draws = 0;
+  monte_carlo_shielding_uncertainty = 0;
+  monte_carlo_attenuation_uncertainty = 0;
+  random_seed = 0;
+  
   // Set the parameters
   // The default slope parameter for filling. Do not change. 
   min_slope = 0.0001;
@@ -340,6 +351,7 @@ void LSDCosmoData::load_cosmogenic_data(string filename, string filetype)
 
   }
   erosion_rate_results = result_vecvec;
+  monte_carlo_results = result_vecvec;
 
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -763,6 +775,44 @@ void LSDCosmoData::load_parameters(string filename)
         cout << "You have not selected a valid toposhield write. Defaulting to true." << endl;
       }
     }
+    else if (lower == "use_scaling_cache")
+    {
+      if(value.find("true") == 0 || value.find("True") == 0)
+      {
+        use_scaling_cache = true;
+      }
+      else if (value.find("false") == 0 || value.find("False") == 0)
+      {
+        use_scaling_cache = false;
+      }
+      else
+      {
+        use_scaling_cache = true;
+        cout << "You have not selected a valid scaling cache option. Defaulting to true." << endl;
+      }
+    }
+    else if (lower == "monte_carlo_draws")
+    {
+      monte_carlo_draws = atoi(value.c_str());
+    }
+    else if (lower == "monte_carlo_shielding_uncertainty")
+    {
+      monte_carlo_shielding_uncertainty = atof(value.c_str());
+    }
+    else if (lower == "monte_carlo_attenuation_uncertainty")
+    {
+      monte_carlo_attenuation_uncertainty = atof(value.c_str());
+    }
+    else if (lower == "random_seed")
+    {
+      // 0, the default, takes the master seed from the clock so the Monte
+      // Carlo draws change from run to run
+      random_seed = atol(value.c_str());
+      if (random_seed != 0)
+      {
+        set_random_master_seed(random_seed);
+      }
+    }
     else
     {
       cout << "Line " << __LINE__ << ": No parameter '"
@@ -1365,7 +1415,10 @@ void LSDCosmoData::check_rasters()
 // Spawn clipped basins
 // This function attempts to speed up shielding calculations by
 // finding basins and then clipping each basin to a DEM. It sucks up a whole bunch
-// of disk space but is faster than doing entire DEMs
+// of disk space. Now that the shielding of a whole DEM is done in parallel
+// (see LSDRaster::TopographicShielding) it is usually quicker to skip the
+// spawning and run the full analysis on the DEM itself, which shields
+// overlapping basins only once.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 vector<string> LSDCosmoData::spawn_clipped_basins(string DEM_fname, int padding_pixels)
 {
@@ -1823,6 +1876,314 @@ LSDRaster LSDCosmoData::calculate_production_raster(LSDRaster& Elevation_Data,
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This calculates the production scaling and pressure of every pixel
+// in a DEM. The atmospheric data is only read, so a single parameter object
+// is shared by the threads.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoData::calculate_production_scaling_and_pressure(LSDRaster& Elevation_Data,
+                                   Array2D<double>& Production_scaling,
+                                   Array2D<double>& Pressure)
+{
+  int NRows = Elevation_Data.get_NRows();
+  int NCols = Elevation_Data.get_NCols();
+  float NDV =  Elevation_Data.get_NoDataValue();
+
+  Array2D<double> New_production(NRows,NCols,double(NDV));
+  Array2D<double> New_pressure(NRows,NCols,double(NDV));
+
+  // now create the CRN parameters object
+  LSDCRNParameters LSDCRNP;
+
+  // get the atmospheric parameters
+  LSDCRNP.load_parameters_for_atmospheric_scaling(path_to_atmospheric_data);
+  LSDCRNP.set_CRONUS_data_maps();
+
+  // a function for scaling stone production, defaults to 1
+  double Fsp = 1.0;
+
+  #pragma omp parallel
+  {
+    // the latitude and longitude
+    double lat,longitude;
+
+    // the sites in this row
+    vector<int> site_cols;
+    vector<double> site_lat, site_lon, site_elev, site_pressure;
+
+    // declare converter object
+    LSDCoordinateConverterLLandUTM Converter;
+
+    #pragma omp for schedule(dynamic,16)
+    for (int row = 0; row < NRows; row++)
+    {
+      site_cols.clear();
+      site_lat.clear();
+      site_lon.clear();
+      site_elev.clear();
+      for(int col = 0; col<NCols; col++)
+      {
+        //exclude NDV
+        if (Elevation_Data.get_data_element(row,col) != NDV)
+        {
+          // To get pressure, first get the lat and long
+          Elevation_Data.get_lat_and_long_locations(row, col, lat, longitude, Converter);
+
+          site_cols.push_back(col);
+          site_lat.push_back(lat);
+          site_lon.push_back(longitude);
+          site_elev.push_back(double(Elevation_Data.get_data_element(row,col)));
+        }
+      }
+
+      // now the pressure of the whole row
+      LSDCRNP.NCEPatm_2(site_lat, site_lon, site_elev, site_pressure);
+
+      for (int i = 0; i < int(site_cols.size()); i++)
+      {
+        New_pressure[row][site_cols[i]] = site_pressure[i];
+        New_production[row][site_cols[i]] = LSDCRNP.stone2000sp(site_lat[i],site_pressure[i], Fsp);
+      }
+    }
+  }
+
+  Production_scaling = New_production;
+  Pressure = New_pressure;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This hashes the inputs to the production scaling (64 bit FNV-1a): the
+// version of the cache, the dimensions and georeferencing of the DEM, its
+// elevations and the bytes of the NCEP files.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+string LSDCosmoData::get_production_scaling_hash(LSDRaster& Elevation_Data)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  const unsigned long long prime = 1099511628211ULL;
+
+  // the version of the file format and of the scaling and pressure
+  // calculations. Change this if either changes so old caches are not used
+  string cache_version = "CRNScaling 1: bsq doubles, stone2000sp, NCEPatm_2";
+  for(int i = 0; i< int(cache_version.size()); i++)
+  {
+    hash = (hash^(unsigned char)(cache_version[i]))*prime;
+  }
+
+  // hash the dimensions
+  int NRows = Elevation_Data.get_NRows();
+  int NCols = Elevation_Data.get_NCols();
+  float header_values[5];
+  header_values[0] = Elevation_Data.get_XMinimum();
+  header_values[1] = Elevation_Data.get_YMinimum();
+  header_values[2] = Elevation_Data.get_DataResolution();
+  header_values[3] = Elevation_Data.get_NoDataValue();
+  header_values[4] = float(NRows)*float(NCols);
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(header_values);
+  for(int i = 0; i< int(sizeof(header_values)); i++)
+  {
+    hash = (hash^bytes[i])*prime;
+  }
+
+  // now the georeferencing
+  map<string,string> GeoReferencingStrings = Elevation_Data.get_GeoReferencingStrings();
+  for(map<string,string>::iterator iter = GeoReferencingStrings.begin();
+      iter != GeoReferencingStrings.end(); iter++)
+  {
+    string this_string = iter->first+"="+iter->second;
+    for(int i = 0; i< int(this_string.size()); i++)
+    {
+      hash = (hash^(unsigned char)(this_string[i]))*prime;
+    }
+  }
+
+  // now the elevations
+  for(int row = 0; row<NRows; row++)
+  {
+    for(int col = 0; col<NCols; col++)
+    {
+      float this_elevation = Elevation_Data.get_data_element(row,col);
+      bytes = reinterpret_cast<const unsigned char*>(&this_elevation);
+      for(int i = 0; i< int(sizeof(float)); i++)
+      {
+        hash = (hash^bytes[i])*prime;
+      }
+    }
+  }
+
+  // and finally the atmospheric data
+  vector<string> NCEP_files;
+  NCEP_files.push_back(path_to_atmospheric_data+"NCEP2.bin");
+  NCEP_files.push_back(path_to_atmospheric_data+"NCEP_hgt.bin");
+  for(int f = 0; f< int(NCEP_files.size()); f++)
+  {
+    ifstream ifs(NCEP_files[f].c_str(), ios::in | ios::binary);
+    vector<char> buffer(65536);
+    while(ifs.read(&buffer[0], buffer.size()) || ifs.gcount() > 0)
+    {
+      int n_read = int(ifs.gcount());
+      for(int i = 0; i< n_read; i++)
+      {
+        hash = (hash^(unsigned char)(buffer[i]))*prime;
+      }
+    }
+  }
+
+  stringstream ss;
+  ss << hex << hash;
+  return ss.str();
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the production scaling and pressure for a DEM, reading them
+// from the cache next to the DEM if its hash matches, and otherwise
+// calculating them and rewriting the cache.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCosmoData::get_production_scaling_cache(LSDRaster& Elevation_Data, string DEM_fname,
+                                   Array2D<double>& Production_scaling,
+                                   Array2D<double>& Pressure)
+{
+  if (not use_scaling_cache)
+  {
+    calculate_production_scaling_and_pressure(Elevation_Data, Production_scaling, Pressure);
+    return;
+  }
+
+  int NRows = Elevation_Data.get_NRows();
+  int NCols = Elevation_Data.get_NCols();
+  string cache_header_name = DEM_fname+"_CRNScaling.hdr";
+  string cache_data_name = DEM_fname+"_CRNScaling.bil";
+  string hash_key = "lsdtt crn scaling hash";
+  string this_hash = get_production_scaling_hash(Elevation_Data);
+
+  // see if there is a cache with the same hash
+  bool cache_is_valid = false;
+  ifstream header_in(cache_header_name.c_str());
+  if (not header_in.fail())
+  {
+    int cache_NRows = 0;
+    int cache_NCols = 0;
+    string cache_hash;
+    string line;
+    while (getline(header_in,line))
+    {
+      size_t equals = line.find('=');
+      if (equals == string::npos)
+      {
+        continue;
+      }
+      string key = line.substr(0,equals);
+      string value = line.substr(equals+1);
+      key.erase(remove_if(key.begin(), key.end(), ::isspace), key.end());
+      value.erase(remove_if(value.begin(), value.end(), ::isspace), value.end());
+      if (key == "samples")
+      {
+        cache_NCols = atoi(value.c_str());
+      }
+      else if (key == "lines")
+      {
+        cache_NRows = atoi(value.c_str());
+      }
+      else if (key == "lsdttcrnscalinghash")
+      {
+        cache_hash = value;
+      }
+    }
+    header_in.close();
+
+    if (cache_hash == this_hash && cache_NRows == NRows && cache_NCols == NCols)
+    {
+      Array2D<double> Cached_production(NRows,NCols);
+      Array2D<double> Cached_pressure(NRows,NCols);
+      ifstream data_in(cache_data_name.c_str(), ios::in | ios::binary);
+      for (int row = 0; row<NRows; row++)
+      {
+        data_in.read(reinterpret_cast<char*>(&Cached_production[row][0]), NCols*sizeof(double));
+      }
+      for (int row = 0; row<NRows; row++)
+      {
+        data_in.read(reinterpret_cast<char*>(&Cached_pressure[row][0]), NCols*sizeof(double));
+      }
+      if (data_in)
+      {
+        cout << "Read the production scaling from the cache " << cache_data_name << endl;
+        Production_scaling = Cached_production;
+        Pressure = Cached_pressure;
+        cache_is_valid = true;
+      }
+    }
+  }
+
+  if (not cache_is_valid)
+  {
+    cout << "Calculating the production scaling for " << DEM_fname << endl;
+    calculate_production_scaling_and_pressure(Elevation_Data, Production_scaling, Pressure);
+
+    // write the cache: band 1 is the production scaling, band 2 the pressure.
+    // Both files are written under temporary names and only moved into place
+    // once they are complete. The old header goes first, so a cache that is
+    // interrupted part way has no header and is never read.
+    string temp_data_name = cache_data_name+".tmp";
+    string temp_header_name = cache_header_name+".tmp";
+    ofstream data_out(temp_data_name.c_str(), ios::out | ios::binary);
+    for (int row = 0; row<NRows; row++)
+    {
+      data_out.write(reinterpret_cast<char*>(&Production_scaling[row][0]), NCols*sizeof(double));
+    }
+    for (int row = 0; row<NRows; row++)
+    {
+      data_out.write(reinterpret_cast<char*>(&Pressure[row][0]), NCols*sizeof(double));
+    }
+    data_out.close();
+
+    ofstream header_ofs(temp_header_name.c_str());
+    header_ofs <<  "ENVI" << endl;
+    header_ofs << "description = {" << endl << cache_data_name << "}" << endl;
+    header_ofs <<  "samples = " << NCols << endl;
+    header_ofs <<  "lines = " << NRows << endl;
+    header_ofs <<  "bands = 2" << endl;
+    header_ofs <<  "header offset = 0" << endl;
+    header_ofs <<  "file type = ENVI Standard" << endl;
+    header_ofs <<  "data type = 5" << endl;
+    header_ofs <<  "interleave = bsq" << endl;
+    header_ofs <<  "byte order = 0" << endl;
+    header_ofs <<  "band names = {production scaling, pressure}" << endl;
+    map<string,string> GeoReferencingStrings = Elevation_Data.get_GeoReferencingStrings();
+    map<string,string>::iterator iter = GeoReferencingStrings.find("ENVI_map_info");
+    if (iter != GeoReferencingStrings.end() )
+    {
+      header_ofs <<  "map info = {"<< iter->second <<"}" << endl;
+    }
+    iter = GeoReferencingStrings.find("ENVI_coordinate_system");
+    if (iter != GeoReferencingStrings.end() )
+    {
+      header_ofs <<  "coordinate system string = {"<< iter->second <<"}" << endl;
+    }
+    header_ofs <<  "data ignore value = " << Elevation_Data.get_NoDataValue() << endl;
+    header_ofs <<  hash_key << " = " << this_hash << endl;
+    header_ofs.close();
+
+    if (data_out.fail() || header_ofs.fail())
+    {
+      cout << "Warning, could not write the production scaling cache " << cache_data_name << endl;
+      remove(temp_data_name.c_str());
+      remove(temp_header_name.c_str());
+      return;
+    }
+
+    remove(cache_header_name.c_str());
+    if (rename(temp_data_name.c_str(), cache_data_name.c_str()) != 0 ||
+        rename(temp_header_name.c_str(), cache_header_name.c_str()) != 0)
+    {
+      cout << "Warning, could not move the production scaling cache into place " << cache_data_name << endl;
+      remove(temp_data_name.c_str());
+      remove(temp_header_name.c_str());
+    }
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //
@@ -1921,6 +2282,20 @@ void LSDCosmoData::print_renamed_parameter_data(string path, string prefix)
   {
     new_param_data << "write_full_scaling_rasters: False" << endl;
   }  
+  if (use_scaling_cache)
+  {
+    new_param_data << "use_scaling_cache: True" << endl;
+  }
+  else
+  {
+    new_param_data << "use_scaling_cache: False" << endl;
+  }
+  new_param_data << "monte_carlo_draws: " << monte_carlo_draws << endl;
+  new_param_data << "monte_carlo_shielding_uncertainty: " 
+                 << monte_carlo_shielding_uncertainty << endl;
+  new_param_data << "monte_carlo_attenuation_uncertainty: " 
+                 << monte_carlo_attenuation_uncertainty << endl;
+  new_param_data << "random_seed: " << random_seed << endl;
   new_param_data.close();
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -2209,6 +2584,12 @@ void LSDCosmoData::basic_cosmogenic_analysis(string DEM_fname)
   //bool data_from_outlet_only = true;      // this needs to be turned off later!!!
   
   
+  // get the production scaling of the whole DEM. This comes from the
+  // cache next to the DEM if the DEM has not changed
+  Array2D<double> Production_scaling;
+  Array2D<double> Pressure;
+  get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
+
   // some temporary doubles to hold the nuclide concentrations
   double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
   double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
@@ -2258,14 +2639,18 @@ void LSDCosmoData::basic_cosmogenic_analysis(string DEM_fname)
     
     // populate the scaling vectors
     thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, TopoShield,
-                                       path_to_atmospheric_data);
+                                       Production_scaling);
     
     // now do the analysis
     vector<double> erate_analysis = thisBasin.full_CRN_erosion_analysis(test_N, 
                                         valid_nuclide_names[samp], test_dN, 
                                         prod_uncert_factor, Muon_scaling);
+    vector<double> MC_analysis = monte_carlo_erosion_analysis(thisBasin,
+                                        valid_cosmo_points[samp], test_N,
+                                        valid_nuclide_names[samp], test_dN);
     
     erosion_rate_results[ valid_cosmo_points[samp] ] = erate_analysis;
+    monte_carlo_results[ valid_cosmo_points[samp] ] = MC_analysis;
   }
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -2452,19 +2837,31 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_nested(vector<string> Rast
       constant_self_depth = CRN_params[1];
     }
 
-    // some temporary doubles to hold the nuclide concentrations
-    double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
-    double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
-    double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
+    // get the production scaling of the whole DEM. This comes from the
+    // cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
 
     //========================
     // LOOPING THROUGH BASINS
     //========================
     // now loop through the valid points, getting the cosmo data 
+    // Each basin is a separate task: the basin, its scaling vectors and the
+    // CRN parameters used by the erosion rate iterations all belong to the
+    // thread doing the work. The results and the basin index raster are
+    // added in the ordered block at the end of the task, so they are added
+    // in sample order regardless of the number of threads.
     cout << "-----------------------------------------------------------" << endl;
     cout << "I found " << n_valid_points << " valid CRN basins in this raster! " << endl;
+    #pragma omp parallel for ordered schedule(dynamic,1)
     for(int samp = 0; samp<n_valid_points; samp++)
     {
+      // some temporary doubles to hold the nuclide concentrations
+      double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
+      double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
+      double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
+
       if( valid_nuclide_names[samp] == "Be10")
       {
         test_N10 = valid_concentrations[samp];
@@ -2507,30 +2904,6 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_nested(vector<string> Rast
       LSDCosmoBasin thisBasin(snapped_junction_indices[samp],FlowInfo, JNetwork,
                               test_N10,test_dN10, test_N26,test_dN26);
 
-      // write the index basin if flag is set to true
-      if(write_basin_index_raster)
-      {
-        cout << "I'm writing a basin index number for you" << endl;
-      
-        if (not written_inital_basin_index)
-        {
-        
-          basin_number = valid_cosmo_points[samp];
-          basin_pixel_area = thisBasin.get_NumberOfCells();
-          basin_area_map[basin_number] = basin_pixel_area;
-          LSDIndexRaster NewBasinIndex = 
-             thisBasin.write_integer_data_to_LSDIndexRaster(basin_number, FlowInfo);
-          BasinIndex = NewBasinIndex;
-          written_inital_basin_index = true;
-        }
-        else
-        {
-          basin_number = valid_cosmo_points[samp];
-          thisBasin.add_basin_to_LSDIndexRaster(BasinIndex, FlowInfo,
-                                                basin_area_map,basin_number);
-        }
-      }
-
       // we need to scale the shielding parameters
       // now do the snow and self shielding
       if (have_snow_raster)
@@ -2576,7 +2949,7 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_nested(vector<string> Rast
       // Now topographic shielding and production scaling
       thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, 
                                          Topographic_shielding,
-                                         path_to_atmospheric_data);
+                                         Production_scaling);
       cout << "The scaling vectors are populated. I am moving on to the analysis" << endl;
 
       // now do the analysis
@@ -2602,22 +2975,50 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_nested(vector<string> Rast
       float R = thisBasin.CalculateBasinRange(FlowInfo, filled_raster);
       double relief = double(R);
 
-      MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[samp] ] = relief;
-      MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[samp] ] = param_for_calc[0];
-      MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[samp] ] = param_for_calc[1];
-      MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[samp] ] = param_for_calc[2];
-      MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[samp] ] = param_for_calc[3];
-      MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[samp] ] =  param_for_calc[11];
-      MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[samp] ] = param_for_calc[4];
-      MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[samp] ] = param_for_calc[5];
-      MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[samp] ] = param_for_calc[6];
-      MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[7];
-      MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[samp] ] = param_for_calc[8];
-      MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[samp] ] = param_for_calc[9];
-      MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[10];
+      // add the results in sample order
+      #pragma omp ordered
+      {
+        // write the index basin if flag is set to true
+        if(write_basin_index_raster)
+        {
+          cout << "I'm writing a basin index number for you" << endl;
+      
+          if (not written_inital_basin_index)
+          {
+        
+            basin_number = valid_cosmo_points[samp];
+            basin_pixel_area = thisBasin.get_NumberOfCells();
+            basin_area_map[basin_number] = basin_pixel_area;
+            LSDIndexRaster NewBasinIndex = 
+               thisBasin.write_integer_data_to_LSDIndexRaster(basin_number, FlowInfo);
+            BasinIndex = NewBasinIndex;
+            written_inital_basin_index = true;
+          }
+          else
+          {
+            basin_number = valid_cosmo_points[samp];
+            thisBasin.add_basin_to_LSDIndexRaster(BasinIndex, FlowInfo,
+                                                  basin_area_map,basin_number);
+          }
+        }
+
+        MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[samp] ] = relief;
+        MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[samp] ] = param_for_calc[0];
+        MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[samp] ] = param_for_calc[1];
+        MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[samp] ] = param_for_calc[2];
+        MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[samp] ] = param_for_calc[3];
+        MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[samp] ] =  param_for_calc[11];
+        MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[samp] ] = param_for_calc[4];
+        MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[samp] ] = param_for_calc[5];
+        MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[samp] ] = param_for_calc[6];
+        MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[7];
+        MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[samp] ] = param_for_calc[8];
+        MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[samp] ] = param_for_calc[9];
+        MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[10];
     
-      // add the erosion rate results to the holding data member
-      erosion_rate_results[ valid_cosmo_points[samp] ] = erate_analysis;
+        // add the erosion rate results to the holding data member
+        erosion_rate_results[ valid_cosmo_points[samp] ] = erate_analysis;
+      }
 
       //cout << "finished adding data" << endl;
 
@@ -2809,19 +3210,31 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis(vector<string> Raster_name
       constant_self_depth = CRN_params[1];
     }
 
-    // some temporary doubles to hold the nuclide concentrations
-    double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
-    double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
-    double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
+    // get the production scaling of the whole DEM. This comes from the
+    // cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
 
     //========================
     // LOOPING THROUGH BASINS
     //========================
     // now loop through the valid points, getting the cosmo data 
+    // Each basin is a separate task: the basin, its scaling vectors and the
+    // CRN parameters used by the erosion rate iterations all belong to the
+    // thread doing the work. The results and the basin index raster are
+    // added in the ordered block at the end of the task, so they are added
+    // in sample order regardless of the number of threads.
     cout << "-----------------------------------------------------------" << endl;
     cout << "I found " << n_valid_points << " valid CRN basins in this raster! " << endl;
+    #pragma omp parallel for ordered schedule(dynamic,1)
     for(int samp = 0; samp<n_valid_points; samp++)
     {
+      // some temporary doubles to hold the nuclide concentrations
+      double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
+      double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
+      double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
+
       if( valid_nuclide_names[samp] == "Be10")
       {
         test_N10 = valid_concentrations[samp];
@@ -2864,30 +3277,6 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis(vector<string> Raster_name
       LSDCosmoBasin thisBasin(snapped_junction_indices[samp],FlowInfo, JNetwork,
                               test_N10,test_dN10, test_N26,test_dN26);
 
-      // write the index basin if flag is set to true
-      if(write_basin_index_raster)
-      {
-        cout << "I'm writing a basin index number for you" << endl;
-      
-        if (not written_inital_basin_index)
-        {
-        
-          basin_number = valid_cosmo_points[samp];
-          basin_pixel_area = thisBasin.get_NumberOfCells();
-          basin_area_map[basin_number] = basin_pixel_area;
-          LSDIndexRaster NewBasinIndex = 
-             thisBasin.write_integer_data_to_LSDIndexRaster(basin_number, FlowInfo);
-          BasinIndex = NewBasinIndex;
-          written_inital_basin_index = true;
-        }
-        else
-        {
-          basin_number = valid_cosmo_points[samp];
-          thisBasin.add_basin_to_LSDIndexRaster(BasinIndex, FlowInfo,
-                                                basin_area_map,basin_number);
-        }
-      }
-
       // we need to scale the shielding parameters
       // now do the snow and self shielding
       if (have_snow_raster)
@@ -2933,13 +3322,16 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis(vector<string> Raster_name
       // Now topographic shielding and production scaling
       thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, 
                                          Topographic_shielding,
-                                         path_to_atmospheric_data);
+                                         Production_scaling);
       cout << "Done populating the scaling vectors. " << endl;
 
       // now do the analysis
       vector<double> erate_analysis = thisBasin.full_CRN_erosion_analysis(test_N, 
                                           valid_nuclide_names[samp], test_dN, 
                                           prod_uncert_factor, Muon_scaling);
+      vector<double> MC_analysis = monte_carlo_erosion_analysis(thisBasin,
+                                          valid_cosmo_points[samp], test_N,
+                                          valid_nuclide_names[samp], test_dN);
     
       cout << "Line 2205, doing analysis" << endl;
     
@@ -2957,22 +3349,51 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis(vector<string> Raster_name
       float R = thisBasin.CalculateBasinRange(FlowInfo, filled_raster);
       double relief = double(R);
 
-      MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[samp] ] = relief;
-      MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[samp] ] = param_for_calc[0];
-      MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[samp] ] = param_for_calc[1];
-      MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[samp] ] = param_for_calc[2];
-      MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[samp] ] = param_for_calc[3];
-      MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[samp] ] =  param_for_calc[11];
-      MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[samp] ] = param_for_calc[4];
-      MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[samp] ] = param_for_calc[5];
-      MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[samp] ] = param_for_calc[6];
-      MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[7];
-      MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[samp] ] = param_for_calc[8];
-      MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[samp] ] = param_for_calc[9];
-      MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[10];
+      // add the results in sample order
+      #pragma omp ordered
+      {
+        // write the index basin if flag is set to true
+        if(write_basin_index_raster)
+        {
+          cout << "I'm writing a basin index number for you" << endl;
+      
+          if (not written_inital_basin_index)
+          {
+        
+            basin_number = valid_cosmo_points[samp];
+            basin_pixel_area = thisBasin.get_NumberOfCells();
+            basin_area_map[basin_number] = basin_pixel_area;
+            LSDIndexRaster NewBasinIndex = 
+               thisBasin.write_integer_data_to_LSDIndexRaster(basin_number, FlowInfo);
+            BasinIndex = NewBasinIndex;
+            written_inital_basin_index = true;
+          }
+          else
+          {
+            basin_number = valid_cosmo_points[samp];
+            thisBasin.add_basin_to_LSDIndexRaster(BasinIndex, FlowInfo,
+                                                  basin_area_map,basin_number);
+          }
+        }
+
+        MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[samp] ] = relief;
+        MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[samp] ] = param_for_calc[0];
+        MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[samp] ] = param_for_calc[1];
+        MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[samp] ] = param_for_calc[2];
+        MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[samp] ] = param_for_calc[3];
+        MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[samp] ] =  param_for_calc[11];
+        MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[samp] ] = param_for_calc[4];
+        MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[samp] ] = param_for_calc[5];
+        MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[samp] ] = param_for_calc[6];
+        MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[7];
+        MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[samp] ] = param_for_calc[8];
+        MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[samp] ] = param_for_calc[9];
+        MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[samp] ] = param_for_calc[10];
     
-      // add the erosion rate results to the holding data member
-      erosion_rate_results[ valid_cosmo_points[samp] ] = erate_analysis;
+        // add the erosion rate results to the holding data member
+        erosion_rate_results[ valid_cosmo_points[samp] ] = erate_analysis;
+        monte_carlo_results[ valid_cosmo_points[samp] ] = MC_analysis;
+      }
 
       //cout << "finished adding data" << endl;
 
@@ -3096,8 +3517,17 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
   LSDJunctionNetwork JNetwork(sources, FlowInfo);
   cout << "Got junction network" << endl;
   
-  // Now convert the data into this UTM zone
-  convert_to_UTM(filled_raster);
+  // Now convert this sample into the UTM zone of the raster. Only this
+  // sample is needed, and the coordinates are kept local since spawned
+  // rasters are processed in parallel (see calculate_erosion_rates)
+  int UTM_zone;
+  bool is_North;
+  filled_raster.get_UTM_information(UTM_zone, is_North);
+  LSDCoordinateConverterLLandUTM Converter;
+  double this_UTM_northing, this_UTM_easting;
+  int eId = 22;             // defines the ellipsiod. This is WGS
+  Converter.LLtoUTM_ForceZone(eId, latitude[valid_samp], longitude[valid_samp], 
+                      this_UTM_northing, this_UTM_easting, UTM_zone);
   cout << "Converted to UTM" << endl;
 
 
@@ -3114,8 +3544,8 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
   // snap to points fuction
   vector<float> fUTM_easting;
   vector<float> fUTM_northing;
-  fUTM_easting.push_back( float(UTM_easting[valid_samp]));
-  fUTM_northing.push_back( float(UTM_northing[valid_samp]));
+  fUTM_easting.push_back( float(this_UTM_easting));
+  fUTM_northing.push_back( float(this_UTM_northing));
   cout << "Got point locations" << endl;
   
   // This snaps the junction network to the valid point
@@ -3237,6 +3667,12 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
     double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
     double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
 
+    // get the production scaling of the whole DEM. This comes from the
+    // cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
+
     //========================
     // Erosion rate in BASIN
     //========================
@@ -3288,9 +3724,9 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
       
 
       cout << endl << "Valid point is: " << valid_cosmo_points[samp]
-           << " Sample name: " << sample_name[ valid_cosmo_points[samp] ] << " Easting: " 
-           << UTM_easting[valid_cosmo_points[samp]] << " Northing: "
-           << UTM_northing[valid_cosmo_points[samp]] << endl;
+           << " Sample name: " << sample_name[valid_samp] << " Easting: " 
+           << this_UTM_easting << " Northing: "
+           << this_UTM_northing << endl;
       cout << "Node index is: " <<  snapped_node_indices[samp] << " and junction is: " 
            << snapped_junction_indices[samp] << endl;
       cout << "-  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -" << endl;
@@ -3364,13 +3800,16 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
       cout << "I am now populating the scaling vectors." << endl;
       thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, 
                                          Topographic_shielding,
-                                         path_to_atmospheric_data);
+                                         Production_scaling);
 
       // GET THE EROSION RATES
       cout << "I have finished with the scaling vectors and am now doing the erosion rate analysis." << endl;
       vector<double> erate_analysis = thisBasin.full_CRN_erosion_analysis(test_N, 
                                           valid_nuclide_names[samp], test_dN, 
                                           prod_uncert_factor, Muon_scaling);
+      vector<double> MC_analysis = monte_carlo_erosion_analysis(thisBasin,
+                                          valid_samp, test_N,
+                                          valid_nuclide_names[samp], test_dN);
       cout << "Done with the erosion rate analysis" << endl;
     
       //cout << "Line 1493, doing analysis" << endl;
@@ -3390,22 +3829,27 @@ void LSDCosmoData::full_shielding_cosmogenic_analysis_for_spawned(vector<string>
       float R = thisBasin.CalculateBasinRange(FlowInfo, filled_raster);
       double relief = double(R);
 
-      MapOfProdAndScaling["BasinRelief"][ valid_samp ] = relief;
-      MapOfProdAndScaling["AverageProdScaling"][ valid_samp ] = param_for_calc[0];
-      MapOfProdAndScaling["AverageTopoShielding"][ valid_samp ] = param_for_calc[1];
-      MapOfProdAndScaling["AverageSelfShielding"][ valid_samp ] = param_for_calc[2];
-      MapOfProdAndScaling["AverageSnowShielding"][ valid_samp ] = param_for_calc[3];
-      MapOfProdAndScaling["AverageShielding"][ valid_samp ] =  param_for_calc[11];
-      MapOfProdAndScaling["AverageCombinedScaling"][ valid_samp ] = param_for_calc[4];
-      MapOfProdAndScaling["outlet_lat"][ valid_samp ] = param_for_calc[5];
-      MapOfProdAndScaling["OutletPressure"][ valid_samp ] = param_for_calc[6];
-      MapOfProdAndScaling["OutletEffectivePressure"][ valid_samp ] = param_for_calc[7];
-      MapOfProdAndScaling["centroid_lat"][ valid_samp ] = param_for_calc[8];
-      MapOfProdAndScaling["CentroidPressure"][ valid_samp ] = param_for_calc[9];
-      MapOfProdAndScaling["CentroidEffectivePressure"][ valid_samp ] = param_for_calc[10];
+      // the results are shared by all the spawned rasters
+      #pragma omp critical(CRN_erosion_rate_results)
+      {
+        MapOfProdAndScaling["BasinRelief"][ valid_samp ] = relief;
+        MapOfProdAndScaling["AverageProdScaling"][ valid_samp ] = param_for_calc[0];
+        MapOfProdAndScaling["AverageTopoShielding"][ valid_samp ] = param_for_calc[1];
+        MapOfProdAndScaling["AverageSelfShielding"][ valid_samp ] = param_for_calc[2];
+        MapOfProdAndScaling["AverageSnowShielding"][ valid_samp ] = param_for_calc[3];
+        MapOfProdAndScaling["AverageShielding"][ valid_samp ] =  param_for_calc[11];
+        MapOfProdAndScaling["AverageCombinedScaling"][ valid_samp ] = param_for_calc[4];
+        MapOfProdAndScaling["outlet_lat"][ valid_samp ] = param_for_calc[5];
+        MapOfProdAndScaling["OutletPressure"][ valid_samp ] = param_for_calc[6];
+        MapOfProdAndScaling["OutletEffectivePressure"][ valid_samp ] = param_for_calc[7];
+        MapOfProdAndScaling["centroid_lat"][ valid_samp ] = param_for_calc[8];
+        MapOfProdAndScaling["CentroidPressure"][ valid_samp ] = param_for_calc[9];
+        MapOfProdAndScaling["CentroidEffectivePressure"][ valid_samp ] = param_for_calc[10];
     
-      // add the erosion rate results to the holding data member
-      erosion_rate_results[ valid_samp ] = erate_analysis;
+        // add the erosion rate results to the holding data member
+        erosion_rate_results[ valid_samp ] = erate_analysis;
+        monte_carlo_results[ valid_samp ] = MC_analysis;
+      }
 
       //cout << "Added the result to the " << valid_samp << " sample." << endl;
       //cout << "finished adding data" << endl;
@@ -3597,6 +4041,18 @@ void LSDCosmoData::Soil_sample_calculator(vector<string> Raster_names,
       constant_self_depth = CRN_params[1];
     }
     
+    // now create the CRN parameters object. The atmospheric data is
+    // loaded once for all the points. The points use their own coordinates
+    // rather than those of the pixel, so they do not use the scaling cache.
+    LSDCRNParameters LSDCRNP;
+  
+    // get the atmospheric parameters
+    LSDCRNP.load_parameters_for_atmospheric_scaling(path_to_atmospheric_data);
+    LSDCRNP.set_CRONUS_data_maps();
+  
+    // a function for scaling stone production, defaults to 1
+    double Fsp = 1.0;
+
     // now get the snow depth and topo and self shielding from the point
     // we need to scale the sheilding parameters
     // now do the snow and self sheilding
@@ -3626,16 +4082,7 @@ void LSDCosmoData::Soil_sample_calculator(vector<string> Raster_names,
       }
       
       // now get the scalings
-      // now create the CRN parameters object
-      LSDCRNParameters LSDCRNP;
       double this_elevation, this_pressure;
-  
-      // get the atmospheric parameters
-      LSDCRNP.load_parameters_for_atmospheric_scaling(path_to_atmospheric_data);
-      LSDCRNP.set_CRONUS_data_maps();
-  
-      // a function for scaling stone production, defaults to 1
-      double Fsp = 1.0;
       
       // now the elevation
       this_elevation = double(topo_test.get_data_element(row,col));
@@ -3663,53 +4110,43 @@ void LSDCosmoData::Soil_sample_calculator(vector<string> Raster_names,
   //vector<double> topo_shield_vec;
   //vector<double> production_vec;
   // you then use these to get at the eroion rate. 
+  //
+  // Each sample is independent: the erosion rate iterations only use local
+  // CRN parameter objects, so the samples are solved in parallel. The
+  // screen output and the results are written in the ordered block, so
+  // they appear in sample order regardless of the number of threads.
+  #pragma omp parallel for ordered schedule(dynamic,1)
   for (int i = 0; i<n_valid_points; i++)
   {
-    cout << "Sample: " <<  sample_name[ valid_cosmo_points[i]] << " snow: " << snow_eff_depth_vec[i] << " self: " << self_eff_depth_vec[i] 
-         << endl << "    topo_shield: " << topo_shield_vec[i] << " production: " << production_vec[i] << endl;
-    
     double test_N,test_dN;
     test_N = valid_concentrations[i];
     test_dN =  valid_concentration_uncertainties[i];
     
-    cout << "    Nuclude: " << valid_nuclide_names[i] << " N: " << test_N << " sigma: " << test_dN << endl;
-    
+    // the shielding before any soil information is added, for the screen output
+    double base_snow_eff_depth = snow_eff_depth_vec[i];
+    double base_self_eff_depth = self_eff_depth_vec[i];
     
     // find any additional soil data, if it is there:
     double this_top_eff_depth = -99;
     double this_eff_thickness = -99;
-    if (has_soil_data_index[i] != -1)
+    int this_index = has_soil_data_index[i];
+    bool soil_index_is_valid = (this_index < int(soil_sample_index.size()));
+    if (this_index != -1 && soil_index_is_valid)
     {
-      // check if the vectors reference back to the correct point
-      int this_index = has_soil_data_index[i];
-      cout << "This index is: " << this_index;
-      
-      if (this_index >= int(soil_sample_index.size()))
-      {
-        cout << "WARNING: your soil sample index is: " << this_index 
-             << " which is bigger than the soil vectors." << endl;
-      }
-      else
-      {
-        this_top_eff_depth = soil_top_effective_depth[this_index];
-        this_eff_thickness = soil_effective_thickness[this_index];
-        cout << "The top eff depth of the soil sample is: " << this_top_eff_depth << endl;
-        cout << "The effective thickness is: " << this_eff_thickness << endl;
-      }
+      this_top_eff_depth = soil_top_effective_depth[this_index];
+      this_eff_thickness = soil_effective_thickness[this_index];
     }
     
     // if there is a surface thickness, add it to the "snow" shielding
     if(this_top_eff_depth>0)
     {
       snow_eff_depth_vec[i] = snow_eff_depth_vec[i]+this_top_eff_depth;
-      cout << "The updated snow is: "  << snow_eff_depth_vec[i] << endl;
     }
     
     // if there is a sample thickness, add it to the "self" shielding
     if(this_eff_thickness>0)
     {
       self_eff_depth_vec[i] = self_eff_depth_vec[i]+this_eff_thickness;
-      cout << "The updated self is: "  << self_eff_depth_vec[i] << endl;
     }
          
     vector<double> erate_analysis = full_CRN_erosion_analysis_point(test_N, 
@@ -3738,23 +4175,54 @@ void LSDCosmoData::Soil_sample_calculator(vector<string> Raster_names,
     double this_shielding = topo_shield_vec[i]*this_self_shield*this_snow_shield;
     double this_comb_scaling = this_shielding*production_vec[i];
 
-    MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[i] ] = 0.0;
-    MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[i] ] = production_vec[i];
-    MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[i] ] = topo_shield_vec[i];
-    MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[i] ] = this_self_shield;
-    MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[i] ] = this_snow_shield;
-    MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[i] ] =  this_shielding;
-    MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[i] ] = this_comb_scaling;
-    MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[i] ] = latitude[i];
-    MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
-    MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
-    MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[i] ] = latitude[i];
-    MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
-    MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
+    // report and store the results in sample order
+    #pragma omp ordered
+    {
+      cout << "Sample: " <<  sample_name[ valid_cosmo_points[i]] << " snow: " << base_snow_eff_depth
+           << " self: " << base_self_eff_depth 
+           << endl << "    topo_shield: " << topo_shield_vec[i] << " production: " << production_vec[i] << endl;
+      cout << "    Nuclude: " << valid_nuclide_names[i] << " N: " << test_N << " sigma: " << test_dN << endl;
+      if (this_index != -1)
+      {
+        cout << "This index is: " << this_index;
+        if (not soil_index_is_valid)
+        {
+          cout << "WARNING: your soil sample index is: " << this_index 
+               << " which is bigger than the soil vectors." << endl;
+        }
+        else
+        {
+          cout << "The top eff depth of the soil sample is: " << this_top_eff_depth << endl;
+          cout << "The effective thickness is: " << this_eff_thickness << endl;
+        }
+      }
+      if(this_top_eff_depth>0)
+      {
+        cout << "The updated snow is: "  << snow_eff_depth_vec[i] << endl;
+      }
+      if(this_eff_thickness>0)
+      {
+        cout << "The updated self is: "  << self_eff_depth_vec[i] << endl;
+      }
+      cout << "The erosion rate is: " << erate_analysis[0] << endl;
+
+      MapOfProdAndScaling["BasinRelief"][ valid_cosmo_points[i] ] = 0.0;
+      MapOfProdAndScaling["AverageProdScaling"][ valid_cosmo_points[i] ] = production_vec[i];
+      MapOfProdAndScaling["AverageTopoShielding"][ valid_cosmo_points[i] ] = topo_shield_vec[i];
+      MapOfProdAndScaling["AverageSelfShielding"][ valid_cosmo_points[i] ] = this_self_shield;
+      MapOfProdAndScaling["AverageSnowShielding"][ valid_cosmo_points[i] ] = this_snow_shield;
+      MapOfProdAndScaling["AverageShielding"][ valid_cosmo_points[i] ] =  this_shielding;
+      MapOfProdAndScaling["AverageCombinedScaling"][ valid_cosmo_points[i] ] = this_comb_scaling;
+      MapOfProdAndScaling["outlet_lat"][ valid_cosmo_points[i] ] = latitude[i];
+      MapOfProdAndScaling["OutletPressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
+      MapOfProdAndScaling["OutletEffectivePressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
+      MapOfProdAndScaling["centroid_lat"][ valid_cosmo_points[i] ] = latitude[i];
+      MapOfProdAndScaling["CentroidPressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
+      MapOfProdAndScaling["CentroidEffectivePressure"][ valid_cosmo_points[i] ] = pressure_vec[i];
     
-    // add the erosion rate results to the holding data member
-    erosion_rate_results[ valid_cosmo_points[i] ] = erate_analysis;
-
+      // add the erosion rate results to the holding data member
+      erosion_rate_results[ valid_cosmo_points[i] ] = erate_analysis;
+    }
   }
 
 
@@ -3812,14 +4280,12 @@ vector<double> LSDCosmoData::full_CRN_erosion_analysis_point(double Nuclide_conc
   bool is_production_uncertainty_minus_on = false;
   
   // first get the prediction of the erosion rate
-  cout << "LINE 2993 I'm predicting the erosion rate of this sample" << endl;
   erate = predict_CRN_erosion_point(Nuclide_conc, Nuclide, prod_uncert_factor, 
                               Muon_scaling, production_uncertainty,
                               average_production_rate,
                               is_production_uncertainty_plus_on,
                               is_production_uncertainty_minus_on, snow_eff_depth,
                               self_eff_depth, topo_shield,production);
-  cout << "The erosion rate is: " << erate << endl;
   
   double no_prod_uncert = 1.0;    // set the scheme to no production uncertainty
                                   // for the external uncertainty
@@ -4549,6 +5015,12 @@ void LSDCosmoData::full_shielding_raster_printer(vector<string> Raster_names,
     double test_N10, test_dN10;   // concetration and uncertainty of 10Be in basin
     double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
 
+    // get the production scaling of the whole DEM. This comes from the
+    // cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
+
     //========================
     // LOOPING THROUGH BASINS
     //========================
@@ -4628,7 +5100,7 @@ void LSDCosmoData::full_shielding_raster_printer(vector<string> Raster_names,
       cout << "Populating shielding vectors" << endl;
       thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, 
                                          Topographic_shielding,
-                                         path_to_atmospheric_data);
+                                         Production_scaling);
 
       // get the prefix of the basin vectors
       string basin_ID =  itoa(valid_cosmo_points[samp]);
@@ -4684,6 +5156,20 @@ void LSDCosmoData::calculate_erosion_rates(int method_flag)
   vector<string> this_Raster_names;
   vector<double> this_Param_names;
   
+  // Spawned rasters hold a single sample each, so each raster is a task.
+  // The samples are independent and the results are stored by sample index,
+  // so they do not depend on the order in which the rasters finish.
+  if (method_flag == 2)
+  {
+    #pragma omp parallel for schedule(dynamic,1)
+    for (int iDEM = 0; iDEM< n_DEMS; iDEM++)
+    {
+      full_shielding_cosmogenic_analysis_for_spawned(DEM_names_vecvec[iDEM],
+                                     snow_self_topo_shielding_params[iDEM]);
+    }
+    return;
+  }
+  
   // now loop through the DEMs
   for (int iDEM = 0; iDEM< n_DEMS; iDEM++)
   {
@@ -4698,10 +5184,6 @@ void LSDCosmoData::calculate_erosion_rates(int method_flag)
     {
       full_shielding_cosmogenic_analysis(this_Raster_names,this_Param_names);
     }
-    else if (method_flag == 2)
-    {
-      full_shielding_cosmogenic_analysis_for_spawned(this_Raster_names,this_Param_names);
-    }
     else if (method_flag == 3)
     {
       cout << "You are doing soil samples on DEM: " <<  this_Raster_names[0] << endl;
@@ -5109,6 +5591,12 @@ void LSDCosmoData::full_shielding_CRN_concentration_predictor(vector<string> Ras
     double test_N26, test_dN26;   // concetration and uncertainty of 26Al in basin
     double test_N, test_dN;       // concentration and uncertainty of the nuclide in basin  
 
+    // get the production scaling of the whole DEM. This comes from the
+    // cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
+
     //========================
     // LOOPING THROUGH BASINS
     //========================
@@ -5228,7 +5716,7 @@ void LSDCosmoData::full_shielding_CRN_concentration_predictor(vector<string> Ras
       // Now topographic shielding and production scaling
       thisBasin.populate_scaling_vectors(FlowInfo, filled_raster, 
                                          Topographic_shielding,
-                                         path_to_atmospheric_data);
+                                         Production_scaling);
       cout << "The scaling vectors are populated. I am moving on to the analysis" << endl;
 
       // now do the analysis
@@ -5351,6 +5839,29 @@ void LSDCosmoData::print_rasters()
   }
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This runs the Monte Carlo uncertainty analysis of a basin. Each sample
+// has its own random stream, numbered by the sample index.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<double> LSDCosmoData::monte_carlo_erosion_analysis(LSDCosmoBasin& thisBasin,
+                            int sample_index, double Nuclide_conc, string Nuclide,
+                            double Nuclide_conc_err)
+{
+  vector<double> MC_analysis;
+  if (monte_carlo_draws > 0)
+  {
+    RandomStream sample_rng(get_random_master_seed(), "crn_monte_carlo", long(sample_index));
+    MC_analysis = thisBasin.MonteCarlo_CRN_erosion_analysis(Nuclide_conc,
+                                 Nuclide, Nuclide_conc_err, prod_uncert_factor,
+                                 Muon_scaling, monte_carlo_draws,
+                                 monte_carlo_shielding_uncertainty,
+                                 monte_carlo_attenuation_uncertainty, sample_rng);
+  }
+  return MC_analysis;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This prints all valid results to a csv file
 //
@@ -5517,6 +6028,44 @@ void LSDCosmoData::print_results()
   }
   results_out.close();
   CRONUS_out.close();
+
+  // the Monte Carlo results
+  if (monte_carlo_draws > 0)
+  {
+    string MC_results_fname = path+param_name+"_CRNMonteCarlo.csv";
+    ofstream MC_out;
+    MC_out.open(MC_results_fname.c_str());
+    MC_out.precision(8);
+    MC_out << "basin_ID,sample_name,nuclide,n_draws,n_valid_draws,"
+           << "erate_mean_g_percm2_peryr,erate_stdev_g_percm2_peryr,"
+           << "erate_p2.5_g_percm2_peryr,erate_p16_g_percm2_peryr,"
+           << "erate_p50_g_percm2_peryr,erate_p84_g_percm2_peryr,"
+           << "erate_p97.5_g_percm2_peryr,erate_p50_mmperkyr_rho2650" << endl;
+    for (int i = 0; i<N_samples; i++)
+    {
+      if (int(monte_carlo_results[i].size()) > 0)
+      {
+        vector<double> MC_analysis = monte_carlo_results[i];
+        MC_out << i << "," << sample_name[i] << "," << nuclide[i] << ","
+               << monte_carlo_draws << "," << int(MC_analysis[0]);
+        for (int j = 1; j<8; j++)
+        {
+          MC_out << "," << MC_analysis[j];
+        }
+        // if no draw converged the statistics are all the basin's
+        // NoDataValue, which is written as it is
+        if (int(MC_analysis[0]) > 0)
+        {
+          MC_out << "," << MC_analysis[5]*1e7/rho << endl;
+        }
+        else
+        {
+          MC_out << "," << MC_analysis[5] << endl;
+        }
+      }
+    }
+    MC_out.close();
+  }
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -5603,22 +6152,13 @@ void LSDCosmoData::print_scaling_and_shielding_complete_rasters()
       Topographic_shielding = T_shield;
     }
 
-    // now create the CRN parameters object
-    LSDCRNParameters LSDCRNP;
     double gamma_spallation = 160;      // in g/cm^2: spallation attentuation depth
 
-    // get the atmospheric parameters
-    LSDCRNP.load_parameters_for_atmospheric_scaling(path_to_atmospheric_data);
-    LSDCRNP.set_CRONUS_data_maps();
-  
-    // a function for scaling stone production, defaults to 1
-    double Fsp = 1.0;
-  
-    // the latitude and longitude
-    double lat,longitude;
-  
-    // decalre converter object
-    LSDCoordinateConverterLLandUTM Converter;
+    // get the production scaling and pressure of the whole DEM. This comes 
+    // from the cache next to the DEM if the DEM has not changed
+    Array2D<double> Production_scaling;
+    Array2D<double> Pressure;
+    get_production_scaling_cache(filled_raster, DEM_fname, Production_scaling, Pressure);
     
     // Get some temporary variables for holding the data. These will get printed
     // to and array.
@@ -5644,15 +6184,9 @@ void LSDCosmoData::print_scaling_and_shielding_complete_rasters()
         // Only do something if there is data
         if(this_elevation != NoDataValue)
         {
-          // To get pressure, first get the lat and long
-          filled_raster.get_lat_and_long_locations(row, col, lat, longitude, Converter);
-
-          // now the pressure
-          this_pressure = LSDCRNP.NCEPatm_2(double(lat), double(longitude), 
-                                        double(this_elevation));
-
-          // now get the scaling
-          this_scaling = LSDCRNP.stone2000sp(lat,this_pressure, Fsp);
+          // the pressure and scaling
+          this_pressure = float(Pressure[row][col]);
+          this_scaling = float(Production_scaling[row][col]);
         
           // update the scaling array
           NewScaling[row][col] = this_scaling;
@@ -59,6 +59,9 @@ using namespace std;
 #ifndef LSDCosmoData_HPP
 #define LSDCosmoData_HPP
 
+// the basins are only passed by reference here
+class LSDCosmoBasin;
+
 class LSDCosmoData
 {
   public:
@@ -220,6 +223,41 @@ class LSDCosmoData
     LSDRaster calculate_production_raster(LSDRaster& Elevation_Data,
                                           string path_to_atmospheric_data);
 
+    /// @brief This calculates the production scaling and the atmospheric
+    ///  pressure of every pixel in a DEM.
+    /// @detail The scaling is Stone (2000) with Fsp = 1, as in
+    ///  LSDCosmoBasin::populate_scaling_vectors. Rows are calculated in parallel.
+    /// @param Elevation_Data a raster holding the elevations
+    /// @param Production_scaling replaced with the production scaling
+    /// @param Pressure replaced with the atmospheric pressure in mbar
+    void calculate_production_scaling_and_pressure(LSDRaster& Elevation_Data,
+                                   Array2D<double>& Production_scaling,
+                                   Array2D<double>& Pressure);
+
+    /// @brief This returns a hash of everything the production scaling of
+    ///  a DEM depends on: the version of the cache format and scaling code,
+    ///  the elevations, the georeferencing and the NCEP atmospheric data.
+    /// @param Elevation_Data a raster holding the elevations
+    /// @return the hash as a hexadecimal string
+    string get_production_scaling_hash(LSDRaster& Elevation_Data);
+
+    /// @brief This gets the production scaling and atmospheric pressure of
+    ///  every pixel in a DEM, using a cache on disk.
+    /// @detail The cache is DEM_fname+"_CRNScaling.bil", a two band double
+    ///  precision ENVI file (band 1 the production scaling, band 2 the pressure).
+    ///  Its header holds the hash from get_production_scaling_hash. If the cache
+    ///  is missing or the hash does not match, the arrays are recalculated
+    ///  and the cache is rewritten. The new files are written under temporary
+    ///  names and renamed into place, so a partial write is never read.
+    ///  If use_scaling_cache is false nothing is read or written.
+    /// @param Elevation_Data a raster holding the elevations
+    /// @param DEM_fname the name of the DEM, without extension
+    /// @param Production_scaling replaced with the production scaling
+    /// @param Pressure replaced with the atmospheric pressure in mbar
+    void get_production_scaling_cache(LSDRaster& Elevation_Data, string DEM_fname,
+                                   Array2D<double>& Production_scaling,
+                                   Array2D<double>& Pressure);
+
     /// @brief this function calculates the UTM coordinates of all the sample
     ///  points for a given UTM zone. 
     /// @param UTM_zone the UTM zone
@@ -339,6 +377,22 @@ class LSDCosmoData
                             double self_eff_depth, double topo_shield,
                             double production);
 
+    /// @brief Runs the Monte Carlo uncertainty analysis of a basin if
+    ///  monte_carlo_draws is positive. The random stream of the sample is
+    ///  numbered by the sample index so the results are reproducible for a
+    ///  given random_seed, whatever the number of threads. A random_seed of
+    ///  0 takes the master seed from the clock.
+    /// @param thisBasin The basin, with its scaling vectors populated
+    /// @param sample_index The index of the sample
+    /// @param Nuclide_conc Concetration of the nuclide
+    /// @param Nuclide Be10 or Al26
+    /// @param Nuclide_conc_err The instrument error in the nuclide concentration
+    /// @return The results of LSDCosmoBasin::MonteCarlo_CRN_erosion_analysis,
+    ///  or an empty vector if there are no draws
+    vector<double> monte_carlo_erosion_analysis(LSDCosmoBasin& thisBasin,
+                            int sample_index, double Nuclide_conc, string Nuclide,
+                            double Nuclide_conc_err);
+
     /// @brief this uses Newton Raphson iteration to retrieve the erosion rate
     ///  from a basin given a nuclide concentration
     /// @param eff_erosion rate The erosion rate in g/cm^2/yr
@@ -577,6 +631,11 @@ class LSDCosmoData
     ///  ErosionRate_COSMOCALC_cmperkyr (assumes 2650 kg/m^2): The erosion
     ///   rate you would get if you took production weighted scaling and used
     ///   cosmocalc. 
+    ///  If monte_carlo_draws is positive the Monte Carlo erosion rates
+    ///  are written to a second file, ending in _CRNMonteCarlo.csv, with the
+    ///  number of valid draws and the mean, standard deviation and
+    ///  percentiles of the erosion rate. If no draw converged these are
+    ///  all the NoDataValue of the basin.
     /// @author SMM
     /// @date 12/03/2015
     void print_results();
@@ -678,6 +737,9 @@ class LSDCosmoData
     
     /// a vector of vectors holding the results of the cosmogenic analysis
     vector< vector<double> > erosion_rate_results;
+
+    /// a vector of vectors holding the Monte Carlo results of each sample
+    vector< vector<double> > monte_carlo_results;
     
     /// a standardisation map for Be10
     map<string,double> standards_Be10;
@@ -740,6 +802,24 @@ class LSDCosmoData
     /// Write the shielding and scaling rasters
     bool write_full_scaling_rasters;
     
+    /// Keep the production scaling and pressure of each DEM in a cache
+    /// next to the DEM (see get_production_scaling_cache)
+    bool use_scaling_cache;
+
+    //-----------------Monte Carlo uncertainty---------------
+    /// The number of Monte Carlo draws for each sample. 0 turns it off.
+    /// The nested analysis does not run the draws
+    int monte_carlo_draws;
+
+    /// The relative (1 sigma) uncertainty of the shielding
+    double monte_carlo_shielding_uncertainty;
+
+    /// The relative (1 sigma) uncertainty of the spallation attenuation length
+    double monte_carlo_attenuation_uncertainty;
+
+    /// The master seed of the random streams. 0 takes it from the clock
+    long random_seed;
+    
     //-----------------Information used in cosmogenic calculators---------------
     /// This contains data with all sorts of scaling parameters
     /// for calculation of erosion rates using other calculators
@@ -2533,6 +2533,100 @@ vector<int> LSDFlowInfo::get_upslope_nodes(int node_number_outlet)
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This labels the basins draining to a list of outlet nodes with a single
+// pass through the S vector. The S vector is ordered so that receivers always
+// come before their donors, so each node can simply take its label from its
+// receiver unless it is an outlet itself.
+//
+// nesting_rule
+//  0: the outlet latest in the list wins
+//  1: the smallest (innermost) basin wins
+//  2: the largest (outermost) basin wins
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+LSDIndexRaster LSDFlowInfo::label_basins_from_outlet_nodes(vector<int>& outlet_nodes,
+                                   vector<int>& basin_labels, int nesting_rule)
+{
+  int n_outlets = int(outlet_nodes.size());
+  if (n_outlets != int(basin_labels.size()))
+  {
+    cout << "LSDFlowInfo::label_basins_from_outlet_nodes, the outlet and label" << endl
+         << "vectors are not the same size!" << endl;
+    exit(EXIT_FAILURE);
+  }
+  if (nesting_rule < 0 || nesting_rule > 2)
+  {
+    cout << "LSDFlowInfo::label_basins_from_outlet_nodes, nesting rule must be 0, 1 or 2" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // seed the outlets. The seed is the index into the outlet vector so
+  // that for rule 0 the later outlet has the higher seed
+  vector<int> seed(NDataNodes,-1);
+  for (int i = 0; i < n_outlets; i++)
+  {
+    int this_node = outlet_nodes[i];
+    if(this_node < 0 || this_node > NDataNodes-1)
+    {
+      cout << "LSDFlowInfo::label_basins_from_outlet_nodes, the node index "
+           << this_node << " does not exist" << endl;
+      exit(EXIT_FAILURE);
+    }
+    if (seed[this_node] == -1 || nesting_rule == 0)
+    {
+      seed[this_node] = i;
+    }
+  }
+
+  // now sweep each base level tree. These occupy contiguous, non-overlapping
+  // parts of the S vector so they can be done in parallel
+  vector<int> owner(NDataNodes,-1);
+  int n_base_level = int(BaseLevelNodeList.size());
+  #pragma omp parallel for schedule(dynamic)
+  for (int bl = 0; bl < n_base_level; bl++)
+  {
+    int bl_node = BaseLevelNodeList[bl];
+    int start_SVector_node = SVectorIndex[bl_node];
+    int end_SVector_node = start_SVector_node+NContributingNodes[bl_node];
+    for (int s = start_SVector_node; s < end_SVector_node; s++)
+    {
+      int this_node = SVector[s];
+      int receiver_node = ReceiverVector[this_node];
+      int inherited = (receiver_node == this_node) ? -1 : owner[receiver_node];
+      int own = seed[this_node];
+
+      int this_owner;
+      if (nesting_rule == 0)
+      {
+        this_owner = (own > inherited) ? own : inherited;
+      }
+      else if (nesting_rule == 1)
+      {
+        this_owner = (own != -1) ? own : inherited;
+      }
+      else
+      {
+        this_owner = (inherited != -1) ? inherited : own;
+      }
+      owner[this_node] = this_owner;
+    }
+  }
+
+  // write the labels to the raster
+  Array2D<int> Basin(NRows,NCols,NoDataValue);
+  for (int node = 0; node < NDataNodes; node++)
+  {
+    if (owner[node] != -1)
+    {
+      Basin[ RowIndex[node] ][ ColIndex[node] ] = basin_labels[ owner[node] ];
+    }
+  }
+
+  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, Basin,GeoReferencingStrings);
+  return IR;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // This function takes a list of source nodes and creates a raster where
@@ -2712,12 +2806,10 @@ int LSDFlowInfo::is_node_upstream(int current_node, int test_node)
 
   int SVector_test_node = SVectorIndex[test_node];
 
-  for(int node = start_SVector_node; node < end_SVector_node; node++)
+  // the upslope nodes are contiguous in the S vector so this is just a range check
+  if (SVector_test_node >= start_SVector_node && SVector_test_node < end_SVector_node)
   {
-    if (node == SVector_test_node)
-    {
-      i = 1;
-    }
+    i = 1;
   }
 
   return i;
@@ -561,6 +561,25 @@ class LSDFlowInfo
   /// @date 01/016/12
   vector<int> get_upslope_nodes(int node_number_outlet);
 
+  ///@brief This function labels the basins upslope of a list of outlet nodes
+  /// in a single sweep through the S vector.
+  ///@details Each outlet seeds its own node and labels are then propagated
+  /// from receivers to donors, so the cost is linear in the number of nodes
+  /// regardless of how many outlets there are. Base level trees occupy
+  /// disjoint parts of the S vector so they are swept in parallel.
+  /// Where basins are nested the nesting_rule determines which label a
+  /// node gets: \n
+  /// 0 == the outlet latest in the list wins (same as overwriting basins in order) \n
+  /// 1 == the smallest (innermost) basin wins \n
+  /// 2 == the largest (outermost) basin wins
+  ///@param outlet_nodes The node indices of the basin outlets.
+  ///@param basin_labels The value written to the raster for each outlet.
+  /// Must be the same length as outlet_nodes.
+  ///@param nesting_rule See details.
+  ///@return LSDIndexRaster of labelled basins, NoData outside of all basins.
+  LSDIndexRaster label_basins_from_outlet_nodes(vector<int>& outlet_nodes,
+                                   vector<int>& basin_labels, int nesting_rule);
+
   /// @brief This function takes a list of sources and then creates a raster
   ///  with nodata values where points are not upslope of the sources
   ///  and 1.0 if they are upslope
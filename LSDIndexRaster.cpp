@@ -2120,7 +2120,7 @@ LSDIndexRaster LSDIndexRaster::find_holes_with_nodata_bots(int NSteps, int NSwee
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDIndexRaster::release_random_bot(Array2D<int>& Visited, int startrow,int startcol, int NSteps)
 {
-  long seed = time(NULL);
+  RandomStream rng = get_serial_random_stream();
 
   float direction;
   float pos_or_neg;
@@ -2139,8 +2139,8 @@ void LSDIndexRaster::release_random_bot(Array2D<int>& Visited, int startrow,int
       //cout << "Curr row: " << curr_row << " and col: " << curr_col << endl;
       Visited[curr_row][curr_col]++;
 
-      direction  = ran3(&seed);
-      pos_or_neg = ran3(&seed);
+      direction  = rng.uniform();
+      pos_or_neg = rng.uniform();
 
       if (direction < 0.5)
       {
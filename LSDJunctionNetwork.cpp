@@ -2488,11 +2488,12 @@ vector<int> LSDJunctionNetwork::extract_basins_order_outlet_nodes(vector<int>& B
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
 LSDIndexRaster LSDJunctionNetwork::ExtractBasinsOrder(int BasinOrder, LSDFlowInfo& FlowInfo)
 {
-  // Declare drainage basins array
-  Array2D<int> basins(NRows,NCols,NoDataValue);
-  // Loop through junction network until you reach nth order channel junction.
+  // Loop through junction network collecting the outlets of the nth order basins.
+  // The labelling itself is done in a single sweep by the FlowInfo object
+  vector<int> outlet_nodes;
+  vector<int> basin_IDs;
   int BasinID = 0;
-  int row,col,node,current_junc,receiver_junc,receiver_junc_SO,n_nodes_in_channel,basin_outlet;
+  int current_junc,receiver_junc,receiver_junc_SO,basin_outlet;
   for (int junctionID=0; junctionID<NJunctions; ++junctionID)
   {
     // Loop through all stream junctions of the required basin order.
@@ -2513,24 +2514,11 @@ LSDIndexRaster LSDJunctionNetwork::ExtractBasinsOrder(int BasinOrder, LSDFlowInf
 
         if(IsTruncated == false)
         {
-          // First, get channel pixels draining from the current junction.
-          LSDIndexChannel StreamLinkVector = LSDIndexChannel(current_junc, JunctionVector[current_junc],
-                                                             receiver_junc, JunctionVector[receiver_junc], FlowInfo);
           // Find final nth order channel pixel, which is the penultimate pixel
           // in channel.
-          n_nodes_in_channel = StreamLinkVector.get_n_nodes_in_channel();
-          // ======================
-          // gets crazy again here.
-          basin_outlet = StreamLinkVector.get_node_in_channel(n_nodes_in_channel-2);
-          // Get all contributing pixels and label with BasinID
-          vector<int> BasinNodeVector = FlowInfo.get_upslope_nodes(basin_outlet);
-          // Loop through basin to label basin pixels with basin ID
-          for (int BasinIndex = 0; BasinIndex < int(BasinNodeVector.size()); ++BasinIndex)
-          {
-            node = BasinNodeVector[BasinIndex];
-            FlowInfo.retrieve_current_row_and_col(node,row,col);
-            basins[row][col] = BasinID;
-          }
+          basin_outlet = get_penultimate_node_from_stream_link(current_junc, FlowInfo);
+          outlet_nodes.push_back(basin_outlet);
+          basin_IDs.push_back(BasinID);
           // Increment BasinID to ensure that each basin is distinct.
           ++BasinID;
         }
@@ -2538,7 +2526,7 @@ LSDIndexRaster LSDJunctionNetwork::ExtractBasinsOrder(int BasinOrder, LSDFlowInf
     }
   }
   // Return raster with all nth order drainage basins.
-  LSDIndexRaster basin_raster(NRows,NCols,XMinimum,YMinimum,DataResolution,NoDataValue,basins,GeoReferencingStrings);
+  LSDIndexRaster basin_raster = FlowInfo.label_basins_from_outlet_nodes(outlet_nodes, basin_IDs, 0);
   return basin_raster;
 }
 
@@ -2850,6 +2838,75 @@ LSDIndexRaster LSDJunctionNetwork::GetChannelfromDreich(int NodeNumber,
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// This gets the nodes of the channel that the DrEICH algorithm fits for a
+// given source node: from the farthest upslope hilltop down to the nth junction
+// downstream. It is the same channel as GetChannelfromDreich but doesn't need
+// a full raster for each channel.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+vector<int> LSDJunctionNetwork::get_nodes_of_Dreich_channel(int NodeNumber, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
+                                      LSDRaster& ElevationRaster, int NJunctions)
+{
+  float downslope_chi = 0;
+
+  //get the junction at the source node
+  int Junction = get_Junction_of_Node(NodeNumber, FlowInfo);
+  // get the hilltop node from this junction
+  int hilltop_node = FlowInfo.find_farthest_upslope_node(NodeNumber, FlowDistance);
+
+  // get the nth junction downstream
+  for (int i = 0; i < NJunctions; i++)
+  {
+    Junction = get_Receiver_of_Junction(Junction);
+  }
+  int final_node = get_Node_of_Junction(Junction);
+
+  LSDChannel new_channel(hilltop_node, final_node, downslope_chi, m_over_n, A_0, FlowInfo,  ElevationRaster);
+  return new_channel.get_NodeSequence();
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// This takes a list of nodes and removes any that have another node in the list
+// upstream of them, so you are left with the farthest upstream nodes. The order
+// of the list is preserved. Each node is tested independently so this is
+// done in parallel.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+vector<int> LSDJunctionNetwork::keep_farthest_upstream_nodes(vector<int>& nodes, LSDFlowInfo& FlowInfo)
+{
+  int n_nodes = int(nodes.size());
+  vector<int> keep(n_nodes,1);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int node = 0; node < n_nodes; node++)
+  {
+    int current_node = nodes[node];
+    for (int i = 0; i < n_nodes; i++)
+    {
+      if (nodes[i] != current_node)
+      {
+        if (FlowInfo.is_node_upstream(current_node, nodes[i]) == 1)
+        {
+          keep[node] = 0;
+          break;
+        }
+      }
+    }
+  }
+
+  vector<int> upstream_nodes;
+  for (int node = 0; node < n_nodes; node++)
+  {
+    if (keep[node] == 1)
+    {
+      upstream_nodes.push_back(nodes[node]);
+    }
+  }
+  return upstream_nodes;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+
 
 // =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 // This function returns all potential channel heads in a DEM. It looks for
@@ -2936,53 +2993,23 @@ vector<int> LSDJunctionNetwork::GetChannelHeadsChiMethodFromValleys(vector<int>
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
                                       LSDRaster& ElevationRaster)
 {
-  vector<int> ChannelHeadNodes;
-  vector<int> ChannelHeadNodes_temp;
-
   int max_nodes = ValleyNodes.size();
-  int node_number = 0;
+  cout << "Fitting channel heads for " << max_nodes << " valley nodes" << endl;
 
-  //loop through junctions collecting channel heads
+  // Each valley is fitted independently so they are farmed out to threads.
+  // Every valley has its own slot so the result does not depend on the
+  // number of threads
+  vector<int> ChannelHeadNodes_temp(max_nodes,NoDataValue);
+  #pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < max_nodes; i++)
   {
-    cout << flush << "Node = " << i+1 << " of " << max_nodes << "\r";
-
-    // get the junction number
-    node_number = ValleyNodes[i];
-
-    // get a local list of channel heads
-	  int channel_head_node = GetChannelHeadsChiMethodFromNode(node_number,
-                                      			MinSegLength, A_0, m_over_n, FlowInfo,
-                                       			FlowDistance, ElevationRaster);
-
-     // now append these channel heads to the master list
-    ChannelHeadNodes_temp.push_back(channel_head_node);
+    ChannelHeadNodes_temp[i] = GetChannelHeadsChiMethodFromNode(ValleyNodes[i],
+                                      MinSegLength, A_0, m_over_n, FlowInfo,
+                                      FlowDistance, ElevationRaster);
   }
 
   //removing any nodes that are not the furthest upstream
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
-
-  for (int node = 0; node < int(ChannelHeadNodes_temp.size()); node++)
-  {
-    vector<int> tests;
-    int current_node = ChannelHeadNodes_temp[node];
-    for (int i = 0; i < int(ChannelHeadNodes_temp.size()); i++)
-    {
-      if (ChannelHeadNodes_temp[i] != current_node)
-      {
-        int test_node = ChannelHeadNodes_temp[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
-      }
-    }
-    find_it = find(tests.begin(), tests.end(), 1);
-    if (find_it == tests.end())
-    {
-      ChannelHeadNodes.push_back(current_node);
-    }
-
-  }
+  vector<int> ChannelHeadNodes = keep_farthest_upstream_nodes(ChannelHeadNodes_temp, FlowInfo);
 
   cout << "No of source nodes: " << ChannelHeadNodes.size() << endl;
 
@@ -3005,53 +3032,23 @@ vector<int> LSDJunctionNetwork::GetChannelHeadsChiMethodFromSources(vector<int>
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
                                       LSDRaster& ElevationRaster, int NJunctions)
 {
-  vector<int> ChannelHeadNodes;
-  vector<int> ChannelHeadNodes_temp;
-
   int max_nodes = ValleySources.size();
-  int node_number = 0;
+  cout << "Fitting channel heads for " << max_nodes << " valley sources" << endl;
 
-  //loop through junctions collecting channel heads
+  // Each source is fitted independently so they are farmed out to threads.
+  // Every source has its own slot so the result does not depend on the
+  // number of threads
+  vector<int> ChannelHeadNodes_temp(max_nodes,NoDataValue);
+  #pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < max_nodes; i++)
   {
-    cout << flush << "Node = " << i+1 << " of " << max_nodes << "\r";
-
-    // get the junction number
-    node_number = ValleySources[i];
-
-    // get a local list of channel heads
-    int channel_head_node = GetChannelHeadsChiMethodFromSourceNode(node_number,
+    ChannelHeadNodes_temp[i] = GetChannelHeadsChiMethodFromSourceNode(ValleySources[i],
                                       MinSegLength, A_0, m_over_n, FlowInfo,
                                       FlowDistance, ElevationRaster, NJunctions);
-
-     // now append these channel heads to the master list
-    ChannelHeadNodes_temp.push_back(channel_head_node);
   }
 
   //removing any nodes that are not the furthest upstream
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
-
-  for (int node = 0; node < int(ChannelHeadNodes_temp.size()); node++)
-  {
-    vector<int> tests;
-    int current_node = ChannelHeadNodes_temp[node];
-    for (int i = 0; i < int(ChannelHeadNodes_temp.size()); i++)
-    {
-      if (ChannelHeadNodes_temp[i] != current_node)
-      {
-        int test_node = ChannelHeadNodes_temp[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
-      }
-    }
-    find_it = find(tests.begin(), tests.end(), 1);
-    if (find_it == tests.end())
-    {
-      ChannelHeadNodes.push_back(current_node);
-    }
-
-  }
+  vector<int> ChannelHeadNodes = keep_farthest_upstream_nodes(ChannelHeadNodes_temp, FlowInfo);
 
   cout << "No of source nodes: " << ChannelHeadNodes.size() << endl;
 
@@ -3067,38 +3064,34 @@ vector<int> LSDJunctionNetwork::GetChannelHeadsChiMethodFromSources(vector<int>
 // FC 21/08/15
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 LSDIndexRaster LSDJunctionNetwork::GetChannelsDreich(vector<int> ValleySources,
-                                      int MinSegLength, float A_0, float m_over_n,
+                                      float A_0, float m_over_n,
                                       LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
-                                      LSDRaster& ElevationRaster, string path_name, int NJunctions)
+                                      LSDRaster& ElevationRaster, int NJunctions)
 {
   Array2D<int> channel_nodes(NRows,NCols,NoDataValue);
 
   int max_nodes = ValleySources.size();
-  int node_number = 0;
+  cout << "Getting DrEICH channels for " << max_nodes << " valley sources" << endl;
 
-  //loop through junctions collecting channels
+  // get the nodes of each channel in parallel. Each source keeps its own
+  // node list so that they can be merged in order afterwards
+  vector< vector<int> > nodes_of_channels(max_nodes);
+  #pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < max_nodes; i++)
   {
-    cout << flush << "Node = " << i+1 << " of " << max_nodes << "\r";
-
-    // get the junction number
-    node_number = ValleySources[i];
-
-    // get an index raster with the channel data
-    LSDIndexRaster Channel = GetChannelfromDreich(node_number, MinSegLength, A_0, m_over_n,
-                         FlowInfo, FlowDistance, ElevationRaster, path_name, NJunctions);
-    Array2D<int> ChannelData = Channel.get_RasterData();
+    nodes_of_channels[i] = get_nodes_of_Dreich_channel(ValleySources[i], A_0, m_over_n,
+                                   FlowInfo, FlowDistance, ElevationRaster, NJunctions);
+  }
 
-    //copy this array to a master array
-    for (int row = 0; row < NRows; row++)
+  //copy the channels to a master array, in the order of the sources
+  int row,col;
+  for (int i = 0; i < max_nodes; i++)
+  {
+    int n_channel_nodes = int(nodes_of_channels[i].size());
+    for (int n = 0; n < n_channel_nodes; n++)
     {
-      for (int col = 0; col < NCols; col++)
-      {
-        if(ChannelData[row][col] != NoDataValue)
-        {
-          channel_nodes[row][col] = ChannelData[row][col];
-        }
-      }
+      FlowInfo.retrieve_current_row_and_col(nodes_of_channels[i][n], row, col);
+      channel_nodes[row][col] = nodes_of_channels[i][n];
     }
   }
 
@@ -3109,62 +3102,62 @@ LSDIndexRaster LSDJunctionNetwork::GetChannelsDreich(vector<int> ValleySources,
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
-// This function returns a 2D integer array containing the locations of all pixels identified
-// as being part of the channel using chi profiles.  It calculates the chi and elevation value
-// of every pixel upstream of the given junction, then bins this data and calculates the pixels
-// in the 95th percentile of each bin.  Any pixels above the 95th percentile are considered part
-// of the channel, and any below are considered to be hillslopes.  This is the first part of the
-// channel head prediction using chi profiles.
+// This function classifies all pixels upstream of a junction as channel or hillslope
+// using chi profiles.  It calculates the chi and elevation value of every pixel upstream
+// of the given junction, then bins this data and calculates the pixels in the 95th
+// percentile of each bin.  Any pixels above the 95th percentile are considered part
+// of the channel, and any below are considered to be hillslopes.
+//
+// It is the shared part of GetChannelHeadsChiMethodAllPixels and
+// GetSourceNodesChiMethodAllPixels. It only touches local data so it can be
+// called for many junctions at once.
 //
 // Parameters: Junction number, A_0, m over n, bin width (suggested value of 10), FlowInfo object,
-// Elevation raster
-// Returns: Array2D<int> with the channel pixel locations
+// Elevation raster, a bool to print the chi profiles
+// Returns (by reference): the upslope nodes and a vector that is 1 for channel nodes
+// and 0 for hillslope nodes
 //
 // FC 01/10/13
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
-Array2D<int> LSDJunctionNetwork::GetChannelHeadsChiMethodAllPixels(int JunctionNumber,
+void LSDJunctionNetwork::classify_upslope_pixels_chi_method(int JunctionNumber,
                                       float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
-                                      LSDRaster& ElevationRaster)
+                                      LSDRaster& ElevationRaster, bool print_profiles,
+                                      vector<int>& upslope_nodes, vector<int>& is_channel)
 {
-  Array2D<int> channel_pixels(NRows,NCols,NoDataValue);
   // get the node index of this junction
   int starting_node = JunctionVector[JunctionNumber];
   string jn_name = itoa(JunctionNumber);
   string uscore = "_";
   jn_name = uscore+jn_name;
+  string dot = ".";
+  string extension = "txt";
 
   //get the chi and elevation values of each upslope node
-  vector<int> upslope_nodes = FlowInfo.get_upslope_nodes(starting_node);
+  upslope_nodes = FlowInfo.get_upslope_nodes(starting_node);
   vector<float> upslope_chi = FlowInfo.get_upslope_chi(starting_node, m_over_n, A_0);
   vector<float> elevation;
   int row,col;
 
-  string string_filename_all;
-  string filename_all = "chi_profile_all";
-  string dot = ".";
-  string extension = "txt";
-  string_filename_all = filename_all+jn_name+dot+extension;
   ofstream chi_profile_all;
-  chi_profile_all.open(string_filename_all.c_str());
-  //cout << "The filename is " << string_filename_all << endl;
+  if (print_profiles)
+  {
+    string filename_all = "chi_profile_all";
+    string string_filename_all = filename_all+jn_name+dot+extension;
+    chi_profile_all.open(string_filename_all.c_str());
+  }
 
   for (int node=0; node < int(upslope_nodes.size()); node++)
   {
     FlowInfo.retrieve_current_row_and_col(upslope_nodes[node], row, col);
     float elev = ElevationRaster.get_data_element(row,col);
     elevation.push_back(elev);
-    chi_profile_all << upslope_chi[node] << " " << elev << endl;
+    if (print_profiles)
+    {
+      chi_profile_all << upslope_chi[node] << " " << elev << endl;
+    }
   }
 
-  string string_filename;
-  string filename = "chi_profile";
-  string_filename = filename+jn_name+dot+extension;
-  //cout << "The filename is " << string_filename << endl;
-
-  ofstream chi_profile;
-  chi_profile.open(string_filename.c_str());
-
   float lower_limit = 0;
   vector<float> mean_chi;
   vector<float> mean_elev;
@@ -3258,41 +3251,34 @@ Array2D<int> LSDJunctionNetwork::GetChannelHeadsChiMethodAllPixels(int JunctionN
     }
   }
 
-  for(int i = 0 ; i< n_bins; i++)
+  if (print_profiles)
   {
-    if (mean_chi[i] != 0)
+    string filename = "chi_profile";
+    string string_filename = filename+jn_name+dot+extension;
+    ofstream chi_profile;
+    chi_profile.open(string_filename.c_str());
+    for(int i = 0 ; i< n_bins; i++)
     {
-      chi_profile << mean_chi[i] << " " << mean_elev[i] << " " << range_min[i] << " " << range_max[i] << " " << elev_regression[i] << endl;
+      if (mean_chi[i] != 0)
+      {
+        chi_profile << mean_chi[i] << " " << mean_elev[i] << " " << range_min[i] << " " << range_max[i] << " " << elev_regression[i] << endl;
+      }
     }
+    chi_profile.close();
   }
-  chi_profile.close();
 
   //classify any nodes to the left of the channel segment as the channel; any nodes to the
   // right are classified as hillslopes
-  vector<int> channel_nodes;
-  vector<int> upslope_nodes_temp;
-  vector<int> source_nodes;
-  vector<int>::iterator iterator_find;
-
+  is_channel.assign(upslope_nodes.size(),0);
   for (int i=0; i < int(upslope_nodes.size()); i++)
   {
     int bin_id = int((upslope_chi[i]-lower_limit)/bin_width);
-    FlowInfo.retrieve_current_row_and_col(upslope_nodes[i], row, col);
     if (upslope_chi[i] <= mean_chi[bin_id] && elevation[i] >= elev_regression[bin_id])
     {
-      channel_pixels[row][col] = 1;
-      channel_nodes.push_back(upslope_nodes[i]);
-    }
-    else
-    {
-      channel_pixels[row][col] = 0;
+      is_channel[i] = 1;
     }
   }
-
-  return channel_pixels;
-
 }
-
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
@@ -3310,132 +3296,88 @@ Array2D<int> LSDJunctionNetwork::GetChannelHeadsChiMethodAllPixels(int JunctionN
 // FC 01/10/13
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
-vector<int> LSDJunctionNetwork::GetSourceNodesChiMethodAllPixels(int JunctionNumber,
+Array2D<int> LSDJunctionNetwork::GetChannelHeadsChiMethodAllPixels(int JunctionNumber,
                                       float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
                                       LSDRaster& ElevationRaster)
 {
-  // get the node index of this junction
-  int starting_node = JunctionVector[JunctionNumber];
-  string jn_name = itoa(JunctionNumber);
-  string uscore = "_";
-  jn_name = uscore+jn_name;
+  Array2D<int> channel_pixels(NRows,NCols,NoDataValue);
 
-  //get the chi and elevation values of each upslope node
-  vector<int> upslope_nodes = FlowInfo.get_upslope_nodes(starting_node);
-  vector<float> upslope_chi = FlowInfo.get_upslope_chi(starting_node, m_over_n, A_0);
-  vector<float> elevation;
-  int row,col;
+  vector<int> upslope_nodes;
+  vector<int> is_channel;
+  classify_upslope_pixels_chi_method(JunctionNumber, A_0, m_over_n, bin_width, FlowInfo,
+                                     ElevationRaster, true, upslope_nodes, is_channel);
 
-  for (int node=0; node < int(upslope_nodes.size()); node++)
+  int row,col;
+  for (int i=0; i < int(upslope_nodes.size()); i++)
   {
-    FlowInfo.retrieve_current_row_and_col(upslope_nodes[node], row, col);
-    float elev = ElevationRaster.get_data_element(row,col);
-    elevation.push_back(elev);
+    FlowInfo.retrieve_current_row_and_col(upslope_nodes[i], row, col);
+    channel_pixels[row][col] = is_channel[i];
   }
 
-  float lower_limit = 0;
-  vector<float> mean_chi;
-  vector<float> mean_elev;
-  vector<float> midpoints;
-  vector<float> medianY;
-  vector<float> st_dev_chi;
-  vector<float> st_dev_elev;
-  vector<float> range_min;
-  vector<float> range_max;
-  vector<int> n_obs;
-
-  float NoDataValue = FlowInfo.get_NoDataValue();
+  return channel_pixels;
 
-  //bin the data to find the range of the 95th percentile
-  bin_data(upslope_chi, elevation, bin_width, mean_chi, mean_elev, midpoints, medianY,
-           st_dev_chi, st_dev_elev, range_min, range_max, n_obs, lower_limit, NoDataValue);
+}
 
-  //find the most linear channel segment (highest r2 value)
-  int n_bins = mean_chi.size();
-  int min_seg_length = n_bins/10;
-  vector<float> channel_chi;
-  vector<float> channel_elev;
-  vector<float>::iterator vec_iter_start;
-  vector<float>::iterator vec_iter_end;
-  float max_r2 = 0;
-  float elev_limit = 0;
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// This is the same as above but for a list of junctions. The junctions are
+// classified in parallel and then written to the array in the order of the list,
+// so where the junctions are nested later junctions overwrite earlier ones.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+Array2D<int> LSDJunctionNetwork::GetChannelHeadsChiMethodAllPixels(vector<int> JunctionNumbers,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster)
+{
+  Array2D<int> channel_pixels(NRows,NCols,NoDataValue);
 
-  for (int channel_segment = min_seg_length; channel_segment <= n_bins-min_seg_length; channel_segment++)
+  int n_junctions = int(JunctionNumbers.size());
+  vector< vector<int> > upslope_nodes(n_junctions);
+  vector< vector<int> > is_channel(n_junctions);
+  #pragma omp parallel for schedule(dynamic)
+  for (int j = 0; j < n_junctions; j++)
   {
-    //assigning the chi values of the channel segment
-    channel_chi.resize(channel_segment);
-    vec_iter_start = mean_chi.begin();
-    vec_iter_end = vec_iter_start+channel_segment;
-    channel_chi.assign(vec_iter_start,vec_iter_end);
-
-    // assigning the elevation values of the channel segment
-    channel_elev.resize(channel_segment);
-    vec_iter_start = range_min.begin();
-    vec_iter_end = vec_iter_start+channel_segment;
-    channel_elev.assign(vec_iter_start,vec_iter_end);
-
-    //performing linear regression on channel segment: getting highest r2
-    vector<float> residuals_chan;
-    vector<float> results_chan = simple_linear_regression(channel_chi,channel_elev, residuals_chan);
-    float r2 = results_chan[2];
-    if (r2 > max_r2)
-    {
-      max_r2 = r2;
-      elev_limit = channel_elev.back();
-    }
+    classify_upslope_pixels_chi_method(JunctionNumbers[j], A_0, m_over_n, bin_width, FlowInfo,
+                                       ElevationRaster, true, upslope_nodes[j], is_channel[j]);
   }
 
-  //extend the linear channel segment up through the plot
-  vector<float> mean_chi_regression;
-  vector<float> range_min_regression;
-  vector<float> elev_regression;
-  mean_chi_regression.resize(range_min.size());
-  range_min_regression.resize(range_min.size());
-  elev_regression.resize(range_min.size());
-  float regression_pointer = 0;
-
-  for (int i=0; i< int(range_min.size()); i++)
+  int row,col;
+  for (int j = 0; j < n_junctions; j++)
   {
-    if (range_min[i] <= elev_limit)
+    for (int i=0; i < int(upslope_nodes[j].size()); i++)
     {
-      if (range_min[i] !=0)
-      {
-        mean_chi_regression[i] = mean_chi[i];
-        range_min_regression[i] = range_min[i];
-        regression_pointer = i;
-      }
+      FlowInfo.retrieve_current_row_and_col(upslope_nodes[j][i], row, col);
+      channel_pixels[row][col] = is_channel[j][i];
     }
   }
 
-  float x1 = mean_chi_regression.front();
-  float y1 = range_min_regression.front();
-  float x2 = mean_chi_regression[regression_pointer];
-  float y2 = range_min_regression[regression_pointer];
-  float gradient = (y2 - y1)/(x2 - x1);
-  float intercept = y2 - (gradient * x2);
+  return channel_pixels;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
 
-  for (int i = 0; i < n_bins; i++)
-  {
-    if (range_min[i] <=elev_limit)
-    {
-      elev_regression[i] = range_min[i];
-    }
-    else
-    {
-      elev_regression[i] = mean_chi[i]*gradient + intercept;
-    }
-  }
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// This function returns an integer vector with the node indexes of the furthest upstream
+// pixels identified as being part of the channel using chi profiles.  See
+// GetChannelHeadsChiMethodAllPixels for how the pixels are classified.
+//
+// Parameters: Junction number, A_0, m over n, bin width (suggested value of 10), FlowInfo object,
+// Elevation raster
+// Returns: vector<int> with the source nodes
+//
+// FC 01/10/13
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+vector<int> LSDJunctionNetwork::GetSourceNodesChiMethodAllPixels(int JunctionNumber,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster)
+{
+  vector<int> upslope_nodes;
+  vector<int> is_channel;
+  classify_upslope_pixels_chi_method(JunctionNumber, A_0, m_over_n, bin_width, FlowInfo,
+                                     ElevationRaster, false, upslope_nodes, is_channel);
 
-  //classify any nodes to the left of the channel segment as the channel; any nodes to the
-  // right are classified as hillslopes
   vector<int> channel_nodes;
-  vector<int> source_nodes;
-
-  for (unsigned int i=0; i < upslope_nodes.size(); i++)
+  for (int i=0; i < int(upslope_nodes.size()); i++)
   {
-    int bin_id = int((upslope_chi[i]-lower_limit)/bin_width);
-    FlowInfo.retrieve_current_row_and_col(upslope_nodes[i], row, col);
-    if (upslope_chi[i] <= mean_chi[bin_id] && elevation[i] >= elev_regression[bin_id])
+    if (is_channel[i] == 1)
     {
       channel_nodes.push_back(upslope_nodes[i]);
     }
@@ -3443,30 +3385,48 @@ vector<int> LSDJunctionNetwork::GetSourceNodesChiMethodAllPixels(int JunctionNum
 
   // find the furthest upslope nodes classified as being part of the channel network (use as sources for next
   // step of chi method)
+  vector<int> source_nodes = keep_farthest_upstream_nodes(channel_nodes, FlowInfo);
 
-  int upstream_test = 0;
-  vector<int>::iterator find_it;
+  cout << "No of channel nodes: " << channel_nodes.size() << endl;
+  cout << "No of source nodes: " << source_nodes.size() << endl;
+  return source_nodes;
+}
 
-  for (unsigned int node =0; node < channel_nodes.size(); node++)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+// This is the same as above but for a list of junctions. The junctions are
+// processed in parallel and the source nodes are returned in the order of
+// the junction list.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-==-=-=-=-=-=-
+vector<int> LSDJunctionNetwork::GetSourceNodesChiMethodAllPixels(vector<int> JunctionNumbers,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster)
+{
+  int n_junctions = int(JunctionNumbers.size());
+  vector< vector<int> > sources_of_junctions(n_junctions);
+  #pragma omp parallel for schedule(dynamic)
+  for (int j = 0; j < n_junctions; j++)
   {
-     vector<int> tests;
-     int current_node = channel_nodes[node];
-     for (unsigned int i = 0; i < channel_nodes.size(); i++)
-     {
-      if (channel_nodes[i] != current_node)
+    vector<int> upslope_nodes;
+    vector<int> is_channel;
+    classify_upslope_pixels_chi_method(JunctionNumbers[j], A_0, m_over_n, bin_width, FlowInfo,
+                                       ElevationRaster, false, upslope_nodes, is_channel);
+
+    vector<int> channel_nodes;
+    for (int i=0; i < int(upslope_nodes.size()); i++)
+    {
+      if (is_channel[i] == 1)
       {
-        int test_node = channel_nodes[i];
-        upstream_test = FlowInfo.is_node_upstream(current_node, test_node);
-        tests.push_back(upstream_test);
+        channel_nodes.push_back(upslope_nodes[i]);
       }
-     }
-     find_it = find(tests.begin(), tests.end(), 1);
-     if (find_it == tests.end())
-     {
-      source_nodes.push_back(current_node);
-     }
+    }
+    sources_of_junctions[j] = keep_farthest_upstream_nodes(channel_nodes, FlowInfo);
+  }
+
+  vector<int> source_nodes;
+  for (int j = 0; j < n_junctions; j++)
+  {
+    source_nodes.insert(source_nodes.end(), sources_of_junctions[j].begin(), sources_of_junctions[j].end());
   }
-  cout << "No of channel nodes: " << channel_nodes.size() << endl;
   cout << "No of source nodes: " << source_nodes.size() << endl;
   return source_nodes;
 }
@@ -3788,6 +3748,332 @@ vector<int> LSDJunctionNetwork::identify_upstream_limits(LSDFlowInfo& FlowInfo,
 //   AreaRaster.write_raster("area","flt");
   return source_nodes;
 }
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// calculate_pelletier_channel_heads_tiled
+//
+// This gives the same channel heads as calculate_pelletier_channel_heads_DTM
+// but the DEM is processed in square tiles so no full size curvature rasters
+// are needed. Each tile computes its own block of tangential curvature (the
+// polyfit windows read the surrounding cells of the filtered DEM) and keeps
+// only two bits per cell: whether it is a possible source and whether it is
+// convergent (long wavelength curvature > 0).
+//
+// The downslope routing in identify_upstream_limits only marks a pixel if a
+// strictly higher neighbour has been marked, so the marked pixels are simply
+// everything reachable downslope from the possible sources through convergent
+// pixels. This is found tile by tile in rounds: each tile floods its own pixels
+// and reads the pixels of the neighbouring tiles from a copy of the tile border
+// rows and columns taken at the start of the round. Tiles are revisited only
+// if the border of a neighbouring tile changed, until nothing changes. A
+// possible source is kept if none of its higher neighbours were marked, which
+// is the times_visited == 1 test of identify_upstream_limits. The sources are returned in the same order as
+// calculate_pelletier_channel_heads_DTM.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+vector<int> LSDJunctionNetwork::calculate_pelletier_channel_heads_tiled(LSDFlowInfo& FlowInfo,
+                  LSDRaster& FilteredTopo, Array2D<float>& topography, float window_radius,
+                  float window_radius_LW, float tan_curv_threshold, int tile_size)
+{
+  if (tile_size < 1)
+  {
+    tile_size = 512;
+  }
+  const unsigned char IS_CANDIDATE = 1;
+  const unsigned char IS_CONVERGENT = 2;
+
+  int n_tile_rows = (NRows+tile_size-1)/tile_size;
+  int n_tile_cols = (NCols+tile_size-1)/tile_size;
+  int n_tiles = n_tile_rows*n_tile_cols;
+
+  // get the curvature tile by tile and only keep the bits that are needed
+  Array2D<unsigned char> cell_state(NRows,NCols,(unsigned char)0);
+  #pragma omp parallel for schedule(dynamic)
+  for (int tile = 0; tile < n_tiles; tile++)
+  {
+    int r0 = (tile/n_tile_cols)*tile_size;
+    int c0 = (tile%n_tile_cols)*tile_size;
+    int nr = min(tile_size,NRows-r0);
+    int nc = min(tile_size,NCols-c0);
+
+    Array2D<float> tan_curv = FilteredTopo.calculate_polyfit_tangential_curvature_block(window_radius,r0,c0,nr,nc);
+    Array2D<float> tan_curv_LW;
+    if (window_radius_LW == window_radius)
+    {
+      tan_curv_LW = tan_curv;
+    }
+    else
+    {
+      tan_curv_LW = FilteredTopo.calculate_polyfit_tangential_curvature_block(window_radius_LW,r0,c0,nr,nc);
+    }
+
+    for (int i = 0; i < nr; i++)
+    {
+      for (int j = 0; j < nc; j++)
+      {
+        unsigned char state = 0;
+        if (tan_curv_LW[i][j] > 0)
+        {
+          state |= IS_CONVERGENT;
+          if (tan_curv[i][j] > tan_curv_threshold)
+          {
+            state |= IS_CANDIDATE;
+          }
+        }
+        cell_state[r0+i][c0+j] = state;
+      }
+    }
+  }
+
+  // flood downslope from the possible sources, in rounds over the tiles
+  Array2D<unsigned char> visited(NRows,NCols,(unsigned char)0);
+  // the neighbouring tiles are only read on their border rows and columns, so
+  // only these halos are copied at the start of each round. Rows 2*tr and
+  // 2*tr+1 of row_halo are the first and last rows of tile row tr, and the
+  // same goes for the columns of col_halo
+  Array2D<unsigned char> row_halo(2*n_tile_rows,NCols,(unsigned char)0);
+  Array2D<unsigned char> col_halo(NRows,2*n_tile_cols,(unsigned char)0);
+  vector<int> active_tiles(n_tiles);
+  for (int tile = 0; tile < n_tiles; tile++)
+  {
+    active_tiles[tile] = tile;
+  }
+  vector<int> border_changed(n_tiles,0);
+  int di[8] = {-1,-1,-1,0,1,1,1,0};
+  int dj[8] = {-1,0,1,1,1,0,-1,-1};
+  bool first_round = true;
+
+  while (not active_tiles.empty())
+  {
+    for (int tr = 0; tr < n_tile_rows; tr++)
+    {
+      int first_row = tr*tile_size;
+      int last_row = min(first_row+tile_size,NRows)-1;
+      for (int j = 0; j < NCols; j++)
+      {
+        row_halo[2*tr][j] = visited[first_row][j];
+        row_halo[2*tr+1][j] = visited[last_row][j];
+      }
+    }
+    for (int tc = 0; tc < n_tile_cols; tc++)
+    {
+      int first_col = tc*tile_size;
+      int last_col = min(first_col+tile_size,NCols)-1;
+      for (int i = 0; i < NRows; i++)
+      {
+        col_halo[i][2*tc] = visited[i][first_col];
+        col_halo[i][2*tc+1] = visited[i][last_col];
+      }
+    }
+
+    int n_active = int(active_tiles.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (int a = 0; a < n_active; a++)
+    {
+      int tile = active_tiles[a];
+      int r0 = (tile/n_tile_cols)*tile_size;
+      int c0 = (tile%n_tile_cols)*tile_size;
+      int r1 = min(r0+tile_size,NRows);
+      int c1 = min(c0+tile_size,NCols);
+      vector<int> stack;
+      bool changed = false;
+
+      // the possible sources are marked on the first visit
+      if (first_round)
+      {
+        for (int i = r0; i < r1; i++)
+        {
+          for (int j = c0; j < c1; j++)
+          {
+            if (cell_state[i][j] & IS_CANDIDATE)
+            {
+              visited[i][j] = 1;
+              stack.push_back(i*NCols+j);
+              if (i == r0 || i == r1-1 || j == c0 || j == c1-1)
+              {
+                changed = true;
+              }
+            }
+          }
+        }
+      }
+
+      // pixels on the tile border can be reached from marked pixels in
+      // neighbouring tiles
+      for (int i = r0; i < r1; i++)
+      {
+        for (int j = c0; j < c1; j++)
+        {
+          if (i != r0 && i != r1-1 && j != c0 && j != c1-1)
+          {
+            continue;
+          }
+          if (visited[i][j] || not (cell_state[i][j] & IS_CONVERGENT) || topography[i][j] == NoDataValue)
+          {
+            continue;
+          }
+          for (int n = 0; n < 8; n++)
+          {
+            int ni = i+di[n];
+            int nj = j+dj[n];
+            if (ni <= 0 || nj <= 0 || ni >= NRows-1 || nj >= NCols-1)
+            {
+              continue;
+            }
+            if (ni >= r0 && ni < r1 && nj >= c0 && nj < c1)
+            {
+              continue;
+            }
+            // a pixel outside this tile is on the border of its own tile
+            unsigned char was_visited;
+            int ntr = ni/tile_size;
+            int ntc = nj/tile_size;
+            if (ni == ntr*tile_size)
+            {
+              was_visited = row_halo[2*ntr][nj];
+            }
+            else if (ni == min((ntr+1)*tile_size,NRows)-1)
+            {
+              was_visited = row_halo[2*ntr+1][nj];
+            }
+            else if (nj == ntc*tile_size)
+            {
+              was_visited = col_halo[ni][2*ntc];
+            }
+            else
+            {
+              was_visited = col_halo[ni][2*ntc+1];
+            }
+            if (was_visited && topography[ni][nj] != NoDataValue && topography[ni][nj] > topography[i][j])
+            {
+              visited[i][j] = 1;
+              stack.push_back(i*NCols+j);
+              changed = true;
+              break;
+            }
+          }
+        }
+      }
+
+      // now flood within the tile
+      while (not stack.empty())
+      {
+        int i = stack.back()/NCols;
+        int j = stack.back()%NCols;
+        stack.pop_back();
+        // edge pixels do not pass on flow
+        if (i == 0 || j == 0 || i == NRows-1 || j == NCols-1 || topography[i][j] == NoDataValue)
+        {
+          continue;
+        }
+        for (int n = 0; n < 8; n++)
+        {
+          int ni = i+di[n];
+          int nj = j+dj[n];
+          if (ni < r0 || ni >= r1 || nj < c0 || nj >= c1 || visited[ni][nj])
+          {
+            continue;
+          }
+          if ((cell_state[ni][nj] & IS_CONVERGENT) && topography[ni][nj] != NoDataValue
+              && topography[i][j] > topography[ni][nj])
+          {
+            visited[ni][nj] = 1;
+            stack.push_back(ni*NCols+nj);
+            if (ni == r0 || ni == r1-1 || nj == c0 || nj == c1-1)
+            {
+              changed = true;
+            }
+          }
+        }
+      }
+      border_changed[tile] = (changed) ? 1 : 0;
+    }
+    first_round = false;
+
+    // revisit the neighbours of any tile whose border changed
+    vector<int> revisit(n_tiles,0);
+    for (int a = 0; a < n_active; a++)
+    {
+      int tile = active_tiles[a];
+      if (border_changed[tile])
+      {
+        int tr = tile/n_tile_cols;
+        int tc = tile%n_tile_cols;
+        for (int n = 0; n < 8; n++)
+        {
+          int ntr = tr+di[n];
+          int ntc = tc+dj[n];
+          if (ntr >= 0 && ntr < n_tile_rows && ntc >= 0 && ntc < n_tile_cols)
+          {
+            revisit[ntr*n_tile_cols+ntc] = 1;
+          }
+        }
+      }
+      border_changed[tile] = 0;
+    }
+    active_tiles.clear();
+    for (int tile = 0; tile < n_tiles; tile++)
+    {
+      if (revisit[tile])
+      {
+        active_tiles.push_back(tile);
+      }
+    }
+  }
+
+  // collect the possible sources in the same order as
+  // calculate_pelletier_channel_heads_DTM
+  vector<int> possible_sources_row;
+  vector<int> possible_sources_col;
+  vector<float> possible_sources_elev;
+  for (int row = 0; row < NRows; row++)
+  {
+    for(int col = 0; col < NCols; col++)
+    {
+      if (cell_state[row][col] & IS_CANDIDATE)
+      {
+        possible_sources_row.push_back(row);
+        possible_sources_col.push_back(col);
+        possible_sources_elev.push_back(topography[row][col]);
+      }
+    }
+  }
+  vector<size_t> index_map;
+  matlab_float_sort_descending(possible_sources_elev, possible_sources_elev, index_map);
+  matlab_int_reorder(possible_sources_row, index_map, possible_sources_row);
+  matlab_int_reorder(possible_sources_col, index_map, possible_sources_col);
+
+  // keep the sources that no marked pixel drains into
+  vector<int> source_nodes;
+  int n_possible_sources = possible_sources_row.size();
+  for (int s = 0; s < n_possible_sources; s++)
+  {
+    int row = possible_sources_row[s];
+    int col = possible_sources_col[s];
+    bool is_drained_into = false;
+    if (topography[row][col] != NoDataValue)
+    {
+      for (int n = 0; n < 8; n++)
+      {
+        int ni = row+di[n];
+        int nj = col+dj[n];
+        if (ni <= 0 || nj <= 0 || ni >= NRows-1 || nj >= NCols-1)
+        {
+          continue;
+        }
+        if (visited[ni][nj] && topography[ni][nj] != NoDataValue && topography[ni][nj] > topography[row][col])
+        {
+          is_drained_into = true;
+          break;
+        }
+      }
+    }
+    if (not is_drained_into)
+    {
+      source_nodes.push_back(FlowInfo.retrieve_node_from_row_and_column(row, col));
+    }
+  }
+  return source_nodes;
+}
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-=
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
@@ -5686,46 +5972,10 @@ LSDIndexRaster LSDJunctionNetwork::extract_hollow(vector<int> CH_junctions, LSDF
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junction_vector(vector<int> basin_junctions, LSDFlowInfo& FlowInfo)
 {
+  vector<int> outlet_nodes = get_basin_outlet_nodes_from_junction_vector(basin_junctions, FlowInfo);
 
-  Array2D<int> Basin(NRows,NCols,NoDataValue);
-
-  for (vector<int>::iterator it = basin_junctions.begin(); it !=  basin_junctions.end(); ++it)
-  {
-
-    int basin_junction = *it;
-
-    if (basin_junction >= int(JunctionVector.size()))
-    {
-      cout << "LSDJunctionNetwork::extract_basin_from_junction junction not in list" << endl;
-      exit(EXIT_FAILURE);
-    }
-
-    int receiver_junc, n_nodes_in_channel, basin_outlet;
-
-    // get the reciever junction
-    receiver_junc = ReceiverVector[basin_junction];
-
-    LSDIndexChannel StreamLinkVector = LSDIndexChannel(basin_junction, JunctionVector[basin_junction],
-                                                             receiver_junc, JunctionVector[receiver_junc], FlowInfo);
-
-    // Find final nth order channel pixel, which is the penultimate pixel
-    // in channel.
-    n_nodes_in_channel = StreamLinkVector.get_n_nodes_in_channel();
-    int node,row,col;
-
-    basin_outlet = StreamLinkVector.get_node_in_channel(n_nodes_in_channel-2);
-    vector<int> BasinNodeVector = FlowInfo.get_upslope_nodes(basin_outlet);
-    // Loop through basin to label basin pixels with basin ID
-    for (int BasinIndex = 0; BasinIndex < int(BasinNodeVector.size()); ++BasinIndex)
-    {
-      node = BasinNodeVector[BasinIndex];
-      FlowInfo.retrieve_current_row_and_col(node,row,col);
-      Basin[row][col] = basin_junction;
-    }
-
-  }
-
-  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, Basin,GeoReferencingStrings);
+  // Basins later in the list overwrite earlier ones
+  LSDIndexRaster IR = FlowInfo.label_basins_from_outlet_nodes(outlet_nodes, basin_junctions, 0);
   return IR;
 }
 
@@ -5743,65 +5993,40 @@ LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junction_vector(vector<in
 // vector is first sorted by upslope drainage area - do the nested basins first,
 // then larger basins won't overwrite these.  FJC 10/01/17
 //
+// Now labelled in a single sweep of the S vector, where the innermost outlet
+// wins, rather than sorting and collecting upslope nodes for each junction.
+//
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 LSDIndexRaster LSDJunctionNetwork::extract_basins_from_junction_vector_nested(vector<int> basin_junctions, LSDFlowInfo& FlowInfo)
 {
-  Array2D<int> Basin(NRows,NCols,NoDataValue);
+  vector<int> outlet_nodes = get_basin_outlet_nodes_from_junction_vector(basin_junctions, FlowInfo);
 
-	// sort basin junctions by contributing nodes
-	vector<size_t> index_map;
-	vector<int> basin_junctions_CP;
-	for (int i = 0; i < int(basin_junctions.size()); i++)
-	{
-		// get contributing pixels of each junction
-		int this_node = get_Node_of_Junction(basin_junctions[i]);
-		basin_junctions_CP.push_back(FlowInfo.NContributingNodes[this_node]);
-	}
-	matlab_int_sort(basin_junctions_CP, basin_junctions_CP, index_map);
-	matlab_int_reorder(basin_junctions, index_map, basin_junctions);
+  // The smallest (innermost) basin wins
+  LSDIndexRaster IR = FlowInfo.label_basins_from_outlet_nodes(outlet_nodes, basin_junctions, 1);
+  return IR;
+}
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This gets the outlet nodes of the basins draining from a vector of junctions.
+// The outlet is the penultimate node in the link below the junction.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<int> LSDJunctionNetwork::get_basin_outlet_nodes_from_junction_vector(vector<int>& basin_junctions,
+                                                                LSDFlowInfo& FlowInfo)
+{
+  vector<int> outlet_nodes;
   for (vector<int>::iterator it = basin_junctions.begin(); it !=  basin_junctions.end(); ++it)
   {
-		cout << "Basin junction: " << *it << endl;
-
     int basin_junction = *it;
 
-    if (basin_junction >= int(JunctionVector.size()))
+    if (basin_junction < 0 || basin_junction >= int(JunctionVector.size()))
     {
       cout << "LSDJunctionNetwork::extract_basin_from_junction junction not in list" << endl;
       exit(EXIT_FAILURE);
     }
 
-    int receiver_junc, n_nodes_in_channel, basin_outlet;
-
-    // get the reciever junction
-    receiver_junc = ReceiverVector[basin_junction];
-
-    LSDIndexChannel StreamLinkVector = LSDIndexChannel(basin_junction, JunctionVector[basin_junction],
-                                                             receiver_junc, JunctionVector[receiver_junc], FlowInfo);
-
-    // Find final nth order channel pixel, which is the penultimate pixel
-    // in channel.
-    n_nodes_in_channel = StreamLinkVector.get_n_nodes_in_channel();
-    int node,row,col;
-
-    basin_outlet = StreamLinkVector.get_node_in_channel(n_nodes_in_channel-2);
-    vector<int> BasinNodeVector = FlowInfo.get_upslope_nodes(basin_outlet);
-    // Loop through basin to label basin pixels with basin ID
-    for (int BasinIndex = 0; BasinIndex < int(BasinNodeVector.size()); ++BasinIndex)
-    {
-      node = BasinNodeVector[BasinIndex];
-      FlowInfo.retrieve_current_row_and_col(node,row,col);
-			if (Basin[row][col] == NoDataValue)
-			{
-      	Basin[row][col] = basin_junction;
-			}
-    }
-
+    outlet_nodes.push_back(get_penultimate_node_from_stream_link(basin_junction, FlowInfo));
   }
-
-  LSDIndexRaster IR(NRows,NCols, XMinimum, YMinimum, DataResolution, NoDataValue, Basin,GeoReferencingStrings);
-  return IR;
+  return outlet_nodes;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
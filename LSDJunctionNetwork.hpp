@@ -819,9 +819,9 @@ class LSDJunctionNetwork
   /// one receiver. However, for a basin of given order, this starts just upstream of the
   /// confluence to the next basin order. So the basin <b>INCLUDES</b> the channel flowing
   /// downstream to the penultamite node.
-	/// UPDATED so that if basins are nested, they don't overwrite each other - basins are
-	/// sorted by the number of contributing pixels, and the smaller basins are written
-	/// first.
+	/// UPDATED so that if basins are nested, they don't overwrite each other - the
+	/// smaller (innermost) basin always keeps its label. The labelling is done in a
+	/// single sweep through the S vector by LSDFlowInfo::label_basins_from_outlet_nodes.
   ///
   /// @param basin_junctions Vector of junction numbers of basins to be extracted.
   /// @param FlowInfo LSDFlowInfo object.
@@ -830,6 +830,15 @@ class LSDJunctionNetwork
   /// @date 10/01/17
 	LSDIndexRaster extract_basins_from_junction_vector_nested(vector<int> basin_junctions, LSDFlowInfo& FlowInfo);
 
+  /// @brief This gets the outlet nodes of basins draining from a vector of junctions.
+  /// @details The outlet is the penultimate node of the link below each junction,
+  ///  consistent with extract_basins_from_junction_vector.
+  /// @param basin_junctions Vector of junction numbers of the basins.
+  /// @param FlowInfo LSDFlowInfo object.
+  /// @return Vector of outlet node indices, in the same order as basin_junctions.
+  vector<int> get_basin_outlet_nodes_from_junction_vector(vector<int>& basin_junctions,
+                                                          LSDFlowInfo& FlowInfo);
+
   /// @brief This function gets the an LSDIndexRaster of basins draining from a vector of junctions.
   /// @details IThis is a highly rudimentary version, which just collects
   ///  all the upslope nodes.
@@ -974,17 +983,17 @@ vector<int> GetChannelHeadsChiMethodFromValleys(vector<int> ValleyNodes,
   /// It looks for channels based on the outlet junctions of valleys.
   /// It returns a LSDIndexRaster with the channels.
   /// @param ValleyNodes
-  /// @param MinSegLength
   /// @param A_0
   /// @param m_over_n
   /// @param FlowInfo
   /// @param FlowDistance
   /// @param ElevationRaster
+  /// @param NJunctions
   /// @return LSDIndexRaster with all channels
   /// @author FJC
   /// @date 21/08/15
-  LSDIndexRaster GetChannelsDreich(vector<int> ValleySources, int MinSegLength, float A_0, float m_over_n,
-                                      LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance, LSDRaster& ElevationRaster, string path_name, int NJunctions);
+  LSDIndexRaster GetChannelsDreich(vector<int> ValleySources, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance, LSDRaster& ElevationRaster, int NJunctions);
 
 
   /// @brief This function returns a 2D array containing the locations of all pixels identified
@@ -1026,6 +1035,79 @@ vector<int> GetChannelHeadsChiMethodFromValleys(vector<int> ValleyNodes,
                                       float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
                                       LSDRaster& ElevationRaster);
 
+  /// @brief This is the same as GetChannelHeadsChiMethodAllPixels but for a
+  /// list of junctions, which are processed in parallel.
+  /// @details The junctions are written to the array in the order of the list,
+  /// so where junctions are nested later ones overwrite earlier ones. The
+  /// result does not depend on the number of threads.
+  /// @param JunctionNumbers the junctions
+  /// @param A_0
+  /// @param m_over_n
+  /// @param bin_width
+  /// @param FlowInfo Flow Info object
+  /// @param ElevationRaster
+  /// @return Array2D<int> with channel pixels
+  Array2D<int> GetChannelHeadsChiMethodAllPixels(vector<int> JunctionNumbers,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster);
+
+  /// @brief This is the same as GetSourceNodesChiMethodAllPixels but for a
+  /// list of junctions, which are processed in parallel.
+  /// @param JunctionNumbers the junctions
+  /// @param A_0
+  /// @param m_over_n
+  /// @param bin_width
+  /// @param FlowInfo Flow Info object
+  /// @param ElevationRaster
+  /// @return vector<int> with source nodes, in the order of the junction list
+  vector<int> GetSourceNodesChiMethodAllPixels(vector<int> JunctionNumbers,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster);
+
+  /// @brief This classifies all the pixels upstream of a junction as channel or
+  /// hillslope using chi profiles. It is used by GetChannelHeadsChiMethodAllPixels
+  /// and GetSourceNodesChiMethodAllPixels.
+  /// @details It only writes to its arguments so it can be run on several
+  /// junctions at once.
+  /// @param JunctionNumber
+  /// @param A_0
+  /// @param m_over_n
+  /// @param bin_width
+  /// @param FlowInfo Flow Info object
+  /// @param ElevationRaster
+  /// @param print_profiles if true the binned chi profiles are printed to text files
+  /// @param upslope_nodes replaced with the nodes upstream of the junction
+  /// @param is_channel replaced with 1 for channel nodes and 0 for hillslope nodes
+  /// @author FC
+  /// @date 01/10/13
+  void classify_upslope_pixels_chi_method(int JunctionNumber,
+                                      float A_0, float m_over_n, float bin_width, LSDFlowInfo& FlowInfo,
+                                      LSDRaster& ElevationRaster, bool print_profiles,
+                                      vector<int>& upslope_nodes, vector<int>& is_channel);
+
+  /// @brief This gets the nodes of the channel used by the DrEICH algorithm for
+  /// a source node, running from the farthest upslope hilltop to the nth junction
+  /// downstream.
+  /// @param NodeNumber the valley source node
+  /// @param A_0
+  /// @param m_over_n
+  /// @param FlowInfo
+  /// @param FlowDistance
+  /// @param ElevationRaster
+  /// @param NJunctions number of downstream junctions to run the channel to
+  /// @return vector of the node indices in the channel
+  vector<int> get_nodes_of_Dreich_channel(int NodeNumber, float A_0, float m_over_n,
+                                      LSDFlowInfo& FlowInfo, LSDRaster& FlowDistance,
+                                      LSDRaster& ElevationRaster, int NJunctions);
+
+  /// @brief This removes any node in a list that has another node of the list
+  /// upstream of it, leaving the farthest upstream nodes.
+  /// @details The order of the list is preserved. The nodes are tested in parallel.
+  /// @param nodes the list of nodes
+  /// @param FlowInfo
+  /// @return the nodes that have no other nodes upstream
+  vector<int> keep_farthest_upstream_nodes(vector<int>& nodes, LSDFlowInfo& FlowInfo);
+
   // channel head identification
   /// @brief This function is used to predict channel head locations based on the method proposed by Pelletier (2013).
   ///
@@ -1091,6 +1173,27 @@ vector<int> GetChannelHeadsChiMethodFromValleys(vector<int> ValleyNodes,
   vector<int> identify_upstream_limits(LSDFlowInfo& FlowInfo, Array2D<float>& topography,
                   vector<int> source_row_vec,vector<int> source_col_vec, Array2D<float>& tan_curv);
 
+  /// @brief Pelletier (2013) channel heads computed tile by tile.
+  ///
+  /// @detail Gives the same sources, in the same order, as
+  /// calculate_pelletier_channel_heads_DTM but the tangential curvature is
+  /// computed for one tile at a time and only two bits per pixel are kept, so
+  /// no full size curvature rasters are needed. The downslope routing of
+  /// identify_upstream_limits is replaced by a flood from the possible sources
+  /// that is done in parallel over the tiles, exchanging tile borders until
+  /// nothing changes.
+  /// @param FlowInfo object
+  /// @param FilteredTopo the (wiener filtered) DEM used for the surface fitting
+  /// @param topography elevation data used for routing (usually the filled DEM)
+  /// @param window_radius radius of the surface fitting window
+  /// @param window_radius_LW radius of the long wavelength surface fitting window
+  /// @param tan_curv_threshold threshold value of tangential curvature
+  /// @param tile_size the side of the tiles in pixels
+  /// @return vector of source node indices
+  vector<int> calculate_pelletier_channel_heads_tiled(LSDFlowInfo& FlowInfo, LSDRaster& FilteredTopo,
+                  Array2D<float>& topography, float window_radius, float window_radius_LW,
+                  float tan_curv_threshold, int tile_size);
+
   /// @brief This function is used to identify concave portions of the landscape using a tangential curvature threshold.
   ///
   /// @details It defines the threshold based on a multiple of the standard deviation
@@ -86,6 +86,7 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include <time.h>
 #include "TNT/tnt.h"
 #include "LSDStatsTools.hpp"
@@ -132,6 +133,9 @@ void LSDMostLikelyPartitionsFinder::reset_derived_data_members()
   vector<float> empty_dv;
   MLE_of_segments = empty_dv;
 
+  vector<double> empty_RSS;
+  RSS_of_segments = empty_RSS;
+
   vector< vector<int> > vv_int;
   segments_for_each_n_segments = vv_int;
 
@@ -142,9 +146,16 @@ void LSDMostLikelyPartitionsFinder::reset_derived_data_members()
   best_fit_AIC = empty_vec;
   best_fit_AICc = empty_vec;
 
-  vector< vector<float> > empty_vecvec;
+  vector< vector<double> > empty_vecvec;
   AIC_for_each_n_segments= empty_vecvec;
   AICc_for_each_n_segments = empty_vecvec;
+
+  vector<double> empty_dbl;
+  cumulative_x = empty_dbl;
+  cumulative_y = empty_dbl;
+  cumulative_xx = empty_dbl;
+  cumulative_xy = empty_dbl;
+  cumulative_yy = empty_dbl;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -465,15 +476,14 @@ LSDMostLikelyPartitionsFinder LSDMostLikelyPartitionsFinder::spawn_thinned_data_
 // SMM 01/02/2013
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_skip(int Mean_skip,int skip_range, vector<int>& node_ref)
+void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_skip(int Mean_skip,int skip_range, vector<int>& node_ref, RandomStream& rng)
 {
 
 
 
   int minimum_skip = Mean_skip - 0.5*skip_range;
-  long seed = time(NULL);
 
-  int N = int((float(skip_range))*(ran3(&seed))+0.5)+minimum_skip;
+  int N = int((float(skip_range))*(rng.uniform())+0.5)+minimum_skip;
   vector<float> thinned_x;
   vector<float> thinned_y;
   vector<int> node_reference;
@@ -534,7 +544,7 @@ void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_skip(int Mean_skip,int
 
     if (new_N_switch == 1)
     {
-      float random_N = ran3(&seed);
+      float random_N = rng.uniform();
       float skippy = (float(skip_range));
       N = int(skippy*(random_N)+0.5)+minimum_skip;
       //cout << "N is: " << N << " and random: " << random_N << " and skppy: " << skippy
@@ -585,7 +595,7 @@ void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_skip(int Mean_skip,int
 // SMM 01/02/2013
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_dchi(float mean_dchi, float variation_dchi, vector<int>& node_ref)
+void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_dchi(float mean_dchi, float variation_dchi, vector<int>& node_ref, RandomStream& rng)
 {
 
   //cout << "LSDMostLikelyPartitionsFinder, LINE 391, mean dchi: " << mean_dchi << endl;
@@ -604,10 +614,9 @@ void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_dchi(float mean_dchi,
   float min_dchi = mean_dchi-variation_dchi;
   float range_chi = 2*variation_dchi;
 
-  long seed = time(NULL);
 
   // get dx using a random seed
-  float dx = ran3(&seed)*range_chi+min_dchi;
+  float dx = rng.uniform()*range_chi+min_dchi;
 
   thinned_x.push_back(x_data[0]);
   thinned_y.push_back(y_data[0]);
@@ -628,7 +637,7 @@ void LSDMostLikelyPartitionsFinder::thin_data_monte_carlo_dchi(float mean_dchi,
       thinned_y.push_back(y_data[i]);
       node_reference.push_back(i);
 
-      dx = ran3(&seed)*range_chi+min_dchi;
+      dx = rng.uniform()*range_chi+min_dchi;
       next_x += dx;
       last_picked = i;
     }
@@ -676,12 +685,11 @@ void LSDMostLikelyPartitionsFinder::print_x_y_data_to_screen()
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDMostLikelyPartitionsFinder::best_fit_driver_AIC_for_linear_segments(vector<float> sigma_values)
 {
-  //cout << "best_fit_driver_AIC_for_linear_segments, getting like data" <<endl;
-  calculate_segment_matrices(base_sigma);
-  //cout << "best_fit_driver_AIC_for_linear_segments, got like data" <<endl;
+  // get the sums used to calculate the RSS of the segments
+  calculate_segment_cost_sums();
 
   // get the maximum liklihood of segments
-  find_max_like_of_segments();
+  find_max_like_of_segments_DP();
 
   get_n_segments_for_various_sigma(sigma_values);
 
@@ -698,12 +706,11 @@ void LSDMostLikelyPartitionsFinder::best_fit_driver_AIC_for_linear_segments(vect
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDMostLikelyPartitionsFinder::best_fit_driver_AIC_for_linear_segments(float sigma)
 {
-  //cout << "best_fit_driver_AIC_for_linear_segments, getting like data" <<endl;
-  calculate_segment_matrices(base_sigma);
-  //cout << "best_fit_driver_AIC_for_linear_segments, got like data" <<endl;
+  // get the sums used to calculate the RSS of the segments
+  calculate_segment_cost_sums();
 
   // get the maximum liklihood of segments
-  find_max_like_of_segments();
+  find_max_like_of_segments_DP();
 
   vector<float> sigma_values;
   sigma_values.push_back(sigma);
@@ -764,8 +771,8 @@ void LSDMostLikelyPartitionsFinder::get_data_from_best_fit_lines(int node, vecto
   vector<float> new_sig_MLE = transform_like_from_sigma1_to_sigma2(base_sigma,
                   MLE_of_segments, sigma_values[n_sigma_for_printing]);
 
-  vector<float> AICc_values = AICc_for_each_n_segments[node];
-  float AICc_value = AICc_values[ best_fit_AICc[n_sigma_for_printing] ];
+  vector<double> AICc_values = AICc_for_each_n_segments[node];
+  float AICc_value = float(AICc_values[ best_fit_AICc[n_sigma_for_printing] ]);
 
   // now print this data
   //cout << endl << endl << endl << "The data from the best fit: " << endl;
@@ -800,8 +807,8 @@ void LSDMostLikelyPartitionsFinder::get_data_from_best_fit_lines(int node, vecto
   this_n_segments =  best_fit_AICc[n_sigma_for_printing]+1;
   this_n_nodes = n_nodes;
   this_AICc = AICc_value;
-  vector<float> AIC_values = AIC_for_each_n_segments[node];
-  this_AIC =  AICc_values[ best_fit_AICc[n_sigma_for_printing] ];
+  vector<double> AIC_values = AIC_for_each_n_segments[node];
+  this_AIC =  float(AICc_values[ best_fit_AICc[n_sigma_for_printing] ]);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -1066,6 +1073,407 @@ void LSDMostLikelyPartitionsFinder::find_max_like_of_segments()
   segments_for_each_n_segments = most_likely_segments;
   MLE_of_segments = MLE_for_segments;
 
+  // the residuals of the most likely segments, for the AIC
+  vector<double> RSS_for_segments(max_n_segments,numeric_limits<double>::infinity());
+  for (int n_elem = 0; n_elem< max_n_segments; n_elem++)
+  {
+    if (not most_likely_segments[n_elem].empty())
+    {
+      RSS_for_segments[n_elem] = calculate_RSS_of_partition(most_likely_segments[n_elem]);
+    }
+  }
+  RSS_of_segments = RSS_for_segments;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This calculates the cumulative sums of the x and y data that are used to get
+// the residual sum of squares of any segment in constant time.
+// The data are shifted by the first data point to avoid loss of precision
+// when the sums are differenced.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDMostLikelyPartitionsFinder::calculate_segment_cost_sums()
+{
+  int n_data_points = x_data.size();
+  vector<double> empty_vec(n_data_points+1,0.0);
+  cumulative_x = empty_vec;
+  cumulative_y = empty_vec;
+  cumulative_xx = empty_vec;
+  cumulative_xy = empty_vec;
+  cumulative_yy = empty_vec;
+
+  if (n_data_points == 0)
+  {
+    return;
+  }
+
+  double x0 = x_data[0];
+  double y0 = y_data[0];
+  double x,y;
+  for (int i = 0; i<n_data_points; i++)
+  {
+    x = double(x_data[i])-x0;
+    y = double(y_data[i])-y0;
+    cumulative_x[i+1] = cumulative_x[i]+x;
+    cumulative_y[i+1] = cumulative_y[i]+y;
+    cumulative_xx[i+1] = cumulative_xx[i]+x*x;
+    cumulative_xy[i+1] = cumulative_xy[i]+x*y;
+    cumulative_yy[i+1] = cumulative_yy[i]+y*y;
+  }
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This gets the residual sum of squares of the least squares line through
+// the nodes start_node to end_node (inclusive). You need to run
+// calculate_segment_cost_sums first.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+double LSDMostLikelyPartitionsFinder::segment_RSS(int start_node, int end_node)
+{
+  double n = double(end_node-start_node+1);
+  double Sx = cumulative_x[end_node+1]-cumulative_x[start_node];
+  double Sy = cumulative_y[end_node+1]-cumulative_y[start_node];
+  double Sxx = cumulative_xx[end_node+1]-cumulative_xx[start_node]-Sx*Sx/n;
+  double Sxy = cumulative_xy[end_node+1]-cumulative_xy[start_node]-Sx*Sy/n;
+  double Syy = cumulative_yy[end_node+1]-cumulative_yy[start_node]-Sy*Sy/n;
+
+  double RSS = Syy;
+  if (Sxx > 0)
+  {
+    RSS = Syy-Sxy*Sxy/Sxx;
+  }
+  if (RSS < 0)
+  {
+    RSS = 0;
+  }
+  return RSS;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This gets the likelihood of a partition, calculated at the base sigma, in
+// exactly the same way as the like_array: it is the product of the
+// likelihoods of the regressions of each segment.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+float LSDMostLikelyPartitionsFinder::calculate_MLE_of_partition(vector<int>& segment_lengths)
+{
+  vector<float> segment_x;
+  vector<float> segment_y;
+  vector<float> residuals;
+  float this_MLE = 1;
+  int start_node = 0;
+  int n_segments = segment_lengths.size();
+  for (int i = 0; i<n_segments; i++)
+  {
+    segment_x.assign(x_data.begin()+start_node,x_data.begin()+start_node+segment_lengths[i]);
+    segment_y.assign(y_data.begin()+start_node,y_data.begin()+start_node+segment_lengths[i]);
+    simple_linear_regression(segment_x, segment_y, residuals);
+    this_MLE = this_MLE*calculate_MLE_from_residuals(residuals, base_sigma);
+    start_node += segment_lengths[i];
+  }
+  return this_MLE;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This gets the residual sum of squares of a partition from the same
+// regressions as calculate_MLE_of_partition. The likelihood of long profiles
+// underflows a float, but -2 log of it is simply RSS/sigma^2, so the AIC is
+// calculated from this instead.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+double LSDMostLikelyPartitionsFinder::calculate_RSS_of_partition(vector<int>& segment_lengths)
+{
+  vector<float> segment_x;
+  vector<float> segment_y;
+  vector<float> residuals;
+  double RSS = 0;
+  int start_node = 0;
+  int n_segments = segment_lengths.size();
+  for (int i = 0; i<n_segments; i++)
+  {
+    segment_x.assign(x_data.begin()+start_node,x_data.begin()+start_node+segment_lengths[i]);
+    segment_y.assign(y_data.begin()+start_node,y_data.begin()+start_node+segment_lengths[i]);
+    simple_linear_regression(segment_x, segment_y, residuals);
+    int n_residuals = residuals.size();
+    for (int r = 0; r<n_residuals; r++)
+    {
+      RSS += double(residuals[r])*double(residuals[r]);
+    }
+    start_node += segment_lengths[i];
+  }
+  return RSS;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This does the same job as find_max_like_of_segments but uses dynamic
+// programming rather than testing every permutation of every partition.
+//
+// The likelihood of a set of segments is exp(-RSS/(2 sigma^2)), where RSS is
+// the total residual sum of squares, so the most likely segments for a given
+// number of segments are those with the smallest RSS. For each number of
+// segments k the smallest RSS of the first j nodes is
+//   D(k,j) = min over i of D(k-1,i) + RSS(i,j-1)
+// where every segment has at least minimum_segment_length nodes. Each layer
+// only needs the layer before it. The start node of the last segment is kept
+// so that the segments can be traced back, but only for the j that k+1
+// segments can reach, so layer k holds n-(k+1)L+1 start nodes.
+//
+// This takes O(k n^2) time rather than the exponential time of the
+// permutations, and does not need the like_array.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDMostLikelyPartitionsFinder::find_max_like_of_segments_DP()
+{
+  int n_data_points = x_data.size();
+  if (minimum_segment_length>n_data_points)
+  {
+    minimum_segment_length = n_data_points;
+  }
+  if (int(cumulative_x.size()) != n_data_points+1)
+  {
+    calculate_segment_cost_sums();
+  }
+  int L = minimum_segment_length;
+  int max_n_segments = n_data_points/L;
+  double huge = 1e300;
+
+  vector<double> last_layer(n_data_points+1,huge);
+  vector<double> this_layer(n_data_points+1,huge);
+  // last_segment_start[k][j-(k+1)*L] is the start of the last segment of the
+  // best k+1 segments of the first j nodes
+  vector< vector<int> > last_segment_start(max_n_segments);
+
+  // one segment
+  last_segment_start[0].assign(n_data_points-L+1,0);
+  for (int j = L; j<=n_data_points; j++)
+  {
+    last_layer[j] = segment_RSS(0,j-1);
+  }
+
+  // now add segments
+  for (int k = 1; k<max_n_segments; k++)
+  {
+    for (int j = 0; j<=n_data_points; j++)
+    {
+      this_layer[j] = huge;
+    }
+    int first_end = (k+1)*L;
+    last_segment_start[k].assign(n_data_points-first_end+1,-1);
+    for (int j = first_end; j<=n_data_points; j++)
+    {
+      double best = huge;
+      int best_start = -1;
+      for (int i = k*L; i<=j-L; i++)
+      {
+        if (last_layer[i] < huge)
+        {
+          double this_RSS = last_layer[i]+segment_RSS(i,j-1);
+          if (this_RSS < best)
+          {
+            best = this_RSS;
+            best_start = i;
+          }
+        }
+      }
+      this_layer[j] = best;
+      last_segment_start[k][j-first_end] = best_start;
+    }
+    last_layer.swap(this_layer);
+  }
+
+  // trace back the segments for each number of segments
+  vector<float> MLE_for_segments(max_n_segments,-0.00000000001);
+  vector<double> RSS_for_segments(max_n_segments);
+  vector< vector <int> > most_likely_segments(max_n_segments);
+  for (int k = 0; k<max_n_segments; k++)
+  {
+    vector<int> segment_lengths(k+1);
+    int end = n_data_points;
+    for (int seg = k; seg>=0; seg--)
+    {
+      int start = last_segment_start[seg][end-(seg+1)*L];
+      segment_lengths[seg] = end-start;
+      end = start;
+    }
+    most_likely_segments[k] = segment_lengths;
+    MLE_for_segments[k] = calculate_MLE_of_partition(segment_lengths);
+    RSS_for_segments[k] = calculate_RSS_of_partition(segment_lengths);
+  }
+  segments_for_each_n_segments = most_likely_segments;
+  MLE_of_segments = MLE_for_segments;
+  RSS_of_segments = RSS_for_segments;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This finds the segments that minimise the total RSS plus a penalty for
+// each segment (optimal partitioning). With a penalty of 4 sigma^2 this is
+// the same as minimising the AIC, since AIC = 4k + RSS/sigma^2.
+//
+// F(t) = min over i of F(i) + RSS(i,t-1) + penalty
+//
+// Only O(n) memory is used. If use_pruning is true then start nodes that
+// can never be optimal again are dropped as in PELT (Killick et al., 2012,
+// JASA 107: 1590-1598). This is exact because splitting a segment never
+// increases the RSS. A start node i that fails the test at t is only dropped
+// once t+minimum_segment_length nodes are reached, since the start node t
+// that beats it cannot be used before then. For typical profiles this makes
+// the search close to O(n).
+//
+// The function returns the total RSS and replaces segment_lengths.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+double LSDMostLikelyPartitionsFinder::optimal_partition_for_penalty(double penalty, bool use_pruning,
+                                      vector<int>& segment_lengths)
+{
+  int n_data_points = x_data.size();
+  if (minimum_segment_length>n_data_points)
+  {
+    minimum_segment_length = n_data_points;
+  }
+  if (int(cumulative_x.size()) != n_data_points+1)
+  {
+    calculate_segment_cost_sums();
+  }
+  int L = minimum_segment_length;
+  double huge = 1e300;
+
+  vector<double> F(n_data_points+1,huge);
+  vector<double> total_RSS(n_data_points+1,0.0);
+  vector<int> last_start(n_data_points+1,-1);
+  vector<int> fails_at(n_data_points+1,-1);
+  vector<int> candidates;
+  F[0] = 0;
+
+  for (int t = L; t<=n_data_points; t++)
+  {
+    // the start node t-L can now end a segment at t
+    if (F[t-L] < huge)
+    {
+      candidates.push_back(t-L);
+    }
+
+    // drop the candidates that can no longer be optimal
+    if (use_pruning)
+    {
+      int n_kept = 0;
+      for (int c = 0; c<int(candidates.size()); c++)
+      {
+        int i = candidates[c];
+        if (fails_at[i] < 0 || t < fails_at[i]+L)
+        {
+          candidates[n_kept] = i;
+          n_kept++;
+        }
+      }
+      candidates.resize(n_kept);
+    }
+
+    double best = huge;
+    int best_start = -1;
+    double best_RSS = 0;
+    for (int c = 0; c<int(candidates.size()); c++)
+    {
+      int i = candidates[c];
+      double this_RSS = segment_RSS(i,t-1);
+      double this_F = F[i]+this_RSS+penalty;
+      if (this_F < best)
+      {
+        best = this_F;
+        best_start = i;
+        best_RSS = total_RSS[i]+this_RSS;
+      }
+    }
+    F[t] = best;
+    last_start[t] = best_start;
+    total_RSS[t] = best_RSS;
+
+    if (use_pruning && best < huge)
+    {
+      for (int c = 0; c<int(candidates.size()); c++)
+      {
+        int i = candidates[c];
+        if (fails_at[i] < 0 && F[i]+segment_RSS(i,t-1) > F[t])
+        {
+          fails_at[i] = t;
+        }
+      }
+    }
+  }
+
+  // trace back the segments
+  vector<int> reversed_lengths;
+  int end = n_data_points;
+  while (end > 0)
+  {
+    int start = last_start[end];
+    reversed_lengths.push_back(end-start);
+    end = start;
+  }
+  segment_lengths.assign(reversed_lengths.rbegin(),reversed_lengths.rend());
+
+  return total_RSS[n_data_points];
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// This is a driver function like best_fit_driver_AIC_for_linear_segments
+// but it is meant for long channels that are fitted without thinning.
+// For each sigma the segments that minimise the AIC are found directly with
+// optimal_partition_for_penalty, so memory is O(n) and, with pruning,
+// the time is close to O(n). The likelihoods of the segments that were found
+// are stored by number of segments so that the rest of the object
+// (AIC, AICc, get_data_from_best_fit_lines) works as before.
+// The best fit by AIC for each sigma is exact. The AICc is compared among the
+// segments found for the sigma values, plus a single segment.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+void LSDMostLikelyPartitionsFinder::best_fit_driver_AIC_for_linear_segments_penalised(vector<float> sigma_values,
+                                      bool use_pruning)
+{
+  int n_data_points = x_data.size();
+  if (minimum_segment_length>n_data_points)
+  {
+    minimum_segment_length = n_data_points;
+  }
+  calculate_segment_cost_sums();
+
+  // numbers of segments that are not found have a likelihood of zero and
+  // an infinite RSS, so they never have the smallest AIC
+  int max_n_segments = n_data_points/minimum_segment_length;
+  vector<float> MLE_for_segments(max_n_segments,0.0);
+  vector<double> RSS_for_segments(max_n_segments,numeric_limits<double>::infinity());
+  vector< vector <int> > most_likely_segments(max_n_segments);
+
+  // a single segment is always available
+  vector<int> segment_lengths(1,n_data_points);
+  most_likely_segments[0] = segment_lengths;
+  MLE_for_segments[0] = calculate_MLE_of_partition(segment_lengths);
+  RSS_for_segments[0] = calculate_RSS_of_partition(segment_lengths);
+
+  int n_sigma = sigma_values.size();
+  for (int i = 0; i< n_sigma; i++)
+  {
+    double penalty = 4.0*double(sigma_values[i])*double(sigma_values[i]);
+    optimal_partition_for_penalty(penalty, use_pruning, segment_lengths);
+    int n_segs = segment_lengths.size();
+    if (most_likely_segments[n_segs-1].empty())
+    {
+      most_likely_segments[n_segs-1] = segment_lengths;
+      MLE_for_segments[n_segs-1] = calculate_MLE_of_partition(segment_lengths);
+      RSS_for_segments[n_segs-1] = calculate_RSS_of_partition(segment_lengths);
+    }
+  }
+  segments_for_each_n_segments = most_likely_segments;
+  MLE_of_segments = MLE_for_segments;
+  RSS_of_segments = RSS_for_segments;
+
+  get_n_segments_for_various_sigma(sigma_values);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -1308,7 +1716,7 @@ vector<float> LSDMostLikelyPartitionsFinder::transform_like_from_sigma1_to_sigma
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-// this function takes the normalized MLE values (normalized with sigma = 1) and returns the
+// this function takes the residual sum of squares of the most likely segments and returns the
 // best fit number of segments from both the AIC and the AICc measures. It also returns
 // two vector of vectors which are the AIC values for the various values of sigma
 // passed to the function in the sigma values vector
@@ -1319,11 +1727,10 @@ vector<float> LSDMostLikelyPartitionsFinder::transform_like_from_sigma1_to_sigma
 void LSDMostLikelyPartitionsFinder::get_n_segments_for_various_sigma(vector<float> sigma_values)
 {
   int n_sigma = sigma_values.size();
-  vector<float> empty_vec;
-  vector<float> AIC_of_segments;
-  vector<float> AICc_of_segments;
-  vector< vector<float> > AIC_for_each(n_sigma);
-  vector< vector<float> > AICc_for_each(n_sigma);
+  vector<double> AIC_of_segments;
+  vector<double> AICc_of_segments;
+  vector< vector<double> > AIC_for_each(n_sigma);
+  vector< vector<double> > AICc_for_each(n_sigma);
   vector<int> bf_AIC(n_sigma);
   vector<int> bf_AICc(n_sigma);
 
@@ -1337,23 +1744,18 @@ void LSDMostLikelyPartitionsFinder::get_n_segments_for_various_sigma(vector<floa
     AICc_for_each[i] = AICc_of_segments;
 
     // now find the minimum AIC and AICc
-    float minimum_AIC = 10000;
     int min_AIC_segments = 0;
-    float minimum_AICc = 10000;
     int min_AICc_segments = 0;
-
     int n_AIC = AIC_of_segments.size();
-    for (int n_seg = 0; n_seg<n_AIC; n_seg++)
+    for (int n_seg = 1; n_seg<n_AIC; n_seg++)
     {
-      if(AIC_of_segments[n_seg] < minimum_AIC)
+      if(AIC_of_segments[n_seg] < AIC_of_segments[min_AIC_segments])
       {
-        minimum_AIC = AIC_of_segments[n_seg];
         min_AIC_segments = n_seg;
       }
 
-      if(AICc_of_segments[n_seg] < minimum_AICc)
+      if(AICc_of_segments[n_seg] < AICc_of_segments[min_AICc_segments])
       {
-        minimum_AICc = AICc_of_segments[n_seg];
         min_AICc_segments = n_seg;
       }
     }
@@ -1372,45 +1774,32 @@ void LSDMostLikelyPartitionsFinder::get_n_segments_for_various_sigma(vector<floa
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-// this function calculates AIC and AICc of segments taking the maximum_MLE based on a sigma of one
+// this function calculates AIC and AICc of segments for a given sigma, from the residual
+// sum of squares of the most likely segments
 //
 // SMM 01/02/2013
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDMostLikelyPartitionsFinder::calculate_AIC_of_segments_with_variable_sigma(float sigma,
-                vector<float>& AIC_of_segments,vector<float>& AICc_of_segments)
+                vector<double>& AIC_of_segments,vector<double>& AICc_of_segments)
 {
-
-  // recast the MLE_vector
-  vector<float> new_sig_MLE = transform_like_from_sigma1_to_sigma2(base_sigma, MLE_of_segments, sigma);
+  // -2 log of the likelihood is RSS/sigma^2. This is calculated from the RSS
+  // since the likelihood itself underflows on long profiles
+  double sigsquared = double(sigma)*double(sigma);
+  double AICn = double(x_data.size());        // this is the number of data elements
 
   // initialize the vector holding the Aikake Information Criterion
   // and then calcualte the AIC and the AICc
-  vector<float> AIC(MLE_of_segments.size(),0.0);
-  vector<float> AICc(MLE_of_segments.size(),0.0);
-  for (int n_elem = 0; n_elem< int(MLE_of_segments.size()); n_elem++)
+  int n_segment_numbers = RSS_of_segments.size();
+  vector<double> AIC(n_segment_numbers,0.0);
+  vector<double> AICc(n_segment_numbers,0.0);
+  for (int n_elem = 0; n_elem< n_segment_numbers; n_elem++)
   {
-    float AICk = (float(n_elem)+1);           // this is the number of segments
-    float AICn = float(x_data.size());        // this is the number of data elements
-    // if the MLE is 0 or less, this will throw an error. This only happens if the fit
-    // is terrible so in this case set AIC and AICc to a large positive number
-    if(new_sig_MLE[n_elem]<= 0)
-    {
-      AIC[n_elem] = 9999;
-      AICc[n_elem] = 9999;
-    }
-    else
-    {
-      //cout << "n_segs: " << n_elem+1
-      //   << " MLE: " <<  new_sig_MLE[n_elem] << " log: "
-      //   << log( new_sig_MLE[n_elem]) << " 2nd term: "
-      //   << -2*log( new_sig_MLE[n_elem]) << endl;
-      AIC[n_elem] = 4*AICk-2*log( new_sig_MLE[n_elem]);    // the 4 comes from the fact that
-                                                             // for each segment there are 2 parameters
-      AICc[n_elem] = AIC[n_elem] + 2*AICk*(AICk+1)/(AICn-AICk-1);
-    }
+    double AICk = double(n_elem)+1;           // this is the number of segments
+    AIC[n_elem] = 4*AICk+RSS_of_segments[n_elem]/sigsquared;  // the 4 comes from the fact that
+                                                               // for each segment there are 2 parameters
+    AICc[n_elem] = AIC[n_elem] + 2*AICk*(AICk+1)/(AICn-AICk-1);
     //cout << "AIC: " << AIC[n_elem] << " and AICc: " << AICc[n_elem] << endl << endl;
-
   }
   AIC_of_segments = AIC;
   AICc_of_segments = AICc;
@@ -1450,6 +1839,34 @@ void LSDMostLikelyPartitionsFinder::get_properties_of_best_fit_segments(int best
   //cout << "Line 1263 segments_for_each_n_segments.size(): "  << segments_for_each_n_segments.size() << endl;
   //cout << "individual_partition.size(): " << individual_partition.size() << endl;
 
+  // if the segment matrices have not been calculated the regressions are
+  // done on the segments directly
+  if (m_array.dim1() == 0)
+  {
+    vector<float> segment_x;
+    vector<float> segment_y;
+    vector<float> residuals;
+    vector<float> regression_results;
+    start_node = 0;
+    for (int i = 0; i<n_segments; i++)
+    {
+      end_node = start_node+individual_partition[i]-1;
+      segment_x.assign(x_data.begin()+start_node,x_data.begin()+end_node+1);
+      segment_y.assign(y_data.begin()+start_node,y_data.begin()+end_node+1);
+      regression_results = simple_linear_regression(segment_x, segment_y, residuals);
+      m[i] = regression_results[0];
+      b[i] = regression_results[1];
+      r2[i] = regression_results[2];
+      DW[i] = regression_results[3];
+      start_node = end_node+1;
+    }
+    m_values = m;
+    b_values = b;
+    r2_values = r2;
+    DW_values = DW;
+    return;
+  }
+
   // now loop through the segments
   start_node = 0;
   for (int i = 0; i<n_segments; i++)
@@ -1518,7 +1935,7 @@ void LSDMostLikelyPartitionsFinder::print_AIC_and_AICc_to_screen(vector<float> s
 {
   // get the number of sigma values
   int n_sigs = sigma_values.size();
-  vector<float> AI_values;
+  vector<double> AI_values;
   vector<int> this_minimum;
   int AI_sz;
   int n_mins;
@@ -156,17 +156,19 @@ class LSDMostLikelyPartitionsFinder
     /// @param Mean_skip
     /// @param skip_range
     /// @param node_ref An index vector of the data points that were selected.
+    /// @param rng The random stream the skips are drawn from.
     /// @author SMM
         /// @date 01/05/13
-    void thin_data_monte_carlo_skip(int Mean_skip,int skip_range, vector<int>& node_ref);
+    void thin_data_monte_carlo_skip(int Mean_skip,int skip_range, vector<int>& node_ref, RandomStream& rng);
 
     /// @brief Thins object based on a monte carlo approach using a mean, max and minimum dchi.
     /// @param mean_dchi
     /// @param variation_dchi
     /// @param node_ref An index vector of the data points that were selected.
+    /// @param rng The random stream the spacings are drawn from.
     /// @author SMM
     /// @date 01/03/13
-    void thin_data_monte_carlo_dchi(float mean_dchi, float variation_dchi, vector<int>& node_ref);
+    void thin_data_monte_carlo_dchi(float mean_dchi, float variation_dchi, vector<int>& node_ref, RandomStream& rng);
 
     /// @brief Function for looking at the x and y data.
     /// @author SMM
@@ -270,6 +272,63 @@ class LSDMostLikelyPartitionsFinder
     /// @date 01/03/13
     void find_max_like_of_segments();
 
+    /// @brief Calculates the cumulative sums of the data used to get the residual
+    /// sum of squares of any segment in constant time.
+    void calculate_segment_cost_sums();
+
+    /// @brief Gets the residual sum of squares of a linear regression through
+    /// a segment. calculate_segment_cost_sums must be called first.
+    /// @param start_node The first node of the segment.
+    /// @param end_node The last node of the segment (inclusive).
+    /// @return The residual sum of squares.
+    double segment_RSS(int start_node, int end_node);
+
+    /// @brief Gets the likelihood (at the base sigma) of a set of segments. This
+    /// is the product of the likelihoods of each segment's regression.
+    /// @param segment_lengths The lengths of the segments, from the first node.
+    /// @return The likelihood of the segments.
+    float calculate_MLE_of_partition(vector<int>& segment_lengths);
+
+    /// @brief Gets the total residual sum of squares of the regressions of a
+    /// set of segments, summed in double precision.
+    /// @param segment_lengths The lengths of the segments, from the first node.
+    /// @return The residual sum of squares of the segments.
+    double calculate_RSS_of_partition(vector<int>& segment_lengths);
+
+    /// @brief Gets the most likely segments for each number of segments using
+    /// dynamic programming.
+    ///
+    /// @details Gives the same result as find_max_like_of_segments but in
+    /// O(k n^2) time rather than by testing every permutation of every
+    /// partition, and without the like_array.
+    void find_max_like_of_segments_DP();
+
+    /// @brief Finds the segments that minimise the total residual sum of squares
+    /// plus a penalty for each segment.
+    ///
+    /// @details With a penalty of 4 sigma^2 this minimises the AIC. Uses O(n)
+    /// memory. If use_pruning is true, start nodes that can no longer be optimal
+    /// are dropped (PELT, Killick et al. 2012), which is still exact and makes
+    /// the search close to O(n) for typical profiles.
+    /// @param penalty The penalty for each segment.
+    /// @param use_pruning If true, use PELT pruning.
+    /// @param segment_lengths Replaced with the lengths of the segments.
+    /// @return The total residual sum of squares of the segments.
+    double optimal_partition_for_penalty(double penalty, bool use_pruning,
+                                         vector<int>& segment_lengths);
+
+    /// @brief Driver function to get best fit segments of long profiles that
+    /// have not been thinned.
+    ///
+    /// @details For each sigma the segments with the minimum AIC are found with
+    /// optimal_partition_for_penalty. The results are stored in the same data
+    /// members as best_fit_driver_AIC_for_linear_segments. The AICc is compared
+    /// among the segments found for the sigma values and a single segment.
+    /// @param sigma_values vector<float> the sigma values
+    /// @param use_pruning If true, use PELT pruning.
+    void best_fit_driver_AIC_for_linear_segments_penalised(vector<float> sigma_values,
+                                                           bool use_pruning);
+
     /// @brief This function drives the partitioning algorithms.
     /// @param k Number of elements in the partition.
         /// @author SMM
@@ -362,21 +421,25 @@ class LSDMostLikelyPartitionsFinder
     // can vary depending on sigma, which we don't know. Therefore, we include this function to scan for best fits across
     // different values fo sigma
 
-    /// @brief Function takes the normalized MLE values (normalized with sigma = 1) and returns the best fit number of segments from both the AIC and the AICc measures.
+    /// @brief Function takes the residual sum of squares of the most likely segments and returns the best fit number of segments from both the AIC and the AICc measures.
     ///
     /// @details It also returns two vector of vectors which are the AIC values for the varius values of sigma passed to the function in the sigma values vector.
     /// @param sigma_values vector of sigma values.
     void get_n_segments_for_various_sigma(vector<float> sigma_values);
 
-    /// @brief Function calculates AIC and AICc of segments taking the maximum_MLE based on a sigma of one.
+    /// @brief Function calculates AIC and AICc of segments for a given sigma.
+    ///
+    /// @details The log likelihood is taken from the residual sum of squares,
+    /// so AIC = RSS/sigma^2 + 4k, in double precision. Numbers of segments
+    /// that were not found have an infinite AIC and AICc.
     /// @param sigma Standard deviation of error.
     /// @param AIC_of_segments
     /// @param AICc_of_segments
      /// @author SMM
     /// @date 01/03/13
     void calculate_AIC_of_segments_with_variable_sigma(float sigma,
-                    vector<float>& AIC_of_segments,
-                    vector<float>& AICc_of_segments);
+                    vector<double>& AIC_of_segments,
+                    vector<double>& AICc_of_segments);
 
     /// @brief Function extracts the m, b, r^2 and DW statistic of the most likeley segments.
     /// @param bestfit_segments_node
@@ -431,6 +494,12 @@ class LSDMostLikelyPartitionsFinder
     /// Maximum likelihood of the different number of segments.
     vector<float> MLE_of_segments;
 
+    /// @brief Residual sum of squares of the most likely segments for each
+    /// number of segments.
+    ///
+    /// @details This is infinite for numbers of segments that were not found.
+    vector<double> RSS_of_segments;
+
     /// @brief Each element of this vector contains the most likeley segments for that number of segments.
     ///
     /// @details So for example segments_for_each_n_segments[3] is a vector containing the lengths of the most likeley
@@ -444,14 +513,26 @@ class LSDMostLikelyPartitionsFinder
     /// is the individual segment lengths.
     vector< vector < vector<int> > > partitions;
 
+    /// @brief Cumulative sums of the x and y data (shifted by the first data point)
+    /// used to get the residual sum of squares of segments.
+    vector<double> cumulative_x;
+    /// Cumulative sum of y.
+    vector<double> cumulative_y;
+    /// Cumulative sum of x^2.
+    vector<double> cumulative_xx;
+    /// Cumulative sum of x*y.
+    vector<double> cumulative_xy;
+    /// Cumulative sum of y^2.
+    vector<double> cumulative_yy;
+
     /// Vector of best fit AIC values.
     vector<int> best_fit_AIC;
     /// Vector of best fit AICc values.
     vector<int> best_fit_AICc;
     /// Vector of vectors of AIC values.
-    vector< vector<float> > AIC_for_each_n_segments;
+    vector< vector<double> > AIC_for_each_n_segments;
     /// Vector of vectors of AICc values.
-    vector< vector<float> > AICc_for_each_n_segments;
+    vector< vector<double> > AICc_for_each_n_segments;
 
   private:
     void create(int this_min_seg_length, vector<float> this_x_data, vector<float> this_y_data);
@@ -1382,6 +1382,54 @@ void LSDCRNParticle::update_21Ne_conc(double dt,double erosion_rate, LSDCRNParam
                (exp(dt*erosion_rate/Gamma_neutron) - 1)/erosion_rate;
   }
 }
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// This updates 10Be, 14C and 21Ne in one go. The terms are evaluated in the
+// same order as update_10Be_conc, update_14C_conc and update_21Ne_conc so
+// the concentrations are identical, but the exponentials that depend on the
+// timestep come from the factors and the depth exponentials are shared
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDCRNParticle::update_3CRN_conc(CRN_exposure_factors& factors,
+                                      LSDCRNParameters& CRNp)
+{
+  double depth_exp[4];
+  for (int i = 0; i<4; i++)
+  {
+    depth_exp[i] = exp(-effective_dLoc/CRNp.Gamma[i]);
+  }
+
+  // 10Be
+  double sum_term = 0;
+  for (int i = 0; i<4; i++)
+  {
+    sum_term+= (CRNp.F_10Be[i]*depth_exp[i]*CRNp.Gamma[i])*
+           factors.time_10Be[i]/factors.denom_10Be[i];
+  }
+  Conc_10Be = Conc_10Be*factors.decay_10Be +  CRNp.S_t*CRNp.P0_10Be*sum_term;
+
+  // 14C
+  sum_term = 0;
+  for (int i = 0; i<4; i++)
+  {
+    sum_term+= (CRNp.F_14C[i]*depth_exp[i]*CRNp.Gamma[i])*
+           factors.time_14C[i]/factors.denom_14C[i];
+  }
+  Conc_14C = Conc_14C*factors.decay_14C +
+             CRNp.S_t*factors.decay_14C*CRNp.P0_14C*sum_term;
+
+  // 21Ne
+  double Gamma_neutron= CRNp.Gamma[0];
+  if (factors.erosion_rate == 0)
+  {
+    Conc_21Ne = Conc_21Ne +  CRNp.S_t*depth_exp[0]*CRNp.P0_21Ne*factors.dt;
+  }
+  else
+  {
+    Conc_21Ne = Conc_21Ne +  CRNp.S_t*depth_exp[0]*Gamma_neutron*CRNp.P0_21Ne*
+               factors.time_21Ne/factors.erosion_rate;
+  }
+}
 
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -2272,6 +2320,24 @@ vector<double> LSDCRNParticle::CRONUS_get_Al_Be_erosion(LSDCRNParameters& LSDCRN
                       double lat, double rho, double N_10Be, double N_26Al, 
                       double sample_del10, double sample_del26,
                       double topo_scale, double snow_scale)
+{
+  bool print_to_screen = true;
+  return CRONUS_get_Al_Be_erosion(LSDCRNP, pressure, lat, rho, N_10Be, N_26Al,
+                                  sample_del10, sample_del26, topo_scale, snow_scale,
+                                  print_to_screen);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// CRONUS Get erosion
+// Overloaded, this one can be kept off the screen so that many samples can
+// be run at once (see CRONUS_emulator.cpp)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<double> LSDCRNParticle::CRONUS_get_Al_Be_erosion(LSDCRNParameters& LSDCRNP, double pressure,
+                      double lat, double rho, double N_10Be, double N_26Al, 
+                      double sample_del10, double sample_del26,
+                      double topo_scale, double snow_scale,
+                      bool print_to_screen)
 {
   // some erosion parameters that will be determined by this function 
   // erate_consts holds all the information that replicates the CRONUS calculator
@@ -2284,7 +2350,10 @@ vector<double> LSDCRNParticle::CRONUS_get_Al_Be_erosion(LSDCRNParameters& LSDCRN
   
   // first scale the thickness
   double thickSF = thickness_scaling_factor(LSDCRNP, use_CRONUS);
-  cout << "thickSF is: " << thickSF << endl;
+  if (print_to_screen)
+  {
+    cout << "thickSF is: " << thickSF << endl;
+  }
   
   // Now get the initial guess
   vector<double> initial_guess = CRONUS_initial_guess(LSDCRNP, pressure, lat, 
@@ -2425,11 +2494,13 @@ vector<double> LSDCRNParticle::CRONUS_get_Al_Be_erosion(LSDCRNParameters& LSDCRN
                       sample_del10, sample_del26, z_mu,  P_mu_z_10Be, P_mu_z_26Al,
                       P_sp_10Be, P_sp_26Al, eff_e_10Be, eff_e_26Al);
   
-  cout << "10Be atoms from spallation: " << uncertainties[8] 
-       << " and muons: " << uncertainties[9]  << endl;
-  cout << "26Al atoms from spallation: " << uncertainties[10] 
-       << " and muons: " << uncertainties[11]  << endl;       
-  
+  if (print_to_screen)
+  {
+    cout << "10Be atoms from spallation: " << uncertainties[8] 
+         << " and muons: " << uncertainties[9]  << endl;
+    cout << "26Al atoms from spallation: " << uncertainties[10] 
+         << " and muons: " << uncertainties[11]  << endl;
+  }
   
   erate_consts[0] = eff_e_10Be;
   erate_consts[1] = eff_e_10Be*1.0e7/rho;
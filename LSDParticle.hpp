@@ -511,6 +511,15 @@ class LSDCRNParticle: public LSDParticle
   /// @date 01/01/2010
   void update_21Ne_conc(double dt,double erosion, LSDCRNParameters& CRNp);
 
+  /// @brief update the 10Be, 14C and 21Ne concentrations together. The result
+  /// is the same as update_10Be_conc, update_14C_conc and update_21Ne_conc, but
+  /// the terms that depend only on the timestep and erosion rate come from
+  /// factors, and the depth terms are shared by the three nuclides
+  /// @param factors from LSDCRNParameters::get_3CRN_exposure_factors
+  /// @param CRNp a CRN parameters object that stores the coefficients
+  /// to approximate production from the different production mechanisms
+  void update_3CRN_conc(CRN_exposure_factors& factors, LSDCRNParameters& CRNp);
+
   /// @brief update the 3He concentration based on a constant erosion rate
   /// using the full production range, including muons. 
   /// @details This function solves for the updated concentration assuming
@@ -1018,6 +1027,27 @@ void update_10Be_SSfull_depth_integrated(double erosion_rate, LSDCRNParameters&
                       double sample_del10, double sample_del26,
                       double topo_scale, double snow_scale);
 
+  /// @brief As CRONUS_get_Al_Be_erosion above, but the thickness scaling
+  ///  and the atoms from spallation and muons are only reported to screen if
+  ///  print_to_screen is true. Samples can then be run in parallel.
+  /// @param LSDCRNP and LSDCRNParameters object
+  /// @param pressure the atmospheric pressure in hPa
+  /// @param lat the latitude
+  /// @param rho the density in kg/m^3
+  /// @param N_10Be the number of 10Be atoms
+  /// @param N_26 the number of 26Al atoms
+  /// @param sample_del10 The accelerator uncertanty in the number of 10Be atoms
+  /// @param sample_del26 The accelerator uncertanty in the number of 26Al atoms
+  /// @param topo_scale the topographic scaling (between 0 and 1)
+  /// @param snow_scale the snow scaling (between 0 and 1)
+  /// @param print_to_screen report the intermediate values to screen
+  /// @return erate_consts as for CRONUS_get_Al_Be_erosion above
+  vector<double> CRONUS_get_Al_Be_erosion(LSDCRNParameters& LSDCRNP, double pressure,
+                      double lat, double rho, double N_10Be, double N_26Al,
+                      double sample_del10, double sample_del26,
+                      double topo_scale, double snow_scale,
+                      bool print_to_screen);
+
   /// @brief This function wraps the functions for getting the erosion rate 
   ///  from Al and Be data. Similar to above but modifies production rates 
   /// @detail The function emulates the get_al_be_erosion.m from the
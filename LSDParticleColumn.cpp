@@ -84,7 +84,7 @@ void LSDParticleColumn::create(int tRow, int tCol, int tNodeIndex,
         double tSoilDensity, double tRockDensity,   
         float tSoilThickness, float tDataResolution, bool tUseDenstyProfile, 
         vector<double> tDensityDepths, vector<double> tDensityDensities, 
-        list<LSDCRNParticle> tCRNParticleList)
+        deque<LSDCRNParticle> tCRNParticleList)
 {
   Row = tRow;
   Col = tCol;
@@ -168,16 +168,13 @@ void LSDParticleColumn::initiate_SS_cosmo_column_3CRN(int start_type,
   }
 
   // now loop through the particles, setting to steady
-  list<LSDCRNParticle>::iterator part_iter;
-  part_iter = CRNParticleList.begin();
-  while(part_iter != CRNParticleList.end())
+  deque<LSDCRNParticle>::iterator part_iter;
+  for (part_iter = CRNParticleList.begin(); part_iter != CRNParticleList.end(); part_iter++)
   {
     // update the CRN_concntrations
     ( *part_iter ).update_10Be_SSfull(eff_eros_rate,CRN_param);
     ( *part_iter ).update_14C_SSfull(eff_eros_rate,CRN_param);
     ( *part_iter ).update_21Ne_SSfull(eff_eros_rate,CRN_param);
- 
-    part_iter++;   
   }
   
   // check the apparent erosion
@@ -253,14 +250,11 @@ LSDParticleColumn LSDParticleColumn::update_CRN_list_rock_only_eros_limit_3CRN(
   double eff_d;            // effective depth in g/cm^2
   double z_p;              // elevation of particle (m)
   double eff_eros_rate;    // effective erosion rate in g/cm^2/yr
-  int eroded_test;         // used to see if particle has eroded
   double effective_dt;     // the time of exposure for particles that have eroded
   double d_frac;           // fraction of depth eroded particles have spent in soil
 
-  // the list and iterators for eroded particles
-  list<LSDCRNParticle> eroded_list;
-  list<LSDCRNParticle>::iterator part_iter;
-  list<LSDCRNParticle>::iterator remove_iter;
+  // the eroded particles
+  deque<LSDCRNParticle> eroded_list;
 
   // so first, determine the depth of material lost
   double depth_lost = uplift_rate*dt- (zeta_new-zeta_old);
@@ -276,13 +270,22 @@ LSDParticleColumn LSDParticleColumn::update_CRN_list_rock_only_eros_limit_3CRN(
   //cout << "Heyjabbajsbba, line 275, effective erosion rate in LSDParticleColumn is: "
   //     << eff_eros_rate << " and eros is: " << depth_lost/dt << endl;
 
+  // The timestep and erosion rate are the same for every particle still in
+  // the ground, so the parts of the concentration update that depend on them
+  // are calculated once for the column
+  CRN_exposure_factors column_factors = 
+                  CRN_param.get_3CRN_exposure_factors(dt,eff_eros_rate);
+  CRN_exposure_factors eroded_factors;
+
   // go through and update the CRN concentrations
   // in the list
-  part_iter = CRNParticleList.begin();
-  while(part_iter != CRNParticleList.end())
+  deque<LSDCRNParticle>::iterator part_iter;
+  for (part_iter = CRNParticleList.begin(); part_iter != CRNParticleList.end(); part_iter++)
   {
+    LSDCRNParticle& this_particle = *part_iter;
+
     // get the old zeta location
-    z_p = ( *part_iter ).get_zetaLoc();
+    z_p = this_particle.get_zetaLoc();
     
     // now add the uplift to that location
     z_p =  z_p +  uplift_rate*dt; 
@@ -300,52 +303,36 @@ LSDParticleColumn LSDParticleColumn::update_CRN_list_rock_only_eros_limit_3CRN(
       // it has zero depth (sampled form surface)
       d = 0;
       eff_d = 0;
+
+      // update the CRN_concentrations
+      eroded_factors = CRN_param.get_3CRN_exposure_factors(effective_dt,eff_eros_rate);
+      this_particle.update_3CRN_conc(eroded_factors, CRN_param);
     }
     else
     {
-      effective_dt = dt;
+      // update the CRN_concentrations
+      this_particle.update_3CRN_conc(column_factors, CRN_param);
     }
 
-    // update the CRN_concentrations
-    ( *part_iter ).update_10Be_conc(effective_dt,eff_eros_rate, CRN_param);
-    ( *part_iter ).update_14C_conc(effective_dt,eff_eros_rate, CRN_param);
-    ( *part_iter ).update_21Ne_conc(effective_dt,eff_eros_rate, CRN_param);
-
     // update the depths
-    ( *part_iter ).update_depths(d, eff_d);
+    this_particle.update_depths(d, eff_d);
 
     // update the zeta locations (these have been advected by uplift
-    ( *part_iter ).update_zetaLoc(z_p);
-
-    part_iter++;
+    this_particle.update_zetaLoc(z_p);
   }
 
   // now go through the list and see if the particles
   // are either eroded or a new particle needs to be added
-  // particles are added to the back of the list and eroded from the front
-  // so first check for erosion
-  eroded_test = 0;
-  do
+  // particles are added to the back of the list and eroded from the front.
+  // If the elevation of the particle is greater than the elevation
+  // of the surface, it is eroded. The eroded particles are all at the front,
+  // and popping them off the front of the deque does not move the rest
+  while (not CRNParticleList.empty() && 
+         CRNParticleList.front().get_zetaLoc() > zeta_new)
   {
-    part_iter = CRNParticleList.begin();
-    z_p = ( *part_iter ).get_zetaLoc();
-
-    // if the elevation of the particle is greater than the elevation
-    // of the surface, it is eroded from the particle list
-    // and eroded_test remains unchanged
-    // if the elevation of the particle is not greater than the surface
-    // elevation, then eroded_test goes to 1 and the loop is exited
-    if (z_p > zeta_new)
-    {
-      //cout << "LINE 82 popping out!" << endl;
-      eroded_list.push_back(*part_iter);
-      CRNParticleList.pop_front();
-    }
-    else
-    {
-      eroded_test = 1;
-    }
-  } while (eroded_test == 0);
+    eroded_list.push_back(CRNParticleList.front());
+    CRNParticleList.pop_front();
+  }
 
   // now see if we insert a particle
   d = (CRNParticleList.back()).getdLoc();
@@ -378,19 +365,11 @@ void LSDParticleColumn::collect_particles(vector<LSDParticleColumn>& ColList_vec
   int N_cols = ColList_vec.size();
   
   // loop through them, aggregating the particles. 
-  list<LSDCRNParticle>::iterator part_iter;
-
   for (int i = 0; i<N_cols; i++)
   {
-    list<LSDCRNParticle> list_from_col = ColList_vec[i].getCRNParticleList();
-    
-    // loop through the columns, collecting particles
-    part_iter =  list_from_col.begin();
-    while(part_iter != list_from_col.end())
-    {  
-      CRNParticleList.push_back(*part_iter);
-      part_iter++;
-    }
+    const deque<LSDCRNParticle>& list_from_col = ColList_vec[i].getCRNParticleList();
+    CRNParticleList.insert(CRNParticleList.end(), list_from_col.begin(), 
+                           list_from_col.end());
   }  
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -406,14 +385,13 @@ vector<double> LSDParticleColumn::calculate_app_erosion_3CRN_neutron_rock_only(
                                                    LSDCRNParameters& CRN_param )
 {
   vector<double> apparent_erosion(3,0.0);
-  list<LSDCRNParticle>::iterator part_iter;
 
   // first go through and update the CRN concentrations
   // in the list
-  part_iter = CRNParticleList.begin();
-  apparent_erosion[0] = (*part_iter).apparent_erosion_10Be_neutron_only(RockDensity, CRN_param);
-  apparent_erosion[1] =(*part_iter).apparent_erosion_14C_neutron_only(RockDensity, CRN_param);
-  apparent_erosion[2] =(*part_iter).apparent_erosion_21Ne(RockDensity, CRN_param);
+  LSDCRNParticle& top_particle = CRNParticleList.front();
+  apparent_erosion[0] = top_particle.apparent_erosion_10Be_neutron_only(RockDensity, CRN_param);
+  apparent_erosion[1] = top_particle.apparent_erosion_14C_neutron_only(RockDensity, CRN_param);
+  apparent_erosion[2] = top_particle.apparent_erosion_21Ne(RockDensity, CRN_param);
   
   //cout << "app erosion from particle at "<< (*part_iter).getdLoc() << " depth" << endl;
     
@@ -430,26 +408,24 @@ void LSDParticleColumn::print_particle_properties_to_screen(LSDCRNParameters& CR
 {
 
   cout << "\n\nColumn at ["<<Row<<"]["<<Col<<"]; density is: " << RockDensity << endl;
-  list<LSDCRNParticle>::iterator part_iter;
-  part_iter = CRNParticleList.begin();
-  while(part_iter != CRNParticleList.end())
+  deque<LSDCRNParticle>::iterator part_iter;
+  for (part_iter = CRNParticleList.begin(); part_iter != CRNParticleList.end(); part_iter++)
   {
+    LSDCRNParticle& this_particle = *part_iter;
+
     // get the zeta location
-    double z_p = ( *part_iter ).get_zetaLoc();
-    double d_loc =   ( *part_iter ).getdLoc();
-    double effD =  ( *part_iter ).geteffective_dLoc();
-    double conc10Be = ( *part_iter ).getConc_10Be();
+    double z_p = this_particle.get_zetaLoc();
+    double d_loc =   this_particle.getdLoc();
+    double effD =  this_particle.geteffective_dLoc();
+    double conc10Be = this_particle.getConc_10Be();
           //double conc14C = ( *part_iter ).getConc_14C();
           //double conc21Ne = ( *part_iter ).getConc_21Ne();
-    double appEros10Be = ( *part_iter ).apparent_erosion_10Be_neutron_only(RockDensity, CRNparam);
+    double appEros10Be = this_particle.apparent_erosion_10Be_neutron_only(RockDensity, CRNparam);
           //double appEros14C = ( *part_iter ).apparent_erosion_14C_neutron_only(RockDensity, CRNparam);
           //double appEros21Ne = ( *part_iter ).apparent_erosion_21Ne_neutron_only(RockDensity, CRNparam);
 
 
     cout << z_p << "\t " << d_loc << "\t" << effD << "\t" << conc10Be << "\t" << appEros10Be << endl;
-
-
-    part_iter++;
   }
 }
 
@@ -49,7 +49,7 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include <iostream>
 #include <vector>
-#include <list>
+#include <deque>
 #include "LSDCRNParameters.hpp"
 #include "LSDParticle.hpp"
 using namespace std;
@@ -78,7 +78,7 @@ class LSDParticleColumn
         double tSoilDensity, double tRockDensity,   
         float tSoilThickness, float tDataResolution, bool tUseDenstyProfile, 
         vector<double> tDensityDepths, vector<double> tDensityDensities, 
-        list<LSDCRNParticle> tCRNParticleList)
+        deque<LSDCRNParticle> tCRNParticleList)
         { create(tRow, tCol, tNodeIndex, tSoilDensity, tRockDensity,   
                  tSoilThickness,tDataResolution, tUseDenstyProfile, 
                  tDensityDepths, tDensityDensities, tCRNParticleList); }
@@ -151,8 +151,9 @@ class LSDParticleColumn
     vector<double> getDensityDensities() const { return DensityDensities;} 
 
     /// @brief function for the CRNParticleList
-    /// @return CRNParticleList the underlying particle list
-     list<LSDCRNParticle> getCRNParticleList() const { return CRNParticleList;} 
+    /// @return CRNParticleList the underlying particles. This is a reference
+    /// so the particles are not copied
+    const deque<LSDCRNParticle>& getCRNParticleList() const { return CRNParticleList;} 
 
 
     //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -304,8 +305,11 @@ class LSDParticleColumn
     /// measurments at depths set by DenstiyDepths    
     vector<double> DensityDensities;
     
-    /// This is the list for holding the particles
-    list<LSDCRNParticle> CRNParticleList;
+    /// This holds the particles, from the top of the column to the bottom.
+    /// Particles are inserted at the back and eroded from the front. 
+    /// It is a deque so both ends are cheap to change and the particles 
+    /// are allocated in blocks rather than one at a time.
+    deque<LSDCRNParticle> CRNParticleList;
     
 
     
@@ -325,7 +329,7 @@ class LSDParticleColumn
         double tSoilDensity, double tRockDensity,   
         float tSoilThickness, float tDataResolution, bool tUseDenstyProfile, 
         vector<double> tDensityDepths, vector<double> tDensityDensities, 
-        list<LSDCRNParticle> tCRNParticleList);
+        deque<LSDCRNParticle> tCRNParticleList);
 };
 
 #endif
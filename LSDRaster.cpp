@@ -1995,14 +1995,14 @@ void LSDRaster::get_row_and_col_of_a_point(float X_coordinate,float Y_coordinate
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDRaster::rewrite_with_random_values(float range)
 {
-  // set a seed for the random values
-  long seed = time(NULL);
+  // get a stream for the random values
+  RandomStream rng = get_serial_random_stream();
 
   for(int row = 0; row<NRows; row++)
   {
     for(int col = 0; col<NCols; col++)
     {
-      RasterData[row][col] = ran3(&seed)*range;
+      RasterData[row][col] = rng.uniform()*range;
     }
   }
 }
@@ -2493,14 +2493,14 @@ void LSDRaster::SetWrapSample(int row, int col, float value)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void LSDRaster::DSSetFeatureCorners(int featuresize, float scale)
 {
-  long seed = time(NULL);
+  RandomStream rng = get_serial_random_stream();
   // the function starts from -featuresize since in the diamond square step
   // of the algorithm it wraps from row and column 0
   for (int row = 0; row < NRows; row+= featuresize)
   {
     for (int col = 0; col<NCols; col+= featuresize)
     {
-      float randn = (ran3(&seed)-0.5)*scale;
+      float randn = (rng.uniform()-0.5)*scale;
       //cout << "setting feature corners, row: " << row << " and col: " << col << endl;
       SetWrapSample(row,col,randn);
     }
@@ -2604,7 +2604,7 @@ void LSDRaster::DSSampleDiamond(int row, int col, int size, float value)
 void LSDRaster::DiamondSquare_SampleStep(int stepsize, float scale)
 {
     int halfstep = stepsize / 2;
-    long seed = time(NULL);
+    RandomStream rng = get_serial_random_stream();
 
   // first do the square step. This gets the sqare for the node
   // at the half distance between the starting points
@@ -2613,7 +2613,7 @@ void LSDRaster::DiamondSquare_SampleStep(int stepsize, float scale)
     for (int col = -halfstep; col < NCols + halfstep; col += stepsize)
     {
       //cout << "SS row and col: " << row << " " << col << endl;
-      DSSampleSquare(row, col, stepsize, ((ran3(&seed)-0.5) * scale));
+      DSSampleSquare(row, col, stepsize, ((rng.uniform()-0.5) * scale));
     }
   }
 
@@ -2628,8 +2628,8 @@ void LSDRaster::DiamondSquare_SampleStep(int stepsize, float scale)
     for (int col = -stepsize; col < NCols; col += stepsize)
     {
       //cout << "DS row and col: " << row << " " << col << endl;
-      DSSampleDiamond(row + halfstep, col, stepsize, ((ran3(&seed)-0.5) * scale));
-      DSSampleDiamond(row, col + halfstep, stepsize, ((ran3(&seed)-0.5) * scale));
+      DSSampleDiamond(row + halfstep, col, stepsize, ((rng.uniform()-0.5) * scale));
+      DSSampleDiamond(row, col + halfstep, stepsize, ((rng.uniform()-0.5) * scale));
     }
   }
 }
@@ -2944,45 +2944,75 @@ LSDRaster LSDRaster::TopographicShielding(int AzimuthStep, int ZenithStep)
   //Array2D<float> MaxFactorArray(NRows,NCols,MaxFactor);
   float MaxWeight = 0;
 
-  //Calculate first shadow with theta value of 90 and scale it
-  Array2D<float> Empty(NRows,NCols,0.);
-  Array2D<float> FinalArray = Empty; // = Shadow(0,90) * Scaler90;
-
-  //loop through all the theta, phi pairs and increment the FinalArray with the scaled values
-  //start at ZenithStep and AzimuthStep and continue up to Max
-
+  //list the theta, phi pairs and their weights
+  //start at ZenithStep and AzimuthStep and continue up to Max.
+  //A zenith of 90 casts no shadows but still adds to the weight
+  vector<int> Azimuths, Zeniths;
+  vector<float> Weightings;
   for (int ZenithAngle = ZenithStep; ZenithAngle <= 90; ZenithAngle += ZenithStep)
   {
     for(int AzimuthAngle = AzimuthStep; AzimuthAngle <= 360; AzimuthAngle += AzimuthStep)
     {
-      fflush(stdout);
-      printf("\nAzimuth: %d, Zenith: %d - ",AzimuthAngle,ZenithAngle);
-
-      //Find cells in shadow (1s and 0s)
-      Array2D<float> ShadowsArray;
-      if (ZenithAngle < 90) ShadowsArray = Shadows(AzimuthAngle,ZenithAngle);
-      else ShadowsArray = Empty;
-
       //Calculate Weighting
       float Weighting = (AzimuthStep*(M_PI/180.))*(ZenithStep*(M_PI/180.))*cos(ZenithAngle*(M_PI/180.))*pow(sin(ZenithAngle*(M_PI/180.)),m);
-      Array2D<float> WeightsArray(NRows,NCols,Weighting);
-
-      //calculate Weight
-      FinalArray += ShadowsArray*WeightsArray;
       MaxWeight += Weighting;
+      if (ZenithAngle < 90)
+      {
+        Azimuths.push_back(AzimuthAngle);
+        Zeniths.push_back(ZenithAngle);
+        Weightings.push_back(Weighting);
+      }
     }
   }
 
-  Array2D<float> ShieldingFactor(NRows,NCols,1);
-  Array2D<float> MaxWeightArray(NRows,NCols,MaxWeight);
-  ShieldingFactor -= FinalArray/MaxWeightArray;
+  //The shadows of a batch of angles are found in parallel, each angle on its
+  //own thread, and then added to the FinalArray in the order of the angles,
+  //so the result does not depend on the number of threads.
+  //The batch size limits the memory used by the shadow masks. The masks are
+  //shorts rather than chars since char stores may alias the raster data and
+  //that slows the shadow search.
+  int NAngles = int(Azimuths.size());
+  int BatchSize = 16;
+  Array2D<float> FinalArray(NRows,NCols,0.);
+  vector< vector<short> > BatchShadows(BatchSize);
+  for (int BatchStart = 0; BatchStart < NAngles; BatchStart += BatchSize)
+  {
+    int NInBatch = min(BatchSize, NAngles-BatchStart);
+    for (int n = 0; n < NInBatch; ++n)
+    {
+      printf("Azimuth: %d, Zenith: %d\n",Azimuths[BatchStart+n],Zeniths[BatchStart+n]);
+    }
+    fflush(stdout);
+
+    //Find cells in shadow (1s and 0s)
+    #pragma omp parallel for schedule(dynamic,1)
+    for (int n = 0; n < NInBatch; ++n)
+    {
+      shadow_mask(Azimuths[BatchStart+n],Zeniths[BatchStart+n],BatchShadows[n]);
+    }
+
+    //calculate Weight
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < NRows; ++i)
+    {
+      for (int n = 0; n < NInBatch; ++n)
+      {
+        const vector<short>& InShadow = BatchShadows[n];
+        float Weighting = Weightings[BatchStart+n];
+        for (int j = 0; j < NCols; ++j)
+        {
+          if (InShadow[i*NCols+j] == 1) FinalArray[i][j] += Weighting;
+        }
+      }
+    }
+  }
 
   //make sure there is no shielding value for NDV cells
   Array2D<float> FinalShieldingFactor(NRows,NCols,NoDataValue);
   for (int i = 0; i < NRows; ++i){
     for (int j = 0; j < NCols; ++j){
       if (RasterData[i][j] != NoDataValue){
-        FinalShieldingFactor[i][j] = ShieldingFactor[i][j];
+        FinalShieldingFactor[i][j] = 1-FinalArray[i][j]/MaxWeight;
       }
     }
   }
@@ -3084,18 +3114,41 @@ Array2D<float> LSDRaster::Shadows(int Azimuth, int ZenithAngle)
 {
   printf("LSDRaster::%s: ",__func__);
 
-  //Declare coordinate and transform arrays
-  Array2D<float> XCoords(NRows,NCols,NoDataValue);
-  Array2D<float> YCoords(NRows,NCols,NoDataValue);
+  vector<short> in_shadow;
+  shadow_mask(Azimuth, ZenithAngle, in_shadow);
+
+  Array2D<float> Shadows(NRows,NCols,0.0);
+  for (int i=0; i<NRows; ++i)
+  {
+    for (int j=0; j<NCols; ++j)
+    {
+      if (in_shadow[i*NCols+j] == 1) Shadows[i][j] = 1;
+    }
+  }
+
+  //Print completion to screen
+  fflush(stdout);
+  printf("100 %% Complete\r");
+
+  //write LSDRaster and return
+  return Shadows;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The shadow search of Shadows. It only reads the raster and does not print,
+// so different angles can be done at the same time on different threads.
+// The cells are in row major order.
+// MDH, Feb 2015
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRaster::shadow_mask(int Azimuth, int ZenithAngle, vector<short>& in_shadow)
+{
+
+  //Declare transform arrays. These are the only arrays the size of the
+  //raster so they are kept to a minimum
   Array2D<float> XCoords_Transform(NRows,NCols,NoDataValue);
   //Array2D<float> YCoords_Transform(NRows,NCols,NoDataValue);
   Array2D<float> ZCoords_Transform(NRows,NCols,NoDataValue);
-  Array2D<float> Shadows(NRows,NCols,0.0);
-
-  //variables for screen printing
-  int PrintStep = (int)(NCols*(NRows/100));
-  int Print = 0;
-  int PrintCounter = 0;
+  in_shadow.assign(NRows*NCols,0);
 
   //parameters for searching along shadow paths
   int NSearch = 2;
@@ -3115,17 +3168,17 @@ Array2D<float> LSDRaster::Shadows(int Azimuth, int ZenithAngle)
     {
       if (RasterData[i][j] != NoDataValue)
       {
-        YCoords[i][j] = (NRows-i)*DataResolution;
-        XCoords[i][j] = j*DataResolution;
+        float YCoord = (NRows-i)*DataResolution;
+        float XCoord = j*DataResolution;
 
         //Modified from Codilean 2006 whose equation 6 appears to be wrong (may be due to differrent origins?)
-        XCoords_Transform[i][j] = XCoords[i][j]*sin(AzimuthRadians)-YCoords[i][j]*cos(AzimuthRadians);
-        //YCoords_Transform[i][j] = XCoords[i][j]*cos(AzimuthRadians)+YCoords[i][j]*sin(AzimuthRadians);
+        XCoords_Transform[i][j] = XCoord*sin(AzimuthRadians)-YCoord*cos(AzimuthRadians);
+        //YCoords_Transform[i][j] = XCoord*cos(AzimuthRadians)+YCoord*sin(AzimuthRadians);
 
         //Modified from Codilean 2006 whose equation 8 is missing a + sign and needs rederiving following the new equation 6
         ZCoords_Transform[i][j] = (RasterData[i][j]*cos(ZenithRadians)
-                                        - (XCoords[i][j]*cos(AzimuthRadians)
-                                  + YCoords[i][j]*sin(AzimuthRadians))*sin(ZenithRadians));
+                                        - (XCoord*cos(AzimuthRadians)
+                                  + YCoord*sin(AzimuthRadians))*sin(ZenithRadians));
       }
     }
   }
@@ -3190,11 +3243,6 @@ Array2D<float> LSDRaster::Shadows(int Azimuth, int ZenithAngle)
     exit(EXIT_FAILURE);
   }
 
-  //print to screen
-  float Percentage = (100.*PrintCounter/(NRows*NCols));
-  fflush(stdout);
-  printf("%3.0f %% Complete\b\b\b\b\b\b\b\b\b\b\b\b\b\b",Percentage);
-
   for (int ii=0; ii < NRows; ++ii)
   {
     //check which direction to loop in
@@ -3208,16 +3256,6 @@ Array2D<float> LSDRaster::Shadows(int Azimuth, int ZenithAngle)
       if (Reversej==1) j = NCols-jj-1;
       else j=jj;
 
-    //print progress to screen (turn this off if parallel?)
-      ++PrintCounter;
-      if (PrintCounter > Print)
-      {
-        float Percentage = (100.*PrintCounter/(NRows*NCols));
-        fflush(stdout);
-        printf("%3.0f\b\b\b",Percentage);
-        Print += PrintStep;
-      }
-
       if (i==0 || i==NRows-1 || j==0 || j==NCols-1) continue;
       else if (RasterData[i][j] == NoDataValue) continue;
 
@@ -3280,22 +3318,124 @@ Array2D<float> LSDRaster::Shadows(int Azimuth, int ZenithAngle)
         {
           //Check if transformed elevation a,b greater than at i,j
           DiffZ = ZCoords_Transform[a][b] - ZCoords_Transform[i][j];
-          if (DiffZ < 0) Shadows[a][b] = 1;
+          if (DiffZ < 0) in_shadow[a*NCols+b] = 1;
           else ShadowFlag += 1;
         }
       }
     }
   }
 
-  //Print completion to screen
-  fflush(stdout);
-  printf("100 %% Complete\r");
-
-  //write LSDRaster and return
-  return Shadows;
 }
 
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// build_polyfit_kernel
+//
+// This sets up the kernel used to fit a 6 term polynomial to the surface:
+// the x and y coordinates of the kernel cells relative to the centre, the
+// circular mask and the matrix A of the normal equations, which is the same
+// for every window.
+//
+// DTM 28/03/2014
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void LSDRaster::build_polyfit_kernel(float window_radius, int& kr, Array2D<float>& x_kernel,
+                                     Array2D<float>& y_kernel, Array2D<int>& mask,
+                                     Array2D<float>& A)
+{
+  kr = int(ceil(window_radius/DataResolution));  // Set radius of kernel
+  int kw=2*kr+1;                                 // width of kernel
+
+  Array2D<float> x_k(kw,kw,NoDataValue);
+  Array2D<float> y_k(kw,kw,NoDataValue);
+  Array2D<int> m_k(kw,kw,0);
+
+  // scale kernel window to resolution of DEM, and translate coordinates to be
+  // centred on cell of interest (the centre cell)
+  float x,y,radial_dist;
+  for(int i=0;i<kw;++i)
+  {
+    for(int j=0;j<kw;++j)
+    {
+      x_k[i][j]=(i-kr)*DataResolution;
+      y_k[i][j]=(j-kr)*DataResolution;
+      // Build circular mask
+      // distance from centre to this point.
+      radial_dist = sqrt(y_k[i][j]*y_k[i][j] + x_k[i][j]*x_k[i][j]);
+
+      //if (floor(radial_dist) <= window_radius)
+      if (radial_dist <= window_radius)
+      {
+        m_k[i][j] = 1;
+      }
+    }
+  }
+  // FIT POLYNOMIAL SURFACE BY LEAST SQUARES REGRESSION AND USE COEFFICIENTS TO
+  // DETERMINE TOPOGRAPHIC METRICS
+  // Have N simultaneous linear equations, and N unknowns.
+  // => b = Ax, where x is a 1xN array containing the coefficients we need for
+  // surface fitting.
+  // A is constructed using different combinations of x and y, thus we only need
+  // to compute this once, since the window size does not change.
+  // For 2nd order surface fitting, there are 6 coefficients, therefore A is a
+  // 6x6 matrix
+  Array2D<float> A_k(6,6,0.0);
+  for (int i=0; i<kw; ++i)
+  {
+    for (int j=0; j<kw; ++j)
+    {
+      if (m_k[i][j] == 1)
+      {
+        x = x_k[i][j];
+        y = y_k[i][j];
+
+        // Generate matrix A
+        A_k[0][0] += pow(x,4);
+        A_k[0][1] += pow(x,2)*pow(y,2);
+        A_k[0][2] += pow(x,3)*y;
+        A_k[0][3] += pow(x,3);
+        A_k[0][4] += pow(x,2)*y;
+        A_k[0][5] += pow(x,2);
+        A_k[1][0] += pow(x,2)*pow(y,2);
+        A_k[1][1] += pow(y,4);
+        A_k[1][2] += x*pow(y,3);
+        A_k[1][3] += x*pow(y,2);
+        A_k[1][4] += pow(y,3);
+        A_k[1][5] += pow(y,2);
+        A_k[2][0] += pow(x,3)*y;
+        A_k[2][1] += x*pow(y,3);
+        A_k[2][2] += pow(x,2)*pow(y,2);
+        A_k[2][3] += pow(x,2)*y;
+        A_k[2][4] += x*pow(y,2);
+        A_k[2][5] += x*y;
+        A_k[3][0] += pow(x,3);
+        A_k[3][1] += x*pow(y,2);
+        A_k[3][2] += pow(x,2)*y;
+        A_k[3][3] += pow(x,2);
+        A_k[3][4] += x*y;
+        A_k[3][5] += x;
+        A_k[4][0] += pow(x,2)*y;
+        A_k[4][1] += pow(y,3);
+        A_k[4][2] += x*pow(y,2);
+        A_k[4][3] += x*y;
+        A_k[4][4] += pow(y,2);
+        A_k[4][5] += y;
+        A_k[5][0] += pow(x,2);
+        A_k[5][1] += pow(y,2);
+        A_k[5][2] += x*y;
+        A_k[5][3] += x;
+        A_k[5][4] += y;
+        A_k[5][5] += 1;
+      }
+    }
+  }
+
+  x_kernel = x_k;
+  y_kernel = y_k;
+  mask = m_k;
+  A = A_k;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // calculate_polyfit_surface_metrics
 //
@@ -3338,14 +3478,14 @@ vector<LSDRaster> LSDRaster::calculate_polyfit_surface_metrics(float window_radi
     window_radius = sqrt(2)*DataResolution;
   }
   // this fits a polynomial surface over a kernel window. First, perpare the
-  // kernel
-  int kr = int(ceil(window_radius/DataResolution));  // Set radius of kernel
+  // kernel and the matrix of the normal equations
+  int kr;
+  Array2D<float> x_kernel, y_kernel, A;
+  Array2D<int> mask;
+  build_polyfit_kernel(window_radius, kr, x_kernel, y_kernel, mask, A);
   int kw=2*kr+1;                                     // width of kernel
 
   Array2D<float> data_kernel(kw,kw,NoDataValue);
-  Array2D<float> x_kernel(kw,kw,NoDataValue);
-  Array2D<float> y_kernel(kw,kw,NoDataValue);
-  Array2D<int> mask(kw,kw,0);
 
   // reset the a,b,c,d,e and f matrices (the coefficient matrices)
   Array2D<float> temp_coef(NRows,NCols,NoDataValue);
@@ -3362,87 +3502,10 @@ vector<LSDRaster> LSDRaster::calculate_polyfit_surface_metrics(float window_radi
   if(raster_selection[6]==1)  tangential_curvature_raster = temp_coef.copy();
   if(raster_selection[7]==1)  classification_raster = temp_coef.copy();
 
-  //float a,b,c,d,e,f;
-
-  // scale kernel window to resolution of DEM, and translate coordinates to be
-  // centred on cell of interest (the centre cell)
-  float x,y,zeta,radial_dist;
-  for(int i=0;i<kw;++i)
-  {
-    for(int j=0;j<kw;++j)
-    {
-      x_kernel[i][j]=(i-kr)*DataResolution;
-      y_kernel[i][j]=(j-kr)*DataResolution;
-      // Build circular mask
-      // distance from centre to this point.
-      radial_dist = sqrt(y_kernel[i][j]*y_kernel[i][j] + x_kernel[i][j]*x_kernel[i][j]);
+  float x,y,zeta;
 
-      //if (floor(radial_dist) <= window_radius)
-      if (radial_dist <= window_radius)
-      {
-        mask[i][j] = 1;
-      }
-    }
-  }
-  // FIT POLYNOMIAL SURFACE BY LEAST SQUARES REGRESSION AND USE COEFFICIENTS TO
-  // DETERMINE TOPOGRAPHIC METRICS
-  // Have N simultaneous linear equations, and N unknowns.
-  // => b = Ax, where x is a 1xN array containing the coefficients we need for
-  // surface fitting.
-  // A is constructed using different combinations of x and y, thus we only need
-  // to compute this once, since the window size does not change.
-  // For 2nd order surface fitting, there are 6 coefficients, therefore A is a
-  // 6x6 matrix
-  Array2D<float> A(6,6,0.0);
-  for (int i=0; i<kw; ++i)
-  {
-    for (int j=0; j<kw; ++j)
-    {
-      if (mask[i][j] == 1)
-      {
-        x = x_kernel[i][j];
-        y = y_kernel[i][j];
-
-        // Generate matrix A
-        A[0][0] += pow(x,4);
-        A[0][1] += pow(x,2)*pow(y,2);
-        A[0][2] += pow(x,3)*y;
-        A[0][3] += pow(x,3);
-        A[0][4] += pow(x,2)*y;
-        A[0][5] += pow(x,2);
-        A[1][0] += pow(x,2)*pow(y,2);
-        A[1][1] += pow(y,4);
-        A[1][2] += x*pow(y,3);
-        A[1][3] += x*pow(y,2);
-        A[1][4] += pow(y,3);
-        A[1][5] += pow(y,2);
-        A[2][0] += pow(x,3)*y;
-        A[2][1] += x*pow(y,3);
-        A[2][2] += pow(x,2)*pow(y,2);
-        A[2][3] += pow(x,2)*y;
-        A[2][4] += x*pow(y,2);
-        A[2][5] += x*y;
-        A[3][0] += pow(x,3);
-        A[3][1] += x*pow(y,2);
-        A[3][2] += pow(x,2)*y;
-        A[3][3] += pow(x,2);
-        A[3][4] += x*y;
-        A[3][5] += x;
-        A[4][0] += pow(x,2)*y;
-        A[4][1] += pow(y,3);
-        A[4][2] += x*pow(y,2);
-        A[4][3] += x*y;
-        A[4][4] += pow(y,2);
-        A[4][5] += y;
-        A[5][0] += pow(x,2);
-        A[5][1] += pow(y,2);
-        A[5][2] += x*y;
-        A[5][3] += x;
-        A[5][4] += y;
-        A[5][5] += 1;
-      }
-    }
-  }
+  // A is the same for every window so it only needs to be decomposed once
+  LU<float> sol_A(A);  // Create LU object
 
   // Move window over DEM, fitting 2nd order polynomial surface to the
   // elevations within the window.
@@ -3512,7 +3575,6 @@ vector<LSDRaster> LSDRaster::calculate_polyfit_surface_metrics(float window_radi
           // Solve matrix equations using LU decomposition using the TNT JAMA
           // package:
           // A.coefs = b, where coefs is the coefficients vector.
-          LU<float> sol_A(A);  // Create LU object
           coeffs = sol_A.solve(bb);
 
           float a=coeffs[0];
@@ -3630,6 +3692,110 @@ vector<LSDRaster> LSDRaster::calculate_polyfit_surface_metrics(float window_radi
   return raster_output;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// calculate_polyfit_tangential_curvature_block
+//
+// This calculates the tangential curvature from the polynomial surface fit
+// (see calculate_polyfit_surface_metrics) but only for a block of the raster.
+// The windows of cells near the edge of the block reach into the surrounding
+// cells, so the values are identical to those of the full raster. It is used
+// to stream curvature tile by tile so that no full size curvature raster is
+// needed. It does not change any data members so blocks can be done in
+// parallel.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+Array2D<float> LSDRaster::calculate_polyfit_tangential_curvature_block(float window_radius,
+                                  int row_start, int col_start, int n_block_rows, int n_block_cols)
+{
+  // same minimum window as calculate_polyfit_surface_metrics
+  if (window_radius < sqrt(2)*DataResolution)
+  {
+    window_radius = sqrt(2)*DataResolution;
+  }
+  int kr;
+  Array2D<float> x_kernel, y_kernel, A;
+  Array2D<int> mask;
+  build_polyfit_kernel(window_radius, kr, x_kernel, y_kernel, mask, A);
+  int kw=2*kr+1;
+  LU<float> sol_A(A);
+
+  Array2D<float> tangential_curvature_block(n_block_rows,n_block_cols,NoDataValue);
+  float x,y,zeta;
+
+  for(int bi=0;bi<n_block_rows;++bi)
+  {
+    int i = row_start+bi;
+    for(int bj=0;bj<n_block_cols;++bj)
+    {
+      int j = col_start+bj;
+      // Avoid edges
+      if((i-kr < 0) || (i+kr+1 > NRows) || (j-kr < 0) || (j+kr+1 > NCols) || RasterData[i][j]==NoDataValue)
+      {
+        continue;
+      }
+
+      // check for nodata values nearby
+      bool ndv_present = false;
+      for(int i_kernel=0;i_kernel<kw && !ndv_present;++i_kernel)
+      {
+        for(int j_kernel=0;j_kernel<kw;++j_kernel)
+        {
+          if(RasterData[i-kr+i_kernel][j-kr+j_kernel]==NoDataValue)
+          {
+            ndv_present = true;
+            break;
+          }
+        }
+      }
+      if(ndv_present)
+      {
+        continue;
+      }
+
+      Array1D<float> bb(6,0.0);
+      Array1D<float> coeffs(6);
+      for (int krow=0; krow<kw; ++krow)
+      {
+        for (int kcol=0; kcol<kw; ++kcol)
+        {
+          if (mask[krow][kcol] == 1)
+          {
+            x = x_kernel[krow][kcol];
+            y = y_kernel[krow][kcol];
+            zeta = RasterData[i-kr+krow][j-kr+kcol];
+            bb[0] += zeta*x*x;
+            bb[1] += zeta*y*y;
+            bb[2] += zeta*x*y;
+            bb[3] += zeta*x;
+            bb[4] += zeta*y;
+            bb[5] += zeta;
+          }
+        }
+      }
+      coeffs = sol_A.solve(bb);
+
+      float a=coeffs[0];
+      float b=coeffs[1];
+      float c=coeffs[2];
+      float d=coeffs[3];
+      float e=coeffs[4];
+
+      float fx, fy, fxx, fyy, fxy, p, q;
+      fx = d;
+      fy = e;
+      fxx = 2*a;
+      fyy = 2*b;
+      fxy = c;
+      p = fx*fx + fy*fy;
+      q = p + 1;
+      if( q>0 && (p*sqrt(q))!=0)
+      {
+        tangential_curvature_block[bi][bj] = (fxx*fy*fy - 2*fxy*fx*fy + fyy*fx*fx)/(p*sqrt(q));
+      }
+    }
+  }
+  return tangential_curvature_block;
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // calculate_polyfit_roughness_metrics
 //
@@ -12345,22 +12511,67 @@ LSDIndexRaster LSDRaster::IsolateChannelsGeonet(float timesteps, float area_thre
 // This function does part (iii) of the above
 LSDIndexRaster LSDRaster::IsolateChannelsQuantileQuantile(string q_q_filename)
 {
+  return IsolateChannelsQuantileQuantile(q_q_filename, 0);
+}
 
-  vector<float> values;
-  for(int i = 0; i < NRows; ++i)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// If sketch_compression is positive the quantiles come from a quantile sketch
+// and the mean and standard deviation from a streaming pass, so the raster is
+// never copied or sorted.
+LSDIndexRaster LSDRaster::IsolateChannelsQuantileQuantile(string q_q_filename, float sketch_compression)
+{
+
+  vector<float> quantile_values,normal_variates,mn_values;
+  int N_points = 10000;//values.size();
+  float mean_curvature, sd_curvature;
+  if (sketch_compression > 0)
   {
-    for(int j = 0; j < NCols; ++j)
+    QuantileSketch sketch = build_quantile_sketch(RasterData, NoDataValue, sketch_compression);
+    quantile_quantile_analysis(sketch, quantile_values, normal_variates, mn_values, N_points);
+
+    double sum = 0;
+    double sum_sq = 0;
+    for(int i = 0; i < NRows; ++i)
     {
-      if(RasterData[i][j] != NoDataValue)
+      for(int j = 0; j < NCols; ++j)
+      {
+        if(RasterData[i][j] != NoDataValue)
+        {
+          sum += RasterData[i][j];
+        }
+      }
+    }
+    double mean = sum/sketch.get_count();
+    for(int i = 0; i < NRows; ++i)
+    {
+      for(int j = 0; j < NCols; ++j)
       {
-        values.push_back(RasterData[i][j]);
+        if(RasterData[i][j] != NoDataValue)
+        {
+          sum_sq += (RasterData[i][j]-mean)*(RasterData[i][j]-mean);
+        }
       }
     }
+    mean_curvature = float(mean);
+    sd_curvature = float(sqrt(sum_sq/sketch.get_count()));
+  }
+  else
+  {
+    vector<float> values;
+    for(int i = 0; i < NRows; ++i)
+    {
+      for(int j = 0; j < NCols; ++j)
+      {
+        if(RasterData[i][j] != NoDataValue)
+        {
+          values.push_back(RasterData[i][j]);
+        }
+      }
+    }
+    quantile_quantile_analysis(values, quantile_values, normal_variates, mn_values, N_points);
+    mean_curvature = get_mean(values);
+    sd_curvature = get_standard_deviation(values,mean_curvature);
   }
-
-  vector<float> quantile_values,normal_variates,mn_values;
-  int N_points = 10000;//values.size();
-  quantile_quantile_analysis(values, quantile_values, normal_variates, mn_values, N_points);
   ofstream ofs;
   ofs.open(q_q_filename.c_str());
 
@@ -12400,8 +12611,6 @@ LSDIndexRaster LSDRaster::IsolateChannelsQuantileQuantile(string q_q_filename)
       else flag = 0;
     }
   }
-  float mean_curvature = get_mean(values);
-  float sd_curvature = get_standard_deviation(values,mean_curvature);
   curvature_threshold = mean_curvature+normal_variates[threshold_index]*sd_curvature;
   cout << "\t Creating channel raster based on curvature threshold (threshold = " << curvature_threshold << ")" << endl;
   Array2D<int> binary_raster(NRows,NCols,NoDataValue);
@@ -13124,19 +13333,43 @@ float LSDRaster::get_threshold_for_floodplain(float bin_width, float peak_thresh
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 float LSDRaster::get_threshold_for_floodplain_QQ(string q_q_filename, float threshold_condition, int lower_percentile, int upper_percentile)
 {
-  //get vector of raster data
-  vector<float> raster_vector;
-  for (int row = 0; row < NRows; row++)
+  return get_threshold_for_floodplain_QQ(q_q_filename, threshold_condition, lower_percentile, upper_percentile, 0);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// The same, but if sketch_compression is positive the quantiles of the raster
+// are estimated from a quantile sketch rather than from a sorted copy
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+float LSDRaster::get_threshold_for_floodplain_QQ(string q_q_filename, float threshold_condition, int lower_percentile, int upper_percentile, float sketch_compression)
+{
+  vector<float> quantile_values,normal_variates,mn_values;
+  int N_points = 10000;//values.size();
+  if (sketch_compression > 0)
   {
-    for (int col = 0; col < NCols; col++)
+    // only the non-negative data is used
+    QuantileSketch sketch(sketch_compression);
+    for (int row = 0; row < NRows; row++)
     {
-      if(RasterData[row][col] >= 0) raster_vector.push_back(RasterData[row][col]);
+      for (int col = 0; col < NCols; col++)
+      {
+        if(RasterData[row][col] >= 0) sketch.add(RasterData[row][col]);
+      }
     }
+    quantile_quantile_analysis_defined_percentiles(sketch, quantile_values, normal_variates, mn_values, N_points, lower_percentile, upper_percentile);
+  }
+  else
+  {
+    //get vector of raster data
+    vector<float> raster_vector;
+    for (int row = 0; row < NRows; row++)
+    {
+      for (int col = 0; col < NCols; col++)
+      {
+        if(RasterData[row][col] >= 0) raster_vector.push_back(RasterData[row][col]);
+      }
+    }
+    quantile_quantile_analysis_defined_percentiles(raster_vector, quantile_values, normal_variates, mn_values, N_points, lower_percentile, upper_percentile);
   }
-
-  vector<float> quantile_values,normal_variates,mn_values;
-  int N_points = 10000;//values.size();
-  quantile_quantile_analysis_defined_percentiles(raster_vector, quantile_values, normal_variates, mn_values, N_points, lower_percentile, upper_percentile);
   ofstream ofs;
   ofs.open(q_q_filename.c_str());
 
@@ -13277,12 +13510,13 @@ LSDRaster LSDRaster::PoupulateRasterGaussian(float minimum, float mean){
 
   bool allowNegative = false;
   Array2D<float> Gauss(NRows, NCols, NoDataValue);
+  RandomStream rng = get_serial_random_stream();
 
   for (int i = 1; i < NRows - 1; ++i){
     for (int j = 1; j < NCols - 1; ++j){
 
       if (RasterData[i][j] != NoDataValue){
-        Gauss[i][j] = getGaussianRandom(minimum, mean, allowNegative);
+        Gauss[i][j] = getGaussianRandom(minimum, mean, allowNegative, rng);
       }
     }
   }
@@ -811,6 +811,18 @@ class LSDRaster
   /// @date Feb 2015
   Array2D<float> Shadows(int Azimuth, int ZenithAngle);
 
+  /// @brief The shadow search of Shadows, without printing to screen.
+  ///
+  /// @details It only reads the raster so several angles can be searched at
+  /// once on different threads.
+  /// @param Azimuth of the illumination source in degrees.
+  /// @param ZenithAngle of the illumination source in degrees
+  /// @param in_shadow replaced with 1 for cells in shadow and 0 otherwise, in
+  /// row major order
+  /// @author MDH
+  /// @date Feb 2015
+  void shadow_mask(int Azimuth, int ZenithAngle, vector<short>& in_shadow);
+
   /// @brief This function generates a topographic shielding raster using the algorithm
   /// outlined in Codilean (2006).
   ///
@@ -826,6 +838,10 @@ class LSDRaster
   /// Takes 2 ints, representing the theta, phi paring required.
   /// Codilean (2006) used 5,5 as the standard values, but in reality values of
   /// 10,15 are often preferred to save processing time.
+  ///
+  /// The shadows of the different angles are found in parallel and added up
+  /// in the order of the angles, so the whole DEM can be shielded at once and
+  /// the result does not depend on the number of threads.
   /// @param theta_step Spacing of sampled theta values.
   /// @param phi_step Spacing of sampled phi values.
   /// @pre phi_step must be a factor of 360.
@@ -865,6 +881,35 @@ class LSDRaster
   /// @date 28/03/2014
   vector<LSDRaster> calculate_polyfit_surface_metrics(float window_radius, vector<int> raster_selection);
 
+  /// @brief Sets up the kernel for the polynomial surface fitting.
+  /// @param window_radius the radius of the circular window
+  /// @param kr replaced with the radius of the kernel in cells
+  /// @param x_kernel replaced with the x offsets of the kernel cells
+  /// @param y_kernel replaced with the y offsets of the kernel cells
+  /// @param mask replaced with the circular mask (1 inside the window)
+  /// @param A replaced with the 6x6 matrix of the normal equations
+  /// @author DTM
+  /// @date 28/03/2014
+  void build_polyfit_kernel(float window_radius, int& kr, Array2D<float>& x_kernel,
+                            Array2D<float>& y_kernel, Array2D<int>& mask, Array2D<float>& A);
+
+  /// @brief Tangential curvature from the polynomial surface fit for a block
+  /// of the raster.
+  ///
+  /// @detail The values are identical to the tangential curvature returned by
+  /// calculate_polyfit_surface_metrics: the windows of cells near the edge of the
+  /// block read the surrounding cells of the raster. This lets the curvature be
+  /// streamed tile by tile, and since no data members are changed blocks can be
+  /// done in parallel.
+  /// @param window_radius the radius of the circular window
+  /// @param row_start the first row of the block
+  /// @param col_start the first column of the block
+  /// @param n_block_rows number of rows in the block
+  /// @param n_block_cols number of columns in the block
+  /// @return An n_block_rows x n_block_cols array of tangential curvature
+  Array2D<float> calculate_polyfit_tangential_curvature_block(float window_radius,
+                                  int row_start, int col_start, int n_block_rows, int n_block_cols);
+
   /// @brief Surface polynomial fitting and extraction of roughness metrics
   ///
   /// @detail
@@ -2133,6 +2178,14 @@ class LSDRaster
   /// @author DTM
   /// @date 10/02/2015
   LSDIndexRaster IsolateChannelsQuantileQuantile(string q_q_filename);
+
+  /// @brief As IsolateChannelsQuantileQuantile, but optionally estimating the
+  /// quantiles from a quantile sketch rather than a sorted copy of the raster.
+  /// @param string q_q_file A text file containing data to produce a q_q_plot.
+  /// @param sketch_compression The compression of the QuantileSketch. If this
+  /// is 0 or less the quantiles are exact.
+  /// @return LSDIndexRaster A binary raster where the pixel value is 1 where the input raster exceeded the defined threshold
+  LSDIndexRaster IsolateChannelsQuantileQuantile(string q_q_filename, float sketch_compression);
   LSDIndexRaster IsolateChannelsQuantileQuantileAdaptive(int half_width);
 
   /// @brief Function to calculate the curvature threshold used for DrEICH channel extraction which varies across the landscape
@@ -2246,6 +2299,13 @@ class LSDRaster
   /// @date 16/11/15
   float get_threshold_for_floodplain_QQ(string q_q_filename, float threshold_condition, int lower_percentile, int upper_percentile);
 
+  /// @brief Function to get threshold from a raster using qq plots, optionally
+  /// estimating the quantiles from a quantile sketch rather than a sorted copy of the raster
+  /// @param q_q_filename Filename for the txt file with the data to visualise the qq plot
+  /// @param sketch_compression The compression of the QuantileSketch. If this
+  /// is 0 or less the quantiles are exact.
+  float get_threshold_for_floodplain_QQ(string q_q_filename, float threshold_condition, int lower_percentile, int upper_percentile, float sketch_compression);
+
   /// @brief Get the lengths in spatial units of each part of the channel network, divided by strahler order.
   /// @param StreamNetwork Raster of the stream network coded by strahler order.
   /// @param FlowDir Array of flowdirections from FlowInfo (Not D-inf).
@@ -306,14 +306,14 @@ void LSDRasterMaker::smooth(int boundary_type)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void LSDRasterMaker::random_square_blobs(int minimum_blob_size, int maximum_blob_size, float minimum_value, float maximum_value, int n_blobs)
 {
-  long seed = time(NULL);
+  RandomStream rng = get_serial_random_stream();
   
   // Lets make some blobs!!!
   for (int blob_n = 0; blob_n < n_blobs; blob_n++)
   {
     // get the centrepoint of the blob
-    float row_frac = ran3(&seed);
-    float col_frac = ran3(&seed);
+    float row_frac = rng.uniform();
+    float col_frac = rng.uniform();
     
     // get the row and column of the centre of the blob
     float frow = row_frac*float(NRows);
@@ -352,7 +352,7 @@ void LSDRasterMaker::random_square_blobs(int minimum_blob_size, int maximum_blob
     }
     else
     {
-      this_size = ran3(&seed)*float(size_range)+float(minimum_blob_size);
+      this_size = rng.uniform()*float(size_range)+float(minimum_blob_size);
     }
     
     int size = int(this_size);
@@ -374,7 +374,7 @@ void LSDRasterMaker::random_square_blobs(int minimum_blob_size, int maximum_blob
     }
     else
     {
-      this_blob_value = ran3(&seed)*value_range+minimum_value;
+      this_blob_value = rng.uniform()*value_range+minimum_value;
     }
     
     //cout << "This blob is: " << blob_n << " with a K of: " << this_blob_value << endl;
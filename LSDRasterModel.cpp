@@ -627,8 +627,8 @@ void LSDRasterModel::initialise_parabolic_surface(float peak_elev, float edge_of
   float row_elev;
   float perturb;
 
-  // the seed for the random perturbation
-  long seed = time(NULL);
+  // the random stream for the perturbation
+  RandomStream rng = get_serial_random_stream();
 
   // loop through getting the parabolic elevation at each row, and then
   // writing across the entire domain
@@ -648,7 +648,7 @@ void LSDRasterModel::initialise_parabolic_surface(float peak_elev, float edge_of
       }
       else      // elsewhere initiate with a parabola
       {
-        perturb = (ran3(&seed))*noise;
+        perturb = (rng.uniform())*noise;
         RasterData[row][col] = row_elev + perturb + edge_offset;
       }
     }
@@ -109,7 +109,11 @@ float ran3(long *idum)
    static int iff=0;
    long mj,mk;
    int i,ii,k;
+   float random_number;
 
+   // the generator state is shared so only one thread can draw at a time
+   #pragma omp critical(ran3_state)
+   {
    if (*idum < 0 || iff == 0) {
       iff=1;
       if(*idum>0)
@@ -141,7 +145,9 @@ float ran3(long *idum)
    mj=ma[inext]-ma[inextp];
    if (mj < MZ) mj += MBIG;
    ma[inext]=mj;
-   return fabs(mj*FAC);
+   random_number = fabs(mj*FAC);
+   }
+   return random_number;
 }
 #undef MBIG
 #undef MSEED
@@ -149,6 +155,478 @@ float ran3(long *idum)
 #undef FAC
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// RandomStream: Philox4x32-10
+// The key is the seed and the counter holds the stream id in its upper two
+// words and the block number in its lower two, so every stream has 2^64 blocks
+// of four numbers to itself. A subsystem name is hashed (64 bit FNV-1a) into
+// the key, giving each named set of streams a sequence of its own.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+void RandomStream::create(long seed, long stream_id)
+{
+  uint64_t seed_bits = uint64_t(seed);
+  uint64_t stream_bits = uint64_t(stream_id);
+  key[0] = uint32_t(seed_bits);
+  key[1] = uint32_t(seed_bits >> 32);
+  counter[0] = 0;
+  counter[1] = 0;
+  counter[2] = uint32_t(stream_bits);
+  counter[3] = uint32_t(stream_bits >> 32);
+
+  // forces a new block on the first draw
+  block_position = 4;
+}
+
+void RandomStream::create(long seed, string subsystem, long stream_id)
+{
+  uint64_t name_hash = 14695981039346656037ULL;
+  for (size_t i = 0; i<subsystem.size(); i++)
+  {
+    name_hash ^= uint64_t((unsigned char)(subsystem[i]));
+    name_hash *= 1099511628211ULL;
+  }
+  create(long(uint64_t(seed) ^ name_hash),stream_id);
+}
+
+void RandomStream::generate_block()
+{
+  uint32_t x0 = counter[0];
+  uint32_t x1 = counter[1];
+  uint32_t x2 = counter[2];
+  uint32_t x3 = counter[3];
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+
+  for(int round = 0; round<10; round++)
+  {
+    uint64_t product0 = uint64_t(PHILOX_M0)*uint64_t(x0);
+    uint64_t product1 = uint64_t(PHILOX_M1)*uint64_t(x2);
+    x0 = uint32_t(product1 >> 32) ^ x1 ^ k0;
+    x1 = uint32_t(product1);
+    x2 = uint32_t(product0 >> 32) ^ x3 ^ k1;
+    x3 = uint32_t(product0);
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  block[0] = x0;
+  block[1] = x1;
+  block[2] = x2;
+  block[3] = x3;
+  block_position = 0;
+
+  // advance the block number
+  if (++counter[0] == 0)
+  {
+    ++counter[1];
+  }
+}
+
+uint32_t RandomStream::next_uint32()
+{
+  if (block_position == 4)
+  {
+    generate_block();
+  }
+  return block[block_position++];
+}
+
+float RandomStream::uniform()
+{
+  // the top 24 bits fill the float mantissa exactly so this never rounds up to 1
+  return float(next_uint32() >> 8)*(1.0f/16777216.0f);
+}
+
+double RandomStream::uniform_double()
+{
+  uint64_t high = next_uint32() >> 5;
+  uint64_t low = next_uint32() >> 6;
+  return double((high << 26) | low)*(1.0/9007199254740992.0);
+}
+
+double RandomStream::normal_double()
+{
+  // Box-Muller rather than a rejection method so that every deviate uses the
+  // same number of draws and discard can skip over them.
+  // 1-u is in (0,1] so the log is finite
+  double u1 = 1.0-uniform_double();
+  double u2 = uniform_double();
+  return sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+}
+
+void RandomStream::discard(unsigned long long n_draws)
+{
+  // first use up what is left of the current block
+  uint64_t left_in_block = uint64_t(4-block_position);
+  if (n_draws < left_in_block)
+  {
+    block_position += int(n_draws);
+    return;
+  }
+  n_draws -= left_in_block;
+
+  // the counter holds the number of the next block so whole blocks are
+  // skipped by advancing it
+  uint64_t block_number = (uint64_t(counter[1]) << 32) | uint64_t(counter[0]);
+  block_number += n_draws/4;
+  counter[0] = uint32_t(block_number);
+  counter[1] = uint32_t(block_number >> 32);
+  block_position = 4;
+
+  // and then the draws into the block after that
+  int remainder = int(n_draws%4);
+  if (remainder > 0)
+  {
+    generate_block();
+    block_position = remainder;
+  }
+}
+#undef PHILOX_M0
+#undef PHILOX_M1
+#undef PHILOX_W0
+#undef PHILOX_W1
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The master seed shared by all the random streams of a run
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+static long random_master_seed = 0;
+static bool random_master_seed_is_set = false;
+static long last_serial_stream_id = 0;
+
+long get_random_master_seed()
+{
+  long seed;
+  #pragma omp critical(random_master_seed)
+  {
+    if (random_master_seed_is_set == false)
+    {
+      random_master_seed = long(time(NULL));
+      random_master_seed_is_set = true;
+    }
+    seed = random_master_seed;
+  }
+  return seed;
+}
+
+void set_random_master_seed(long seed)
+{
+  #pragma omp critical(random_master_seed)
+  {
+    random_master_seed = seed;
+    random_master_seed_is_set = true;
+    last_serial_stream_id = 0;
+  }
+}
+
+RandomStream get_serial_random_stream()
+{
+  long stream_id;
+  #pragma omp critical(random_master_seed)
+  {
+    stream_id = --last_serial_stream_id;
+  }
+  return RandomStream(get_random_master_seed(),stream_id);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The quantile sketch
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void QuantileSketch::create(double this_compression)
+{
+  compression = (this_compression < 10) ? 10 : this_compression;
+  buffer_capacity = size_t(10*compression);
+  means.clear();
+  weights.clear();
+  buffer_values.clear();
+  buffer_weights.clear();
+  buffer_values.reserve(buffer_capacity);
+  buffer_weights.reserve(buffer_capacity);
+  sorted_buffer_values.clear();
+  sorted_buffer_weights.clear();
+  sorted_buffer_is_current = false;
+  total_weight = 0;
+  minimum = 0;
+  maximum = 0;
+}
+
+void QuantileSketch::add(double value, double weight)
+{
+  if (weight <= 0)
+  {
+    return;
+  }
+  if (total_weight == 0)
+  {
+    minimum = value;
+    maximum = value;
+  }
+  else
+  {
+    if (value < minimum) minimum = value;
+    if (value > maximum) maximum = value;
+  }
+  buffer_values.push_back(value);
+  buffer_weights.push_back(weight);
+  total_weight += weight;
+  sorted_buffer_is_current = false;
+
+  if (buffer_values.size() > buffer_capacity)
+  {
+    compress();
+  }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+  // the other sketch's centroids and buffer are just weighted values
+  int n_centroids = int(other.means.size());
+  for (int i = 0; i<n_centroids; i++)
+  {
+    add(other.means[i],other.weights[i]);
+  }
+  int n_buffer = int(other.buffer_values.size());
+  for (int i = 0; i<n_buffer; i++)
+  {
+    add(other.buffer_values[i],other.buffer_weights[i]);
+  }
+
+  // the centroid means lie inside the range of the other sketch's data,
+  // so its extremes need to be carried across explicitly
+  if (other.total_weight > 0)
+  {
+    if (other.minimum < minimum) minimum = other.minimum;
+    if (other.maximum > maximum) maximum = other.maximum;
+  }
+}
+
+void QuantileSketch::compress()
+{
+  if (buffer_values.empty())
+  {
+    return;
+  }
+
+  // sort the buffer and merge it with the centroids, which are already in
+  // order. Sorting on the (value, weight) pairs means ties are broken the
+  // same way every time.
+  vector< pair<double,double> > buffer_points(buffer_values.size());
+  for (size_t i = 0; i<buffer_values.size(); i++)
+  {
+    buffer_points[i] = make_pair(buffer_values[i],buffer_weights[i]);
+  }
+  buffer_values.clear();
+  buffer_weights.clear();
+  sort(buffer_points.begin(),buffer_points.end());
+
+  vector< pair<double,double> > centroid_points(means.size());
+  for (size_t i = 0; i<means.size(); i++)
+  {
+    centroid_points[i] = make_pair(means[i],weights[i]);
+  }
+  vector< pair<double,double> > points(centroid_points.size()+buffer_points.size());
+  std::merge(centroid_points.begin(),centroid_points.end(),
+             buffer_points.begin(),buffer_points.end(),points.begin());
+
+  // the k_1 scale function, k = delta/(2 pi) asin(2q-1). Each centroid may
+  // span at most one unit of k, which keeps the centroids small in the tails
+  double k_scale = compression/(2.0*M_PI);
+  double W = 0;
+  for (size_t i = 0; i<points.size(); i++)
+  {
+    W += points[i].second;
+  }
+
+  vector<double> new_means;
+  vector<double> new_weights;
+  double weight_so_far = 0;
+  double this_sum = points[0].first*points[0].second;
+  double this_weight = points[0].second;
+  double q_limit = 0.5*(sin( (k_scale*asin(-1.0)+1.0)/k_scale )+1.0);
+  for (size_t i = 1; i<points.size(); i++)
+  {
+    double proposed = this_weight + points[i].second;
+    if ( (weight_so_far+proposed)/W <= q_limit)
+    {
+      this_sum += points[i].first*points[i].second;
+      this_weight = proposed;
+    }
+    else
+    {
+      new_means.push_back(this_sum/this_weight);
+      new_weights.push_back(this_weight);
+      weight_so_far += this_weight;
+
+      double q = weight_so_far/W;
+      if (q > 1) q = 1;
+      double k = k_scale*asin(2*q-1)+1.0;
+      q_limit = (k/k_scale >= M_PI/2) ? 1.0 : 0.5*(sin(k/k_scale)+1.0);
+
+      this_sum = points[i].first*points[i].second;
+      this_weight = points[i].second;
+    }
+  }
+  new_means.push_back(this_sum/this_weight);
+  new_weights.push_back(this_weight);
+
+  means.swap(new_means);
+  weights.swap(new_weights);
+}
+
+int QuantileSketch::get_n_centroids()
+{
+  if (!means.empty())
+  {
+    compress();
+    return int(means.size());
+  }
+  return int(buffer_values.size());
+}
+
+double QuantileSketch::quantile(double q)
+{
+  if (total_weight == 0)
+  {
+    return 0;
+  }
+  if (q <= 0) return minimum;
+  if (q >= 1) return maximum;
+
+  // Until the buffer has overflowed for the first time there are no centroids
+  // and the buffer holds every value, so the quantile can be exact. The sorted
+  // buffer is kept so repeated queries do not sort it again.
+  vector<double>* point_values = &means;
+  vector<double>* point_weights = &weights;
+  if (means.empty())
+  {
+    if (!sorted_buffer_is_current)
+    {
+      vector< pair<double,double> > buffer_points(buffer_values.size());
+      for (size_t i = 0; i<buffer_values.size(); i++)
+      {
+        buffer_points[i] = make_pair(buffer_values[i],buffer_weights[i]);
+      }
+      sort(buffer_points.begin(),buffer_points.end());
+      sorted_buffer_values.resize(buffer_points.size());
+      sorted_buffer_weights.resize(buffer_points.size());
+      for (size_t i = 0; i<buffer_points.size(); i++)
+      {
+        sorted_buffer_values[i] = buffer_points[i].first;
+        sorted_buffer_weights[i] = buffer_points[i].second;
+      }
+      sorted_buffer_is_current = true;
+    }
+    point_values = &sorted_buffer_values;
+    point_weights = &sorted_buffer_weights;
+  }
+  else
+  {
+    compress();
+  }
+
+  // Each centroid sits at the middle of the ranks it covers, and we
+  // interpolate linearly in rank between them (and out to the minimum and
+  // maximum). For single values this is the interpolation of get_percentile.
+  double rank = q*(total_weight-1);
+  int n_points = int(point_values->size());
+  double start = 0;
+  double prev_rank = 0;
+  double prev_value = minimum;
+  for (int i = 0; i<n_points; i++)
+  {
+    double this_rank = start + 0.5*((*point_weights)[i]-1);
+    if (rank <= this_rank)
+    {
+      if (this_rank <= prev_rank)
+      {
+        return (*point_values)[i];
+      }
+      double frac = (rank-prev_rank)/(this_rank-prev_rank);
+      return prev_value + frac*((*point_values)[i]-prev_value);
+    }
+    prev_rank = this_rank;
+    prev_value = (*point_values)[i];
+    start += (*point_weights)[i];
+  }
+  double last_rank = total_weight-1;
+  if (last_rank <= prev_rank)
+  {
+    return maximum;
+  }
+  double frac = (rank-prev_rank)/(last_rank-prev_rank);
+  return prev_value + frac*(maximum-prev_value);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Build quantile sketches of data in parallel. The blocks have a fixed size
+// so the result does not depend on the number of threads.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+QuantileSketch build_quantile_sketch(vector<float>& data, float ndv, double compression)
+{
+  const int block_size = 65536;
+  int n_data = int(data.size());
+  int n_blocks = (n_data+block_size-1)/block_size;
+  vector<QuantileSketch> block_sketches(n_blocks, QuantileSketch(compression));
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for (int b = 0; b<n_blocks; b++)
+  {
+    int end = min(n_data,(b+1)*block_size);
+    for (int i = b*block_size; i<end; i++)
+    {
+      if (data[i] != ndv)
+      {
+        block_sketches[b].add(data[i]);
+      }
+    }
+  }
+
+  QuantileSketch sketch(compression);
+  for (int b = 0; b<n_blocks; b++)
+  {
+    sketch.merge(block_sketches[b]);
+  }
+  return sketch;
+}
+
+QuantileSketch build_quantile_sketch(Array2D<float>& data, float ndv, double compression)
+{
+  int NRows = data.dim1();
+  int NCols = data.dim2();
+  int rows_per_block = (NCols > 0) ? max(1,65536/NCols) : 1;
+  int n_blocks = (NRows+rows_per_block-1)/rows_per_block;
+  vector<QuantileSketch> block_sketches(n_blocks, QuantileSketch(compression));
+
+  #pragma omp parallel for schedule(dynamic,1)
+  for (int b = 0; b<n_blocks; b++)
+  {
+    int end = min(NRows,(b+1)*rows_per_block);
+    for (int row = b*rows_per_block; row<end; row++)
+    {
+      for (int col = 0; col<NCols; col++)
+      {
+        if (data[row][col] != ndv)
+        {
+          block_sketches[b].add(data[row][col]);
+        }
+      }
+    }
+  }
+
+  QuantileSketch sketch(compression);
+  for (int b = 0; b<n_blocks; b++)
+  {
+    sketch.merge(block_sketches[b]);
+  }
+  return sketch;
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 //These return the keys from a map
 vector<string> extract_keys(map<string, int> input_map)
@@ -343,7 +821,7 @@ Array2D<int> revetrse_array_cols(Array2D<int> data_array)
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // Randomly sample from a vector without replacement DTM 21/04/2014
 //------------------------------------------------------------------------------
-vector<float> sample_without_replacement(vector<float> population_vector, int N)
+vector<float> sample_without_replacement(vector<float> population_vector, int N, RandomStream& rng)
 {
   vector<float> sample_vector;
   int Population = population_vector.size();
@@ -355,13 +833,11 @@ vector<float> sample_without_replacement(vector<float> population_vector, int N)
 
   int sample_count = 0;
   float random_number,Population_remaining;
-  long seed;
   int vector_ref;
   while (sample_count < N)
   {
     Population_remaining = population_vector.size();
-    seed = time(NULL);
-    random_number = ran3(&seed);
+    random_number = rng.uniform();
     vector_ref = floor(random_number*Population_remaining);
 
     if(vector_ref == Population_remaining)
@@ -375,7 +851,7 @@ vector<float> sample_without_replacement(vector<float> population_vector, int N)
   }
   return sample_vector;
 }
-vector<int> sample_without_replacement(vector<int> population_vector, int N)
+vector<int> sample_without_replacement(vector<int> population_vector, int N, RandomStream& rng)
 {
   vector<int> sample_vector;
   int Population = population_vector.size();
@@ -387,13 +863,11 @@ vector<int> sample_without_replacement(vector<int> population_vector, int N)
 
   int sample_count = 0;
   float random_number,Population_remaining;
-  long seed;
   int vector_ref;
   while (sample_count < N)
   {
     Population_remaining = population_vector.size();
-    seed = time(NULL);
-    random_number = ran3(&seed);
+    random_number = rng.uniform();
     vector_ref = floor(random_number*Population_remaining);
 
     if(vector_ref == Population_remaining)
@@ -462,6 +936,10 @@ float get_median(vector<float> y_data, float ndv)
     }
   }
   int n_data_points = y_data_nndv.size();
+  if (n_data_points == 0)
+  {
+    return ndv;
+  }
 
   sort(y_data_nndv.begin(),y_data_nndv.end());
 
@@ -1060,6 +1538,12 @@ float get_percentile(vector<float>& data, float percentile)
   else percentile_value = data[k] + d*(data[k+1]-data[k]);
   return percentile_value;
 }
+
+// The same, estimated from a quantile sketch
+float get_percentile(QuantileSketch& sketch, float percentile)
+{
+  return float(sketch.percentile(percentile));
+}
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 // quantile_quantile_analysis
@@ -1070,41 +1554,7 @@ float get_percentile(vector<float>& data, float percentile)
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 void quantile_quantile_analysis(vector<float>& data, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points)
 {
-  vector<size_t> index_map;
-  vector<float> data_sorted;
-  matlab_float_sort(data, data_sorted, index_map);
-  float quantile,x;
-  vector<float> snv,vals;
-
-  for(int i = 0; i < N_points; ++i)
-  {
-    quantile = (1.+ float(i))/(float(N_points)+1.);
-    x = (sqrt(2)*inverf(quantile*2-1));
-    vals.push_back(get_percentile(data_sorted, quantile*100));
-    snv.push_back(x);
-  }
-  // CONSTRUCTING NORMALLY DISTRIBUTED MODEL
-  // Now get upper quartile and lower quartile boundaries
-  float q25x = get_percentile(snv,25);
-  float q75x = get_percentile(snv,75);
-  float q25y = get_percentile(vals,25);
-  float q75y = get_percentile(vals,75);
-
-  float slope = (q75y-q25y)/(q75x-q25x);
-//   cout << "slope = " << slope << endl;
-  float centerx = (q25x + q75x)/2;
-  float centery = (q25y + q75y)/2;
-  float intercept =centery-slope*centerx;
-  vector<float> mn_vals;
-
-  for(int i = 0; i < N_points; ++i)
-  {
-    mn_vals.push_back(intercept+slope*snv[i]);
-  }
-
-  standard_normal_variates=snv;
-  values = vals;
-  mn_values = mn_vals;
+  quantile_quantile_analysis_defined_percentiles(data, values, standard_normal_variates, mn_values, N_points, 25, 75);
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
@@ -1133,29 +1583,62 @@ void quantile_quantile_analysis_defined_percentiles(vector<float>& data, vector<
     vals.push_back(get_percentile(data_sorted, quantile*100));
     snv.push_back(x);
   }
-  // CONSTRUCTING NORMALLY DISTRIBUTED MODEL
-  // Now get upper quartile and lower quartile boundaries
-  float q_lower_x = get_percentile(snv,lower_percentile);
-  float q_upper_x = get_percentile(snv,upper_percentile);
-  float q_lower_y = get_percentile(vals,lower_percentile);
-  float q_upper_y = get_percentile(vals,upper_percentile);
-	cout << "q_lower_x: " << q_lower_x << " q_lower_y: " << q_lower_y << " q_upper_x: " << q_upper_x << " q_upper_y: " << q_upper_y << endl;
 
-  float slope = (q_upper_y-q_lower_y)/(q_upper_x-q_lower_x);
-//   cout << "slope = " << slope << endl;
-  float centerx = (q_lower_x + q_upper_x)/2;
-  float centery = (q_lower_y + q_upper_y)/2;
-  float intercept =centery-slope*centerx;
-  vector<float> mn_vals;
+  standard_normal_variates=snv;
+  values = vals;
+  mn_values = quantile_quantile_normal_model(snv, vals, lower_percentile, upper_percentile);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// quantile_quantile_analysis from a quantile sketch. The quantiles of the data
+// are estimated from the sketch so no sorted copy of the data is needed
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void quantile_quantile_analysis(QuantileSketch& sketch, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points)
+{
+  quantile_quantile_analysis_defined_percentiles(sketch, values, standard_normal_variates, mn_values, N_points, 25, 75);
+}
 
+void quantile_quantile_analysis_defined_percentiles(QuantileSketch& sketch, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points, int lower_percentile, int upper_percentile)
+{
+  vector<float> vals,snv;
   for(int i = 0; i < N_points; ++i)
   {
-    mn_vals.push_back(intercept+slope*snv[i]);
+    float quantile = (1.+ float(i))/(float(N_points)+1.);
+    snv.push_back(sqrt(2)*inverf(quantile*2-1));
+    vals.push_back(float(sketch.percentile(quantile*100)));
   }
 
   standard_normal_variates=snv;
   values = vals;
-  mn_values = mn_vals;
+  mn_values = quantile_quantile_normal_model(snv, vals, lower_percentile, upper_percentile);
+}
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The normally distributed model of a quantile-quantile analysis: the line
+// through the lower and upper percentiles of the values against the standard
+// normal variates, evaluated at each variate
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<float> quantile_quantile_normal_model(vector<float>& standard_normal_variates, vector<float>& values, int lower_percentile, int upper_percentile)
+{
+  float q_lower_x = get_percentile(standard_normal_variates,lower_percentile);
+  float q_upper_x = get_percentile(standard_normal_variates,upper_percentile);
+  float q_lower_y = get_percentile(values,lower_percentile);
+  float q_upper_y = get_percentile(values,upper_percentile);
+
+  float slope = (q_upper_y-q_lower_y)/(q_upper_x-q_lower_x);
+  float centerx = (q_lower_x + q_upper_x)/2;
+  float centery = (q_lower_y + q_upper_y)/2;
+  float intercept = centery-slope*centerx;
+
+  vector<float> mn_vals;
+  int N_points = int(standard_normal_variates.size());
+  for(int i = 0; i < N_points; ++i)
+  {
+    mn_vals.push_back(intercept+slope*standard_normal_variates[i]);
+  }
+  return mn_vals;
 }
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
@@ -1332,12 +1815,11 @@ double Gauss_rand(int Nrand, double GaussAdd, double GaussFac)
 //
 // Extreme values can fall below or above the boundaries in < 3 sigma of cases.
 //
-// Seed for random number will fail post 2038. I will instruct my firstborn to resolve this
-// problem.
+// The uniform deviates are drawn from rng.
 //
 // SWDG 9/6/16
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-float getGaussianRandom(float minimum, float mean, bool allowNegative){
+float getGaussianRandom(float minimum, float mean, bool allowNegative, RandomStream& rng){
 
   float s = 0;
   float u = 0;
@@ -1346,11 +1828,8 @@ float getGaussianRandom(float minimum, float mean, bool allowNegative){
   while (s == 0.0 || s >= 1.0){
 
     //get random values from a uniform distribution between -1 and 1
-    long seed1 = time(NULL);
-    u = (ran3(&seed1) * 2.0) - 1.0;
-
-    long seed2= time(NULL);
-    v = (ran3(&seed2) * 2.0) - 1.0;
+    u = (rng.uniform() * 2.0) - 1.0;
+    v = (rng.uniform() * 2.0) - 1.0;
 
     s = (u * u) + (v * v);
 
@@ -1362,7 +1841,7 @@ float getGaussianRandom(float minimum, float mean, bool allowNegative){
 
   if (z < 0.0 && allowNegative == false){
     // recurse until a non negative value is generated.
-    getGaussianRandom(minimum, mean, allowNegative);
+    getGaussianRandom(minimum, mean, allowNegative, rng);
   }
   else{
     return z;
@@ -1384,47 +1863,68 @@ float getGaussianRandom(float minimum, float mean, bool allowNegative){
 // [6] standard deviation
 // [7] standard error
 // [8] median absolute deviation (MAD)
+// Resamples with fewer than two points or no spread in x have no slope and
+// are left out of the statistics. If no resample has a slope the statistics
+// are all -9999.
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-vector<float> bootstrap_linear_regression(vector<float>& x_data, vector<float>& y_data, int N_iterations, float acceptance_prob)
+vector<float> bootstrap_linear_regression(vector<float>& x_data, vector<float>& y_data, int N_iterations, float acceptance_prob,
+                                          RandomStream& rng)
 {
-  vector<float> residuals;
-  long seed1 = time(NULL);
   int N_nodes = int(x_data.size());
 
-  vector<float> regress_slope;
-  vector<float> regress_intercept;
-
+  // The iterations are independent so they run in parallel. Each iteration
+  // makes one draw per node, so iteration i skips ahead i*N_nodes draws and
+  // gets exactly the numbers it would have had in a serial loop.
+  // The regression is fused into the resampling pass: the accepted points
+  // update running means and co-moments (Welford) so nothing is copied.
+  vector<float> resample_slope(N_iterations,0.0);
+  vector<int> has_slope(N_iterations,0);
+  RandomStream start_rng = rng;
+  #pragma omp parallel for schedule(static)
   for(int i = 0; i<N_iterations; i++)
   {
-    vector<float> this_x;
-    vector<float> this_y;
+    RandomStream this_rng = start_rng;
+    this_rng.discard((unsigned long long)(i)*(unsigned long long)(N_nodes));
+
+    double n_kept = 0;
+    double mean_x = 0;
+    double mean_y = 0;
+    double C_xx = 0;
+    double C_xy = 0;
     for(int node = 0; node<N_nodes; node++)
     {
-      float this_prob = ran3(&seed1);
-      //cout << "node: " << node << " ap:" << acceptance_prob << " thisProb = " << this_prob << endl;
-
+      float this_prob = this_rng.uniform();
       if (this_prob > acceptance_prob)
       {
-        this_x.push_back( x_data[node]);
-        this_y.push_back( y_data[node]);
-
-        //cout << "x: " << x_data[node] << " y: " << y_data[node] << endl;
+        n_kept++;
+        double dx = double(x_data[node])-mean_x;
+        mean_x += dx/n_kept;
+        mean_y += (double(y_data[node])-mean_y)/n_kept;
+        C_xx += dx*(double(x_data[node])-mean_x);
+        C_xy += dx*(double(y_data[node])-mean_y);
       }
-
-
-
     }
-    // get the regression
-    vector<float> regress_coeff = simple_linear_regression(this_x, this_y, residuals);
-    regress_slope.push_back(regress_coeff[0]);
-    regress_intercept.push_back(regress_coeff[1]);
-
-    //cout << "RS: " << regress_coeff[0] << " RI: " << regress_coeff[1] << endl;
 
+    // fewer than two points or no spread in x has no regression
+    if (C_xx > 0)
+    {
+      resample_slope[i] = float(C_xy/C_xx);
+      has_slope[i] = 1;
+    }
+  }
+  // leave the caller's stream where the serial loop would have left it
+  rng.discard((unsigned long long)(N_iterations)*(unsigned long long)(N_nodes));
 
+  // Now the slopes are contained in the regress_slope vector.
+  // These can be used to get median and confidence interval numbers.
+  vector<float> regress_slope;
+  for(int i = 0; i<N_iterations; i++)
+  {
+    if (has_slope[i])
+    {
+      regress_slope.push_back(resample_slope[i]);
+    }
   }
-  // Now the slope and intercept will be contained in regress_slope and regress_intercept
-  // vectors. These can be used to get median and confidence interval numbers.
   vector<float> descriptive_stats_slope =  calculate_descriptive_stats(regress_slope);
 
   //cout << "Got the descriptive stats from the bootstrap: " << endl;
@@ -3846,7 +4346,7 @@ void generate_random_segments(float sigma, int minimum_n_nodes, int mean_segment
     cout << " changing to maximum segment length allowed" << endl;
     segment_range = 2*mean_segment_length -2;
   }
-  long seed = time(NULL);
+  RandomStream rng = get_serial_random_stream();
 
   // set up data vectors
   vector<float> empty_vec;
@@ -3863,7 +4363,7 @@ void generate_random_segments(float sigma, int minimum_n_nodes, int mean_segment
   int this_segment_length;
   while (total_nodes < minimum_n_nodes)
   {
-    this_segment_length = int (float(segment_range)*ran3(&seed))
+    this_segment_length = int (float(segment_range)*rng.uniform())
                           + mean_segment_length-int(0.5*float(segment_range));
 
     nodes_in_segments.push_back(this_segment_length);
@@ -3889,7 +4389,7 @@ void generate_random_segments(float sigma, int minimum_n_nodes, int mean_segment
     }
     else
     {
-      this_offset = ran3(&seed)*offset_range;
+      this_offset = rng.uniform()*offset_range;
       segment_x_data.push_back(old_x+dx);
       segment_y_data.push_back(old_y+this_offset);
       old_x += dx;
@@ -3897,7 +4397,7 @@ void generate_random_segments(float sigma, int minimum_n_nodes, int mean_segment
     }
 
     // get the slope of this segment
-    this_m = ran3(&seed)*m_range;
+    this_m = rng.uniform()*m_range;
     slope_of_segments.push_back(this_m);
 
     // loop through the segment nodes, adding segments as one goes.
@@ -3931,7 +4431,7 @@ void generate_random_segments(float sigma, int minimum_n_nodes, int mean_segment
   cout << "n_nodes: " << total_nodes << " and in all_x_data: " << all_x_data.size() << endl;
   for(int node = 0; node<total_nodes; node++)
   {
-    all_y_data[node] += sigma*(ran3(&seed)-0.5);
+    all_y_data[node] += sigma*(rng.uniform()-0.5);
     cout << all_x_data[node] << " " << all_y_data[node] << endl;
   }
   cout << endl << endl;
@@ -4149,6 +4649,123 @@ float calculate_RMSE_from_residuals(vector<float>& residuals)
   return RMSE;
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The Gelman-Rubin potential scale reduction factor (Gelman and Rubin, 1992).
+// All chains must have the same length. Values close to 1 mean the chains
+// have mixed; returns a large number if there is nothing to compare.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float gelman_rubin_Rhat(vector< vector<float> >& chains)
+{
+  int n_chains = int(chains.size());
+  if (n_chains < 2 || chains[0].size() < 2)
+  {
+    return 1e10;
+  }
+  int n_samples = int(chains[0].size());
+
+  // the chain means and the within chain variances
+  vector<double> chain_means(n_chains,0.0);
+  double W = 0;
+  double grand_mean = 0;
+  for(int c = 0; c<n_chains; c++)
+  {
+    double sum = 0;
+    for(int i = 0; i<n_samples; i++)
+    {
+      sum += chains[c][i];
+    }
+    chain_means[c] = sum/double(n_samples);
+    grand_mean += chain_means[c];
+
+    double sum_sq = 0;
+    for(int i = 0; i<n_samples; i++)
+    {
+      double d = chains[c][i]-chain_means[c];
+      sum_sq += d*d;
+    }
+    W += sum_sq/double(n_samples-1);
+  }
+  W = W/double(n_chains);
+  grand_mean = grand_mean/double(n_chains);
+
+  // the between chain variance
+  double B = 0;
+  for(int c = 0; c<n_chains; c++)
+  {
+    double d = chain_means[c]-grand_mean;
+    B += d*d;
+  }
+  B = B*double(n_samples)/double(n_chains-1);
+
+  if (W <= 0)
+  {
+    // the chains are stuck: they have only mixed if they are stuck in the same place
+    return (B <= 0) ? 1.0 : 1e10;
+  }
+  double var_plus = (double(n_samples-1)/double(n_samples))*W + B/double(n_samples);
+  return float(sqrt(var_plus/W));
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The effective sample size of a chain. The integrated autocorrelation time
+// is summed over pairs of lags until the sum of a pair goes negative
+// (Geyer, 1992, the initial positive sequence estimator).
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float effective_sample_size(vector<float>& chain)
+{
+  int n_samples = int(chain.size());
+  if (n_samples < 4)
+  {
+    return float(n_samples);
+  }
+
+  double mean = 0;
+  for(int i = 0; i<n_samples; i++)
+  {
+    mean += chain[i];
+  }
+  mean = mean/double(n_samples);
+
+  vector<double> centred(n_samples);
+  double variance = 0;
+  for(int i = 0; i<n_samples; i++)
+  {
+    centred[i] = chain[i]-mean;
+    variance += centred[i]*centred[i];
+  }
+  if (variance <= 0)
+  {
+    // a chain that never moves carries the information of one sample
+    return 1.0;
+  }
+
+  // autocorrelation at lag 0 is 1, add the pairs of lags after that
+  double tau = -1.0;
+  for(int lag = 0; lag+1 < n_samples; lag += 2)
+  {
+    double rho_pair = 0;
+    for(int l = lag; l<= lag+1; l++)
+    {
+      double sum = 0;
+      for(int i = 0; i+l<n_samples; i++)
+      {
+        sum += centred[i]*centred[i+l];
+      }
+      rho_pair += sum/variance;
+    }
+    if (rho_pair < 0)
+    {
+      break;
+    }
+    tau += 2.0*rho_pair;
+  }
+  if (tau < 1.0)
+  {
+    tau = 1.0;
+  }
+  return float(double(n_samples)/tau);
+}
+
 
 string itoa(int num)
 {
@@ -7615,6 +8232,12 @@ float get_MAD(vector<float> vecval, float NDV)
 // BG - 08/01/2018
 vector<float> get_modified_z_score(vector<float> vecval,float NDV)
 {
+  // nothing to score
+  if (vecval.empty())
+  {
+    return vecval;
+  }
+
   // first get the MAD and the median
   float MAD = get_MAD(vecval,NDV);
   float med = get_median(vecval,NDV);
@@ -7743,7 +8366,7 @@ vector<float> gaussian_KDE(vector<float> vpoint, float h)
       // setting the testing for this run for this sum
       Xi = *tuvalu;
       float y = 0;
-      y = (X-Xi/h);
+      y = (X-Xi)/h;
       // incrementing the sum: using a gaussian kernel for each X - Xi
       sum += 1/(sqrt(2*PI)) * exp(-pow(y,2)/2);
     }
@@ -7756,6 +8379,382 @@ vector<float> gaussian_KDE(vector<float> vpoint, float h)
 
 }
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Binned kernel density estimation
+// The data are linearly binned onto a regular grid and the kernel is convolved
+// with the bin counts using an FFT, so the cost is O(n + M log M) for n data
+// and M grid points rather than the O(n^2) of the direct sum in gaussian_KDE.
+// Following Wand and Jones (1995) Kernel Smoothing, Appendix D, and the
+// KernSmooth implementation of it.
+//
+// Accuracy: the gaussian kernel is truncated at 5 bandwidths (the neglected
+// tail is below 6e-7 of the kernel mass) and linear binning with a grid spacing
+// delta perturbs each kernel by at most (delta/h)^2/8 of its peak height. The
+// densities at the data are linearly interpolated from the grid, which adds at
+// most the same again, so the binned density differs from the exact sum by less
+// than (delta/h)^2/4 of the maximum density. With the default of 10 bins per
+// bandwidth that is 0.25%.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Linear binning: each datum splits its unit weight between the two grid
+// points either side of it in proportion to its distance from them.
+// Data outside [lo, hi] are dropped.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void linear_binning(vector<double>& x, double lo, double hi, int n_bins, vector<double>& counts)
+{
+  counts.assign(n_bins,0.0);
+  if (n_bins < 2)
+  {
+    if (n_bins == 1)
+    {
+      counts[0] = double(x.size());
+    }
+    return;
+  }
+  double delta = (hi-lo)/double(n_bins-1);
+  int n_data = int(x.size());
+  for (int i = 0; i<n_data; i++)
+  {
+    double pos = (x[i]-lo)/delta;
+    if (pos < 0 || pos > double(n_bins-1))
+    {
+      continue;
+    }
+    int left = int(floor(pos));
+    if (left >= n_bins-1)
+    {
+      counts[n_bins-1] += 1.0;
+    }
+    else
+    {
+      double frac = pos-double(left);
+      counts[left] += 1.0-frac;
+      counts[left+1] += frac;
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// An in place radix 2 complex FFT. The size of re and im must be a power of 2.
+// The inverse transform includes the 1/N normalisation.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void radix2_fft(vector<double>& re, vector<double>& im, bool inverse)
+{
+  int N = int(re.size());
+
+  // bit reversal permutation
+  for (int i = 1, j = 0; i<N; i++)
+  {
+    int bit = N >> 1;
+    for ( ; j & bit; bit >>= 1)
+    {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j)
+    {
+      swap(re[i],re[j]);
+      swap(im[i],im[j]);
+    }
+  }
+
+  // the butterflies
+  double sign = (inverse) ? 1.0 : -1.0;
+  for (int len = 2; len <= N; len <<= 1)
+  {
+    double angle = sign*2.0*M_PI/double(len);
+    double w_re = cos(angle);
+    double w_im = sin(angle);
+    for (int start = 0; start<N; start += len)
+    {
+      double cur_re = 1.0;
+      double cur_im = 0.0;
+      for (int k = 0; k < len/2; k++)
+      {
+        int a = start+k;
+        int b = a+len/2;
+        double t_re = re[b]*cur_re - im[b]*cur_im;
+        double t_im = re[b]*cur_im + im[b]*cur_re;
+        re[b] = re[a]-t_re;
+        im[b] = im[a]-t_im;
+        re[a] += t_re;
+        im[a] += t_im;
+        double next_re = cur_re*w_re - cur_im*w_im;
+        cur_im = cur_re*w_im + cur_im*w_re;
+        cur_re = next_re;
+      }
+    }
+  }
+
+  if (inverse)
+  {
+    for (int i = 0; i<N; i++)
+    {
+      re[i] /= double(N);
+      im[i] /= double(N);
+    }
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Convolve the bin counts with a symmetric kernel given at lags 0..L (in grid
+// spacings). Returns, for every grid point j, sum_i counts[i]*kernel[|j-i|].
+// The arrays are zero padded so the circular convolution does not wrap.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<double> convolve_binned_counts(vector<double>& counts, vector<double>& kernel)
+{
+  int M = int(counts.size());
+  int L = int(kernel.size())-1;
+  int P = 1;
+  while (P < M+L+1)
+  {
+    P <<= 1;
+  }
+
+  vector<double> k_re(P,0.0), k_im(P,0.0), c_re(P,0.0), c_im(P,0.0);
+  k_re[0] = kernel[0];
+  for (int l = 1; l<=L; l++)
+  {
+    k_re[l] = kernel[l];
+    k_re[P-l] = kernel[l];
+  }
+  for (int j = 0; j<M; j++)
+  {
+    c_re[j] = counts[j];
+  }
+
+  radix2_fft(k_re,k_im,false);
+  radix2_fft(c_re,c_im,false);
+  for (int i = 0; i<P; i++)
+  {
+    double re = k_re[i]*c_re[i] - k_im[i]*c_im[i];
+    double im = k_re[i]*c_im[i] + k_im[i]*c_re[i];
+    c_re[i] = re;
+    c_im[i] = im;
+  }
+  radix2_fft(c_re,c_im,true);
+
+  vector<double> conv(c_re.begin(),c_re.begin()+M);
+  return conv;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The binned gaussian density on the grid lo + j*delta, j = 0..n_bins-1
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<double> binned_gaussian_KDE_grid(vector<double>& x, double h, double lo, double hi, int n_bins)
+{
+  vector<double> counts;
+  linear_binning(x, lo, hi, n_bins, counts);
+  double n = double(x.size());
+  double delta = (n_bins > 1) ? (hi-lo)/double(n_bins-1) : 0.0;
+
+  // the kernel is truncated at 5 bandwidths
+  int L = (delta > 0) ? int(floor(5.0*h/delta)) : 0;
+  if (L > n_bins-1)
+  {
+    L = n_bins-1;
+  }
+  vector<double> kernel(L+1);
+  for (int l = 0; l<=L; l++)
+  {
+    double arg = double(l)*delta/h;
+    kernel[l] = exp(-0.5*arg*arg)/(sqrt(2.0*M_PI)*n*h);
+  }
+
+  return convolve_binned_counts(counts, kernel);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The binned estimate of the density functional psi_r = E[f^(r)(X)] (r even)
+// using a gaussian kernel with bandwidth g. This is bkfe in KernSmooth.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+double binned_kernel_functional(vector<double>& counts, int r, double g, double lo, double hi)
+{
+  int M = int(counts.size());
+  double delta = (hi-lo)/double(M-1);
+  double n = 0;
+  for (int j = 0; j<M; j++)
+  {
+    n += counts[j];
+  }
+
+  // the derivative kernels are truncated at 4+r bandwidths
+  double tau = 4.0+double(r);
+  int L = int(floor(tau*g/delta));
+  if (L > M-1)
+  {
+    L = M-1;
+  }
+
+  // phi^(r)(x) = He_r(x) phi(x) for even r, with He_r the Hermite polynomials
+  vector<double> kernel(L+1);
+  for (int l = 0; l<=L; l++)
+  {
+    double arg = double(l)*delta/g;
+    double He_old = 1.0;
+    double He = arg;
+    if (r == 0)
+    {
+      He = 1.0;
+    }
+    for (int i = 2; i<=r; i++)
+    {
+      double He_new = arg*He - double(i-1)*He_old;
+      He_old = He;
+      He = He_new;
+    }
+    kernel[l] = He*exp(-0.5*arg*arg)/(sqrt(2.0*M_PI)*pow(g,double(r+1)));
+  }
+
+  vector<double> conv = convolve_binned_counts(counts, kernel);
+  double psi = 0;
+  for (int j = 0; j<M; j++)
+  {
+    psi += counts[j]*conv[j];
+  }
+  return psi/(n*n);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The two stage direct plug-in bandwidth of Sheather and Jones (1991), as set
+// out by Wand and Jones (1995, section 3.6) and computed with binned
+// functionals (dpik in KernSmooth). Each stage is a single binned evaluation so
+// there is no search over bandwidths.
+// If the data are too few or too uniform for the plug-in it falls back to
+// Terrell's (1990) rule used by auto_KDE.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+float binned_plugin_bandwidth(vector<float> vpoint)
+{
+  int n = int(vpoint.size());
+  if (n == 0)
+  {
+    cout<< endl << "FATAL ERROR LSDStatstools::binned_plugin_bandwidth empty vector" << endl;
+    exit(EXIT_FAILURE);
+  }
+  float mean = get_mean(vpoint);
+  float S =  get_standard_deviation(vpoint,mean);
+  float terrell_h = 1.144 * S * pow(n, -0.2);
+  if (n < 3)
+  {
+    return terrell_h;
+  }
+
+  // the scale is the smaller of the standard deviation and the normalised IQR
+  vector<float> sorted_points = vpoint;
+  sort(sorted_points.begin(),sorted_points.end());
+  float IQR = get_percentile(sorted_points,75)-get_percentile(sorted_points,25);
+  double scale = S;
+  if (IQR > 0 && IQR/1.349 < scale)
+  {
+    scale = IQR/1.349;
+  }
+  if (scale <= 0)
+  {
+    return terrell_h;
+  }
+
+  // bin the standardised data
+  int n_bins = 401;
+  vector<double> x(n);
+  for (int i = 0; i<n; i++)
+  {
+    x[i] = (double(vpoint[i])-double(mean))/scale;
+  }
+  double lo = (double(sorted_points[0])-double(mean))/scale;
+  double hi = (double(sorted_points[n-1])-double(mean))/scale;
+  vector<double> counts;
+  linear_binning(x, lo, hi, n_bins, counts);
+
+  // stage one: psi_6 from the normal reference, stage two: psi_4 from psi_6
+  double dn = double(n);
+  double alpha = pow(2.0*pow(sqrt(2.0),9.0)/(7.0*dn),1.0/9.0);
+  double psi6 = binned_kernel_functional(counts, 6, alpha, lo, hi);
+  if (psi6 >= 0)
+  {
+    return terrell_h;
+  }
+  alpha = pow(-3.0*sqrt(2.0/M_PI)/(psi6*dn),1.0/7.0);
+  double psi4 = binned_kernel_functional(counts, 4, alpha, lo, hi);
+  if (psi4 <= 0)
+  {
+    return terrell_h;
+  }
+
+  double h = scale*pow(1.0/(2.0*sqrt(M_PI)*psi4*dn),0.2);
+  return float(h);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The binned gaussian density at each datum: a drop in replacement for
+// gaussian_KDE. bins_per_bandwidth sets the grid spacing (see the accuracy
+// note above); the grid is capped at 2^20 points so a few far outliers cannot
+// blow up the memory, which coarsens the grid in that case.
+// If h is not positive the density is undefined and NoData (-9999) is returned.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+vector<float> binned_gaussian_KDE(vector<float> vpoint, float h, int bins_per_bandwidth)
+{
+  int n = int(vpoint.size());
+  vector<float> vout(n,-9999);
+  if (n == 0 || h <= 0)
+  {
+    return vout;
+  }
+
+  vector<double> x(vpoint.begin(),vpoint.end());
+  double lo = *min_element(x.begin(),x.end());
+  double hi = *max_element(x.begin(),x.end());
+
+  int max_bins = 1 << 20;
+  double target_delta = double(h)/double(bins_per_bandwidth);
+  double n_bins_d = ceil((hi-lo)/target_delta)+1;
+  int n_bins = (n_bins_d > double(max_bins)) ? max_bins : int(n_bins_d);
+  if (n_bins < 2)
+  {
+    n_bins = 2;
+    hi = lo+target_delta;
+  }
+  double delta = (hi-lo)/double(n_bins-1);
+
+  vector<double> grid_density = binned_gaussian_KDE_grid(x, h, lo, hi, n_bins);
+
+  // interpolate back to the data
+  for (int i = 0; i<n; i++)
+  {
+    double pos = (x[i]-lo)/delta;
+    int left = int(floor(pos));
+    if (left >= n_bins-1)
+    {
+      vout[i] = float(grid_density[n_bins-1]);
+    }
+    else
+    {
+      double frac = pos-double(left);
+      vout[i] = float((1.0-frac)*grid_density[left] + frac*grid_density[left+1]);
+    }
+  }
+  return vout;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The binned counterpart of auto_KDE: plug-in bandwidth and binned density
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+pair<float,vector<float> > binned_auto_KDE(vector<float> vpoint)
+{
+  if(vpoint.size() == 0)
+  {
+    cout<< endl << "FATAL ERROR LSDStatstools::binned_auto_KDE empty vector" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  float h = binned_plugin_bandwidth(vpoint);
+  vector<float> vout = binned_gaussian_KDE(vpoint,h,10);
+
+  pair<float,vector<float> > gat = make_pair(h,vout);
+  return gat;
+}
+
+
 
 // Detection of outlier based on the First Minimum on the KDE pdf
 // Testing it right now
@@ -8336,18 +9335,46 @@ vector<double> TV1D_denoise_v2(vector<double> input,  double lambda) {
     cout << "Lambda = 0, TVD will only be a minimization by the sum of squares" << endl ;
   }
 
+  vector<double> output;
+  vector<unsigned int> indstart_low;
+  vector<unsigned int> indstart_up;
+  TV1D_denoise_v2(input, output, lambda, indstart_low, indstart_up);
+  return output;
+}
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// The working version of the taut string denoiser. The output and the two
+// segment start buffers are resized here, so a caller denoising many signals
+// (e.g. one per source) can hand in the same buffers every time and avoid
+// reallocating them. The segment starts are indices so they are kept as
+// unsigned ints rather than doubles.
+// This does not touch any shared state so it can be called from several
+// threads at once as long as each has its own buffers.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+void TV1D_denoise_v2(const vector<double>& input, vector<double>& output, double lambda,
+                     vector<unsigned int>& indstart_low, vector<unsigned int>& indstart_up)
+{
   unsigned int width = input.size();
-  vector<double> output(width);
-  vector<double> indstart_low(width);
-  vector<double> indstart_up(width);
+  output.resize(width);
+  if (width == 0)
+  {
+    return;
+  }
+  if (indstart_low.size() < width)
+  {
+    indstart_low.resize(width);
+  }
+  if (indstart_up.size() < width)
+  {
+    indstart_up.resize(width);
+  }
   unsigned int j_low = 0, j_up = 0, jseg = 0, indjseg = 0, i=1, indjseg2, ind;
   double output_low_first = input[0]-lambda;
   double output_low_curr = output_low_first;
   double output_up_first = input[0]+lambda;
   double output_up_curr = output_up_first;
   double twolambda=2.0*lambda;
-  if (width==1) {output = input;}
+  if (width==1) {output[0] = input[0];}
   else
   {
 
@@ -8462,7 +9489,6 @@ vector<double> TV1D_denoise_v2(vector<double> input,  double lambda) {
           }
     }
   }
-  return output;
 }
 
 
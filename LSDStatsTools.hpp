@@ -53,6 +53,7 @@
 #include <vector>
 #include <map>
 #include <math.h>
+#include <stdint.h>
 #include "TNT/tnt.h"
 using namespace std;
 using namespace TNT;
@@ -61,6 +62,194 @@ using namespace TNT;
 #ifndef StatsTools_H
 #define StatsTools_H
 
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// A counter based random number stream (Philox4x32-10, Salmon et al., 2011,
+// Parallel random numbers: as easy as 1, 2, 3).
+//
+// Each number is a pure function of the seed, the stream id and how many
+// numbers have been drawn from the stream, so there is no shared state. Give
+// every parallel task the same master seed and its own stream id (a basin or
+// channel index, say) and the results do not depend on the number of threads
+// or on the order in which the tasks run.
+//
+// Code that numbers its own streams (by basin, say) should also name itself.
+// The name is mixed into the key, so two analyses that both count their
+// streams from 0 never draw the same numbers.
+//
+// USAGE:
+//
+// RandomStream rng(get_random_master_seed(), "basin_bootstrap", basin_index);
+// float u = rng.uniform();         // in [0,1)
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+class RandomStream
+{
+  public:
+    /// @brief The default constructor: seed 0, stream 0
+    RandomStream()                             { create(0,0); }
+
+    /// @brief Create the stream_id'th stream of the sequence started by seed
+    /// @param seed The master seed
+    /// @param stream_id The id of this stream, usually a task index
+    RandomStream(long seed, long stream_id)    { create(seed,stream_id); }
+
+    /// @brief Create the stream_id'th stream of a named set of streams
+    /// @param seed The master seed
+    /// @param subsystem The name of the code numbering the streams
+    /// @param stream_id The id of this stream within that code
+    RandomStream(long seed, string subsystem, long stream_id)
+                                               { create(seed,subsystem,stream_id); }
+
+    /// @brief Restart the stream at the start of a (possibly different) sequence
+    /// @param seed The master seed
+    /// @param stream_id The id of this stream
+    void reset(long seed, long stream_id)      { create(seed,stream_id); }
+
+    /// @brief Restart the stream at the start of a stream of a named set
+    /// @param seed The master seed
+    /// @param subsystem The name of the code numbering the streams
+    /// @param stream_id The id of this stream within that code
+    void reset(long seed, string subsystem, long stream_id)
+                                               { create(seed,subsystem,stream_id); }
+
+    /// @brief Draw 32 random bits
+    uint32_t next_uint32();
+
+    /// @brief Draw a uniform random number in [0,1)
+    float uniform();
+
+    /// @brief Draw a uniform random number in [0,1) with double precision
+    double uniform_double();
+
+    /// @brief Draw a standard normal deviate (Box-Muller). This always uses
+    ///  four 32 bit draws.
+    double normal_double();
+
+    /// @brief Skip ahead as if n_draws calls to next_uint32 had been made
+    ///  (uniform uses one draw, uniform_double two, normal_double four). This is constant time, so
+    ///  a loop of tasks that each use a fixed number of draws can be split
+    ///  across threads and still draw exactly the numbers of the serial loop.
+    /// @param n_draws the number of 32 bit draws to skip
+    void discard(unsigned long long n_draws);
+
+  private:
+    void create(long seed, long stream_id);
+    void create(long seed, string subsystem, long stream_id);
+
+    /// Encrypts the counter to refill block and then advances the counter
+    void generate_block();
+
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    int block_position;
+};
+
+// The master seed for random streams. Unless set_random_master_seed is called
+// this is taken from the clock the first time it is requested.
+long get_random_master_seed();
+void set_random_master_seed(long seed);
+
+// A fresh stream for code that does not run as a set of parallel tasks. These
+// are unnamed and numbered downward from -1, so they never coincide with the
+// stream of a task, and a serial program gets the same streams every time it
+// is run with the same master seed.
+RandomStream get_serial_random_stream();
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+// A mergeable streaming quantile sketch (the merging t-digest of Dunning,
+// 2019, Computing extremely accurate quantiles using t-digests).
+//
+// Values are added one at a time and the sketch keeps a bounded number of
+// weighted centroids, so percentiles of very large rasters can be estimated
+// without copying and sorting the data. The centroids are smallest in the
+// tails, so extreme percentiles are the most accurate. The compression sets
+// the accuracy: the sketch holds no more than about compression centroids.
+// Until more than 10*compression values have been added nothing is merged
+// and percentiles are exact, with the same interpolation as get_percentile.
+//
+// Sketches built on parts of a dataset can be merged. The result depends only
+// on the order of the values and of the merges, so building sketches over
+// fixed blocks and merging them in block order (as build_quantile_sketch
+// does) gives the same answer with any number of threads.
+//
+// USAGE:
+//
+// QuantileSketch sketch(200);
+// for (...) sketch.add(value);
+// float p90 = sketch.percentile(90);
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+class QuantileSketch
+{
+  public:
+    /// @brief The default constructor: compression 200
+    QuantileSketch()                           { create(200); }
+
+    /// @brief Create an empty sketch
+    /// @param compression The accuracy parameter. Larger is more accurate
+    ///  and uses more memory.
+    QuantileSketch(double compression)         { create(compression); }
+
+    /// @brief Add a value to the sketch
+    void add(double value)                     { add(value,1.0); }
+
+    /// @brief Add a value with a weight (a number of copies) to the sketch
+    void add(double value, double weight);
+
+    /// @brief Add everything in another sketch to this one
+    void merge(const QuantileSketch& other);
+
+    /// @brief Estimate a quantile
+    /// @param q The quantile, between 0 and 1
+    double quantile(double q);
+
+    /// @brief Estimate a percentile (0 to 100, as in get_percentile)
+    double percentile(double pct)              { return quantile(pct/100.0); }
+
+    /// @brief The number (total weight) of values added
+    double get_count() const                   { return total_weight; }
+
+    /// @brief The exact minimum and maximum of the values added
+    double get_minimum() const                 { return minimum; }
+    double get_maximum() const                 { return maximum; }
+
+    double get_compression() const             { return compression; }
+
+    /// @brief The number of centroids held, after merging the buffer
+    int get_n_centroids();
+
+  private:
+    void create(double compression);
+
+    /// Merges the buffer into the centroids
+    void compress();
+
+    double compression;
+    size_t buffer_capacity;
+
+    /// The centroids, sorted by mean
+    vector<double> means;
+    vector<double> weights;
+
+    /// Values that have been added but not merged into the centroids
+    vector<double> buffer_values;
+    vector<double> buffer_weights;
+
+    /// A sorted copy of the buffer for exact quantiles, kept until a value is added
+    vector<double> sorted_buffer_values;
+    vector<double> sorted_buffer_weights;
+    bool sorted_buffer_is_current;
+
+    double total_weight;
+    double minimum;
+    double maximum;
+};
+
+// Build a quantile sketch of a vector or array, ignoring ndv. The data is cut
+// into fixed blocks that are sketched in parallel and merged in order, so the
+// result does not depend on the number of threads.
+QuantileSketch build_quantile_sketch(vector<float>& data, float ndv, double compression);
+QuantileSketch build_quantile_sketch(Array2D<float>& data, float ndv, double compression);
+
 // tools for getting keys from a map
 vector<string> extract_keys(map<string, int> input_map);
 vector<string> extract_keys(map<string, float> input_map);
@@ -104,6 +293,8 @@ float get_standard_error(vector<float>& y_data, float standard_deviation);
 vector<float> get_common_statistics(vector<float>& y_data);
 vector<float> calculate_descriptive_stats(vector<float>& data);
 float get_percentile(vector<float>& data, float percentile);
+// the same but estimated from a quantile sketch, which needs no sorted copy of the data
+float get_percentile(QuantileSketch& sketch, float percentile);
 
 
 // sort a vector of vector in regards to a first vector, they all need the same number of element
@@ -145,12 +336,22 @@ void quantile_quantile_analysis(vector<float>& data, vector<float>& values, vect
 // modified to pass in percentiles as arguments
 void quantile_quantile_analysis_defined_percentiles(vector<float>& data, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points, int lower_percentile, int upper_percentile);
 
+// the quantile_quantile analyses, with the quantiles of the data taken from a
+// quantile sketch rather than from a sorted copy of the data
+void quantile_quantile_analysis(QuantileSketch& sketch, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points);
+void quantile_quantile_analysis_defined_percentiles(QuantileSketch& sketch, vector<float>& values, vector<float>& standard_normal_variates, vector<float>& mn_values, int N_points, int lower_percentile, int upper_percentile);
+
+// the normally distributed model used by the quantile_quantile analyses: the line
+// through the lower and upper percentiles of the values, evaluated at each variate
+vector<float> quantile_quantile_normal_model(vector<float>& standard_normal_variates, vector<float>& values, int lower_percentile, int upper_percentile);
+
 // Bootstrapping of linear regressions
 // N_iterations is the number of bootstrap iterations
 // acceptance probablility is the probability that you will accept any given data point
 // in an iteration. This runs without replacement
 // Returns summary statistics (see cpp code for details)
-vector<float> bootstrap_linear_regression(vector<float>& x_data, vector<float>& y_data, int N_iterations, float acceptance_prob);
+vector<float> bootstrap_linear_regression(vector<float>& x_data, vector<float>& y_data, int N_iterations, float acceptance_prob,
+                                          RandomStream& rng);
 
 
 // calculates least squares linear regression for two datasets, returning
@@ -362,11 +563,19 @@ float calculate_MLE_from_residuals(vector<float>& residuals, float sigma);
 // RMSE estimator
 float calculate_RMSE_from_residuals(vector<float>& residuals);
 
-// a random number generator
+// convergence diagnostics for Markov chains
+// Gelman-Rubin potential scale reduction factor of a set of chains of equal length
+float gelman_rubin_Rhat(vector< vector<float> >& chains);
+// effective sample size of a chain, from its autocorrelation truncated with
+// Geyer's initial positive sequence
+float effective_sample_size(vector<float>& chain);
+
+// a random number generator. This keeps its state in statics so draws from
+// different threads interleave unpredictably: use a RandomStream instead.
 float ran3( long *idum );
 // Randomly sample from a vector without replacement DTM 21/04/2014
-vector<float> sample_without_replacement(vector<float> population_vector, int N);
-vector<int> sample_without_replacement(vector<int> population_vector, int N);
+vector<float> sample_without_replacement(vector<float> population_vector, int N, RandomStream& rng);
+vector<int> sample_without_replacement(vector<int> population_vector, int N, RandomStream& rng);
 
 // conversion from numbers to strings
 string itoa(int num);
@@ -386,12 +595,11 @@ double Gauss_rand(int Nrand, double GaussAdd, double GaussFac);
 //
 // Extreme values can fall below or above the boundaries in < 3 sigma of cases.
 //
-// Seed for random number will fail post 2038. I will instruct my firstborn to resolve this
-// problem.
+// The uniform deviates are drawn from rng.
 //
 // SWDG 9/6/16
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
-float getGaussianRandom(float minimum, float mean, bool allowNegative);
+float getGaussianRandom(float minimum, float mean, bool allowNegative, RandomStream& rng);
 
 // Log binning module
 // two overloaded functions:
@@ -747,6 +955,23 @@ vector<int> is_outlier_MZS(vector<float> vecval, float NDV, float threshold);
 pair<float,vector<float> > auto_KDE(vector<float> vpoint);
 vector<float> gaussian_KDE(vector<float> vpoint, float h);
 
+// Binned kernel density estimation: linear binning onto a regular grid and
+// FFT convolution with the kernel, O(n + M log M) instead of O(n^2).
+// binned_gaussian_KDE is a drop in replacement for gaussian_KDE; with
+// bins_per_bandwidth grid points per bandwidth it is within
+// (1/bins_per_bandwidth)^2/4 of the maximum density of the exact sum.
+// binned_plugin_bandwidth is the Sheather-Jones direct plug-in bandwidth
+// (Wand and Jones 1995), computed from binned density functionals.
+// The grid level functions work on any 1-D data.
+void linear_binning(vector<double>& x, double lo, double hi, int n_bins, vector<double>& counts);
+void radix2_fft(vector<double>& re, vector<double>& im, bool inverse);
+vector<double> convolve_binned_counts(vector<double>& counts, vector<double>& kernel);
+vector<double> binned_gaussian_KDE_grid(vector<double>& x, double h, double lo, double hi, int n_bins);
+double binned_kernel_functional(vector<double>& counts, int r, double g, double lo, double hi);
+float binned_plugin_bandwidth(vector<float> vpoint);
+vector<float> binned_gaussian_KDE(vector<float> vpoint, float h, int bins_per_bandwidth);
+pair<float,vector<float> > binned_auto_KDE(vector<float> vpoint);
+
 
 //-------------------------------------------------------------------
 // The code was written by Vikas C. Raykar
@@ -873,4 +1098,14 @@ class UnivariateDensityDerivative{
 
 vector<double> TV1D_denoise_v2(vector<double> input,  double lambda);
 
+/// @brief Total variation denoising (Condat's O(N) taut string algorithm)
+///  writing into caller supplied buffers so they can be reused between signals
+/// @param input the signal to denoise
+/// @param output the denoised signal, resized to the size of the input
+/// @param lambda the regularisation parameter
+/// @param indstart_low workspace, grown as needed
+/// @param indstart_up workspace, grown as needed
+void TV1D_denoise_v2(const vector<double>& input, vector<double>& output, double lambda,
+                     vector<unsigned int>& indstart_low, vector<unsigned int>& indstart_up);
+
 #endif
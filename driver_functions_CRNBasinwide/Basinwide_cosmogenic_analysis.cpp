@@ -83,7 +83,8 @@ int main (int nNumberofArgs,char *argv[])
     cout << "  (Either \\ or / depending on your operating system.)" << endl;
     cout << "* Second the prefix of the parameter files." << endl;
     cout << "* The third is a method flag. 0 does things without error analysis or muons," << endl;
-    cout << "  1 is a full analysis without spawned basins." << endl;
+    cout << "  1 is a full analysis without spawned basins. The topographic shielding" << endl;
+    cout << "    of each DEM is calculated once, in parallel, and shared by all its basins." << endl;
     cout << "  2 is a full analysis with spawned basins." << endl;
     cout << "---------------------------------------------------------" << endl;
     cout << "There must be two parameter files in the named path." << endl;
@@ -102,6 +102,10 @@ int main (int nNumberofArgs,char *argv[])
   // print the muon comparison file
   LSDCRNParameters LSDCRNP;
 
+  // the muon fluxes are interpolated from a table, which is built
+  // the first time the emulator is run
+  LSDCRNP.load_CRONUS_muon_table(path_to_atmospheric_data+"CRONUS_muon_table.bin");
+
   // get the information out of the file
   // make sure the filename works
   ifstream ifs(filename.c_str());
@@ -185,41 +189,55 @@ int main (int nNumberofArgs,char *argv[])
   
   int n_samp = sample_name.size();
   cout << "I found " << n_samp << " samples!" << endl;
-  for(int samp = 0; samp < n_samp; samp++)
+
+  // The samples are independent, so they are shared between the threads.
+  // Each thread has its own copy of the parameters (the muon table is shared)
+  // and the results are written in sample order as they are finished.
+  #pragma omp parallel
   {
-    cout << "Sample details: Name: " << sample_name[samp] << " lat: " << sample_latitude[samp]
-         << " Conc: " <<  sample_Concentration_standardised[samp] << " eff p:" << sample_eff_pressure[samp] << endl;
-  
-    // initiate a particle. We'll just repeatedly call this particle
-    // for the sample.
-    int startType = 0;
-    double Xloc = 0;
-    double Yloc = 0;
-    double  startdLoc = 0.0;
-    double  start_effdloc = 0.0;
-    double startzLoc = 0.0;
+    LSDCRNParameters thread_LSDCRNP = LSDCRNP;
+
+    #pragma omp for ordered schedule(dynamic,1)
+    for(int samp = 0; samp < n_samp; samp++)
+    {
+      // initiate a particle. We'll just repeatedly call this particle
+      // for the sample.
+      int startType = 0;
+      double Xloc = 0;
+      double Yloc = 0;
+      double  startdLoc = 0.0;
+      double  start_effdloc = 0.0;
+      double startzLoc = 0.0;
 
-    // create a particle at zero depth
-    LSDCRNParticle eroded_particle(startType, Xloc, Yloc,
-                               startdLoc, start_effdloc, startzLoc);
+      // create a particle at zero depth
+      LSDCRNParticle eroded_particle(startType, Xloc, Yloc,
+                                 startdLoc, start_effdloc, startzLoc);
 
-    // now get the cronus emulator
-    double pressure = sample_eff_pressure[samp];
-    double site_lat = sample_latitude[samp];
-    double rho = 2650;
-    double topo_scale =sample_shielding[samp];
-    double snow_scale = 1;
-    double N_26Al = 0;
-    double sample_del26 =  0;
-    double N_10Be_test = sample_Concentration_standardised[samp];
-    double sample_del10 = sample_Concentration_uncertainty_standardised[samp];
-    vector<double> erateinfo = eroded_particle.CRONUS_get_Al_Be_erosion(LSDCRNP, pressure,
-                      site_lat, rho, N_10Be_test, N_26Al,sample_del10, sample_del26,
-                      topo_scale,  snow_scale);
-                      
-    CRONUS_out << sample_name[samp] << "," << topo_scale << ",-99," << erateinfo[2]
-               << "," << erateinfo[0] << "," << erateinfo[1] << ","
-               << erateinfo[3] << "," <<  erateinfo[4] << endl;
+      // now get the cronus emulator
+      double pressure = sample_eff_pressure[samp];
+      double site_lat = sample_latitude[samp];
+      double rho = 2650;
+      double topo_scale =sample_shielding[samp];
+      double snow_scale = 1;
+      double N_26Al = 0;
+      double sample_del26 =  0;
+      double N_10Be_test = sample_Concentration_standardised[samp];
+      double sample_del10 = sample_Concentration_uncertainty_standardised[samp];
+      bool print_to_screen = false;
+      vector<double> erateinfo = eroded_particle.CRONUS_get_Al_Be_erosion(thread_LSDCRNP, pressure,
+                        site_lat, rho, N_10Be_test, N_26Al,sample_del10, sample_del26,
+                        topo_scale,  snow_scale, print_to_screen);
+
+      #pragma omp ordered
+      {
+        cout << "Sample details: Name: " << sample_name[samp] << " lat: " << sample_latitude[samp]
+             << " Conc: " <<  sample_Concentration_standardised[samp] << " eff p:" << sample_eff_pressure[samp] << endl;
+
+        CRONUS_out << sample_name[samp] << "," << topo_scale << ",-99," << erateinfo[2]
+                   << "," << erateinfo[0] << "," << erateinfo[1] << ","
+                   << erateinfo[3] << "," <<  erateinfo[4] << endl;
+      }
+    }
   }
   CRONUS_out.close();
 
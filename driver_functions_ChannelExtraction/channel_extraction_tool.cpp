@@ -598,36 +598,19 @@ int main (int nNumberofArgs,char *argv[])
     // now get an initial junction network. This will be refined in later steps.
     LSDJunctionNetwork ChanNetwork(sources, FilterFlowInfo);
 
+    // The curvature is calculated tile by tile from the filtered DEM so no
+    // full size curvature rasters are held in memory. The long wavelength
+    // curvature has always been taken from the short wavelength fit, so the
+    // same radius is passed for both.
     float surface_fitting_window_radius = this_float_map["surface_fitting_radius"];
-    float surface_fitting_window_radius_LW = 25;
-    vector<LSDRaster> surface_fitting, surface_fitting_LW;
-    LSDRaster tan_curvature;
-    LSDRaster tan_curvature_LW;
-    string curv_name = "_tan_curv";
-    vector<int> raster_selection(8, 0);
-    raster_selection[6] = 1;
-
-    // Two surface fittings: one for the short wacelength and one long wavelength
-    surface_fitting = topo_test_wiener.calculate_polyfit_surface_metrics(surface_fitting_window_radius, raster_selection);
-    surface_fitting_LW = topo_test_wiener.calculate_polyfit_surface_metrics(surface_fitting_window_radius_LW, raster_selection);
-
-    for(int i = 0; i<int(raster_selection.size()); ++i)
-    {
-      if(raster_selection[i]==1)
-      {
-        tan_curvature = surface_fitting[i];
-        //tan_curvature.write_raster((path_name+DEM_name+curv_name), DEM_flt_extension);
-        tan_curvature_LW = surface_fitting[i];
-        //tan_curvature_LW.write_raster((path_name+DEM_name+curv_name+"_LW"), DEM_flt_extension);
-      }
-    }
-
+    float surface_fitting_window_radius_LW = surface_fitting_window_radius;
+    int pelletier_tile_size = 512;
 
     Array2D<float> topography = filled_topography.get_RasterData();
-    Array2D<float> curvature = tan_curvature.get_RasterData();
-    Array2D<float> curvature_LW = tan_curvature_LW.get_RasterData();
     cout << "\tLocating channel heads..." << endl;
-    vector<int> ChannelHeadNodes = ChanNetwork.calculate_pelletier_channel_heads_DTM(FilterFlowInfo, topography, this_float_map["curvature_threshold"], curvature,curvature_LW);
+    vector<int> ChannelHeadNodes = ChanNetwork.calculate_pelletier_channel_heads_tiled(FilterFlowInfo, topo_test_wiener, topography,
+                                      surface_fitting_window_radius, surface_fitting_window_radius_LW,
+                                      this_float_map["curvature_threshold"], pelletier_tile_size);
 
     // Now filter out false positives along channel according to a threshold
     // catchment area
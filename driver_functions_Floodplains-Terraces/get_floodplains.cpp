@@ -78,6 +78,8 @@ int main (int nNumberofArgs,char *argv[])
 	float_default_map["surface_fitting_window_radius"] = 6;
 	float_default_map["Min slope filling"] = 0.0001;
 	float_default_map["QQ threshold"] = 0.005;
+	// if positive, the QQ quantiles come from a quantile sketch of this compression
+	float_default_map["QQ sketch compression"] = 0;
 
 	// set default bool parameters
 	bool_default_map["Filter topography"] = true;
@@ -179,11 +181,11 @@ int main (int nNumberofArgs,char *argv[])
   // get the channel relief and slope threshold using quantile-quantile plots
   cout << "Getting channel relief threshold from QQ plots" << endl;
   string qq_fname = DATA_DIR+DEM_ID+"_qq_relief.txt";
-  float relief_threshold_from_qq = ChannelRelief.get_threshold_for_floodplain_QQ(qq_fname, this_float_map["QQ threshold"], this_int_map["Relief lower percentile"], this_int_map["Relief upper percentile"]);
+  float relief_threshold_from_qq = ChannelRelief.get_threshold_for_floodplain_QQ(qq_fname, this_float_map["QQ threshold"], this_int_map["Relief lower percentile"], this_int_map["Relief upper percentile"], this_float_map["QQ sketch compression"]);
 
   cout << "Getting slope threshold from QQ plots" << endl;
   string qq_slope = path_name+DEM_ID+"_qq_slope.txt";
-  float slope_threshold_from_qq = Slope.get_threshold_for_floodplain_QQ(qq_slope, this_float_map["QQ threshold"], this_int_map["Slope lower percentile"], this_int_map["Slope upper percentile"]);
+  float slope_threshold_from_qq = Slope.get_threshold_for_floodplain_QQ(qq_slope, this_float_map["QQ threshold"], this_int_map["Slope lower percentile"], this_int_map["Slope upper percentile"], this_float_map["QQ sketch compression"]);
 
 	cout << "Relief threshold: " << relief_threshold_from_qq << " Slope threshold: " << slope_threshold_from_qq << endl;
 
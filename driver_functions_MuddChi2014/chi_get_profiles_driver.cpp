@@ -143,8 +143,8 @@ int main (int nNumberofArgs,char *argv[])
 	param_str = uscore+sigma_str+uscore+skip_str+uscore+msl_str+uscore+tn_str;
 
 	// create the chi network
-	LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname);
-	LSDChiNetwork ChiNetwork_extended(Chan_for_chi_ingestion_fname);
+	LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname,0);
+	LSDChiNetwork ChiNetwork_extended(Chan_for_chi_ingestion_fname,1);
 	ChiNetwork_extended.extend_tributaries_to_outlet();
 
 	//=-=-=-=-=-=-=-=-=-=-=-=-
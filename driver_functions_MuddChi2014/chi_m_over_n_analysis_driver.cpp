@@ -141,8 +141,8 @@ int main (int nNumberofArgs,char *argv[])
 
 	cout << "Channel file name is: " << Chan_for_chi_ingestion_fname << endl;
 
-	LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname);
-	LSDChiNetwork ChiNetwork_extended(Chan_for_chi_ingestion_fname);
+	LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname,0);
+	LSDChiNetwork ChiNetwork_extended(Chan_for_chi_ingestion_fname,1);
 	ChiNetwork_extended.extend_tributaries_to_outlet();
 
 	// get the best fit m over n ratio for this basin
@@ -219,6 +219,10 @@ int main (int nNumberofArgs,char *argv[])
   float_default_map["MCMC_movern_minimum"] = 0.05;
   float_default_map["MCMC_movern_maximum"] = 1.5;
   float_default_map["MCMC_chain_links"] = 5000;
+  int_default_map["MCMC_n_chains"] = 4;
+  int_default_map["MCMC_burn_in_links"] = 1000;
+  float_default_map["MCMC_target_Rhat"] = 1.05;
+  float_default_map["MCMC_target_ESS"] = 400;
 
   // this switch turns on all the appropriate runs for estimating
   // the best fit m/n
@@ -244,6 +248,10 @@ int main (int nNumberofArgs,char *argv[])
   int_default_map["skip"] = 2;
   float_default_map["sigma"] = 20;
 
+  // the master seed for the monte carlo routines. Zero means take it from the
+  // clock; any other value makes the random draws repeatable between runs.
+  int_default_map["random_seed"] = 0;
+
   // switches for chi analysis
   // These just print simple chi maps
   bool_default_map["print_chi_coordinate_raster"] = false;
@@ -291,6 +299,11 @@ int main (int nNumberofArgs,char *argv[])
   map<string,bool> this_bool_map = LSDPP.get_bool_parameters();
   map<string,string> this_string_map = LSDPP.get_string_parameters();
 
+  if(this_int_map["random_seed"] != 0)
+  {
+    set_random_master_seed(long(this_int_map["random_seed"]));
+  }
+
 
   // catch some stupid parameters
   cout << endl << endl << "=====================================" << endl;
@@ -1403,11 +1416,13 @@ int main (int nNumberofArgs,char *argv[])
   // acceptance rate on the metropolis algorithm (25-33%) you need a sigma value so high that it
   // just ranbomly jumps across the entirety of concavity test space. 
   // More or less useless, really. I (SMM) spent over a week screwing around with this, sadly...
+  // The multichain driver runs several chains per basin in parallel on an m/n lattice,
+  // caches the misfit of every visited m/n and stops once the chains have converged.
   if (this_bool_map["MCMC_movern_analysis"])
   {
     cout << "I am going to explore m/n using the MCMC method" << endl;
-    cout << "THIS DOESN'T WORK!!! IT IS FOR TESTING ONLY!!!!" << endl;
-    cout << "ALSO THIS METHOD THAT DOESN'T WORK WILL TAKE FOREVER!!!" << endl;
+    cout << "I will run " << this_int_map["MCMC_n_chains"] << " chains per basin and stop" << endl;
+    cout << "once R-hat and the effective sample size reach their targets." << endl;
     // Lets make a new chi tool: this won't be segmented since we only
     // need it for m/n
     LSDChiTools ChiTool_MCMC(FlowInfo);
@@ -1422,11 +1437,14 @@ int main (int nNumberofArgs,char *argv[])
     int pixel_thresh_for_this_example = this_int_map["threshold_contributing_pixels"] -1;
 
     bool use_points = true;
-    ChiTool_MCMC.MCMC_driver(FlowInfo, pixel_thresh_for_this_example,
-                             this_float_map["collinearity_MLE_sigma"],
+    ChiTool_MCMC.MCMC_multichain_driver(FlowInfo, pixel_thresh_for_this_example,
                              this_float_map["MCMC_movern_minimum"],
                              this_float_map["MCMC_movern_maximum"],
-                             this_float_map["MCMC_chain_links"],
+                             int(this_float_map["MCMC_chain_links"]),
+                             this_int_map["MCMC_n_chains"],
+                             this_int_map["MCMC_burn_in_links"],
+                             this_float_map["MCMC_target_Rhat"],
+                             this_float_map["MCMC_target_ESS"],
                              OUT_DIR, OUT_ID, use_points);
 
   }
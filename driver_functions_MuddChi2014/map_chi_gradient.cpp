@@ -311,7 +311,7 @@ int main (int nNumberofArgs,char *argv[])
       ChannelTree.convert_chan_file_for_ArcMap_ingestion(Chan_for_chi_ingestion_fname);
       // Create chi network automatically here, rather than reading in a file
       // create the chi network
-      LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname);
+      LSDChiNetwork ChiNetwork(Chan_for_chi_ingestion_fname,0);
       ChiNetwork.extend_tributaries_to_outlet();
 
       // Now run the chi-analysis to contruct the best fit m/n value for each
@@ -6,8 +6,9 @@
 // The driver file has a number of options that allow the user to calculate
 // different kinds of chi analysis.
 //
-// This version divides the analysis up by basin. Creates a new DEM for each
-// basin and a parameter file and launches the standalone chi_mapping_tool.exe for each.
+// This version divides the analysis up by basin. The DEM and flow routing are
+// computed once and the basins are then analysed in parallel within this
+// process, with the results of every basin merged into single csv files.
 //
 // The documentation is here:
 // https://lsdtopotools.github.io/LSDTopoTools_ChiMudd2014/
@@ -51,6 +52,8 @@
 #include <ctime>
 #include <sys/time.h>
 #include <fstream>
+#include <sstream>
+#include <cstdio>
 #include <omp.h>
 #include "../LSDStatsTools.hpp"
 #include "../LSDChiNetwork.hpp"
@@ -67,6 +70,10 @@
 #include "../LSDShapeTools.hpp"
 #include "../LSDRasterMaker.hpp"
 
+// merges the csv files written for each basin into a single file
+void merge_basin_csv_files(string merged_fname, vector<string>& basin_fnames,
+                           vector<int>& basin_keys, vector<int>& source_key_offsets);
+
 int main (int nNumberofArgs,char *argv[])
 {
 
@@ -95,14 +102,6 @@ int main (int nNumberofArgs,char *argv[])
     exit(EXIT_SUCCESS);
   }
 
-  string chi_tool_executable = "chi_mapping_tool.exe";
-  ifstream chi_exec(chi_tool_executable.c_str());
-  if (!chi_exec.good())
-  {
-    cout << "The chi_mapping_tool.exe has not been compiled or could not be found." << endl;
-    exit(EXIT_SUCCESS);
-  }
-  
   string path_name = argv[1];
   string f_name = argv[2];
 
@@ -158,6 +157,22 @@ int main (int nNumberofArgs,char *argv[])
 
   // knickpoint analysis. This is still under development.
   bool_default_map["ksn_knickpoint_analysis"] = false;
+  int_default_map["force_skip_knickpoint_analysis"] = 2;
+  int_default_map["force_n_iteration_knickpoint_analysis"] = 20;
+  float_default_map["force_A0_knickpoint_analysis"] = 1;
+  float_default_map["MZS_threshold"] = 0.5;
+  float_default_map["TVD_lambda"] = -1;
+  float_default_map["TVD_lambda_bchi"] = 10000;
+  int_default_map["kp_node_combining"] = 10;
+  int_default_map["stepped_combining_window"] = 10;
+  int_default_map["window_stepped_kp_detection"] = 100;
+  float_default_map["std_dev_coeff_stepped_kp"] = 4;
+
+  // Scheduling the basins. The number of threads analysing basins (0 uses the
+  // OpenMP default) and the largest number of basin pixels that may be
+  // analysed at once (0 means no limit). The latter controls the peak memory.
+  int_default_map["basin_threads"] = 0;
+  int_default_map["maximum_concurrent_basin_pixels"] = 0;
 
   // basic parameters for calculating chi
   float_default_map["A_0"] = 1;
@@ -222,6 +237,10 @@ int main (int nNumberofArgs,char *argv[])
   int_default_map["skip"] = 2;
   float_default_map["sigma"] = 20;
 
+  // the master seed for the monte carlo routines. Zero means take it from the
+  // clock; any other value makes the random draws repeatable between runs.
+  int_default_map["random_seed"] = 0;
+
   // switches for chi analysis
   // These just print simple chi maps
 
@@ -269,6 +288,11 @@ int main (int nNumberofArgs,char *argv[])
   map<string,bool> this_bool_map = LSDPP.get_bool_parameters();
   map<string,string> this_string_map = LSDPP.get_string_parameters();
 
+  if(this_int_map["random_seed"] != 0)
+  {
+    set_random_master_seed(long(this_int_map["random_seed"]));
+  }
+
   // catch some stupid parameters
   cout << endl << endl << "=====================================" << endl;
   cout << "I am going to check your parameters and fix ones likeley to lead to segmentation faults." << endl;
@@ -340,13 +364,47 @@ int main (int nNumberofArgs,char *argv[])
     this_bool_map["calculate_MLE_collinearity"] = true;
     this_bool_map["calculate_MLE_collinearity_with_points_MC"] = true;
     this_bool_map["print_profiles_fxn_movern_csv"] = true;
-    this_bool_map["movern_residuals_test"] = true;
 
     // run the SA methods of estimating best fit m/n
     this_bool_map["print_slope_area_data"] = true;
     this_bool_map["segment_slope_area_data"] = true;
   }
 
+  //----------------------------------------------------------------------------//
+  // Some of the chi_mapping_tool analyses are not run basin by basin. Rather
+  // than silently skip them, stop here if any of them have been asked for.
+  //----------------------------------------------------------------------------//
+  vector<string> unsupported_analyses;
+  unsupported_analyses.push_back("calculate_MLE_collinearity_with_points");
+  unsupported_analyses.push_back("movern_residuals_test");
+  unsupported_analyses.push_back("MCMC_movern_analysis");
+  unsupported_analyses.push_back("use_precipitation_raster_for_chi");
+  unsupported_analyses.push_back("print_discharge_raster");
+  unsupported_analyses.push_back("print_chi_no_discharge");
+  unsupported_analyses.push_back("check_chi_maps");
+  unsupported_analyses.push_back("print_chi_coordinate_raster");
+  unsupported_analyses.push_back("print_simple_chi_map_to_csv");
+  unsupported_analyses.push_back("print_simple_chi_map_with_basins_to_csv");
+  unsupported_analyses.push_back("print_basic_M_chi_map_to_csv");
+  unsupported_analyses.push_back("print_source_keys");
+  unsupported_analyses.push_back("print_baselevel_keys");
+  unsupported_analyses.push_back("print_segments");
+  unsupported_analyses.push_back("print_segments_raster");
+  bool found_unsupported_analysis = false;
+  for (int i = 0; i< int(unsupported_analyses.size()); i++)
+  {
+    if (this_bool_map[unsupported_analyses[i]])
+    {
+      cout << "ERROR: the parallel chi mapping tool cannot do " << unsupported_analyses[i] << endl;
+      found_unsupported_analysis = true;
+    }
+  }
+  if (found_unsupported_analysis)
+  {
+    cout << "Please set these to false, or run chi_mapping_tool instead." << endl;
+    exit(EXIT_FAILURE);
+  }
+
   cout << "Read filename is: " <<  DATA_DIR+DEM_ID << endl;
   cout << "Write filename is: " << OUT_DIR+OUT_ID << endl;
 
@@ -772,905 +830,495 @@ int main (int nNumberofArgs,char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  // Pad the DEMs by 1 pixel
-  int padding_pixels = 2;
-  
-  // Loop through base level junctions and generate a DEM for each basin
-  // create the new driver file while we're at it
+  //============================================================================
+  // THE PER BASIN CHI ANALYSIS STARTS HERE
+  // Rather than writing a DEM for each basin and launching a new
+  // chi_mapping_tool for it, every basin is analysed in this process using the
+  // DEM, FlowInfo and JunctionNetwork computed above. These are only read from
+  // here on, so the basins can share them.
+  //============================================================================
+
+  // Chi is calculated upslope of each baselevel junction so that each basin is
+  // treated as though it had been clipped at its outlet junction.
+  vector<int> basin_outlet_nodes;
+  vector<int> basin_pixels;
   for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
   {
-    cout << "Getting basin for baselevel junction " << BaseLevelJunctions[BN] << endl;
-    LSDBasin thisBasin(BaseLevelJunctions[BN],FlowInfo, JunctionNetwork);
-    cout << "Writing DEM" << endl;
-    LSDRaster BasinRaster = thisBasin.TrimPaddedRasterToBasin(padding_pixels, 
-                                         FlowInfo,filled_topography);
-    
-    // name the new DEM file
-    string INT = string(itoa(BaseLevelJunctions[BN]));
-    string basin_fname = "basin" + INT;
-    
-    cout << "Writing a new basin DEM to: " << basin_fname << endl;
-        
-    BasinRaster.write_raster(path_name+basin_fname,"bil");
-    
-    // open the driver file and read its contents
-    // replace the read and write fname parameters and write a new param file
-    string basin_driver = "basin"+INT+"_movern.driver";
-    LSDPP.set_read_fname(basin_fname);
-    LSDPP.set_write_fname(basin_fname);
-    //LSDPP.print_parameters(basin_driver);
-    map<string,string> replace_parameters;
-    replace_parameters["only_take_largest_basin"] = "true";
-    
-    LSDPP.replace_and_print_parameter_file(basin_driver,DATA_DIR, basin_fname,OUT_DIR,basin_fname,replace_parameters);
+    int outlet_node = JunctionNetwork.get_Node_of_Junction(BaseLevelJunctions[BN]);
+    basin_outlet_nodes.push_back(outlet_node);
+    basin_pixels.push_back(FlowInfo.retrieve_contributing_pixels_of_node(outlet_node));
   }
-  
-  //clear out memory!
-  LSDRaster EmptyLSDRaster;
-  LSDIndexRaster EmptyLSDIndexRaster;
-  LSDFlowInfo EmptyLSDFlowInfo;
-  LSDJunctionNetwork EmptyLSDJunctionNetwork;
-  
-  topography_raster = EmptyLSDRaster;
-  filled_topography = EmptyLSDRaster;
-  DrainageArea = EmptyLSDRaster;
-  DistanceFromOutlet = EmptyLSDRaster;
-  FlowInfo = EmptyLSDFlowInfo;
-  FlowAcc = EmptyLSDIndexRaster;
-  JunctionNetwork = EmptyLSDJunctionNetwork;
-  
-  // Loop through baselevel junctions and launch chi analysis
-  #pragma omp parallel for
-  for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
+
+  cout << "Calculating the chi coordinate for A_0: " << A_0 << " and m/n: " << movern << endl;
+  LSDRaster chi_coordinate = FlowInfo.get_upslope_chi_from_multiple_starting_nodes(basin_outlet_nodes,
+                                        movern, A_0, thresh_area_for_chi);
+  LSDRaster chi_coordinate_kp;
+  if(this_bool_map["ksn_knickpoint_analysis"])
   {
-    cout << "Launching Chi Analysis for basin " << BN << endl;
-    //launch job!
-    string INT = string(itoa(BaseLevelJunctions[BN]));
-    string basin_fname = "basin" + INT;
-    string basin_driver = "basin"+INT+"_movern.driver";
-		string launch = "./chi_mapping_tool.exe " + path_name + " " + basin_driver;
-		system(launch.c_str());
+    chi_coordinate_kp = FlowInfo.get_upslope_chi_from_multiple_starting_nodes(basin_outlet_nodes,
+                                        movern, this_float_map["force_A0_knickpoint_analysis"], thresh_area_for_chi);
   }
-}
-
-//  //  cout << "BL junc is: " << BaseLevelJunctions[BN] << " node is: " << JunctionNetwork.get_Node_of_Junction(BaseLevelJunctions[BN]) << endl;
-//  //  vector<int> UPSN = FlowInfo.get_upslope_nodes(JunctionNetwork.get_Node_of_Junction(BaseLevelJunctions[BN]));
-//  //  cout << "Pixels for that node are: " << UPSN.size() << endl;
-//  //}
-
-//  //============================================================================
-//  // THE CHI STUFF STARTS HERE
-//  // now use a ChiTool object to print the chi tree to csv
-//  LSDChiTools ChiTool(FlowInfo);
-
-//  // calculate chi for the entire DEM
-//  cout << "Calculating the chi coordinate for A_0: " << A_0 << " and m/n: " << movern << endl;
-//  LSDRaster chi_coordinate;
-//  LSDRaster Discharge;
-//  if(this_bool_map["use_precipitation_raster_for_chi"])
-//  {
-
-//    string Precip_f_name = DATA_DIR+this_string_map["precipitation_fname"];
-//    cout << "I am loading a precipitation raster. " << Precip_f_name<<".bil" << endl;
-//    cout << "Note this MUST be the same size as the base DEM or it will crash!" << endl;
-
-//    if(this_string_map["precipitation_fname"]=="NULL")
-//    {
-//      cout << "You have asked to use a precipitation raster but have not given a name." << endl;
-//      cout << "Set the name of the raster with the keyword precipitation_fname" << endl;
-//      exit(EXIT_FAILURE);
-//    }
-
-//    // calculate the discharge
-//    // note: not discharge yet, need to multiply by cell area
-//    LSDRaster VolumePrecipitation(Precip_f_name,raster_ext);
-//    float dx = VolumePrecipitation.get_DataResolution();
-
-//    // volume precipitation per time precipitation times the cell areas
-//    VolumePrecipitation.raster_multiplier(dx*dx);
-
-//    // discharge accumulates this precipitation
-//    Discharge = FlowInfo.upslope_variable_accumulator(VolumePrecipitation);
-//    chi_coordinate = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern,A_0,thresh_area_for_chi,Discharge);
-
-//    if(this_bool_map["print_discharge_raster"])
-//    {
-//      string Discharge_fname = OUT_DIR+OUT_ID+"_Q";
-//      Discharge.write_raster(Discharge_fname, raster_ext);
-//    }
-//    // Print the chi raster
-//    if(this_bool_map["print_chi_coordinate_raster"])
-//    {
-//      string chi_coord_string = OUT_DIR+OUT_ID+"_chi_coordQ";
-//      chi_coordinate.write_raster(chi_coord_string,raster_ext);
-//    }
-
-
-//  }
-//  else
-//  {
-//    chi_coordinate = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern,A_0,thresh_area_for_chi);
-//    // Print the chi raster
-//    if(this_bool_map["print_chi_coordinate_raster"])
-//    {
-//      string chi_coord_string = OUT_DIR+OUT_ID+"_chi_coord";
-//      chi_coordinate.write_raster(chi_coord_string,raster_ext);
-//    }
-//  }
-
-//  // This bit prints a chi coordinate raster even if you are using precipitation
-//  if(this_bool_map["print_chi_coordinate_raster"] && this_bool_map["use_precipitation_raster_for_chi"] && this_bool_map["print_chi_no_discharge"])
-//  {
-//    LSDRaster NoDischargeChi = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern,A_0,thresh_area_for_chi);
-//    string chi_coord_string = OUT_DIR+OUT_ID+"_chi_coord";
-//    NoDischargeChi.write_raster(chi_coord_string,raster_ext);
-//  }
-//  //============================================================================
-
-
-
-//  if (this_bool_map["print_simple_chi_map_to_csv"])
-//  {
-//    cout <<"I am printing a simple chi map for you to csv." << endl;
-
-//    string chi_csv_fname = OUT_DIR+OUT_ID+"_chi_coord.csv";
-//    ChiTool.chi_map_to_csv(FlowInfo, chi_csv_fname, chi_coordinate);
-
-//    if ( this_bool_map["convert_csv_to_geojson"])
-//    {
-//      string gjson_name = OUT_DIR+OUT_ID+"_chi_coord.geojson";
-//      LSDSpatialCSVReader thiscsv(chi_csv_fname);
-//      thiscsv.print_data_to_geojson(gjson_name);
-//    }
-
-//  }
-
-
-
-//  //============================================================================
-//  // Print basins with chi to csv
-//  if (this_bool_map["print_simple_chi_map_with_basins_to_csv"])
-//  {
-//    cout <<"I am printing a simple chi map with basins for you to csv." << endl;
-//    LSDIndexRaster basin_raster = ChiTool.get_basin_raster(FlowInfo, JunctionNetwork, BaseLevelJunctions);
-//    string chi_csv_fname = OUT_DIR+DEM_ID+"_chi_coord_basins.csv";
-//    ChiTool.chi_map_to_csv(FlowInfo, chi_csv_fname, chi_coordinate,basin_raster);
-
-//    if ( this_bool_map["convert_csv_to_geojson"])
-//    {
-//      string gjson_name = OUT_DIR+DEM_ID+"_chi_coord_basins.geojson";
-//      LSDSpatialCSVReader thiscsv(chi_csv_fname);
-//      thiscsv.print_data_to_geojson(gjson_name);
-//    }
-//  }
-
-
-//  // now source and outlet nodes for segmentation and other operations.
-//  vector<int> source_nodes;
-//  vector<int> outlet_nodes;
-//  vector<int> baselevel_node_of_each_basin;
-//  if (this_bool_map["print_segmented_M_chi_map_to_csv"]
-//        || this_bool_map["print_basic_M_chi_map_to_csv"]
-//        || this_bool_map["calculate_MLE_collinearity"]
-//        || this_bool_map["print_profiles_fxn_movern_csv"]
-//        || this_bool_map["print_slope_area_data"]
-//        || this_bool_map["print_source_keys"]
-//        || this_bool_map["print_baselevel_keys"]
-//        || this_bool_map["print_basin_raster"]
-//        || this_bool_map["MCMC_movern_analysis"]
-//        || this_bool_map["print_chi_data_maps"])
-//  {
-//    cout << "I am getting the source and outlet nodes for the overlapping channels" << endl;
-//    cout << "The n_nodes to visit are: " << n_nodes_to_visit << endl;
-
-//    if (this_bool_map["extend_channel_to_node_before_receiver_junction"])
-//    {
-//      cout << endl << endl << "=====================================================" << endl;
-//      cout << "I am now getting the channels for the chi tool." << endl;
-//      cout << "  These channels extend below the junction to the channel that stops" << endl;
-//      cout << "  just before the reciever junction. This option is used to remain" << endl;
-//      cout << "  consitent with basin ordering, since a 2nd order basin will begin" << endl;
-//      cout << "  at the channel one node upslope of the most upstream 3rd order junction." << endl;
-//      cout << "  If you simply want the channel starting from the selcted junction, " << endl;
-//      cout << "  set the option:" << endl;
-//      cout << "    extend_channel_to_node_before_receiver_junction" << endl;
-//      cout << "  to false." << endl;
-//      cout << "=====================================================" << endl << endl;
-
-//      JunctionNetwork.get_overlapping_channels_to_downstream_outlets(FlowInfo, BaseLevelJunctions, DistanceFromOutlet,
-//                                    source_nodes,outlet_nodes,baselevel_node_of_each_basin,n_nodes_to_visit);
-
-//    }
-//    else
-//    {
-//      cout << endl << endl << "=====================================================" << endl;
-//      cout << "I am now getting the channels for the chi tool." << endl;
-//      cout << "  These channels will start from the baselevel junctions selected. " << endl;
-//      cout << "  If you want them to extend to below the junction to the channel that stops" << endl;
-//      cout << "  just before the reciever junction, then set the option:" << endl;
-//      cout << "    extend_channel_to_node_before_receiver_junction" << endl;
-//      cout << "  to true." << endl;
-//      cout << "=====================================================" << endl << endl;
-
-//      JunctionNetwork.get_overlapping_channels(FlowInfo, BaseLevelJunctions, DistanceFromOutlet,
-//                                    source_nodes,outlet_nodes,baselevel_node_of_each_basin,n_nodes_to_visit);
-//    }
-//  }
-
-
-//  //============================================================================
-//  // Print a basin raster if you want it.
-//  if(this_bool_map["print_basin_raster"] || this_bool_map["print_litho_info"] || this_bool_map["ksn_knickpoint_analysis"] )
-//  {
-//    cout << "I am going to print the basins for you. " << endl;
-//    LSDChiTools ChiTool_basins(FlowInfo);
-//    ChiTool_basins.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-//    string basin_raster_prefix = OUT_DIR+OUT_ID;
-//    ChiTool_basins.print_basins(FlowInfo, JunctionNetwork, BaseLevelJunctions, basin_raster_prefix);
-//    
-//    if(this_bool_map["print_litho_info"])
-//    {
-//      
-//      // loading finished
-//      // now getting the basins informations
-//      map<int,map<int,int> > basin_litho_count = ChiTool_basins.get_basin_lithocount(FlowInfo, JunctionNetwork, geolithomap, BaseLevelJunctions);
-//      //geolithomap.detect_unique_values();
-//      string csv_slbc_fname = OUT_DIR+OUT_ID+"_SBASLITH.csv";
-//      ChiTool_basins.extended_litho_basin_to_csv(FlowInfo, csv_slbc_fname, basin_litho_count);
-//      
-//    }
-//  }
-
-
-//  if (this_bool_map["print_segmented_M_chi_map_to_csv"])
-//  {
-//    cout << "I am calculating the segmented channels" << endl;
-//    if (source_nodes.size() == 0)
-//    {
-//      cout << "I don't seem to have any source nodes!" << endl;
-//    }
-
-//    // check to see if we want segments. If that is the case, the
-//    // skip and iterations default to 0 and 1
-//    if (this_bool_map["print_segments"])
-//    {
-//      n_iterations = 1;
-//      skip = 0;
-//      ChiTool.chi_map_automator(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate, target_nodes,
-//                            n_iterations, skip, minimum_segment_length, sigma);
-//      ChiTool.segment_counter(FlowInfo, maximum_segment_length);
-//      if (this_bool_map["print_segments_raster"])
-//      {
-//        LSDIndexRaster SegmentsRaster = ChiTool.segment_mapping(FlowInfo, maximum_segment_length);
-//        string Segments_raster_name = OUT_DIR+OUT_ID+"_Segments";
-//        SegmentsRaster.write_raster(Segments_raster_name,raster_ext);
-//      }
-//    }
-//    else
-//    {
-//      ChiTool.chi_map_automator(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate, target_nodes,
-//                            n_iterations, skip, minimum_segment_length, sigma);
-//    }
-
-//    string csv_full_fname = OUT_DIR+OUT_ID+"_MChiSegmented.csv";
-//    cout << "Let me print all the data for you into a csv file called " << csv_full_fname << endl;
-//    ChiTool.print_data_maps_to_file_full(FlowInfo, csv_full_fname);
-//    cout << "That is your file printed!" << endl;
-
-//    if ( this_bool_map["convert_csv_to_geojson"])
-//    {
-//      cout << "Now let me print your chi network to a geojson" << endl;
-//      string gjson_name = OUT_DIR+OUT_ID+"_MChiSegmented.geojson";
-//      LSDSpatialCSVReader thiscsv(csv_full_fname);
-//      thiscsv.print_data_to_geojson(gjson_name);
-//    }
-//  }
-
-//  //============================================================================
-//  // CHECK CHI IN THE CHITOOL OBJECT
-//  // This is really only for debugging
-//  //============================================================================
-//  if(this_bool_map["check_chi_maps"])
-//  {
-//    float thresh_area_for_chi = 0;
-//    LSDChiTools ChiTool_chi_checker(FlowInfo);
-//    ChiTool_chi_checker.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // first the logic if you are using a precipitation raster
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      string chiQ_data_maps_string = OUT_DIR+OUT_ID+"_checkchiQ.csv";
-//      ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, chiQ_data_maps_string);
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_checkchiQ.geojson";
-//        LSDSpatialCSVReader thiscsv(chiQ_data_maps_string);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-
-//      // now get the chi coordinate without the discharge
-//      LSDRaster chi_noQ = FlowInfo.get_upslope_chi_from_all_baselevel_nodes(movern,A_0,thresh_area_for_chi);
-//      ChiTool_chi_checker.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_noQ);
-//      string chi_data_maps_string = OUT_DIR+OUT_ID+"_checkchi.csv";
-//      ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, chi_data_maps_string);
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_checkchi.geojson";
-//        LSDSpatialCSVReader thiscsv(chi_data_maps_string);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-//    }
-//    else
-//    {
-//      string chi_data_maps_string = OUT_DIR+OUT_ID+"_checkchi.csv";
-//      ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, chi_data_maps_string);
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_checkchi.geojson";
-//        LSDSpatialCSVReader thiscsv(chi_data_maps_string);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-//    }
-//  }
-//  //============================================================================
-
-
-
-//  //============================================================================
-//  // This is for visualisation of the basins
-//  //============================================================================
-//  if(this_bool_map["print_chi_data_maps"])
-//  {
-//    cout << "I am going to print some simple chi data maps for visualisation." << endl;
-//    LSDChiTools ChiTool_chi_checker(FlowInfo);
-//    ChiTool_chi_checker.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // first the logic if you are using a precipitation raster
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      string chiQ_data_maps_string = OUT_DIR+OUT_ID+"_chi_data_mapQ.csv";
-//      ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, chiQ_data_maps_string);
-
-
-//      // if this gets burned, do it
-//      if(this_bool_map["burn_raster_to_csv"])
-//      {
-//        cout << "You asked me to burn a raster to the csv" << endl;
-//        if(burn_raster_exists)
-//        {
-//          string header_for_burn_data;
-//          if(this_bool_map["print_litho_info"])
-//          {
-//            header_for_burn_data = OUT_ID + "_geol";
-//          }
-//          else
-//          {
-//            header_for_burn_data = this_string_map["burn_data_csv_column_header"];
-//          }
-
-//          cout << "I am burning the raster into the column header " << header_for_burn_data << endl;
-//          string full_csv_name = chiQ_data_maps_string;
-//          LSDSpatialCSVReader CSVFile(RI,full_csv_name);
-
-//          cout << "I am burning the raster to the csv file." << endl;
-//          CSVFile.burn_raster_data_to_csv(BurnRaster,header_for_burn_data);
-
-//          string full_burned_csv_name = OUT_DIR+OUT_ID+"_chiQ_data_map_burned.csv";
-//          cout << "Now I'll print the data to a new file" << endl;
-//          CSVFile.print_data_to_csv(full_burned_csv_name);
-
-//          if ( this_bool_map["convert_csv_to_geojson"])
-//          {
-//            string gjson_name = OUT_DIR+OUT_ID+"_chiQ_data_map_burned.geojson";
-//            LSDSpatialCSVReader thiscsv(full_burned_csv_name);
-//            thiscsv.print_data_to_geojson(gjson_name);
-//          }
-//        }
-//        else
-//        {
-//          cout << "The raster you asked me to burn doesn't exist. I am not burning." << endl;
-//        }
-//      }
-
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_chi_data_mapQ.geojson";
-//        LSDSpatialCSVReader thiscsv(chiQ_data_maps_string);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-
-//    }
-//    else
-//    {
-//      string chi_data_maps_string = OUT_DIR+OUT_ID+"_chi_data_map.csv";
-//      ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, chi_data_maps_string);
-
-
-//      // if this gets burned, do it
-//      if(this_bool_map["burn_raster_to_csv"])
-//      {
-//        cout << "You asked me to burn a raster to the csv" << endl;
-//        if(burn_raster_exists)
-//        {
-//          string header_for_burn_data;
-//          if(this_bool_map["print_litho_info"])
-//          {
-//            header_for_burn_data = OUT_ID + "_geol";
-//          }
-//          else
-//          {
-//            header_for_burn_data = this_string_map["burn_data_csv_column_header"];
-//          }
-
-//          cout << "I am burning the raster into the column header " << header_for_burn_data << endl;
-//          string full_csv_name = chi_data_maps_string;
-//          LSDSpatialCSVReader CSVFile(RI,full_csv_name);
-
-//          cout << "I am burning the raster to the csv file." << endl;
-//          CSVFile.burn_raster_data_to_csv(BurnRaster,header_for_burn_data);
-
-//          string full_burned_csv_name = OUT_DIR+OUT_ID+"_chi_data_map_burned.csv";
-//          cout << "Now I'll print the data to a new file" << endl;
-//          CSVFile.print_data_to_csv(full_burned_csv_name);
-
-//          if ( this_bool_map["convert_csv_to_geojson"])
-//          {
-//            string gjson_name = OUT_DIR+OUT_ID+"_chi_data_map_burned.geojson";
-//            LSDSpatialCSVReader thiscsv(full_burned_csv_name);
-//            thiscsv.print_data_to_geojson(gjson_name);
-//          }
-//        }
-//        else
-//        {
-//          cout << "The raster you asked me to burn doesn't exist. I am not burning." << endl;
-//        }
-//      }
-
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_chi_data_map.geojson";
-//        LSDSpatialCSVReader thiscsv(chi_data_maps_string);
-//        thiscsv.print_data_to_geojson(gjson_name);
-
-
-
-//      }
-//    }
-//  }
-//  //============================================================================
-
-
-
 
-//  if (this_bool_map["MCMC_movern_analysis"])
-//  {
-//    cout << "I am going to explore m/n using the MCMC method" << endl;
-//    cout << "WARNING!!! This could take a while." << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_MCMC(FlowInfo);
-//    ChiTool_MCMC.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
+  // Get the channels of all the basins at once and then split them up by basin.
+  // The channels start at the baselevel junctions, since chi is zero there.
+  vector<int> all_source_nodes;
+  vector<int> all_outlet_nodes;
+  vector<int> all_baselevel_nodes;
+  JunctionNetwork.get_overlapping_channels(FlowInfo, BaseLevelJunctions, DistanceFromOutlet,
+                                all_source_nodes,all_outlet_nodes,all_baselevel_nodes,n_nodes_to_visit);
 
+  map<int,int> basin_number_of_outlet_node;
+  for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
+  {
+    basin_number_of_outlet_node[basin_outlet_nodes[BN]] = BN;
+  }
+  vector< vector<int> > basin_source_nodes(N_BaseLevelJuncs);
+  vector< vector<int> > basin_channel_outlets(N_BaseLevelJuncs);
+  vector< vector<int> > basin_baselevel_nodes(N_BaseLevelJuncs);
+  int n_channels = int(all_source_nodes.size());
+  for (int c = 0; c< n_channels; c++)
+  {
+    map<int,int>::iterator bn_iter = basin_number_of_outlet_node.find(all_baselevel_nodes[c]);
+    if (bn_iter != basin_number_of_outlet_node.end())
+    {
+      int BN = bn_iter->second;
+      basin_source_nodes[BN].push_back(all_source_nodes[c]);
+      basin_channel_outlets[BN].push_back(all_outlet_nodes[c]);
+      basin_baselevel_nodes[BN].push_back(all_baselevel_nodes[c]);
+    }
+  }
 
-//    // Get the pixel threshold. Make it one less than the previous threshold to ensure
-//    // you get all the nodes in the basin
-//    //cout << "BUG TRACKER" << endl; exit(EXIT_FAILURE);
-//    int pixel_thresh_for_this_example = this_int_map["threshold_contributing_pixels"] -1;
-
-//    bool use_points = true;
-//    ChiTool_MCMC.MCMC_driver(FlowInfo, pixel_thresh_for_this_example,
-//                             this_float_map["collinearity_MLE_sigma"],
-//                             this_float_map["MCMC_movern_minimum"],
-//                             this_float_map["MCMC_movern_maximum"],
-//                             this_float_map["MCMC_chain_links"],
-//                             OUT_DIR, OUT_ID, use_points);
-
-//  }
-
-
-
-
-
-
-
-
-
-//  if (this_bool_map["movern_residuals_test"])
-//  {
-//    cout << "I am going to explore m/n using the residuals method" << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_residuals(FlowInfo);
-//    ChiTool_residuals.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // Calculate and print results
-//    string residuals_name = OUT_DIR+OUT_ID+"_residual_movernstats";
-//    ChiTool_residuals.calculate_goodness_of_fit_collinearity_fxn_movern_using_median_residuals(FlowInfo, JunctionNetwork,
-//                      this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      residuals_name);                  
-
-//  }
-
-
-
-
-
-
-
-
-
-
-//  if (this_bool_map["calculate_MLE_collinearity"])
-//  {
-
-//    cout << "I am testing the collinearity for you. " << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_movern(FlowInfo);
-//    ChiTool_movern.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // test the basin collinearity test
-//    //int baselevel_key = 1;
-//    vector<int> reference_source;
-//    vector<int> test_source;
-//    vector<float> MLE_values;
-//    vector<float> RMSE_values;
-//    //bool only_use_mainstem_as_reference = true;
+  // the source keys of each basin are offset so they stay unique in the merged files
+  vector<int> source_key_offsets;
+  int n_sources_so_far = 0;
+  for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
+  {
+    source_key_offsets.push_back(n_sources_so_far);
+    n_sources_so_far += int(basin_source_nodes[BN].size());
+  }
 
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      cout << "Using a discharge raster to check collinearity." << endl;
-//      string movern_name = OUT_DIR+OUT_ID+"_movernstatsQ";
-//      ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge(FlowInfo,
-//                      JunctionNetwork, this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      movern_name, Discharge, this_float_map["collinearity_MLE_sigma"]);
-//    }
-//    else
-//    {
-//      string movern_name = OUT_DIR+OUT_ID+"_movernstats";
-//      ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern(FlowInfo, JunctionNetwork,
-//                      this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      movern_name, this_float_map["collinearity_MLE_sigma"]);
-//    }
-//  }
+  // the knickpoint analysis uses its own lambda for the total variation denoising
+  float TVD_lambda = this_float_map["TVD_lambda"];
+  if(this_bool_map["ksn_knickpoint_analysis"] && TVD_lambda < 0)
+  {
+    cout << "You choose a negative lambda for the total variations denoising. I am going to determine it automatically based of your m/n value." << endl;
+    if(movern <= 0.1){ TVD_lambda = 0.1;}
+    else if(movern <= 0.15){ TVD_lambda = 0.3;}
+    else if(movern <= 0.2){ TVD_lambda = 0.5;}
+    else if(movern <= 0.3){ TVD_lambda = 2;}
+    else if(movern <= 0.35){ TVD_lambda = 3;}
+    else if(movern <= 0.4){ TVD_lambda = 5;}
+    else if(movern <= 0.45){ TVD_lambda = 10;}
+    else if(movern <= 0.5){ TVD_lambda = 20;}
+    else if(movern <= 0.55){ TVD_lambda = 40;}
+    else if(movern <= 0.6){ TVD_lambda = 100;}
+    else if(movern <= 0.65){ TVD_lambda = 200;}
+    else if(movern <= 0.7){ TVD_lambda = 300;}
+    else if(movern <= 0.75){ TVD_lambda = 500;}
+    else if(movern <= 0.80){ TVD_lambda = 1000;}
+    else if(movern <= 0.85){ TVD_lambda = 2000;}
+    else if(movern <= 0.90){ TVD_lambda = 5000;}
+    else if(movern <= 0.95){ TVD_lambda = 10000;}
+    else{TVD_lambda = 2000;}
+  }
 
+  //============================================================================
+  // Print a basin raster if you want it. This is done once for all the basins
+  // so the basin keys in the raster match those of the merged csv files.
+  //============================================================================
+  if(this_bool_map["print_basin_raster"] || this_bool_map["print_litho_info"])
+  {
+    cout << "I am going to print the basins for you. " << endl;
+    LSDChiTools ChiTool_basins(FlowInfo);
+    ChiTool_basins.chi_map_automator_chi_only(FlowInfo, all_source_nodes, all_outlet_nodes, all_baselevel_nodes,
+                            filled_topography, DistanceFromOutlet,
+                            DrainageArea, chi_coordinate);
+    string basin_raster_prefix = OUT_DIR+OUT_ID;
+    ChiTool_basins.print_basins(FlowInfo, JunctionNetwork, BaseLevelJunctions, basin_raster_prefix);
+
+    if(this_bool_map["print_litho_info"])
+    {
+      map<int,map<int,int> > basin_litho_count = ChiTool_basins.get_basin_lithocount(FlowInfo, JunctionNetwork, geolithomap, BaseLevelJunctions);
+      string csv_slbc_fname = OUT_DIR+OUT_ID+"_SBASLITH.csv";
+      ChiTool_basins.extended_litho_basin_to_csv(FlowInfo, csv_slbc_fname, basin_litho_count);
+    }
+  }
 
+  // The basins are handed out as tasks, largest first. The pixels of the
+  // basins handed out since the last wait are counted, and once the next
+  // basin would take them over maximum_concurrent_basin_pixels the running
+  // basins are waited for before it starts. This bounds the peak memory.
+  // A basin is always started if nothing else is running.
+  vector<int> sorted_basin_pixels;
+  vector<size_t> basin_order;
+  matlab_int_sort(basin_pixels, sorted_basin_pixels, basin_order);
+  long maximum_concurrent_pixels = long(this_int_map["maximum_concurrent_basin_pixels"]);
+
+  int n_basin_threads = this_int_map["basin_threads"];
+  if (n_basin_threads <= 0)
+  {
+    n_basin_threads = omp_get_max_threads();
+  }
+  cout << "I am analysing " << N_BaseLevelJuncs << " basins on " << n_basin_threads << " threads." << endl;
 
+  #pragma omp parallel num_threads(n_basin_threads)
+  {
+    #pragma omp single
+    {
+      long pixels_in_batch = 0;
+      for (int i = 0; i< N_BaseLevelJuncs; i++)
+      {
+        int BN = int(basin_order[N_BaseLevelJuncs-1-i]);
+        long this_basin_pixels = long(basin_pixels[BN]);
 
+        // wait for the running basins if there is no room for this one
+        if (maximum_concurrent_pixels > 0 && pixels_in_batch > 0
+            && pixels_in_batch+this_basin_pixels > maximum_concurrent_pixels)
+        {
+          #pragma omp taskwait
+          pixels_in_batch = 0;
+        }
+        pixels_in_batch += this_basin_pixels;
 
+        #pragma omp task firstprivate(BN,this_basin_pixels)
+        {
+          string INT = string(itoa(BaseLevelJunctions[BN]));
+          string basin_prefix = OUT_DIR+OUT_ID+"_basin"+INT;
+          #pragma omp critical(basin_log)
+          {
+            cout << "Starting the chi analysis of basin " << BN << " with junction " << BaseLevelJunctions[BN]
+                 << " and " << this_basin_pixels << " pixels" << endl;
+          }
+
+          if (basin_source_nodes[BN].size() > 0)
+          {
+            if (this_bool_map["print_chi_data_maps"])
+            {
+              LSDChiTools ChiTool_chi_checker(FlowInfo);
+              ChiTool_chi_checker.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_chi_checker.chi_map_automator_chi_only(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate);
+              ChiTool_chi_checker.print_chi_data_map_to_csv(FlowInfo, basin_prefix+"_chi_data_map.csv");
+            }
+
+            if (this_bool_map["calculate_MLE_collinearity"])
+            {
+              LSDChiTools ChiTool_movern(FlowInfo);
+              ChiTool_movern.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_movern.chi_map_automator_chi_only(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate);
+              ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern(FlowInfo, JunctionNetwork,
+                              this_float_map["start_movern"], this_float_map["delta_movern"],
+                              this_int_map["n_movern"],
+                              this_bool_map["only_use_mainstem_as_reference"],
+                              basin_prefix+"_movernstats", this_float_map["collinearity_MLE_sigma"]);
+            }
+
+            if (this_bool_map["calculate_MLE_collinearity_with_points_MC"])
+            {
+              LSDChiTools ChiTool_movern(FlowInfo);
+              ChiTool_movern.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_movern.chi_map_automator_chi_only(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate);
+              ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern_using_points_MC(FlowInfo, JunctionNetwork,
+                              this_float_map["start_movern"], this_float_map["delta_movern"],
+                              this_int_map["n_movern"],
+                              this_bool_map["only_use_mainstem_as_reference"],
+                              basin_prefix+"_MCpoint", this_float_map["collinearity_MLE_sigma"],
+                              this_int_map["MC_point_fractions"],
+                              this_int_map["MC_point_iterations"],
+                              this_float_map["max_MC_point_fraction"]);
+            }
+
+            if (this_bool_map["print_profiles_fxn_movern_csv"])
+            {
+              LSDChiTools ChiTool_movern(FlowInfo);
+              ChiTool_movern.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_movern.chi_map_automator_chi_only(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate);
+              if(this_bool_map["burn_raster_to_csv"])
+              {
+                ChiTool_movern.print_profiles_as_fxn_movern_with_burned_raster(FlowInfo, basin_prefix+"_burned_movern.csv",
+                                    this_float_map["start_movern"],
+                                    this_float_map["delta_movern"],
+                                    this_int_map["n_movern"],
+                                    BurnRaster,
+                                    this_string_map["burn_data_csv_column_header"]);
+              }
+              else
+              {
+                ChiTool_movern.print_profiles_as_fxn_movern(FlowInfo, basin_prefix+"_movern.csv",
+                                    this_float_map["start_movern"],
+                                    this_float_map["delta_movern"],
+                                    this_int_map["n_movern"]);
+              }
+            }
+
+            if (this_bool_map["print_slope_area_data"])
+            {
+              LSDChiTools ChiTool_SA(FlowInfo);
+              ChiTool_SA.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_SA.chi_map_automator_chi_only(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate);
+
+              vector<int> SA_midpoint_nodes;
+              vector<float> SA_slopes;
+              ChiTool_SA.get_slope_area_data(FlowInfo, this_float_map["SA_vertical_interval"],
+                                    SA_midpoint_nodes,SA_slopes);
+              ChiTool_SA.print_slope_area_data_to_csv(FlowInfo, SA_midpoint_nodes, SA_slopes,
+                                    basin_prefix+"_SAvertical.csv");
+              ChiTool_SA.bin_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes,
+                                    this_float_map["log_A_bin_width"], basin_prefix+"_SAbinned.csv");
+
+              if (this_bool_map["bootstrap_SA_data"])
+              {
+                ChiTool_SA.bootstrap_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes,
+                                    this_int_map["N_SA_bootstrap_iterations"],
+                                    this_float_map["SA_bootstrap_retain_node_prbability"],
+                                    basin_prefix+"_SABootstrap.csv");
+              }
+              if (this_bool_map["segment_slope_area_data"])
+              {
+                ChiTool_SA.segment_binned_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes,
+                                    this_float_map["log_A_bin_width"],
+                                    this_int_map["slope_area_minimum_segment_length"],
+                                    basin_prefix+"_SAsegmented.csv");
+              }
+            }
+
+            if (this_bool_map["print_segmented_M_chi_map_to_csv"])
+            {
+              LSDChiTools ChiTool(FlowInfo);
+              ChiTool.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool.chi_map_automator(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate, target_nodes,
+                                    n_iterations, skip, minimum_segment_length, sigma);
+              ChiTool.print_data_maps_to_file_full(FlowInfo, basin_prefix+"_MChiSegmented.csv");
+            }
+
+            if (this_bool_map["ksn_knickpoint_analysis"])
+            {
+              LSDChiTools ChiTool_kp(FlowInfo);
+              ChiTool_kp.set_random_stream_key_offsets(BN, source_key_offsets[BN]);
+              ChiTool_kp.chi_map_automator(FlowInfo, basin_source_nodes[BN],
+                                    basin_channel_outlets[BN], basin_baselevel_nodes[BN],
+                                    filled_topography, DistanceFromOutlet,
+                                    DrainageArea, chi_coordinate_kp, target_nodes,
+                                    this_int_map["force_n_iteration_knickpoint_analysis"],
+                                    this_int_map["force_skip_knickpoint_analysis"],
+                                    minimum_segment_length, sigma);
+              ChiTool_kp.segment_counter(FlowInfo, maximum_segment_length);
+              ChiTool_kp.ksn_knickpoint_automator(FlowInfo, OUT_DIR, OUT_ID+"_basin"+INT,
+                                    this_float_map["MZS_threshold"], TVD_lambda, this_float_map["TVD_lambda_bchi"],
+                                    this_int_map["stepped_combining_window"], this_int_map["window_stepped_kp_detection"],
+                                    this_float_map["std_dev_coeff_stepped_kp"], this_int_map["kp_node_combining"]);
+            }
+          }
+        }
+      }
+    }
+  }
 
+  //============================================================================
+  // Merge the files of each basin into a single file, in basin order
+  //============================================================================
+  vector<int> basin_keys;
+  for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
+  {
+    basin_keys.push_back(BN);
+  }
 
+  // the merged files that have locations in them can be converted to geojson
+  vector<string> merged_suffixes;
+  vector<bool> merged_is_spatial;
+  if (this_bool_map["print_chi_data_maps"])
+  {
+    merged_suffixes.push_back("_chi_data_map.csv");
+    merged_is_spatial.push_back(true);
+  }
+  if (this_bool_map["calculate_MLE_collinearity"])
+  {
+    merged_suffixes.push_back("_movernstats_basinstats.csv");
+    merged_is_spatial.push_back(false);
+    for(int i = 0; i< this_int_map["n_movern"]; i++)
+    {
+      float this_movern = float(i)*this_float_map["delta_movern"]+this_float_map["start_movern"];
+      merged_suffixes.push_back("_movernstats_"+dtoa(this_movern)+"_fullstats.csv");
+      merged_is_spatial.push_back(false);
+    }
+  }
+  if (this_bool_map["calculate_MLE_collinearity_with_points_MC"])
+  {
+    merged_suffixes.push_back("_MCpoint_points_MC_basinstats.csv");
+    merged_is_spatial.push_back(false);
+    for(int i = 0; i< this_int_map["n_movern"]; i++)
+    {
+      float this_movern = float(i)*this_float_map["delta_movern"]+this_float_map["start_movern"];
+      merged_suffixes.push_back("_MCpoint_"+dtoa(this_movern)+"_pointsMC.csv");
+      merged_is_spatial.push_back(false);
+    }
+  }
+  if (this_bool_map["print_profiles_fxn_movern_csv"])
+  {
+    if(this_bool_map["burn_raster_to_csv"])
+    {
+      merged_suffixes.push_back("_burned_movern.csv");
+    }
+    else
+    {
+      merged_suffixes.push_back("_movern.csv");
+    }
+    merged_is_spatial.push_back(false);
+  }
+  if (this_bool_map["print_slope_area_data"])
+  {
+    merged_suffixes.push_back("_SAvertical.csv");
+    merged_is_spatial.push_back(true);
+    merged_suffixes.push_back("_SAbinned.csv");
+    merged_is_spatial.push_back(false);
+    if (this_bool_map["bootstrap_SA_data"])
+    {
+      merged_suffixes.push_back("_SABootstrap.csv");
+      merged_is_spatial.push_back(false);
+    }
+    if (this_bool_map["segment_slope_area_data"])
+    {
+      merged_suffixes.push_back("_SAsegmented.csv");
+      merged_is_spatial.push_back(false);
+    }
+  }
+  if (this_bool_map["print_segmented_M_chi_map_to_csv"])
+  {
+    merged_suffixes.push_back("_MChiSegmented.csv");
+    merged_is_spatial.push_back(true);
+  }
+  if (this_bool_map["ksn_knickpoint_analysis"])
+  {
+    merged_suffixes.push_back("_ksnkp_raw.csv");
+    merged_suffixes.push_back("_ksnkp_SK.csv");
+    merged_suffixes.push_back("_ksnkp_mchi.csv");
+    merged_suffixes.push_back("_ksnkp.csv");
+    for (int k = 0; k< 4; k++)
+    {
+      merged_is_spatial.push_back(true);
+    }
+  }
 
+  int n_merged = int(merged_suffixes.size());
+  for (int m = 0; m< n_merged; m++)
+  {
+    vector<string> basin_fnames;
+    for (int BN = 0; BN< N_BaseLevelJuncs; BN++)
+    {
+      string INT = string(itoa(BaseLevelJunctions[BN]));
+      basin_fnames.push_back(OUT_DIR+OUT_ID+"_basin"+INT+merged_suffixes[m]);
+    }
+    string merged_fname = OUT_DIR+OUT_ID+merged_suffixes[m];
+    cout << "Merging the basin files into: " << merged_fname << endl;
+    merge_basin_csv_files(merged_fname, basin_fnames, basin_keys, source_key_offsets);
 
-//  if(this_bool_map["calculate_MLE_collinearity_with_points"])
-//  {
-//    cout << "I am going to test the experimental MLE collinearity functions" << endl;
-//    cout << "I am testing the collinearity for you. " << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_movern(FlowInfo);
-//    ChiTool_movern.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
+    if ( this_bool_map["convert_csv_to_geojson"] && merged_is_spatial[m])
+    {
+      string gjson_name = merged_fname.substr(0,merged_fname.size()-4)+".geojson";
+      LSDSpatialCSVReader thiscsv(merged_fname);
+      thiscsv.print_data_to_geojson(gjson_name);
+    }
+  }
+}
 
-//    vector<float> chi_fracs_to_test;
-//    chi_fracs_to_test.push_back(0.25);
-//    chi_fracs_to_test.push_back(0.2);
-//    chi_fracs_to_test.push_back(0.15);
-//    chi_fracs_to_test.push_back(0.1);
-//    chi_fracs_to_test.push_back(0.05);
 
-//    // test the basin collinearity test
-//    //int baselevel_key = 1;
-//    vector<int> reference_source;
-//    vector<int> test_source;
-//    vector<float> MLE_values;
-//    vector<float> RMSE_values;
-//    //bool only_use_mainstem_as_reference = true;
+// This merges the csv files written for each basin into a single file. The
+// header is taken from the first basin file. Each basin was analysed on its
+// own so its basin_key (basin_number in the points MC files) is always 0 and
+// its source keys start at 0: these are replaced by the key of the basin and
+// offset by the number of sources in the basins before it. The basin files are removed once they are merged.
+void merge_basin_csv_files(string merged_fname, vector<string>& basin_fnames,
+                           vector<int>& basin_keys, vector<int>& source_key_offsets)
+{
+  ofstream merged_out;
+  merged_out.open(merged_fname.c_str());
 
-//    float this_sigma = this_float_map["collinearity_MLE_sigma"];
-//    this_sigma = 10;        // just for debugging
+  bool header_written = false;
+  int n_basins = int(basin_fnames.size());
+  for (int BN = 0; BN< n_basins; BN++)
+  {
+    ifstream basin_in(basin_fnames[BN].c_str());
+    if (basin_in.fail())
+    {
+      continue;
+    }
 
+    // find the columns with keys in them
+    string line;
+    getline(basin_in,line);
+    if (not header_written)
+    {
+      merged_out << line << endl;
+      header_written = true;
+    }
+    int basin_key_column = -1;
+    vector<bool> is_source_key_column;
+    stringstream header_ss(line);
+    string column;
+    int n_columns = 0;
+    while (getline(header_ss,column,','))
+    {
+      column = RemoveControlCharactersFromEndOfString(column);
+      if (column == "basin_key" || column == "basin_number")
+      {
+        basin_key_column = n_columns;
+      }
+      bool is_source = (column.size() >= 10 && column.compare(column.size()-10,10,"source_key") == 0);
+      is_source_key_column.push_back(is_source);
+      n_columns++;
+    }
 
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      cout << "Using a discharge raster to check collinearity." << endl;
-//      string movern_name = OUT_DIR+OUT_ID+"_point_movernstatsQ";
-//      ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern_with_discharge_using_points(FlowInfo,
-//                      JunctionNetwork, this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      movern_name, Discharge, this_sigma,
-//                      chi_fracs_to_test);
-//    }
-//    else
-//    {
-//      string movern_name = OUT_DIR+OUT_ID+"_point_movernstats";
-//      ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern_using_points(FlowInfo, JunctionNetwork,
-//                      this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      movern_name, this_sigma,
-//                      chi_fracs_to_test);
-//    }
-
-//  }
-
-
-
-
-
-
-
-//  if(this_bool_map["calculate_MLE_collinearity_with_points_MC"])
-//  {
-//    cout << "I am going to test the MLE collinearity functions using points with Monte Carlo sampling." << endl;
-//    cout << "I am testing the collinearity for you. " << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_movern(FlowInfo);
-//    ChiTool_movern.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // test the basin collinearity test
-//    //int baselevel_key = 1;
-//    vector<int> reference_source;
-//    vector<int> test_source;
-//    vector<float> MLE_values;
-//    vector<float> RMSE_values;
-//    //bool only_use_mainstem_as_reference = true;
-
-//    float this_sigma = this_float_map["collinearity_MLE_sigma"];
-//    this_sigma = this_float_map["collinearity_MLE_sigma"];        // just for debugging
-
-
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      cout << "The Monte Carlo points routine does not have precipitaiton implemented yet." << endl;
-//    }
-//    else
-//    {
-//      string movern_name = OUT_DIR+OUT_ID+"_MCpoint";
-//      ChiTool_movern.calculate_goodness_of_fit_collinearity_fxn_movern_using_points_MC(FlowInfo, JunctionNetwork,
-//                      this_float_map["start_movern"], this_float_map["delta_movern"],
-//                      this_int_map["n_movern"],
-//                      this_bool_map["only_use_mainstem_as_reference"],
-//                      movern_name, this_sigma,
-//                      this_int_map["MC_point_fractions"],
-//                      this_int_map["MC_point_iterations"],
-//                      this_float_map["max_MC_point_fraction"]);
-//    }
-
-//  }
-
-
-
-
-
-//  if(this_bool_map["print_profiles_fxn_movern_csv"] )
-//  {
-//    cout << endl << "Let me loop through m/n values and print the profiles to a single csv." << endl;
-//    // Lets make a new chi tool: this won't be segmented since we only
-//    // need it for m/n
-//    LSDChiTools ChiTool_movern(FlowInfo);
-
-//    cout << "Running automator" << endl;
-//    // we always need to run the automator first
-//    ChiTool_movern.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-
-//    cout << "Looping m over n" << endl;
-//    // now loop through m/n values, printing them all to the csv file
-
-
-//    if(this_bool_map["use_precipitation_raster_for_chi"])
-//    {
-//      cout << "Using a discharge raster to calculate m over n." << endl;
-//      if(this_bool_map["burn_raster_to_csv"])
-//      {
-//        cout << "I am using a burned raster for plotting the profiles. " << endl;
-//        string movern_name = OUT_DIR+OUT_ID+"_burned_movernQ.csv";
-//        ChiTool_movern.print_profiles_as_fxn_movern_with_discharge_and_burned_raster(FlowInfo, movern_name,
-//                                  this_float_map["start_movern"],
-//                                  this_float_map["delta_movern"],
-//                                  this_int_map["n_movern"],
-//                                  Discharge,BurnRaster,
-//                                  this_string_map["burn_data_csv_column_header"]);
-//      }
-//      else
-//      {
-//        cout << "I am plotting the profiles. " << endl;
-//        string movern_name = OUT_DIR+OUT_ID+"_movernQ.csv";
-//        ChiTool_movern.print_profiles_as_fxn_movern_with_discharge(FlowInfo, movern_name,
-//                                  this_float_map["start_movern"],
-//                                  this_float_map["delta_movern"],
-//                                  this_int_map["n_movern"],
-//                                  Discharge);
-//      }
-//    }
-//    else
-//    {
-
-//      if(this_bool_map["burn_raster_to_csv"])
-//      {
-//        cout << "I am using a burned raster for plotting the profiles. " << endl;
-//        string movern_name = OUT_DIR+OUT_ID+"_burned_movern.csv";
-//        ChiTool_movern.print_profiles_as_fxn_movern_with_burned_raster(FlowInfo, movern_name,
-//                                  this_float_map["start_movern"],
-//                                  this_float_map["delta_movern"],
-//                                  this_int_map["n_movern"],
-//                                  BurnRaster,
-//                                  this_string_map["burn_data_csv_column_header"]);
-//                                  
-//        //cout << "TEST I will print the burn raster" << endl;
-//        // BurnRaster.write_raster(OUT_DIR+OUT_ID+"_theburnYOYO","bil");
-//        // exit(EXIT_FAILURE);
-//        
-//      }
-//      else
-//      {
-//        cout << "I am plotting the profiles. " << endl;
-//        string movern_name = OUT_DIR+OUT_ID+"_movern.csv";
-//        ChiTool_movern.print_profiles_as_fxn_movern(FlowInfo, movern_name,
-//                                  this_float_map["start_movern"],
-//                                  this_float_map["delta_movern"],
-//                                  this_int_map["n_movern"]);
-//      }
-//    }
-//  }
-
-//  if (this_bool_map["print_slope_area_data"])
-//  {
-//    cout << "I am going to calculate slope-area data for you. " << endl;
-//    LSDChiTools ChiTool_SA(FlowInfo);
-//    ChiTool_SA.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-//    cout << "Got the data into the data maps." << endl;
-
-//    float vertical_interval = this_float_map["SA_vertical_interval"];
-//    string filename_SA = OUT_DIR+OUT_ID+"_SAvertical.csv";
-//    string filename_binned = OUT_DIR+OUT_ID+"_SAbinned.csv";
-
-//    vector<int> SA_midpoint_nodes;
-//    vector<float> SA_slopes;
-//    ChiTool_SA.get_slope_area_data(FlowInfo, vertical_interval,
-//                                   SA_midpoint_nodes,SA_slopes);
-
-//    cout << "Printing raw S-A data." << endl;
-//    ChiTool_SA.print_slope_area_data_to_csv(FlowInfo, SA_midpoint_nodes, SA_slopes, filename_SA);
-
-//    cout << "Printing binned S-A data." << endl;
-//    ChiTool_SA.bin_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes, this_float_map["log_A_bin_width"],filename_binned);
-
-//    if (this_bool_map["bootstrap_SA_data"])
-//    {
-//      cout << "I am going to bootstrap the S-A data for you." << endl;
-//      string filename_SAbootstrap = OUT_DIR+OUT_ID+"_SABootstrap.csv";
-//      ChiTool_SA.bootstrap_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes,
-//                                           this_int_map["N_SA_bootstrap_iterations"],
-//                                           this_float_map["SA_bootstrap_retain_node_prbability"],
-//                                           filename_SAbootstrap);
-//    }
-
-
-//    if (this_bool_map["segment_slope_area_data"])
-//    {
-//      cout << "I am going to segment the S-A data from the main stem channel for you." << endl;
-//      string filename_SAseg = OUT_DIR+OUT_ID+"_SAsegmented.csv";
-//      ChiTool_SA.segment_binned_slope_area_data(FlowInfo, SA_midpoint_nodes, SA_slopes,
-//                                  this_float_map["log_A_bin_width"],
-//                                  this_int_map["slope_area_minimum_segment_length"],
-//                                  filename_SAseg);
-//    }
-//  }
-
-//  if (this_bool_map["print_basic_M_chi_map_to_csv"])
-//  {
-//    // Note that this uses the chi coordinate derived from early in this code
-//    // and will use the discharge-based raster if that has been called.
-//    LSDChiTools ChiTool2(FlowInfo);
-//    ChiTool2.chi_map_automator_rudimentary(FlowInfo, source_nodes,outlet_nodes, baselevel_node_of_each_basin,
-//                                    filled_topography, DistanceFromOutlet, DrainageArea,
-//                                    chi_coordinate, basic_Mchi_regression_nodes);
-//    string csv_full_fname = OUT_DIR+OUT_ID+"_MChiBasic.csv";
-//    ChiTool2.print_data_maps_to_file_full(FlowInfo, csv_full_fname);
-
-//    if ( this_bool_map["convert_csv_to_geojson"])
-//    {
-//      string gjson_name = OUT_DIR+OUT_ID+"_MChiBasic.geojson";
-//      LSDSpatialCSVReader thiscsv(csv_full_fname);
-//      thiscsv.print_data_to_geojson(gjson_name);
-//    }
-//  }
-
-
-//  if (this_bool_map["print_source_keys"]
-//        || this_bool_map["print_baselevel_keys"])
-//  {
-//    cout << "I am going to print the source and baselevel keys for you. " << endl;
-//    LSDChiTools ChiTool_keys(FlowInfo);
-//    ChiTool_keys.chi_map_automator_chi_only(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                            filled_topography, DistanceFromOutlet,
-//                            DrainageArea, chi_coordinate);
-
-//    // These print the source and baselelvel keys if wanted
-//    if (this_bool_map["print_source_keys"])
-//    {
-//      string sources_keys_name = OUT_DIR+OUT_ID+"_SourceKeys.csv";
-//      ChiTool_keys.print_source_keys(FlowInfo, sources_keys_name);
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_SourceKeys.geojson";
-//        LSDSpatialCSVReader thiscsv(sources_keys_name);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-
-//    }
-//    if (this_bool_map["print_baselevel_keys"])
-//    {
-//      string baselevel_keys_name = OUT_DIR+OUT_ID+"_BaselevelKeys.csv";
-//      ChiTool_keys.print_baselevel_keys(FlowInfo, JunctionNetwork, baselevel_keys_name);
-
-//      if ( this_bool_map["convert_csv_to_geojson"])
-//      {
-//        string gjson_name = OUT_DIR+OUT_ID+"_BaselevelKeys.geojson";
-//        LSDSpatialCSVReader thiscsv(baselevel_keys_name);
-//        thiscsv.print_data_to_geojson(gjson_name);
-//      }
-//    }
-//  }
-
-
-
-//  if(this_bool_map["ksn_knickpoint_analysis"])
-//  {
-//    n_iterations = 1;
-//    skip = 0;
-//    ChiTool.chi_map_automator(FlowInfo, source_nodes, outlet_nodes, baselevel_node_of_each_basin,
-//                          filled_topography, DistanceFromOutlet,
-//                          DrainageArea, chi_coordinate, target_nodes,
-//                          n_iterations, skip, minimum_segment_length, sigma);
-//    ChiTool.segment_counter(FlowInfo, maximum_segment_length);
-//    ChiTool.ksn_knickpoint_detection(FlowInfo);
-//    string csv_full_fname_knockpoint = OUT_DIR+OUT_ID+"_KsnKn.csv";
-//    ChiTool.print_knickpoint_to_csv(FlowInfo,csv_full_fname_knockpoint);
-//    // Testing something
-//    string csv_full_fname = OUT_DIR+OUT_ID+"_MChiSegmented_TESTKNICKPOINT.csv";
-//    cout << "Let me print A Test File " << csv_full_fname << endl;
-//    ChiTool.print_data_maps_to_file_full(FlowInfo, csv_full_fname);
-//  }
-//}
+    // now copy the data, replacing the keys
+    while (getline(basin_in,line))
+    {
+      if (line.empty())
+      {
+        continue;
+      }
+      stringstream line_ss(line);
+      string value;
+      int c = 0;
+      while (getline(line_ss,value,','))
+      {
+        if (c > 0)
+        {
+          merged_out << ",";
+        }
+        if (c == basin_key_column)
+        {
+          merged_out << basin_keys[BN];
+        }
+        else if (c < n_columns && is_source_key_column[c] && atoi(value.c_str()) >= 0)
+        {
+          merged_out << atoi(value.c_str())+source_key_offsets[BN];
+        }
+        else
+        {
+          merged_out << value;
+        }
+        c++;
+      }
+      merged_out << endl;
+    }
+    basin_in.close();
+    remove(basin_fnames[BN].c_str());
+  }
+  merged_out.close();
+}
@@ -887,8 +887,8 @@ int main (int nNumberofArgs,char *argv[])
     cout << "I am going to force your model through a series of cycles, varying" << endl;
     cout << " either K or U." << endl;
     
-    // get the seed for the random forcing. 
-    long seed = time(NULL);
+    // get the random stream for the random forcing.
+    RandomStream rng = get_serial_random_stream();
     
     
     float time_gap = this_float_map["maximum_time_for_random_cycle"]-this_float_map["minimum_time_for_random_cycle"];
@@ -935,14 +935,14 @@ int main (int nNumberofArgs,char *argv[])
       cout << "++CYCLE NUMBER: "  << i << "+++++" << endl;
       
       // get the time of this cycle
-      float this_time = time_gap*ran3(&seed)+this_float_map["minimum_time_for_random_cycle"];
+      float this_time = time_gap*rng.uniform()+this_float_map["minimum_time_for_random_cycle"];
       current_end_time = current_end_time+this_time;
       mod.set_endTime(current_end_time);
       
       
       
       // now for the uplift
-      float this_U = U_gap*ran3(&seed)+this_float_map["minimum_U_for_random_cycle"];
+      float this_U = U_gap*rng.uniform()+this_float_map["minimum_U_for_random_cycle"];
       current_end_time = current_end_time+this_time;
       
       Uout << this_time <<"," << current_end_time << "," << this_U << endl;